@@ -22,6 +22,10 @@
     ------------------------------------------------------------------------------------
 */
 #include "internal.h"
+#include "arena.h"
+#include "cursor.h"
+#include "encoder.h"
+#include "flat.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -120,25 +124,33 @@ unsigned short act_inspect(const struct ROAct *act) {
 
 struct ROAct *act_load(struct _reader *reader) {
 	struct ROAct *ret;
+	struct _arena *arena;
+	struct _cursor cursor;
 	unsigned int actionId, motionId, sprclipId, attachpointId, eventId;
+	unsigned int sprclipsize, motionendsize;
 	char magic[2];
+	int error;
 
 	if (reader == NULL || reader->error) {
 		_xlog("act.load : invalid argument (reader=%p reader.error=%d)\n", reader, reader->error);
 		return(NULL);
 	}
 
-	ret = (struct ROAct*)_xalloc(sizeof(struct ROAct));
+	arena = _arena_loadinit(reader->remaining(reader));
+	ret = (struct ROAct*)_arena_newobject(arena, sizeof(struct ROAct));
 	memset(ret, 0, sizeof(struct ROAct));
 
-	reader->read(&magic, 2, 1, reader);
+	_cursor_init(&cursor, reader);
+	_cursor_need(&cursor, 16); // header
+	_cursor_bytes(&cursor, magic, 2);
 	if (memcmp(ACT_MAGIC, magic, 2) != 0) {
 		_xlog("act.load : invalid header x%02X%02X (\"%-2s\")\n", magic[0], magic[1], magic);
+		_cursor_destroy(&cursor);
 		act_unload(ret);
 		return(NULL);
 	}
 
-	reader->read(&ret->version, 2, 1, reader);
+	ret->version = _cursor_u16(&cursor);
 	//_xlog("ACT Version: %u.%u\n", (ret->version >> 8) & 0xFF, ret->version & 0xFF);
 	switch (ret->version) {
 		default:
@@ -147,6 +159,7 @@ struct ROAct *act_load(struct _reader *reader) {
 				break;// supported? not sure what's the base version... probably 0x100 or 0x101
 			}
 			_xlog("act.load : unknown version 0x%X (v%u.%u)\n", ret->version, (ret->version >> 8) & 0xFF, ret->version & 0xFF);
+			_cursor_destroy(&cursor);
 			act_unload(ret);
 			return(NULL);
 		case 0x200:
@@ -158,77 +171,95 @@ struct ROAct *act_load(struct _reader *reader) {
 			break;// supported
 	}
 
+	// sizes that depend on the version
+	sprclipsize = 16;
+	if (ret->version >= 0x200)
+		sprclipsize += 16 + ((ret->version >= 0x204)? 4: 0) + ((ret->version >= 0x205)? 8: 0);
+	motionendsize = ((ret->version >= 0x200)? 4: 0) + ((ret->version >= 0x203)? 4: 0);
+
 	// read actions
-	reader->read(&ret->actioncount, 2, 1, reader);
-	reader->read(&ret->reserved, 10, 1, reader);
+	ret->actioncount = _cursor_u16(&cursor);
+	_cursor_bytes(&cursor, ret->reserved, 10);
 	if (ret->actioncount > 0) {
-		ret->actions = (struct ROActAction*)_xalloc(sizeof(struct ROActAction) * ret->actioncount);
+		ret->actions = (struct ROActAction*)_arena_alloc(arena, sizeof(struct ROActAction) * ret->actioncount);
 		memset(ret->actions, 0, sizeof(struct ROActAction) * ret->actioncount);
-		for (actionId = 0; actionId < ret->actioncount; actionId++) {
+		for (actionId = 0; actionId < ret->actioncount && !cursor.error; actionId++) {
 			struct ROActAction *action = &ret->actions[actionId];
 			// read motions
-			reader->read(&action->motioncount, 4, 1, reader);
+			if (_cursor_need(&cursor, 4) != 0)
+				break;
+			action->motioncount = _cursor_u32(&cursor);
 			if (action->motioncount > 0) {
-				action->motions = (struct ROActMotion*)_xalloc(sizeof(struct ROActMotion) * action->motioncount);
+				if (_mul_over_limit(action->motioncount, sizeof(struct ROActMotion), 0x7FFFFFFF)) {
+					_xlog("act.load : [%u] too many motions (%u)\n", actionId, action->motioncount);
+					action->motioncount = 0;
+					cursor.error = 1;
+					break;
+				}
+				action->motions = (struct ROActMotion*)_arena_alloc(arena, sizeof(struct ROActMotion) * action->motioncount);
 				memset(action->motions, 0, sizeof(struct ROActMotion) * action->motioncount);
 				for (motionId = 0; motionId < action->motioncount; motionId++) {
 					struct ROActMotion *motion = &action->motions[motionId];
-					reader->read(&motion->range1, 4, 4, reader);
-					reader->read(&motion->range2, 4, 4, reader);
+					if (_cursor_need(&cursor, 36) != 0)
+						break;
+					_cursor_bytes(&cursor, motion->range1, 16);
+					_cursor_bytes(&cursor, motion->range2, 16);
 					// read sprclips
-					reader->read(&motion->sprclipcount, 4, 1, reader);
+					motion->sprclipcount = _cursor_u32(&cursor);
 					if (motion->sprclipcount > 0) {
-						motion->sprclips = (struct ROActSprClip*)_xalloc(sizeof(struct ROActSprClip) * motion->sprclipcount);
-						memset(motion->sprclips, 0, sizeof(struct ROActSprClip) * motion->sprclipcount);
+						if (_cursor_needarray(&cursor, sprclipsize, motion->sprclipcount) != 0) {
+							motion->sprclipcount = 0;
+							break;
+						}
+						motion->sprclips = (struct ROActSprClip*)_arena_alloc(arena, sizeof(struct ROActSprClip) * motion->sprclipcount);
 						for (sprclipId = 0; sprclipId < motion->sprclipcount; sprclipId++) {
 							struct ROActSprClip *sprclip = &motion->sprclips[sprclipId];
-							reader->read(&sprclip->x, 4, 1, reader);
-							reader->read(&sprclip->y, 4, 1, reader);
-							reader->read(&sprclip->sprNo, 4, 1, reader);
-							reader->read(&sprclip->mirrorOn, 4, 1, reader);
+							sprclip->x = _cursor_i32(&cursor);
+							sprclip->y = _cursor_i32(&cursor);
+							sprclip->sprNo = _cursor_i32(&cursor);
+							sprclip->mirrorOn = _cursor_u32(&cursor);
 							sprclip->color = 0xFFFFFFFF;
 							sprclip->xZoom = sprclip->yZoom = 1.0f;
 							sprclip->angle = 0;
 							sprclip->sprType = 0;
 							sprclip->width = sprclip->height = 0;
 							if (ret->version >= 0x200) {
-								reader->read(&sprclip->color, 4, 1, reader);
-								if (ret->version >= 0x204) {
-									reader->read(&sprclip->xZoom, 4, 1, reader);
-									reader->read(&sprclip->yZoom, 4, 1, reader);
-								}
-								else {
-									float zoom;
-									reader->read(&zoom, 4, 1, reader);
-									sprclip->xZoom = sprclip->yZoom = zoom;
-								}
-								reader->read(&sprclip->angle, 4, 1, reader);
-								reader->read(&sprclip->sprType, 4, 1, reader);
+								sprclip->color = _cursor_u32(&cursor);
+								sprclip->xZoom = _cursor_f32(&cursor);
+								sprclip->yZoom = (ret->version >= 0x204)? _cursor_f32(&cursor): sprclip->xZoom;
+								sprclip->angle = _cursor_i32(&cursor);
+								sprclip->sprType = _cursor_i32(&cursor);
 								if (ret->version >= 0x205) {
-									reader->read(&sprclip->width, 4, 1, reader);
-									reader->read(&sprclip->height, 4, 1, reader);
+									sprclip->width = _cursor_i32(&cursor);
+									sprclip->height = _cursor_i32(&cursor);
 								}
 							}
 						}
 					}
 					// read eventId
+					if (_cursor_need(&cursor, motionendsize) != 0)
+						break;
 					motion->eventId = -1;
 					if (ret->version >= 0x200) {
-						reader->read(&motion->eventId, 4, 1, reader);
+						motion->eventId = _cursor_i32(&cursor);
 						if (ret->version == 0x200)
 							motion->eventId = -1;// no array of events in this version
 					}
 					// read attach points
 					if (ret->version >= 0x203) {
-						reader->read(&motion->attachpointcount, 4, 1, reader);
+						motion->attachpointcount = _cursor_u32(&cursor);
 						if (motion->attachpointcount > 0) {
-							motion->attachpoints = (struct ROActAttachPoint*)_xalloc(sizeof(struct ROActAttachPoint) * motion->attachpointcount);
-							memset(motion->attachpoints, 0, sizeof(struct ROActAttachPoint) * motion->attachpointcount);
+							if (_cursor_needarray(&cursor, 4 + sizeof(struct ROActAttachPoint), motion->attachpointcount) != 0) {
+								motion->attachpointcount = 0;
+								break;
+							}
+							motion->attachpoints = (struct ROActAttachPoint*)_arena_alloc(arena, sizeof(struct ROActAttachPoint) * motion->attachpointcount);
 							for (attachpointId = 0; attachpointId < motion->attachpointcount; attachpointId++) {
 								struct ROActAttachPoint *attachpoint = &motion->attachpoints[attachpointId];
-								int ignored;
-								reader->read(&ignored, 4, 1, reader);
-								reader->read(attachpoint, sizeof(struct ROActAttachPoint), 1, reader);
+								_cursor_skip(&cursor, 4); // ignored
+								attachpoint->x = _cursor_i32(&cursor);
+								attachpoint->y = _cursor_i32(&cursor);
+								attachpoint->attr = _cursor_i32(&cursor);
 							}
 						}
 					}
@@ -237,27 +268,33 @@ struct ROAct *act_load(struct _reader *reader) {
 		}
 	}
 	// read events
-	if (ret->version >= 0x201) {
-		reader->read(&ret->eventcount, 4, 1, reader);
+	if (ret->version >= 0x201 && _cursor_need(&cursor, 4) == 0) {
+		ret->eventcount = _cursor_u32(&cursor);
 		if (ret->eventcount > 0) {
-			ret->events = (struct ROActEvent*)_xalloc(sizeof(struct ROActEvent) * ret->eventcount);
-			memset(ret->events, 0, sizeof(struct ROActEvent) * ret->eventcount);
-			for (eventId = 0; eventId < ret->eventcount; eventId++) {
-				struct ROActEvent *evt = &ret->events[eventId];
-				reader->read(evt, sizeof(struct ROActEvent), 1, reader);
-				evt->name[39] = 0;
+			if (_cursor_needarray(&cursor, sizeof(struct ROActEvent), ret->eventcount) != 0)
+				ret->eventcount = 0;
+			else {
+				ret->events = (struct ROActEvent*)_arena_alloc(arena, sizeof(struct ROActEvent) * ret->eventcount);
+				for (eventId = 0; eventId < ret->eventcount; eventId++) {
+					struct ROActEvent *evt = &ret->events[eventId];
+					_cursor_bytes(&cursor, evt, sizeof(struct ROActEvent));
+					evt->name[39] = 0;
+				}
 			}
 		}
 	}
 	// read delays
 	if (ret->version >= 0x202) {
-		if (ret->actioncount > 0) {
-			ret->delays = (float*)_xalloc(sizeof(float) * ret->actioncount);
-			reader->read(ret->delays, 4, ret->actioncount, reader);
+		if (ret->actioncount > 0 && _cursor_needarray(&cursor, 4, ret->actioncount) == 0) {
+			ret->delays = (float*)_arena_alloc(arena, sizeof(float) * ret->actioncount);
+			for (actionId = 0; actionId < ret->actioncount; actionId++)
+				ret->delays[actionId] = _cursor_f32(&cursor);
 		}
 	}
 
-	if (reader->error) {
+	error = cursor.error;
+	_cursor_destroy(&cursor);
+	if (error) {
 		_xlog("act.load : read error\n");
 		act_unload(ret);
 		return(NULL);
@@ -271,7 +308,7 @@ struct ROAct *act_loadFromData(const unsigned char *data, unsigned int length) {
 	struct ROAct *ret;
 	struct _reader *reader;
 
-	reader = memreader_init(data, length);
+	reader = statsreader_init(memreader_init(data, length), ROINT_FORMAT_ACT);
 	ret = act_load(reader);
 	reader->destroy(reader);
 
@@ -283,7 +320,7 @@ struct ROAct *act_loadFromFile(const char *fn) {
 	struct ROAct *ret;
 	struct _reader *reader;
 
-	reader = filereader_init(fn);
+	reader = statsreader_init(filereader_init(fn), ROINT_FORMAT_ACT);
 	ret = act_load(reader);
 	reader->destroy(reader);
 
@@ -310,8 +347,9 @@ struct ROAct *act_loadFromGrf(struct ROGrfFile *file) {
 
 
 int act_save(const struct ROAct *act, struct _writer *writer) {
-	unsigned int actionId, motionId, sprclipId, attachpointId, eventId;
+	unsigned int actionId, motionId, sprclipId, attachpointId;
 	unsigned short minimumver;
+	struct _encoder encoder;
 
 	if (act == NULL || writer == NULL || writer->error) {
 		_xlog("act.save : invalid argument (act=%o writer=%p writer.error=%d)\n", act, writer, writer->error);
@@ -344,73 +382,77 @@ int act_save(const struct ROAct *act, struct _writer *writer) {
 		return(1);
 	}
 
-	writer->write(ACT_MAGIC, 2, 1, writer);
-	writer->write(&act->version, 2, 1, writer);
+	_encoder_init(&encoder, writer);
+	_encoder_reserve(&encoder, 16);
+	_encoder_bytes(&encoder, ACT_MAGIC, 2);
+	_encoder_u16(&encoder, act->version);
 	// write actions
-	writer->write(&act->actioncount, 2, 1, writer);
-	writer->write(&act->reserved, 10, 1, writer);
-	for (actionId = 0; actionId < act->actioncount; actionId++) {
+	_encoder_u16(&encoder, act->actioncount);
+	_encoder_bytes(&encoder, act->reserved, 10);
+	for (actionId = 0; actionId < act->actioncount && !encoder.error; actionId++) {
 		const struct ROActAction *action = &act->actions[actionId];
 		// write motions
-		writer->write(&action->motioncount, 4, 1, writer);
+		_encoder_reserve(&encoder, 4);
+		_encoder_u32(&encoder, action->motioncount);
 		for (motionId = 0; motionId < action->motioncount; motionId++) {
 			struct ROActMotion *motion = &action->motions[motionId];
-			writer->write(&motion->range1, 4, 4, writer);
-			writer->write(&motion->range2, 4, 4, writer);
+			_encoder_reserve(&encoder, 36);
+			_encoder_bytes(&encoder, motion->range1, 16);
+			_encoder_bytes(&encoder, motion->range2, 16);
 			// write sprclips
-			writer->write(&motion->sprclipcount, 4, 1, writer);
+			_encoder_u32(&encoder, motion->sprclipcount);
 			for (sprclipId = 0; sprclipId < motion->sprclipcount; sprclipId++) {
 				const struct ROActSprClip *sprclip = &motion->sprclips[sprclipId];
-				writer->write(&sprclip->x, 4, 1, writer);
-				writer->write(&sprclip->y, 4, 1, writer);
-				writer->write(&sprclip->sprNo, 4, 1, writer);
-				writer->write(&sprclip->mirrorOn, 4, 1, writer);
+				_encoder_reserve(&encoder, 44);
+				_encoder_i32(&encoder, sprclip->x);
+				_encoder_i32(&encoder, sprclip->y);
+				_encoder_i32(&encoder, sprclip->sprNo);
+				_encoder_u32(&encoder, sprclip->mirrorOn);
 				if (act->version >= 0x200) {
-					writer->write(&sprclip->color, 4, 1, writer);
-					if (act->version >= 0x204) {
-						writer->write(&sprclip->xZoom, 4, 1, writer);
-						writer->write(&sprclip->yZoom, 4, 1, writer);
-					}
-					else
-						writer->write(&sprclip->xZoom, 4, 1, writer);
-					writer->write(&sprclip->angle, 4, 1, writer);
-					writer->write(&sprclip->sprType, 4, 1, writer);
+					_encoder_u32(&encoder, sprclip->color);
+					_encoder_f32(&encoder, sprclip->xZoom);
+					if (act->version >= 0x204)
+						_encoder_f32(&encoder, sprclip->yZoom);
+					_encoder_i32(&encoder, sprclip->angle);
+					_encoder_i32(&encoder, sprclip->sprType);
 					if (act->version >= 0x205) {
-						writer->write(&sprclip->width, 4, 1, writer);
-						writer->write(&sprclip->height, 4, 1, writer);
+						_encoder_i32(&encoder, sprclip->width);
+						_encoder_i32(&encoder, sprclip->height);
 					}
 				}
 			}
+			_encoder_reserve(&encoder, 8);
 			// write eventId
 			if (act->version >= 0x200)
-				writer->write(&motion->eventId, 4, 1, writer);
+				_encoder_i32(&encoder, motion->eventId);
 			// write attach points
 			if (act->version >= 0x203) {
-				writer->write(&motion->attachpointcount, 4, 1, writer);
+				_encoder_u32(&encoder, motion->attachpointcount);
 				for (attachpointId = 0; attachpointId < motion->attachpointcount; attachpointId++) {
 					const struct ROActAttachPoint *attachpoint = &motion->attachpoints[attachpointId];
-					int ignored = 0;
-					writer->write(&ignored, 4, 1, writer);
-					writer->write(attachpoint, sizeof(struct ROActAttachPoint), 1, writer);
+					_encoder_reserve(&encoder, 16);
+					_encoder_zeros(&encoder, 4); // ignored
+					_encoder_i32(&encoder, attachpoint->x);
+					_encoder_i32(&encoder, attachpoint->y);
+					_encoder_i32(&encoder, attachpoint->attr);
 				}
 			}
 		}
 	}
 	// write events
 	if (act->version >= 0x201) {
-		writer->write(&act->eventcount, 4, 1, writer);
-		for (eventId = 0; eventId < act->eventcount; eventId++) {
-			struct ROActEvent *evt = &act->events[eventId];
-			writer->write(evt, sizeof(struct ROActEvent), 1, writer);
-		}
+		_encoder_reserve(&encoder, 4);
+		_encoder_u32(&encoder, act->eventcount);
+		if (act->eventcount > 0)
+			_encoder_write(&encoder, act->events, sizeof(struct ROActEvent) * act->eventcount);
 	}
 	// write delays
 	if (act->version >= 0x202) {
 		if (act->actioncount > 0)
-			writer->write(act->delays, 4, act->actioncount, writer);
+			_encoder_write(&encoder, act->delays, 4 * act->actioncount);
 	}
 
-	if (writer->error) {
+	if (_encoder_destroy(&encoder)) {
 		_xlog("act.save : write error\n");
 		return(1);
 	}
@@ -423,7 +465,7 @@ int act_saveToData(const struct ROAct *act, unsigned char **data_out, unsigned l
 	int ret;
 	struct _writer *writer;
 
-	writer = memwriter_init(data_out, size_out);
+	writer = statswriter_init(memwriter_init(data_out, size_out), ROINT_FORMAT_ACT);
 	ret = act_save(act, writer);
 	writer->destroy(writer);
 
@@ -433,21 +475,103 @@ int act_saveToData(const struct ROAct *act, unsigned char **data_out, unsigned l
 
 int act_saveToFile(const struct ROAct *act, const char *fn) {
 	int ret;
-	struct _writer *writer;
+	struct _writer *writer, *memwriter;
 
-	writer = filewriter_init(fn);
+	memwriter = memwriter_init(NULL, NULL);
+	writer = statswriter_init(memwriter, ROINT_FORMAT_ACT);
 	ret = act_save(act, writer);
+	if (ret == 0)
+		ret = memwriter_savefile(memwriter, fn);
 	writer->destroy(writer);
 
 	return(ret);
 }
 
 
+int act_saveToFlat(const struct ROAct *act, unsigned char **data_out, unsigned long *size_out) {
+	struct _flat flat;
+	unsigned long root, actions, motions;
+	unsigned int actionId, motionId;
+
+	if (act == NULL || data_out == NULL || size_out == NULL) {
+		_xlog("act.saveToFlat : invalid argument (act=%p data_out=%p size_out=%p)\n", act, data_out, size_out);
+		return(1);
+	}
+	if (act_inspect(act) == 0) {
+		_xlog("act.saveToFlat : invalid\n");
+		return(1);
+	}
+
+	_flat_init(&flat, ROINT_FORMAT_ACT);
+	root = _flat_add(&flat, act, sizeof(struct ROAct));
+	actions = _flat_addptr(&flat, root + offsetof(struct ROAct, actions), act->actions, sizeof(struct ROActAction) * act->actioncount);
+	for (actionId = 0; actions != 0 && actionId < act->actioncount; actionId++) {
+		const struct ROActAction *action = &act->actions[actionId];
+		unsigned long actionAt = actions + sizeof(struct ROActAction) * actionId;
+		motions = _flat_addptr(&flat, actionAt + offsetof(struct ROActAction, motions), action->motions, sizeof(struct ROActMotion) * action->motioncount);
+		for (motionId = 0; motions != 0 && motionId < action->motioncount; motionId++) {
+			const struct ROActMotion *motion = &action->motions[motionId];
+			unsigned long motionAt = motions + sizeof(struct ROActMotion) * motionId;
+			_flat_addptr(&flat, motionAt + offsetof(struct ROActMotion, sprclips), motion->sprclips, sizeof(struct ROActSprClip) * motion->sprclipcount);
+			_flat_addptr(&flat, motionAt + offsetof(struct ROActMotion, attachpoints), motion->attachpoints, sizeof(struct ROActAttachPoint) * motion->attachpointcount);
+		}
+	}
+	_flat_addptr(&flat, root + offsetof(struct ROAct, events), act->events, sizeof(struct ROActEvent) * act->eventcount);
+	_flat_addptr(&flat, root + offsetof(struct ROAct, delays), act->delays, sizeof(float) * act->actioncount);
+
+	return(_flat_finish(&flat, root, data_out, size_out));
+}
+
+
+const struct ROAct *act_attachFlat(void *data, unsigned long size) {
+	int moved;
+	const struct ROAct *act = (const struct ROAct*)_flat_attach(data, size, ROINT_FORMAT_ACT, sizeof(struct ROAct), &moved);
+
+	if (act != NULL && moved && act_verifyFlat(data, size) != 0)
+		return(NULL); // relocated from an unknown address, do not trust it
+	return(act);
+}
+
+
+int act_verifyFlat(const void *data, unsigned long size) {
+	const struct ROAct *act = (const struct ROAct*)_flat_verify(data, size, ROINT_FORMAT_ACT, sizeof(struct ROAct));
+	unsigned int actionId, motionId;
+
+	if (act == NULL)
+		return(1);
+	// every array must fit in the block
+	if (_flat_checkarray(data, act->actions, act->actioncount, sizeof(struct ROActAction)) ||
+		_flat_checkarray(data, act->events, act->eventcount, sizeof(struct ROActEvent)) ||
+		(act->delays != NULL && _flat_checkarray(data, act->delays, act->actioncount, sizeof(float)))) {
+		_xlog("act.verifyFlat : invalid\n");
+		return(1);
+	}
+	for (actionId = 0; actionId < act->actioncount; actionId++) {
+		const struct ROActAction *action = &act->actions[actionId];
+		if (_flat_checkarray(data, action->motions, action->motioncount, sizeof(struct ROActMotion))) {
+			_xlog("act.verifyFlat : [%u] invalid motions\n", actionId);
+			return(1);
+		}
+		for (motionId = 0; motionId < action->motioncount; motionId++) {
+			const struct ROActMotion *motion = &action->motions[motionId];
+			if (_flat_checkarray(data, motion->sprclips, motion->sprclipcount, sizeof(struct ROActSprClip)) ||
+				_flat_checkarray(data, motion->attachpoints, motion->attachpointcount, sizeof(struct ROActAttachPoint))) {
+				_xlog("act.verifyFlat : [%u][%u] invalid motion\n", actionId, motionId);
+				return(1);
+			}
+		}
+	}
+	return(0);
+}
+
+
 void act_unload(struct ROAct* act) {
 	unsigned int actionId, motionId;
 
 	if (act == NULL)
 		return;
+	if (_arena_release(act) == 0)
+		return;// loaded in arena mode, everything is released
 
 	if (act->actions != NULL) {
 		for (actionId = 0; actionId < act->actioncount; actionId++) {
@@ -0,0 +1,256 @@
+/*
+    ------------------------------------------------------------------------------------
+    LICENSE:
+    ------------------------------------------------------------------------------------
+    This file is part of The Open Ragnarok Project
+    Copyright 2007 - 2012 The Open Ragnarok Team
+    For the latest information visit http://www.open-ragnarok.org
+    ------------------------------------------------------------------------------------
+    This program is free software; you can redistribute it and/or modify it under
+    the terms of the GNU Lesser General Public License as published by the Free Software
+    Foundation; either version 2 of the License, or (at your option) any later
+    version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License along with
+    this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+    Place - Suite 330, Boston, MA 02111-1307, USA, or go to
+    http://www.gnu.org/copyleft/lesser.txt.
+    ------------------------------------------------------------------------------------
+*/
+#include "internal.h"
+#include "arena.h"
+#include "atomic.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// Alignment of the allocations. (same as malloc on 64-bit systems)
+#define ARENA_ALIGN 16
+/// Size of the first block when the input length is unknown.
+#define ARENA_FIRSTSIZE 0x1000
+/// Smallest and biggest first block sized from the input length.
+#define ARENA_FIRSTMIN 0x200
+#define ARENA_FIRSTMAX 0x100000
+/// Maximum size of the shared blocks.
+#define ARENA_MAXSIZE 0x4000
+/// Size of the block header.
+#define ARENA_HEADERSIZE ((sizeof(struct _arenablock) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+/// Size of the arena structure in the first block.
+#define ARENA_SELFSIZE ((sizeof(struct _arena) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+
+struct _arenablock {
+	struct _arenablock *next;
+	size_t size; // for the sized free
+};
+
+struct _arena {
+	struct _arenablock *blocks; // current block first
+	unsigned char *ptr;
+	unsigned char *end;
+	size_t nextsize; // size of the next block
+};
+
+// Registry of the objects that own an arena. (open addressing, linear probing)
+struct _arenaentry {
+	const void *object;
+	struct _arena *arena;
+};
+
+static unsigned char arena_loadmode = ROINT_LOADMODE_HEAP;
+static volatile unsigned int arena_lock = 0;
+static volatile unsigned int arena_count = 0;
+static unsigned int arena_capacity = 0;
+static struct _arenaentry *arena_entries = NULL;
+
+
+static unsigned int _arena_hash(const void *object) {
+	size_t h = (size_t)object / ARENA_ALIGN;
+	h ^= h >> 15;
+	return((unsigned int)(h * 2654435761u));
+}
+
+
+// Insert without growing. The lock must be held.
+static void _arena_insert(struct _arenaentry *entries, unsigned int capacity, const void *object, struct _arena *arena) {
+	unsigned int i = _arena_hash(object) & (capacity - 1);
+
+	while (entries[i].object != NULL)
+		i = (i + 1) & (capacity - 1);
+	entries[i].object = object;
+	entries[i].arena = arena;
+}
+
+
+static void _arena_register(const void *object, struct _arena *arena) {
+	unsigned int count;
+
+	while (!_xatomic_cas(&arena_lock, 0, 1))
+		;
+	count = _xatomic_load(&arena_count);
+	if ((count + 1) * 2 > arena_capacity) {// keep the load factor under 1/2
+		unsigned int capacity = (arena_capacity == 0)? 64: arena_capacity * 2;
+		struct _arenaentry *entries = (struct _arenaentry*)_xalloc_global(sizeof(struct _arenaentry) * capacity);
+		unsigned int i;
+		memset(entries, 0, sizeof(struct _arenaentry) * capacity);
+		for (i = 0; i < arena_capacity; i++) {
+			if (arena_entries[i].object != NULL)
+				_arena_insert(entries, capacity, arena_entries[i].object, arena_entries[i].arena);
+		}
+		if (arena_entries != NULL)
+			_xfree_global(arena_entries, sizeof(struct _arenaentry) * arena_capacity);
+		arena_entries = entries;
+		arena_capacity = capacity;
+	}
+	_arena_insert(arena_entries, arena_capacity, object, arena);
+	_xatomic_store(&arena_count, count + 1);
+	_xatomic_store(&arena_lock, 0);
+}
+
+
+// Remove the object from the registry and return its arena. (NULL if not found)
+static struct _arena *_arena_unregister(const void *object) {
+	struct _arena *ret = NULL;
+	unsigned int i, j;
+
+	if (_xatomic_load(&arena_count) == 0)
+		return(NULL);// nothing was loaded in arena mode
+	while (!_xatomic_cas(&arena_lock, 0, 1))
+		;
+	if (arena_capacity > 0) {
+		i = _arena_hash(object) & (arena_capacity - 1);
+		while (arena_entries[i].object != NULL && arena_entries[i].object != object)
+			i = (i + 1) & (arena_capacity - 1);
+		if (arena_entries[i].object == object) {
+			ret = arena_entries[i].arena;
+			arena_entries[i].object = NULL;
+			// shift back the entries of the cluster so lookups never stop early
+			for (j = (i + 1) & (arena_capacity - 1); arena_entries[j].object != NULL; j = (j + 1) & (arena_capacity - 1)) {
+				unsigned int k = _arena_hash(arena_entries[j].object) & (arena_capacity - 1);
+				if ((j > i && (k <= i || k > j)) || (j < i && (k <= i && k > j))) {
+					arena_entries[i] = arena_entries[j];
+					arena_entries[j].object = NULL;
+					i = j;
+				}
+			}
+			_xatomic_store(&arena_count, _xatomic_load(&arena_count) - 1);
+		}
+	}
+	_xatomic_store(&arena_lock, 0);
+	return(ret);
+}
+
+
+struct _arena *_arena_loadinit(unsigned long sizehint) {
+	struct _arenablock *block;
+	struct _arena *arena;
+	size_t size = ARENA_FIRSTSIZE;
+
+	if (arena_loadmode != ROINT_LOADMODE_ARENA)
+		return(NULL);
+
+	if (sizehint > 0) {
+		// the loaded data takes about as much memory as the input, small loads fit in one tight block
+		size = (sizehint < ARENA_FIRSTMAX)? ARENA_HEADERSIZE + ARENA_SELFSIZE + (size_t)sizehint + (size_t)sizehint / 8: ARENA_FIRSTMAX;
+		if (size < ARENA_FIRSTMIN)
+			size = ARENA_FIRSTMIN;
+		size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+	}
+	block = (struct _arenablock*)_xalloc(size);
+	block->next = NULL;
+	block->size = size;
+	arena = (struct _arena*)((unsigned char*)block + ARENA_HEADERSIZE);
+	arena->blocks = block;
+	arena->ptr = (unsigned char*)arena + ARENA_SELFSIZE;
+	arena->end = (unsigned char*)block + size;
+	arena->nextsize = ARENA_FIRSTSIZE * 2;
+	if (sizehint > 0 && size / 2 < arena->nextsize) // loads that outgrow a small block grow by small steps
+		arena->nextsize = (size / 2 < ARENA_FIRSTMIN)? ARENA_FIRSTMIN: (size / 2 + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+	return(arena);
+}
+
+
+void *_arena_alloc(struct _arena *arena, size_t size) {
+	struct _arenablock *block;
+	unsigned char *ret;
+
+	if (arena == NULL)
+		return(_xalloc(size));
+
+	size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+	if (size > (size_t)(arena->end - arena->ptr)) {
+		if (size > arena->nextsize / 4) {
+			// big allocation in its own block, keep bumping in the current block
+			block = (struct _arenablock*)_xalloc(ARENA_HEADERSIZE + size);
+			block->next = arena->blocks->next;
+			block->size = ARENA_HEADERSIZE + size;
+			arena->blocks->next = block;
+			return((unsigned char*)block + ARENA_HEADERSIZE);
+		}
+		block = (struct _arenablock*)_xalloc(ARENA_HEADERSIZE + arena->nextsize);
+		block->next = arena->blocks;
+		block->size = ARENA_HEADERSIZE + arena->nextsize;
+		arena->blocks = block;
+		arena->ptr = (unsigned char*)block + ARENA_HEADERSIZE;
+		arena->end = arena->ptr + arena->nextsize;
+		if (arena->nextsize < ARENA_MAXSIZE)
+			arena->nextsize *= 2;
+	}
+	ret = arena->ptr;
+	arena->ptr += size;
+	return(ret);
+}
+
+
+void *_arena_newobject(struct _arena *arena, size_t size) {
+	void *ret = _arena_alloc(arena, size);
+
+	if (arena != NULL)
+		_arena_register(ret, arena);
+	return(ret);
+}
+
+
+void *_arena_realloc(struct _arena *arena, void *ptr, size_t oldsize, size_t size) {
+	void *ret;
+
+	if (arena == NULL)
+		return(_xrealloc(ptr, oldsize, size));
+	ret = _arena_alloc(arena, size);
+	if (ptr != NULL)
+		memcpy(ret, ptr, (oldsize < size)? oldsize: size);
+	return(ret);
+}
+
+
+int _arena_release(const void *object) {
+	struct _arena *arena = _arena_unregister(object);
+	struct _arenablock *block;
+
+	if (arena == NULL)
+		return(1);
+	block = arena->blocks;
+	while (block != NULL) {// the arena itself is in the last block
+		struct _arenablock *next = block->next;
+		_xfreesize(block, block->size);
+		block = next;
+	}
+	return(0);
+}
+
+
+void roint_set_load_mode(unsigned char mode) {
+	if (mode > ROINT_LOADMODE_ARENA)
+		mode = ROINT_LOADMODE_HEAP;
+	arena_loadmode = mode;
+}
+
+
+unsigned char roint_get_load_mode(void) {
+	return(arena_loadmode);
+}
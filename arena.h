@@ -0,0 +1,55 @@
+/*
+    ------------------------------------------------------------------------------------
+    LICENSE:
+    ------------------------------------------------------------------------------------
+    This file is part of The Open Ragnarok Project
+    Copyright 2007 - 2012 The Open Ragnarok Team
+    For the latest information visit http://www.open-ragnarok.org
+    ------------------------------------------------------------------------------------
+    This program is free software; you can redistribute it and/or modify it under
+    the terms of the GNU Lesser General Public License as published by the Free Software
+    Foundation; either version 2 of the License, or (at your option) any later
+    version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License along with
+    this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+    Place - Suite 330, Boston, MA 02111-1307, USA, or go to
+    http://www.gnu.org/copyleft/lesser.txt.
+    ------------------------------------------------------------------------------------
+*/
+#ifndef __ROINT_INTERNAL_ARENA_H
+#define __ROINT_INTERNAL_ARENA_H
+
+// For ROInt internal use only
+
+// Bump allocator for the ROINT_LOADMODE_ARENA load mode.
+// A loader calls _arena_loadinit and allocates the object and everything inside it
+// with _arena_newobject and _arena_alloc. With an arena, the memory comes from a few
+// big blocks and the unload function releases them all with _arena_release.
+// Without an arena (NULL), the functions fall back to _xalloc.
+
+#include <stddef.h> // size_t
+
+struct _arena;
+
+/// Returns a new arena if the load mode is ROINT_LOADMODE_ARENA, NULL otherwise.
+/// The first block is sized from 'sizehint', the input length (reader->remaining, 0 if unknown).
+struct _arena *_arena_loadinit(unsigned long sizehint);
+/// Allocate the object of a load, which owns the arena. (not zero-filled)
+/// Without an arena, same as _xalloc.
+void *_arena_newobject(struct _arena *arena, size_t size);
+/// Allocate memory that lives until the arena is released. (not zero-filled)
+/// Without an arena, same as _xalloc.
+void *_arena_alloc(struct _arena *arena, size_t size);
+/// Resize memory from _arena_alloc. (arena memory is copied and stays until the arena is released)
+/// Without an arena, same as _xrealloc.
+void *_arena_realloc(struct _arena *arena, void *ptr, size_t oldsize, size_t size);
+/// If 'object' came from _arena_newobject with an arena, release the arena and return 0.
+/// Returns 1 if the object was allocated with _xalloc and must be freed normally.
+int _arena_release(const void *object);
+
+#endif /* __ROINT_INTERNAL_ARENA_H */
@@ -0,0 +1,90 @@
+/*
+    ------------------------------------------------------------------------------------
+    LICENSE:
+    ------------------------------------------------------------------------------------
+    This file is part of The Open Ragnarok Project
+    Copyright 2007 - 2012 The Open Ragnarok Team
+    For the latest information visit http://www.open-ragnarok.org
+    ------------------------------------------------------------------------------------
+    This program is free software; you can redistribute it and/or modify it under
+    the terms of the GNU Lesser General Public License as published by the Free Software
+    Foundation; either version 2 of the License, or (at your option) any later
+    version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License along with
+    this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+    Place - Suite 330, Boston, MA 02111-1307, USA, or go to
+    http://www.gnu.org/copyleft/lesser.txt.
+    ------------------------------------------------------------------------------------
+*/
+#ifndef __ROINT_INTERNAL_ATOMIC_H
+#define __ROINT_INTERNAL_ATOMIC_H
+
+// Minimal sequentially consistent atomic operations.
+// Only what the library needs; values are 32-bit unsigned ints or pointers.
+
+#if defined(_MSC_VER)
+#	include <intrin.h>
+#	define _XATOMIC_INLINE static __inline
+
+_XATOMIC_INLINE unsigned int _xatomic_load(volatile unsigned int *ptr) {
+	return((unsigned int)_InterlockedOr((volatile long*)ptr, 0));
+}
+_XATOMIC_INLINE void _xatomic_store(volatile unsigned int *ptr, unsigned int val) {
+	_InterlockedExchange((volatile long*)ptr, (long)val);
+}
+// Returns non-zero if *ptr was expected and is now val.
+_XATOMIC_INLINE int _xatomic_cas(volatile unsigned int *ptr, unsigned int expected, unsigned int val) {
+	return(_InterlockedCompareExchange((volatile long*)ptr, (long)val, (long)expected) == (long)expected);
+}
+// Returns the new value.
+_XATOMIC_INLINE unsigned int _xatomic_add(volatile unsigned int *ptr, unsigned int val) {
+	return((unsigned int)_InterlockedExchangeAdd((volatile long*)ptr, (long)val) + val);
+}
+_XATOMIC_INLINE void *_xatomic_loadptr(void *volatile *ptr) {
+	return(_InterlockedCompareExchangePointer(ptr, NULL, NULL));
+}
+// Returns the previous value.
+_XATOMIC_INLINE void *_xatomic_xchgptr(void *volatile *ptr, void *val) {
+	return(_InterlockedExchangePointer(ptr, val));
+}
+// Returns non-zero if *ptr was expected and is now val.
+_XATOMIC_INLINE int _xatomic_casptr(void *volatile *ptr, void *expected, void *val) {
+	return(_InterlockedCompareExchangePointer(ptr, val, expected) == expected);
+}
+
+#else // gcc/clang builtins
+#	define _XATOMIC_INLINE static __inline__
+
+_XATOMIC_INLINE unsigned int _xatomic_load(volatile unsigned int *ptr) {
+	return(__atomic_load_n(ptr, __ATOMIC_SEQ_CST));
+}
+_XATOMIC_INLINE void _xatomic_store(volatile unsigned int *ptr, unsigned int val) {
+	__atomic_store_n(ptr, val, __ATOMIC_SEQ_CST);
+}
+// Returns non-zero if *ptr was expected and is now val.
+_XATOMIC_INLINE int _xatomic_cas(volatile unsigned int *ptr, unsigned int expected, unsigned int val) {
+	return(__atomic_compare_exchange_n(ptr, &expected, val, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST));
+}
+// Returns the new value.
+_XATOMIC_INLINE unsigned int _xatomic_add(volatile unsigned int *ptr, unsigned int val) {
+	return(__atomic_add_fetch(ptr, val, __ATOMIC_SEQ_CST));
+}
+_XATOMIC_INLINE void *_xatomic_loadptr(void *volatile *ptr) {
+	return(__atomic_load_n(ptr, __ATOMIC_SEQ_CST));
+}
+// Returns the previous value.
+_XATOMIC_INLINE void *_xatomic_xchgptr(void *volatile *ptr, void *val) {
+	return(__atomic_exchange_n(ptr, val, __ATOMIC_SEQ_CST));
+}
+// Returns non-zero if *ptr was expected and is now val.
+_XATOMIC_INLINE int _xatomic_casptr(void *volatile *ptr, void *expected, void *val) {
+	return(__atomic_compare_exchange_n(ptr, &expected, val, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST));
+}
+#endif
+
+#endif /* __ROINT_INTERNAL_ATOMIC_H */
@@ -0,0 +1,616 @@
+/*
+    ------------------------------------------------------------------------------------
+    LICENSE:
+    ------------------------------------------------------------------------------------
+    This file is part of The Open Ragnarok Project
+    Copyright 2007 - 2011 The Open Ragnarok Team
+    For the latest information visit http://www.open-ragnarok.org
+    ------------------------------------------------------------------------------------
+    This program is free software; you can redistribute it and/or modify it under
+    the terms of the GNU Lesser General Public License as published by the Free Software
+    Foundation; either version 2 of the License, or (at your option) any later
+    version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License along with
+    this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+    Place - Suite 330, Boston, MA 02111-1307, USA, or go to
+    http://www.gnu.org/copyleft/lesser.txt.
+    ------------------------------------------------------------------------------------
+*/
+#include "internal.h"
+#include "arena.h"
+#include "atomic.h"
+#include "thread.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+
+const char CATALOG_MAGIC[4] = {'R','O','C','T'};
+const unsigned short CATALOG_VERSION = 0x100;
+
+/// Uncompressed bytes needed to recognize an entry.
+#define CATALOG_PEEK 64
+/// Entries claimed by a thread at a time.
+#define CATALOG_BATCH 64
+
+
+struct _catalog_build {
+	struct ROGrf **grfs;
+	const struct ROGrfSnapshot **snaps;
+	unsigned int grfcount;
+	unsigned int *firstentry; // index of the first entry of each archive (grfcount+1 elements)
+	unsigned int options;
+	struct ROCatalogEntry *entries;
+	const char **names; // name of each entry (NULL if skipped)
+	volatile unsigned int next; // next entry to scan
+};
+
+
+static unsigned short catalog__u16(const unsigned char *data) {
+	unsigned short ret;
+	memcpy(&ret, data, 2);
+	return(ret);
+}
+
+
+static unsigned int catalog__u32(const unsigned char *data) {
+	unsigned int ret;
+	memcpy(&ret, data, 4);
+	return(ret);
+}
+
+
+// Does the file name end with the extension? (case insensitive)
+static int catalog__hasext(const char *name, const char *ext) {
+	size_t namelen = strlen(name);
+	size_t extlen = strlen(ext);
+	size_t i;
+
+	if (namelen < extlen)
+		return(0);
+	name += namelen - extlen;
+	for (i = 0; i < extlen; i++) {
+		char c = name[i];
+		if (c >= 'A' && c <= 'Z')
+			c = c - 'A' + 'a';
+		if (c != ext[i])
+			return(0);
+	}
+	return(1);
+}
+
+
+// Fills the entry from the first bytes of the data (head, headlen bytes).
+// data returns more bytes (up to n) when needed, directly from 'full' if the whole data is available.
+static void catalog__parse(struct ROCatalogEntry *entry, const char *name, const unsigned char *head, unsigned int headlen, const unsigned char *full, const struct ROGrfSnapshot *snap, const struct ROGrfFile *file) {
+	if (headlen >= 6 && memcmp(head, "AC", 2) == 0 && catalog__hasext(name, ".act")) {
+		entry->type = ROCATALOG_ACT;
+		entry->version = catalog__u16(head + 2);
+		entry->count = catalog__u16(head + 4);
+	}
+	else if (headlen >= 6 && memcmp(head, "SP", 2) == 0 && catalog__hasext(name, ".spr")) {
+		unsigned int offset;
+		entry->type = ROCATALOG_SPR;
+		entry->version = catalog__u16(head + 2);
+		entry->count = catalog__u16(head + 4);
+		offset = 6;
+		if (entry->version >= 0x200 && headlen >= 8) {
+			entry->count2 = catalog__u16(head + 6);
+			offset = 8;
+		}
+		if (entry->count + entry->count2 > 0 && headlen >= offset + 4) {
+			entry->width = catalog__u16(head + offset);
+			entry->height = catalog__u16(head + offset + 2);
+		}
+	}
+	else if (headlen >= 14 && (memcmp(head, "GRAT", 4) == 0 || memcmp(head, "GRGN", 4) == 0)) {
+		entry->type = (head[2] == 'A')? ROCATALOG_GAT: ROCATALOG_GND;
+		entry->version = (unsigned short)((head[4] << 8) | head[5]);
+		entry->width = catalog__u32(head + 6);
+		entry->height = catalog__u32(head + 10);
+	}
+	else if (headlen >= 6 && memcmp(head, "GRSW", 4) == 0) {
+		entry->type = ROCATALOG_RSW;
+		entry->version = (unsigned short)((head[4] << 8) | head[5]);
+	}
+	else if (headlen >= 20 && memcmp(head, "STRM", 4) == 0) {
+		entry->type = ROCATALOG_STR;
+		entry->version = (unsigned short)catalog__u32(head + 4);
+		entry->count2 = catalog__u32(head + 8);
+		entry->count = catalog__u32(head + 16);
+	}
+	else if (headlen >= 6 && memcmp(head, "GRSM", 4) == 0) {
+		// node count comes after the texture names
+		unsigned int offset;
+		entry->type = ROCATALOG_RSM;
+		entry->version = (unsigned short)((head[4] << 8) | head[5]);
+		offset = 6 + 4 + 4 + ((entry->version >= 0x104)? 1: 0) + 16;
+		if (headlen >= offset + 4) {
+			unsigned int texturecount = catalog__u32(head + offset);
+			entry->count2 = texturecount;
+			if (texturecount <= 0xFFFF) {
+				offset += 4 + 40 * texturecount + 40;
+				if (offset + 4 <= (unsigned int)file->uncompressedLength) {
+					if (full != NULL)
+						entry->count = catalog__u32(full + offset);
+					else {
+						unsigned char *buf = (unsigned char*)_xalloc(offset + 4);
+						if (grf_snapshot_peek(snap, file, buf, offset + 4) == (int)(offset + 4))
+							entry->count = catalog__u32(buf + offset);
+						_xfree(buf);
+					}
+				}
+			}
+		}
+	}
+	else if (headlen >= 26 && memcmp(head, "BM", 2) == 0) {
+		int height;
+		entry->type = ROCATALOG_BMP;
+		entry->width = catalog__u32(head + 18);
+		height = (int)catalog__u32(head + 22);
+		entry->height = (unsigned int)((height < 0)? -height: height); // top-down bitmaps have negative height
+	}
+	else if (headlen >= 2 && head[0] == 0xFF && head[1] == 0xD8) {
+		entry->type = ROCATALOG_JPG;
+	}
+	else if (headlen >= 12 && memcmp(head, "RIFF", 4) == 0 && memcmp(head + 8, "WAVE", 4) == 0) {
+		entry->type = ROCATALOG_WAV;
+	}
+	else if (headlen >= 18 && catalog__hasext(name, ".tga")) {
+		entry->type = ROCATALOG_TGA;
+		entry->width = catalog__u16(head + 12);
+		entry->height = catalog__u16(head + 14);
+	}
+	else if (catalog__hasext(name, ".pal") && file->uncompressedLength == 1024) {
+		entry->type = ROCATALOG_PAL;
+	}
+	else if (catalog__hasext(name, ".imf")) {
+		entry->type = ROCATALOG_IMF;
+	}
+}
+
+
+// Scans the archive entries claimed by this thread.
+static void catalog__thread(void *arg, unsigned int index) {
+	struct _catalog_build *build = (struct _catalog_build*)arg;
+	unsigned int total = build->firstentry[build->grfcount];
+	unsigned char *buf = NULL;
+	unsigned int bufsize = 0;
+	unsigned int first, i;
+
+	(void)index;
+	while ((first = _xatomic_add(&build->next, CATALOG_BATCH) - CATALOG_BATCH) < total) {
+		unsigned int archive = 0;
+		for (i = first; i < first + CATALOG_BATCH && i < total; i++) {
+			struct ROCatalogEntry *entry = &build->entries[i];
+			const struct ROGrfSnapshot *snap;
+			const struct ROGrfFile *file;
+			unsigned char head[CATALOG_PEEK];
+			unsigned int needed;
+			int headlen;
+
+			while (i >= build->firstentry[archive + 1])
+				archive++;
+			snap = build->snaps[archive];
+			file = grf_snapshot_getfileinfo(snap, i - build->firstentry[archive]);
+			if (file == NULL || !(file->flags & GRF_FLAG_FILE))
+				continue; // directory
+
+			memset(entry, 0, sizeof(struct ROCatalogEntry));
+			entry->archive = (unsigned short)archive;
+			entry->size = (unsigned int)file->uncompressedLength;
+
+			needed = (build->options & ROCATALOG_HASH_DATA)? (unsigned int)file->uncompressedLength: (unsigned int)file->compressedLengthAligned;
+			if (needed > bufsize) {
+				if (buf != NULL)
+					_xfree(buf);
+				bufsize = needed;
+				buf = (unsigned char*)_xalloc(bufsize);
+			}
+
+			if (build->options & ROCATALOG_HASH_DATA) {
+				if (grf_snapshot_read(snap, file, buf) != 0)
+					continue;
+				entry->hash = (unsigned int)crc32(crc32(0, NULL, 0), buf, needed);
+				catalog__parse(entry, file->fileName, buf, needed, buf, snap, file);
+			}
+			else {
+				if (grf_snapshot_readstored(snap, file, buf) != 0)
+					continue;
+				entry->hash = (unsigned int)crc32(crc32(0, NULL, 0), buf, needed);
+				headlen = grf_snapshot_peek(snap, file, head, sizeof(head));
+				if (headlen < 0)
+					continue;
+				catalog__parse(entry, file->fileName, head, (unsigned int)headlen, NULL, snap, file);
+			}
+			build->names[i] = file->fileName;
+		}
+	}
+
+	if (buf != NULL)
+		_xfree(buf);
+}
+
+
+struct _catalog_sort {
+	const char *name;
+	unsigned int index;
+};
+
+
+static int catalog__compare(const void *a, const void *b) {
+	const struct _catalog_sort *sa = (const struct _catalog_sort*)a;
+	const struct _catalog_sort *sb = (const struct _catalog_sort*)b;
+	int r = strcmp(sa->name, sb->name);
+	if (r != 0)
+		return(r);
+	return((sa->index < sb->index)? -1: (sa->index > sb->index));
+}
+
+
+// Builds the type index of the catalog. (entries must be sorted)
+static void catalog__indextypes(struct ROCatalog *ret) {
+	unsigned int i, pos[ROCATALOG_TYPECOUNT];
+
+	memset(ret->typeoffsets, 0, sizeof(ret->typeoffsets));
+	for (i = 0; i < ret->entrycount; i++)
+		ret->typeoffsets[ret->entries[i].type + 1]++;
+	for (i = 0; i < ROCATALOG_TYPECOUNT; i++) {
+		ret->typeoffsets[i + 1] += ret->typeoffsets[i];
+		pos[i] = ret->typeoffsets[i];
+	}
+	for (i = 0; i < ret->entrycount; i++)
+		ret->bytype[pos[ret->entries[i].type]++] = i;
+}
+
+
+struct ROCatalog *catalog_build(struct ROGrf **grfs, unsigned int grfcount, unsigned int threadcount, unsigned int options) {
+	struct _catalog_build build;
+	struct _catalog_sort *sorted;
+	struct ROCatalog *ret;
+	unsigned int i, total, count, namessize;
+	int *slots;
+
+	if (grfs == NULL || grfcount == 0 || grfcount > 0xFFFF) {
+		_xlog("catalog.build : invalid argument (grfs=%p grfcount=%u)\n", grfs, grfcount);
+		return(NULL);
+	}
+
+	memset(&build, 0, sizeof(build));
+	build.grfs = grfs;
+	build.grfcount = grfcount;
+	build.options = options;
+	build.snaps = (const struct ROGrfSnapshot**)_xalloc(sizeof(struct ROGrfSnapshot*) * grfcount);
+	build.firstentry = (unsigned int*)_xalloc(sizeof(unsigned int) * (grfcount + 1));
+	slots = (int*)_xalloc(sizeof(int) * grfcount);
+	total = 0;
+	for (i = 0; i < grfcount; i++) {
+		build.snaps[i] = grf_snapshot_acquire(grfs[i], &slots[i]);
+		if (build.snaps[i] == NULL) {
+			_xlog("catalog.build : cannot read archive %u\n", i);
+			while (i-- > 0)
+				grf_snapshot_release(grfs[i], slots[i]);
+			_xfree(slots);
+			_xfree(build.firstentry);
+			_xfree(build.snaps);
+			return(NULL);
+		}
+		build.firstentry[i] = total;
+		total += grf_snapshot_filecount(build.snaps[i]);
+	}
+	build.firstentry[grfcount] = total;
+	build.entries = (struct ROCatalogEntry*)_xalloc(sizeof(struct ROCatalogEntry) * (total + 1));
+	build.names = (const char**)_xalloc(sizeof(const char*) * (total + 1));
+	memset(build.names, 0, sizeof(const char*) * (total + 1));
+
+	// scan
+	if (threadcount == 0)
+		threadcount = _xthread_hwcount();
+	if (threadcount > total / CATALOG_BATCH + 1)
+		threadcount = total / CATALOG_BATCH + 1;
+	_xthread_parallel(threadcount, &catalog__thread, &build);
+
+	// sort by name, then archive (entries are in archive order)
+	sorted = (struct _catalog_sort*)_xalloc(sizeof(struct _catalog_sort) * (total + 1));
+	count = 0;
+	namessize = 0;
+	for (i = 0; i < total; i++) {
+		if (build.names[i] == NULL)
+			continue;
+		sorted[count].name = build.names[i];
+		sorted[count].index = i;
+		namessize += (unsigned int)strlen(build.names[i]) + 1;
+		count++;
+	}
+	qsort(sorted, count, sizeof(struct _catalog_sort), &catalog__compare);
+	for (i = 0; i < grfcount; i++)
+		namessize += (unsigned int)strlen((grfs[i]->filename != NULL)? grfs[i]->filename: "") + 1;
+
+	ret = (struct ROCatalog*)_xalloc(sizeof(struct ROCatalog));
+	memset(ret, 0, sizeof(struct ROCatalog));
+	ret->archivecount = (unsigned short)grfcount;
+	ret->options = (unsigned short)options;
+	ret->entrycount = count;
+	ret->namessize = namessize;
+	ret->archives = (unsigned int*)_xalloc(sizeof(unsigned int) * grfcount);
+	ret->entries = (struct ROCatalogEntry*)_xalloc(sizeof(struct ROCatalogEntry) * (count + 1));
+	ret->bytype = (unsigned int*)_xalloc(sizeof(unsigned int) * (count + 1));
+	ret->names = (char*)_xalloc(namessize + 1);
+	namessize = 0;
+	for (i = 0; i < grfcount; i++) {
+		const char *name = (grfs[i]->filename != NULL)? grfs[i]->filename: "";
+		size_t len = strlen(name) + 1;
+		ret->archives[i] = namessize;
+		memcpy(ret->names + namessize, name, len);
+		namessize += (unsigned int)len;
+	}
+	for (i = 0; i < count; i++) {
+		size_t len = strlen(sorted[i].name) + 1;
+		ret->entries[i] = build.entries[sorted[i].index];
+		ret->entries[i].name = namessize;
+		memcpy(ret->names + namessize, sorted[i].name, len);
+		namessize += (unsigned int)len;
+	}
+	catalog__indextypes(ret);
+
+	_xfree(sorted);
+	for (i = 0; i < grfcount; i++)
+		grf_snapshot_release(grfs[i], slots[i]);
+	_xfree(slots);
+	_xfree(build.names);
+	_xfree(build.entries);
+	_xfree(build.firstentry);
+	_xfree(build.snaps);
+
+	return(ret);
+}
+
+
+const struct ROCatalogEntry *catalog_find(const struct ROCatalog *catalog, const char *name) {
+	unsigned int lo, hi;
+
+	if (catalog == NULL || name == NULL)
+		return(NULL);
+
+	// first entry not lower than name
+	lo = 0;
+	hi = catalog->entrycount;
+	while (lo < hi) {
+		unsigned int mid = lo + (hi - lo) / 2;
+		if (strcmp(catalog->names + catalog->entries[mid].name, name) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo < catalog->entrycount && strcmp(catalog->names + catalog->entries[lo].name, name) == 0)
+		return(&catalog->entries[lo]);
+	return(NULL);
+}
+
+
+const unsigned int *catalog_findtype(const struct ROCatalog *catalog, unsigned char type, unsigned int *count) {
+	if (count != NULL)
+		*count = 0;
+	if (catalog == NULL || type >= ROCATALOG_TYPECOUNT)
+		return(NULL);
+	if (catalog->typeoffsets[type] == catalog->typeoffsets[type + 1])
+		return(NULL);
+
+	if (count != NULL)
+		*count = catalog->typeoffsets[type + 1] - catalog->typeoffsets[type];
+	return(catalog->bytype + catalog->typeoffsets[type]);
+}
+
+
+const char *catalog_name(const struct ROCatalog *catalog, const struct ROCatalogEntry *entry) {
+	if (catalog == NULL || entry == NULL)
+		return(NULL);
+
+	return(catalog->names + entry->name);
+}
+
+
+const char *catalog_archive(const struct ROCatalog *catalog, unsigned short archive) {
+	if (catalog == NULL || archive >= catalog->archivecount)
+		return(NULL);
+
+	return(catalog->names + catalog->archives[archive]);
+}
+
+
+struct ROCatalog *catalog_load(struct _reader *reader) {
+	struct ROCatalog *ret;
+	struct _arena *arena;
+	unsigned short version, reserved;
+	char magic[4];
+	unsigned int i;
+
+	if (reader == NULL || reader->error) {
+		_xlog("catalog.load : invalid argument (reader=%p reader.error=%d)\n", reader, reader->error);
+		return(NULL);
+	}
+
+	reader->read(magic, 4, 1, reader);
+	if (memcmp(CATALOG_MAGIC, magic, 4) != 0) {
+		_xlog("catalog.load : invalid header x%02X%02X%02X%02X (\"%-4s\")\n", magic[0], magic[1], magic[2], magic[3], magic);
+		return(NULL);
+	}
+	reader->read(&version, 2, 1, reader);
+	if (version != CATALOG_VERSION) {
+		_xlog("catalog.load : unknown version 0x%X (v%u.%u)\n", version, (version >> 8) & 0xFF, version & 0xFF);
+		return(NULL);
+	}
+
+	arena = _arena_loadinit(reader->remaining(reader));
+	ret = (struct ROCatalog*)_arena_newobject(arena, sizeof(struct ROCatalog));
+	memset(ret, 0, sizeof(struct ROCatalog));
+	reader->read(&ret->archivecount, 2, 1, reader);
+	reader->read(&ret->options, 2, 1, reader);
+	reader->read(&reserved, 2, 1, reader);
+	reader->read(&ret->entrycount, 4, 1, reader);
+	reader->read(&ret->namessize, 4, 1, reader);
+	if (reader->error ||
+		_mul_over_limit(ret->entrycount, sizeof(struct ROCatalogEntry), 0x7FFFFFFF) ||
+		ret->namessize == 0 || ret->namessize > 0x7FFFFFFF) {
+		_xlog("catalog.load : invalid sizes\n");
+		catalog_unload(ret);
+		return(NULL);
+	}
+
+	ret->archives = (unsigned int*)_arena_alloc(arena, sizeof(unsigned int) * (ret->archivecount + 1));
+	ret->entries = (struct ROCatalogEntry*)_arena_alloc(arena, sizeof(struct ROCatalogEntry) * (ret->entrycount + 1));
+	ret->bytype = (unsigned int*)_arena_alloc(arena, sizeof(unsigned int) * (ret->entrycount + 1));
+	ret->names = (char*)_arena_alloc(arena, ret->namessize + 1);
+	reader->read(ret->archives, sizeof(unsigned int), ret->archivecount, reader);
+	reader->read(ret->entries, sizeof(struct ROCatalogEntry), ret->entrycount, reader);
+	reader->read(ret->bytype, sizeof(unsigned int), ret->entrycount, reader);
+	reader->read(ret->typeoffsets, sizeof(ret->typeoffsets), 1, reader);
+	reader->read(ret->names, 1, ret->namessize, reader);
+	if (reader->error) {
+		_xlog("catalog.load : read error\n");
+		catalog_unload(ret);
+		return(NULL);
+	}
+
+	// validate
+	ret->names[ret->namessize] = 0;
+	if (ret->names[ret->namessize - 1] != 0 || ret->typeoffsets[0] != 0 || ret->typeoffsets[ROCATALOG_TYPECOUNT] != ret->entrycount) {
+		_xlog("catalog.load : invalid data\n");
+		catalog_unload(ret);
+		return(NULL);
+	}
+	for (i = 0; i < ROCATALOG_TYPECOUNT; i++) {
+		if (ret->typeoffsets[i] > ret->typeoffsets[i + 1]) {
+			_xlog("catalog.load : invalid type index\n");
+			catalog_unload(ret);
+			return(NULL);
+		}
+	}
+	for (i = 0; i < ret->archivecount; i++) {
+		if (ret->archives[i] >= ret->namessize) {
+			_xlog("catalog.load : [%u] invalid archive name\n", i);
+			catalog_unload(ret);
+			return(NULL);
+		}
+	}
+	for (i = 0; i < ret->entrycount; i++) {
+		if (ret->entries[i].name >= ret->namessize || ret->entries[i].archive >= ret->archivecount ||
+			ret->entries[i].type >= ROCATALOG_TYPECOUNT || ret->bytype[i] >= ret->entrycount) {
+			_xlog("catalog.load : [%u] invalid entry\n", i);
+			catalog_unload(ret);
+			return(NULL);
+		}
+	}
+
+	return(ret);
+}
+
+
+struct ROCatalog *catalog_loadFromData(const unsigned char *data, unsigned long length) {
+	struct ROCatalog *ret;
+	struct _reader *reader;
+
+	reader = statsreader_init(memreader_init(data, length), ROINT_FORMAT_CATALOG);
+	ret = catalog_load(reader);
+	reader->destroy(reader);
+
+	return(ret);
+}
+
+
+struct ROCatalog *catalog_loadFromFile(const char *fn) {
+	struct ROCatalog *ret;
+	struct _reader *reader;
+
+	reader = statsreader_init(filereader_init(fn), ROINT_FORMAT_CATALOG);
+	ret = catalog_load(reader);
+	reader->destroy(reader);
+
+	return(ret);
+}
+
+
+int catalog_save(const struct ROCatalog *catalog, struct _writer *writer) {
+	unsigned short reserved = 0;
+
+	if (catalog == NULL || writer == NULL || writer->error) {
+		_xlog("catalog.save : invalid argument (catalog=%p writer=%p writer.error=%d)\n", catalog, writer, writer->error);
+		return(1);
+	}
+
+	writer->write(CATALOG_MAGIC, 4, 1, writer);
+	writer->write(&CATALOG_VERSION, 2, 1, writer);
+	writer->write(&catalog->archivecount, 2, 1, writer);
+	writer->write(&catalog->options, 2, 1, writer);
+	writer->write(&reserved, 2, 1, writer);
+	writer->write(&catalog->entrycount, 4, 1, writer);
+	writer->write(&catalog->namessize, 4, 1, writer);
+	if (catalog->archivecount > 0)
+		writer->write(catalog->archives, sizeof(unsigned int), catalog->archivecount, writer);
+	if (catalog->entrycount > 0) {
+		writer->write(catalog->entries, sizeof(struct ROCatalogEntry), catalog->entrycount, writer);
+		writer->write(catalog->bytype, sizeof(unsigned int), catalog->entrycount, writer);
+	}
+	writer->write(catalog->typeoffsets, sizeof(catalog->typeoffsets), 1, writer);
+	writer->write(catalog->names, 1, catalog->namessize, writer);
+
+	if (writer->error) {
+		_xlog("catalog.save : write error\n");
+		return(1);
+	}
+
+	return(0);
+}
+
+
+int catalog_saveToData(const struct ROCatalog *catalog, unsigned char **data_out, unsigned long *size_out) {
+	int ret;
+	struct _writer *writer;
+
+	writer = statswriter_init(memwriter_init(data_out, size_out), ROINT_FORMAT_CATALOG);
+	ret = catalog_save(catalog, writer);
+	writer->destroy(writer);
+
+	return(ret);
+}
+
+
+int catalog_saveToFile(const struct ROCatalog *catalog, const char *fn) {
+	int ret;
+	struct _writer *writer, *memwriter;
+
+	memwriter = memwriter_init(NULL, NULL);
+	writer = statswriter_init(memwriter, ROINT_FORMAT_CATALOG);
+	ret = catalog_save(catalog, writer);
+	if (ret == 0)
+		ret = memwriter_savefile(memwriter, fn);
+	writer->destroy(writer);
+
+	return(ret);
+}
+
+
+void catalog_unload(struct ROCatalog *catalog) {
+	if (catalog == NULL)
+		return;
+	if (_arena_release(catalog) == 0)
+		return;// loaded in arena mode, everything is released
+
+	if (catalog->archives != NULL)
+		_xfree(catalog->archives);
+	if (catalog->entries != NULL)
+		_xfree(catalog->entries);
+	if (catalog->bytype != NULL)
+		_xfree(catalog->bytype);
+	if (catalog->names != NULL)
+		_xfree(catalog->names);
+
+	_xfree(catalog);
+}
@@ -0,0 +1,139 @@
+/*
+    ------------------------------------------------------------------------------------
+    LICENSE:
+    ------------------------------------------------------------------------------------
+    This file is part of The Open Ragnarok Project
+    Copyright 2007 - 2012 The Open Ragnarok Team
+    For the latest information visit http://www.open-ragnarok.org
+    ------------------------------------------------------------------------------------
+    This program is free software; you can redistribute it and/or modify it under
+    the terms of the GNU Lesser General Public License as published by the Free Software
+    Foundation; either version 2 of the License, or (at your option) any later
+    version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License along with
+    this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+    Place - Suite 330, Boston, MA 02111-1307, USA, or go to
+    http://www.gnu.org/copyleft/lesser.txt.
+    ------------------------------------------------------------------------------------
+*/
+#include "internal.h"
+#include "cursor.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Biggest section that is zero-filled on error.
+// Bigger sections are empty on error, so the caller must check the return value.
+#define CURSOR_ZEROFILL_LIMIT 0x10000
+// First chunk read into the buffer for big sections, doubled while the data lasts.
+#define CURSOR_CHUNK 0x100000 // 1M
+
+
+void _cursor_init(struct _cursor *cursor, struct _reader *reader) {
+	cursor->reader = reader;
+	cursor->ptr = NULL;
+	cursor->end = NULL;
+	cursor->buf = NULL;
+	cursor->bufsize = 0;
+	cursor->error = (reader == NULL || reader->error);
+}
+
+
+void _cursor_destroy(struct _cursor *cursor) {
+	struct _reader *reader = cursor->reader;
+
+	if (!cursor->error && cursor->ptr < cursor->end)
+		reader->seek(reader, -(long)(cursor->end - cursor->ptr), SEEK_CUR);
+	if (cursor->buf != NULL)
+		_xfree(cursor->buf);
+	cursor->buf = NULL;
+	cursor->bufsize = 0;
+	cursor->ptr = cursor->end = NULL;
+}
+
+
+int _cursor_need(struct _cursor *cursor, unsigned long size) {
+	struct _reader *reader = cursor->reader;
+	unsigned long remaining = (unsigned long)(cursor->end - cursor->ptr);
+	unsigned long capacity, filled;
+
+	if (!cursor->error) {
+		if (size <= remaining)
+			return(0);
+		if (remaining == 0) {
+			const unsigned char *ptr = reader->borrow(reader, size);
+			if (ptr != NULL) {
+				cursor->ptr = ptr;
+				cursor->end = ptr + size;
+				return(0);
+			}
+			if (reader->error)
+				cursor->error = 1;
+		}
+	}
+	if (cursor->error) {
+		remaining = 0;
+		if (size > CURSOR_ZEROFILL_LIMIT) {
+			// don't allocate a big section of zeros for a truncated or corrupt file
+			cursor->ptr = cursor->end = NULL;
+			return(1);
+		}
+	}
+
+	// copy into the buffer, after the unused bytes
+	// big sections grow with the data that is actually read, so a corrupt count can't allocate much more than the file
+	capacity = size;
+	if (!cursor->error && size > CURSOR_CHUNK && size - remaining > CURSOR_CHUNK)
+		capacity = remaining + CURSOR_CHUNK;
+	if (capacity + 1 > cursor->bufsize) {
+		unsigned char *old = cursor->buf;
+		cursor->buf = (unsigned char*)_xalloc(capacity + 1);
+		cursor->bufsize = capacity + 1;
+		if (remaining > 0)
+			memcpy(cursor->buf, cursor->ptr, remaining);
+		if (old != NULL)
+			_xfree(old);
+	}
+	else if (remaining > 0)
+		memmove(cursor->buf, cursor->ptr, remaining);
+	filled = remaining;
+	while (!cursor->error && reader->read(cursor->buf + filled, capacity - filled, 1, reader) == 0) {
+		filled = capacity;
+		if (filled == size) {
+			cursor->ptr = cursor->buf;
+			cursor->end = cursor->buf + size;
+			return(0);
+		}
+		capacity = (size - capacity > capacity)? capacity * 2: size;
+		if (capacity + 1 > cursor->bufsize) {
+			cursor->buf = (unsigned char*)_xrealloc(cursor->buf, cursor->bufsize, capacity + 1);
+			cursor->bufsize = capacity + 1;
+		}
+	}
+
+	cursor->error = 1;
+	if (size > CURSOR_ZEROFILL_LIMIT) {
+		cursor->ptr = cursor->end = NULL;
+		return(1);
+	}
+	memset(cursor->buf, 0, size);
+	cursor->ptr = cursor->buf;
+	cursor->end = cursor->buf + size;
+	return(1);
+}
+
+
+int _cursor_needarray(struct _cursor *cursor, unsigned long size, unsigned long count) {
+	if (_mul_over_limit(size, count, 0x7FFFFFFF)) {
+		_xlog("cursor.need : too much data (size=%lu count=%lu)\n", size, count);
+		cursor->error = 1;
+		return(_cursor_need(cursor, 0));
+	}
+	return(_cursor_need(cursor, size * count));
+}
@@ -0,0 +1,98 @@
+/*
+    ------------------------------------------------------------------------------------
+    LICENSE:
+    ------------------------------------------------------------------------------------
+    This file is part of The Open Ragnarok Project
+    Copyright 2007 - 2012 The Open Ragnarok Team
+    For the latest information visit http://www.open-ragnarok.org
+    ------------------------------------------------------------------------------------
+    This program is free software; you can redistribute it and/or modify it under
+    the terms of the GNU Lesser General Public License as published by the Free Software
+    Foundation; either version 2 of the License, or (at your option) any later
+    version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License along with
+    this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+    Place - Suite 330, Boston, MA 02111-1307, USA, or go to
+    http://www.gnu.org/copyleft/lesser.txt.
+    ------------------------------------------------------------------------------------
+*/
+#ifndef __ROINT_INTERNAL_CURSOR_H
+#define __ROINT_INTERNAL_CURSOR_H
+
+// For ROInt internal use only
+
+// Decoding cursor over the data of a reader.
+// _cursor_need makes the next section of data available with a single bounds check
+// (borrowed from the reader when possible, otherwise read with a single call,
+// or in growing chunks for big sections so a corrupt size fails before a big allocation),
+// then the inlined fetch functions decode the section without further checks.
+// Fetching more than the section is a bug.
+
+#if defined(_MSC_VER)
+#	define _XCURSOR_INLINE static __inline
+#else
+#	define _XCURSOR_INLINE static __inline__
+#endif
+
+#include <string.h> // memcpy
+
+struct _reader;
+
+struct _cursor {
+	struct _reader *reader;
+	const unsigned char *ptr; // next byte of the section
+	const unsigned char *end; // end of the section
+	unsigned char *buf; // copy of the section when the reader can't lend it
+	unsigned long bufsize;
+	int error; // error indicator (0 for success)
+};
+
+/// Start decoding at the current position of the reader.
+void _cursor_init(struct _cursor *cursor, struct _reader *reader);
+/// Give the unused bytes back to the reader and free the buffer.
+void _cursor_destroy(struct _cursor *cursor);
+/// Make the next 'size' bytes available. (updates error indicator)
+/// On error small sections are zero-filled, like reader->read does, and
+/// big ones (over 64k) are empty, so check the return value before fetching variable sized data.
+/// Returns 0 on success.
+int _cursor_need(struct _cursor *cursor, unsigned long size);
+/// Same as _cursor_need for 'count' elements of size 'size', checking for overflow.
+int _cursor_needarray(struct _cursor *cursor, unsigned long size, unsigned long count);
+
+_XCURSOR_INLINE unsigned char _cursor_u8(struct _cursor *cursor) {
+	return(*cursor->ptr++);
+}
+_XCURSOR_INLINE unsigned short _cursor_u16(struct _cursor *cursor) {
+	const unsigned char *p = cursor->ptr;
+	cursor->ptr += 2;
+	return((unsigned short)(p[0] | (p[1] << 8)));
+}
+_XCURSOR_INLINE unsigned int _cursor_u32(struct _cursor *cursor) {
+	const unsigned char *p = cursor->ptr;
+	cursor->ptr += 4;
+	return((unsigned int)p[0] | ((unsigned int)p[1] << 8) | ((unsigned int)p[2] << 16) | ((unsigned int)p[3] << 24));
+}
+_XCURSOR_INLINE int _cursor_i32(struct _cursor *cursor) {
+	return((int)_cursor_u32(cursor));
+}
+_XCURSOR_INLINE float _cursor_f32(struct _cursor *cursor) {
+	unsigned int u = _cursor_u32(cursor);
+	float f;
+	memcpy(&f, &u, 4);
+	return(f);
+}
+/// Copy raw bytes. (structures must match the little-endian file layout)
+_XCURSOR_INLINE void _cursor_bytes(struct _cursor *cursor, void *dest, unsigned long size) {
+	memcpy(dest, cursor->ptr, size);
+	cursor->ptr += size;
+}
+_XCURSOR_INLINE void _cursor_skip(struct _cursor *cursor, unsigned long size) {
+	cursor->ptr += size;
+}
+
+#endif /* __ROINT_INTERNAL_CURSOR_H */
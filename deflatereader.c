@@ -35,23 +35,48 @@
 #include <zlib.h>
 
 
+// Seek checkpoints (needs inflateGetDictionary)
+#if ZLIB_VERNUM >= 0x1271
+#	define DEFLATEREADER_CHECKPOINTS
+#endif
+
+
 #define CAST_UP(type, member, ptr) (type*)( (char*)ptr - offsetof(type,member) )
 #define CAST_DOWN(ptr, member) ( &ptr->member )
 
 
+/// State of the inflater at a deflate block boundary.
+struct _deflatecheckpoint {
+	unsigned long out_offset;
+	unsigned long in_offset; // relative to in_start, first byte that is not fully used
+	unsigned char bits; // bits of the previous byte that are still unused (0-7)
+	unsigned char byte; // previous byte
+	unsigned short windowlength;
+	unsigned char *window; // last 32k of output
+};
+
+
 struct _deflatereader {
 	struct _reader base;
 	struct _reader *parent;
 	z_stream stream;
+	int windowBits;
 	unsigned long out_offset;
 	unsigned long in_start;
 	unsigned long in_size; // relative to in_start
 	unsigned long in_offset; // relative to in_start
+	// checkpoints (sorted by out_offset)
+	unsigned long span; // output between checkpoints (0 = disabled)
+	unsigned int checkpointcount;
+	unsigned int checkpointlimit;
+	struct _deflatecheckpoint *checkpoints;
 	unsigned char in_buf[0x8000]; // 32k
 };
 
 
 const int DEFLATEREADER_WINDOW_BITS = MAX_WBITS;
+const char DEFLATEREADER_INDEX_MAGIC[4] = {'D','F','I','X'};
+const unsigned short DEFLATEREADER_INDEX_VERSION = 0x100;
 
 
 void _deflatereader_zerror(const char *funcname, int err) {
@@ -89,12 +114,26 @@ void _deflatereader_zfree_func(voidpf opaque, voidpf address) {
 
 void _deflatereader_input(struct _deflatereader *deflatereader) {
 	struct _reader *parent = deflatereader->parent;
+	const unsigned char *ptr;
 	unsigned long bytes;
 
 	if (deflatereader->stream.avail_in > 0)
 		return; // already has data
 
 	bytes = deflatereader->in_size - deflatereader->in_offset;
+	if (bytes > 0x40000000)
+		bytes = 0x40000000; // avail_in is a uInt
+	ptr = parent->borrow(parent, bytes);
+	if (ptr != NULL) {// inflate directly from the parent
+		deflatereader->stream.next_in = (Bytef*)ptr;
+		deflatereader->stream.avail_in = (uInt)bytes;
+		deflatereader->in_offset += bytes;
+		return;
+	}
+	if (parent->error) {
+		_xlog("deflatereader.input : parent.borrow error\n");
+		return;
+	}
 	if (bytes > sizeof(deflatereader->in_buf))
 		bytes = sizeof(deflatereader->in_buf);
 	parent->read(deflatereader->in_buf, bytes, 1, parent);
@@ -108,6 +147,116 @@ void _deflatereader_input(struct _deflatereader *deflatereader) {
 }
 
 
+void _deflatereader_clearcheckpoints(struct _deflatereader *deflatereader) {
+	unsigned int i;
+
+	for (i = 0; i < deflatereader->checkpointcount; i++)
+		_xfree(deflatereader->checkpoints[i].window);
+	if (deflatereader->checkpoints != NULL)
+		_xfree(deflatereader->checkpoints);
+	deflatereader->checkpoints = NULL;
+	deflatereader->checkpointcount = 0;
+	deflatereader->checkpointlimit = 0;
+}
+
+
+// Appends an uninitialized checkpoint.
+struct _deflatecheckpoint *_deflatereader_newcheckpoint(struct _deflatereader *deflatereader) {
+	if (deflatereader->checkpointcount == deflatereader->checkpointlimit) {
+		struct _deflatecheckpoint *tmp = deflatereader->checkpoints;
+		deflatereader->checkpointlimit = deflatereader->checkpointlimit * 2 + 8;
+		deflatereader->checkpoints = (struct _deflatecheckpoint*)_xalloc(sizeof(struct _deflatecheckpoint) * deflatereader->checkpointlimit);
+		if (tmp != NULL) {
+			memcpy(deflatereader->checkpoints, tmp, sizeof(struct _deflatecheckpoint) * deflatereader->checkpointcount);
+			_xfree(tmp);
+		}
+	}
+	return(&deflatereader->checkpoints[deflatereader->checkpointcount++]);
+}
+
+
+// Adds a checkpoint at the current position. (must be at a block boundary, after the last checkpoint)
+void _deflatereader_addcheckpoint(struct _deflatereader *deflatereader, unsigned long out_offset) {
+#ifdef DEFLATEREADER_CHECKPOINTS
+	struct _deflatecheckpoint *checkpoint;
+	unsigned char window[0x8000];
+	uInt windowlength = sizeof(window);
+
+	if (inflateGetDictionary(&deflatereader->stream, window, &windowlength) != Z_OK)
+		return;
+	checkpoint = _deflatereader_newcheckpoint(deflatereader);
+	checkpoint->out_offset = out_offset;
+	checkpoint->in_offset = deflatereader->in_offset - deflatereader->stream.avail_in;
+	checkpoint->bits = (unsigned char)(deflatereader->stream.data_type & 7);
+	checkpoint->byte = (checkpoint->bits > 0)? deflatereader->stream.next_in[-1]: 0;
+	checkpoint->windowlength = (unsigned short)windowlength;
+	checkpoint->window = (unsigned char*)_xalloc(windowlength + 1);
+	memcpy(checkpoint->window, window, windowlength);
+#else
+	(void)deflatereader;
+	(void)out_offset;
+#endif
+}
+
+
+// Returns the last checkpoint at or before out_offset. (NULL if none)
+struct _deflatecheckpoint *_deflatereader_findcheckpoint(struct _deflatereader *deflatereader, unsigned long out_offset) {
+	unsigned int lo = 0;
+	unsigned int hi = deflatereader->checkpointcount;
+
+	while (lo < hi) {
+		unsigned int mid = lo + (hi - lo) / 2;
+		if (deflatereader->checkpoints[mid].out_offset <= out_offset)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo == 0)
+		return(NULL);
+	return(&deflatereader->checkpoints[lo - 1]);
+}
+
+
+// Restarts inflating from the checkpoint, or from the start if NULL. Returns 0 on success.
+int _deflatereader_restart(struct _deflatereader *deflatereader, const struct _deflatecheckpoint *checkpoint) {
+	struct _reader *parent = deflatereader->parent;
+	unsigned long in_offset = (checkpoint != NULL)? checkpoint->in_offset: 0;
+	int err;
+
+	if (parent->seek(parent, (long)(deflatereader->in_start + in_offset), SEEK_SET) != 0) {
+		_xlog("deflatereader.seek : parent.seek error\n");
+		return(1);
+	}
+	deflatereader->in_offset = in_offset;
+	deflatereader->stream.next_in = Z_NULL;
+	deflatereader->stream.avail_in = 0;
+	if (checkpoint == NULL) {
+		deflatereader->out_offset = 0;
+#ifdef DEFLATEREADER_CHECKPOINTS
+		err = inflateReset2(&deflatereader->stream, deflatereader->windowBits); // undo raw mode of checkpoints
+#else
+		err = inflateReset(&deflatereader->stream);
+#endif
+	}
+#ifdef DEFLATEREADER_CHECKPOINTS
+	else {
+		// continue as raw deflate data
+		deflatereader->out_offset = checkpoint->out_offset;
+		err = inflateReset2(&deflatereader->stream, -DEFLATEREADER_WINDOW_BITS);
+		if (err == Z_OK && checkpoint->bits > 0)
+			err = inflatePrime(&deflatereader->stream, checkpoint->bits, checkpoint->byte >> (8 - checkpoint->bits));
+		if (err == Z_OK)
+			err = inflateSetDictionary(&deflatereader->stream, checkpoint->window, checkpoint->windowlength);
+	}
+#endif
+	if (err != Z_OK) {
+		_deflatereader_zerror("seek",err);
+		return(1);
+	}
+	return(0);
+}
+
+
 void deflatereader_destroy(struct _reader *reader) {
 	struct _deflatereader *deflatereader = CAST_UP(struct _deflatereader,base,reader);
 	int err;
@@ -119,6 +268,7 @@ void deflatereader_destroy(struct _reader *reader) {
 	err = inflateEnd(&deflatereader->stream);
 	if (err != Z_OK)
 		_deflatereader_zerror("destroy", err);
+	_deflatereader_clearcheckpoints(deflatereader);
 	_xfree(deflatereader);
 }
 
@@ -149,12 +299,28 @@ int deflatereader_read(void *dest, unsigned long size, unsigned int count, struc
 			break;
 		}
 		else {
-			int err = inflate(&deflatereader->stream, Z_SYNC_FLUSH);
+			unsigned long out_offset = deflatereader->out_offset + wanted - deflatereader->stream.avail_out;
+			unsigned long last_offset = (deflatereader->checkpointcount > 0)? deflatereader->checkpoints[deflatereader->checkpointcount - 1].out_offset: 0;
+			int flush = Z_SYNC_FLUSH;
+			int err;
+			if (deflatereader->span > 0 && out_offset >= last_offset + deflatereader->span)
+				flush = Z_BLOCK; // stop at the next block boundary
+			err = inflate(&deflatereader->stream, flush);
 			if (err != Z_OK && err != Z_STREAM_END) {
 				_deflatereader_zerror("read",err);
 				reader->error = 1;
 				break;
 			}
+			if (flush == Z_BLOCK && (deflatereader->stream.data_type & 128) && !(deflatereader->stream.data_type & 64)) {
+				out_offset = deflatereader->out_offset + wanted - deflatereader->stream.avail_out;
+				if (out_offset >= last_offset + deflatereader->span)
+					_deflatereader_addcheckpoint(deflatereader, out_offset);
+			}
+			if (err == Z_STREAM_END && deflatereader->stream.avail_out > 0) {
+				_xlog("deflatereader.read : not enough data\n");
+				reader->error = 1;
+				break;
+			}
 		}
 	}
 	if (deflatereader->stream.avail_out > 0)
@@ -167,9 +333,7 @@ int deflatereader_read(void *dest, unsigned long size, unsigned int count, struc
 
 int deflatereader_seek(struct _reader *reader, long pos, int origin) {
 	struct _deflatereader *deflatereader = CAST_UP(struct _deflatereader,base,reader);
-	struct _reader *parent = deflatereader->parent;
 	unsigned long out_offset = deflatereader->out_offset;
-	int err;
 	unsigned char buf[0x8000]; // 32k
 
 	reader->error = 0;
@@ -198,19 +362,15 @@ int deflatereader_seek(struct _reader *reader, long pos, int origin) {
 	}
 	if (reader->error)
 		return(reader->error);
-	if (parent->seek(parent, deflatereader->in_start, SEEK_SET) != 0) {
-		_xlog("deflatereader.seek : parent.seek error\n");
-		reader->error = 1;
-		return(reader->error);
-	}
-	deflatereader->out_offset = 0;
-	deflatereader->stream.next_in = Z_NULL;
-	deflatereader->stream.avail_in = 0;
-	err = inflateReset(&deflatereader->stream);
-	if (err != Z_OK) {
-		_deflatereader_zerror("seek",err);
-		reader->error = 1;
-		return(reader->error);
+	{// restart from the closest point before out_offset
+		struct _deflatecheckpoint *checkpoint = _deflatereader_findcheckpoint(deflatereader, out_offset);
+		if (out_offset < deflatereader->out_offset ||
+			(checkpoint != NULL && checkpoint->out_offset > deflatereader->out_offset)) {
+			if (_deflatereader_restart(deflatereader, checkpoint) != 0) {
+				reader->error = 1;
+				return(reader->error);
+			}
+		}
 	}
 	while (deflatereader->out_offset < out_offset) {
 		unsigned long wanted = out_offset - deflatereader->out_offset;
@@ -234,6 +394,17 @@ unsigned long deflatereader_tell(struct _reader *reader) {
 }
 
 
+const unsigned char *deflatereader_borrow(struct _reader *reader, unsigned long size) {
+	reader->error = 0;
+	return(NULL); // the output is not kept in memory
+}
+
+
+unsigned long deflatereader_remaining(struct _reader *reader) {
+	return(0); // unknown until inflated
+}
+
+
 struct _reader *deflatereader_init(struct _reader *parent, unsigned char type) {
 	struct _deflatereader *ret = (struct _deflatereader*)_xalloc(sizeof(struct _deflatereader));
 	int windowBits;
@@ -243,6 +414,8 @@ struct _reader *deflatereader_init(struct _reader *parent, unsigned char type) {
 	ret->base.read = &deflatereader_read;
 	ret->base.seek = &deflatereader_seek;
 	ret->base.tell = &deflatereader_tell;
+	ret->base.borrow = &deflatereader_borrow;
+	ret->base.remaining = &deflatereader_remaining;
 	ret->base.error = 0;
 	
 	ret->stream.zalloc = (alloc_func)&_deflatereader_zalloc_func;
@@ -264,10 +437,16 @@ struct _reader *deflatereader_init(struct _reader *parent, unsigned char type) {
 	ret->in_offset = 0;
 	ret->out_offset = 0;
 
+	ret->span = 0;
+	ret->checkpointcount = 0;
+	ret->checkpointlimit = 0;
+	ret->checkpoints = NULL;
+
 	if (type == 255)
 		windowBits = -DEFLATEREADER_WINDOW_BITS;
 	else
 		windowBits = DEFLATEREADER_WINDOW_BITS + (int)type * 16;
+	ret->windowBits = windowBits;
 	err = inflateInit2(&ret->stream, windowBits);
 	if (err != Z_OK) {
 		_deflatereader_zerror("init",err);
@@ -276,3 +455,92 @@ struct _reader *deflatereader_init(struct _reader *parent, unsigned char type) {
 
 	return(CAST_DOWN(ret,base));
 }
+
+
+void deflatereader_setcheckpoints(struct _reader *reader, unsigned long span) {
+	struct _deflatereader *deflatereader = CAST_UP(struct _deflatereader,base,reader);
+
+#ifdef DEFLATEREADER_CHECKPOINTS
+	deflatereader->span = span;
+#else
+	(void)deflatereader;
+	(void)span;
+#endif
+}
+
+
+int deflatereader_saveindex(struct _reader *reader, struct _writer *writer) {
+	struct _deflatereader *deflatereader = CAST_UP(struct _deflatereader,base,reader);
+	unsigned int i;
+
+	writer->write(DEFLATEREADER_INDEX_MAGIC, 4, 1, writer);
+	writer->write(&DEFLATEREADER_INDEX_VERSION, 2, 1, writer);
+	writer->write(&deflatereader->checkpointcount, 4, 1, writer);
+	for (i = 0; i < deflatereader->checkpointcount; i++) {
+		const struct _deflatecheckpoint *checkpoint = &deflatereader->checkpoints[i];
+		unsigned int out_offset = (unsigned int)checkpoint->out_offset;
+		unsigned int in_offset = (unsigned int)checkpoint->in_offset;
+		writer->write(&out_offset, 4, 1, writer);
+		writer->write(&in_offset, 4, 1, writer);
+		writer->write(&checkpoint->bits, 1, 1, writer);
+		writer->write(&checkpoint->byte, 1, 1, writer);
+		writer->write(&checkpoint->windowlength, 2, 1, writer);
+		writer->write(checkpoint->window, 1, checkpoint->windowlength, writer);
+	}
+	if (writer->error) {
+		_xlog("deflatereader.saveindex : write error\n");
+		return(1);
+	}
+	return(0);
+}
+
+
+int deflatereader_loadindex(struct _reader *reader, struct _reader *index) {
+	struct _deflatereader *deflatereader = CAST_UP(struct _deflatereader,base,reader);
+	unsigned short version;
+	unsigned int count, i;
+	char magic[4];
+
+	index->read(magic, 4, 1, index);
+	index->read(&version, 2, 1, index);
+	index->read(&count, 4, 1, index);
+	if (index->error || memcmp(DEFLATEREADER_INDEX_MAGIC, magic, 4) != 0 || version != DEFLATEREADER_INDEX_VERSION) {
+		_xlog("deflatereader.loadindex : invalid header\n");
+		return(1);
+	}
+#ifndef DEFLATEREADER_CHECKPOINTS
+	if (count > 0) {
+		_xlog("deflatereader.loadindex : checkpoints not supported\n");
+		return(1);
+	}
+#endif
+
+	_deflatereader_clearcheckpoints(deflatereader);
+	for (i = 0; i < count; i++) {
+		struct _deflatecheckpoint checkpoint;
+		unsigned int out_offset, in_offset;
+		index->read(&out_offset, 4, 1, index);
+		index->read(&in_offset, 4, 1, index);
+		index->read(&checkpoint.bits, 1, 1, index);
+		index->read(&checkpoint.byte, 1, 1, index);
+		index->read(&checkpoint.windowlength, 2, 1, index);
+		checkpoint.out_offset = out_offset;
+		checkpoint.in_offset = in_offset;
+		if (index->error || checkpoint.bits > 7 || checkpoint.windowlength > 0x8000 ||
+			in_offset == 0 || in_offset >= deflatereader->in_size ||
+			(i > 0 && out_offset <= deflatereader->checkpoints[i - 1].out_offset)) {
+			_xlog("deflatereader.loadindex : [%u] invalid checkpoint\n", i);
+			_deflatereader_clearcheckpoints(deflatereader);
+			return(1);
+		}
+		checkpoint.window = (unsigned char*)_xalloc(checkpoint.windowlength + 1);
+		index->read(checkpoint.window, 1, checkpoint.windowlength, index);
+		*_deflatereader_newcheckpoint(deflatereader) = checkpoint;
+	}
+	if (index->error) {
+		_xlog("deflatereader.loadindex : read error\n");
+		_deflatereader_clearcheckpoints(deflatereader);
+		return(1);
+	}
+	return(0);
+}
@@ -23,6 +23,8 @@
 */
 #ifdef ROINT_INTERNAL
 #	include "internal.h"
+#	include "atomic.h"
+#	include "thread.h"
 #else
 #	include "writer.h"
 #	define _xlog printf
@@ -40,10 +42,38 @@
 #define CAST_DOWN(ptr, member) ( &ptr->member )
 
 
+/// Compressed block of the parallel mode.
+struct _deflatewriter_block {
+	unsigned char *out;
+	unsigned long outsize; // output space
+	unsigned long outlength;
+	unsigned long check; // crc32 or adler32 of the input
+	int error;
+};
+
+
 struct _deflatewriter {
 	struct _writer base;
 	struct _writer *parent;
 	z_stream stream;
+
+	// parallel mode (streams != NULL)
+	unsigned char type;
+	unsigned int threadcount;
+	z_stream *streams; // one per thread
+	unsigned int streamcount; // initialized streams
+	unsigned char *in; // dictionary followed by the blocks
+	unsigned long incapacity;
+	unsigned long dictlength;
+	unsigned long inlength;
+	unsigned int blockcount; // blocks in a full batch
+	struct _deflatewriter_block *blocks;
+	volatile unsigned int nextblock;
+	unsigned int batchblocks; // blocks in the current batch
+	int batchlast; // the current batch ends the stream
+	int started; // header was written
+	unsigned long check; // crc32 or adler32 of the input
+	unsigned long total; // size of the input
 };
 
 
@@ -52,6 +82,14 @@ const int DEFLATEWRITER_METHOD = Z_DEFLATED;
 const int DEFLATEWRITER_WINDOW_BITS = MAX_WBITS;
 const int DEFLATEWRITER_MEM_LEVEL = MAX_MEM_LEVEL;
 const int DEFLATEWRITER_STRATEGY = Z_DEFAULT_STRATEGY;
+/// Size of the input blocks of the parallel mode.
+const unsigned long DEFLATEWRITER_BLOCKSIZE = 0x20000; // 128k
+/// Size of the dictionary of the parallel mode. (deflate window)
+const unsigned long DEFLATEWRITER_DICTSIZE = 0x8000; // 32k
+/// Blocks per thread in a batch of the parallel mode.
+const unsigned int DEFLATEWRITER_THREADBLOCKS = 4;
+/// Initial size of the input buffer of the parallel mode.
+const unsigned long DEFLATEWRITER_FIRSTSIZE = 0x1000; // 4k
 
 
 /// zlib error
@@ -130,11 +168,207 @@ void _deflatewriter_output(struct _deflatewriter *deflatewriter, const void *dat
 }
 
 
+/// Compresses blocks of the current batch. (parallel mode)
+void _deflatewriter_thread(void *arg, unsigned int index) {
+	struct _deflatewriter *deflatewriter = (struct _deflatewriter*)arg;
+	z_stream *stream = &deflatewriter->streams[index];
+	unsigned int i;
+
+	while ((i = _xatomic_add(&deflatewriter->nextblock, 1) - 1) < deflatewriter->batchblocks) {
+		struct _deflatewriter_block *block = &deflatewriter->blocks[i];
+		unsigned long offset = deflatewriter->dictlength + i * DEFLATEWRITER_BLOCKSIZE;
+		unsigned long length = deflatewriter->dictlength + deflatewriter->inlength - offset;
+		unsigned long dictlength = (offset < DEFLATEWRITER_DICTSIZE)? offset: DEFLATEWRITER_DICTSIZE;
+		int last = (deflatewriter->batchlast && i + 1 == deflatewriter->batchblocks);
+		int err;
+
+		if (length > DEFLATEWRITER_BLOCKSIZE)
+			length = DEFLATEWRITER_BLOCKSIZE;
+		if (deflatewriter->type == 1)
+			block->check = crc32(0, deflatewriter->in + offset, (uInt)length);
+		else
+			block->check = adler32(1, deflatewriter->in + offset, (uInt)length);
+
+		err = deflateReset(stream);
+		if (err == Z_OK && dictlength > 0) // prime with the previous input
+			err = deflateSetDictionary(stream, deflatewriter->in + offset - dictlength, (uInt)dictlength);
+		if (err == Z_OK) {
+			stream->next_in = deflatewriter->in + offset;
+			stream->avail_in = (uInt)length;
+			stream->next_out = block->out;
+			stream->avail_out = (uInt)block->outsize;
+			// sync flush ends the block on a byte boundary so the blocks can be concatenated
+			err = deflate(stream, last? Z_FINISH: Z_SYNC_FLUSH);
+			if (err == Z_OK && (last || stream->avail_in != 0 || stream->avail_out == 0))
+				err = Z_BUF_ERROR; // not enough output space
+			else if (err == Z_STREAM_END)
+				err = Z_OK;
+		}
+		block->outlength = (unsigned long)(stream->next_out - block->out);
+		block->error = (err != Z_OK);
+		if (err != Z_OK)
+			_deflatewriter_zerror("thread", err);
+	}
+}
+
+
+/// Writes 'count' bytes of 'value' to the parent. (little-endian if 'le', big-endian otherwise)
+void _deflatewriter_number(struct _deflatewriter *deflatewriter, unsigned long value, unsigned int count, int le) {
+	unsigned char buf[4];
+	unsigned int i;
+
+	for (i = 0; i < count; i++)
+		buf[le? i: count - 1 - i] = (unsigned char)(value >> (8 * i));
+	deflatewriter->parent->write(buf, 1, count, deflatewriter->parent);
+}
+
+
+/// Initializes the streams of 'threadcount' threads and the output of the blocks
+/// of the current batch. (parallel mode)
+/// Everything is allocated when first needed, so a small output uses a single stream
+/// and a single small block. (0 on success)
+int _deflatewriter_prepare(struct _deflatewriter *deflatewriter, unsigned int threadcount) {
+	unsigned int i;
+	int err;
+
+	for (; deflatewriter->streamcount < threadcount; deflatewriter->streamcount++) {// raw deflate, the header and trailer are written by the batches
+		z_stream *stream = &deflatewriter->streams[deflatewriter->streamcount];
+		stream->zalloc = (alloc_func)&_deflatewriter_zalloc_func;
+		stream->zfree = (free_func)&_deflatewriter_zfree_func;
+		stream->opaque = (voidpf)deflatewriter;
+		err = deflateInit2(stream,
+			DEFLATEWRITER_LEVEL,
+			DEFLATEWRITER_METHOD,
+			-DEFLATEWRITER_WINDOW_BITS,
+			DEFLATEWRITER_MEM_LEVEL,
+			DEFLATEWRITER_STRATEGY);
+		if (err != Z_OK) {
+			_deflatewriter_zerror("prepare",err);
+			return(1);
+		}
+	}
+	for (i = 0; i < deflatewriter->batchblocks; i++) {
+		struct _deflatewriter_block *block = &deflatewriter->blocks[i];
+		unsigned long length = deflatewriter->inlength - i * DEFLATEWRITER_BLOCKSIZE;
+		unsigned long outsize;
+		if (length > DEFLATEWRITER_BLOCKSIZE)
+			length = DEFLATEWRITER_BLOCKSIZE;
+		outsize = deflateBound(&deflatewriter->streams[0], length) + 64; // room for the sync flush marker
+		if (block->outsize < outsize) {
+			if (block->out != NULL)
+				_xfree(block->out);
+			block->out = (unsigned char*)_xalloc(outsize);
+			block->outsize = (block->out != NULL)? outsize: 0;
+			if (block->out == NULL) {
+				_xlog("deflatewriter.prepare : out of memory\n");
+				return(1);
+			}
+		}
+	}
+	return(0);
+}
+
+
+/// Compresses the buffered input in parallel and outputs it in order. (parallel mode)
+/// last=1 : terminate the stream
+void _deflatewriter_batch(struct _deflatewriter *deflatewriter, int last) {
+	struct _writer *parent = deflatewriter->parent;
+	unsigned long keep;
+	unsigned int threadcount;
+	unsigned int i;
+
+	deflatewriter->batchblocks = (unsigned int)((deflatewriter->inlength + DEFLATEWRITER_BLOCKSIZE - 1) / DEFLATEWRITER_BLOCKSIZE);
+	if (last && deflatewriter->batchblocks == 0)
+		deflatewriter->batchblocks = 1; // empty final block
+	deflatewriter->batchlast = last;
+	deflatewriter->nextblock = 0;
+	threadcount = deflatewriter->threadcount;
+	if (threadcount > deflatewriter->batchblocks)
+		threadcount = deflatewriter->batchblocks;
+	if (_deflatewriter_prepare(deflatewriter, threadcount) != 0) {
+		deflatewriter->base.error = 1;
+		return;
+	}
+	_xthread_parallel(threadcount, &_deflatewriter_thread, deflatewriter);
+
+	if (!deflatewriter->started) {
+		deflatewriter->started = 1;
+		if (deflatewriter->type == 1) {// gzip header (no name, no time, best compression, unknown os)
+			static const unsigned char header[10] = {0x1F,0x8B,Z_DEFLATED,0,0,0,0,0,2,0xFF};
+			parent->write(header, 1, sizeof(header), parent);
+		}
+		else if (deflatewriter->type == 0) {// zlib header (32k window, best compression)
+			static const unsigned char header[2] = {0x78,0xDA};
+			parent->write(header, 1, sizeof(header), parent);
+		}
+	}
+	for (i = 0; i < deflatewriter->batchblocks; i++) {
+		struct _deflatewriter_block *block = &deflatewriter->blocks[i];
+		unsigned long length = deflatewriter->inlength - i * DEFLATEWRITER_BLOCKSIZE;
+		if (length > DEFLATEWRITER_BLOCKSIZE)
+			length = DEFLATEWRITER_BLOCKSIZE;
+		if (block->error)
+			deflatewriter->base.error = 1;
+		else if (block->outlength > 0)
+			parent->write(block->out, 1, block->outlength, parent);
+		if (deflatewriter->type == 1)
+			deflatewriter->check = crc32_combine(deflatewriter->check, block->check, (z_off_t)length);
+		else
+			deflatewriter->check = adler32_combine(deflatewriter->check, block->check, (z_off_t)length);
+	}
+	deflatewriter->total += deflatewriter->inlength;
+	if (last) {
+		if (deflatewriter->type == 1) {// crc32 and input size
+			_deflatewriter_number(deflatewriter, deflatewriter->check, 4, 1);
+			_deflatewriter_number(deflatewriter, deflatewriter->total, 4, 1);
+		}
+		else if (deflatewriter->type == 0) // adler32
+			_deflatewriter_number(deflatewriter, deflatewriter->check, 4, 0);
+	}
+	if (parent->error) {
+		_xlog("deflatewriter.batch : parent.write error\n");
+		deflatewriter->base.error = 1;
+	}
+
+	// keep the end of the input as dictionary
+	keep = deflatewriter->dictlength + deflatewriter->inlength;
+	if (keep > DEFLATEWRITER_DICTSIZE)
+		keep = DEFLATEWRITER_DICTSIZE;
+	if (keep > 0)
+		memmove(deflatewriter->in, deflatewriter->in + deflatewriter->dictlength + deflatewriter->inlength - keep, keep);
+	deflatewriter->dictlength = keep;
+	deflatewriter->inlength = 0;
+}
+
+
 void deflatewriter_destroy(struct _writer *writer) {
 	struct _deflatewriter *deflatewriter = CAST_UP(struct _deflatewriter,base,writer);
 	struct _writer *parent = deflatewriter->parent;
 	int err;
 
+	if (deflatewriter->streams != NULL) {
+		unsigned int i;
+		if (!writer->error)
+			_deflatewriter_batch(deflatewriter, 1);
+		for (i = 0; i < deflatewriter->streamcount; i++) {
+			err = deflateEnd(&deflatewriter->streams[i]);
+			if (err != Z_OK && err != Z_DATA_ERROR) {// Z_DATA_ERROR : freed in the middle of a block
+				_deflatewriter_zerror("destroy", err);
+				writer->error = 1;
+			}
+		}
+		for (i = 0; i < deflatewriter->blockcount; i++)
+			if (deflatewriter->blocks[i].out != NULL)
+				_xfree(deflatewriter->blocks[i].out);
+		_xfree(deflatewriter->blocks);
+		_xfree(deflatewriter->streams);
+		if (deflatewriter->in != NULL)
+			_xfree(deflatewriter->in);
+		parent->error = writer->error; // propagate
+		_xfree(deflatewriter);
+		return;
+	}
+
 	_deflatewriter_output(deflatewriter, Z_NULL, 0, Z_FINISH);
 	err = deflateEnd(&deflatewriter->stream);
 	if (err != Z_OK) {
@@ -158,7 +392,44 @@ int deflatewriter_write(const void *src, unsigned long size, unsigned int count,
 	}
 
 	bytes = (unsigned int)size * count;
-	_deflatewriter_output(deflatewriter, src, bytes, Z_NO_FLUSH);
+	if (deflatewriter->streams != NULL) {// buffer and compress full batches
+		const unsigned char *data = (const unsigned char*)src;
+		unsigned long batchsize = deflatewriter->blockcount * DEFLATEWRITER_BLOCKSIZE;
+		while (bytes > 0 && !writer->error) {
+			unsigned long length;
+			if (deflatewriter->inlength == batchsize) // only when there is more data, so the last block is never empty
+				_deflatewriter_batch(deflatewriter, 0);
+			if (deflatewriter->dictlength + deflatewriter->inlength == deflatewriter->incapacity) {// grow up to a full batch
+				unsigned long capacity = deflatewriter->incapacity * 2;
+				unsigned char *in;
+				if (capacity < DEFLATEWRITER_FIRSTSIZE)
+					capacity = DEFLATEWRITER_FIRSTSIZE;
+				if (capacity < deflatewriter->incapacity + bytes)
+					capacity = deflatewriter->incapacity + bytes;
+				if (capacity > DEFLATEWRITER_DICTSIZE + batchsize)
+					capacity = DEFLATEWRITER_DICTSIZE + batchsize;
+				in = (unsigned char*)_xrealloc(deflatewriter->in, deflatewriter->incapacity, capacity);
+				if (in == NULL) {
+					_xlog("deflatewriter.write : out of memory\n");
+					writer->error = 1;
+					break;
+				}
+				deflatewriter->in = in;
+				deflatewriter->incapacity = capacity;
+			}
+			length = deflatewriter->incapacity - deflatewriter->dictlength - deflatewriter->inlength;
+			if (length > batchsize - deflatewriter->inlength) // the dictionary is shorter before the first batch
+				length = batchsize - deflatewriter->inlength;
+			if (length > bytes)
+				length = bytes;
+			memcpy(deflatewriter->in + deflatewriter->dictlength + deflatewriter->inlength, data, length);
+			deflatewriter->inlength += length;
+			data += length;
+			bytes -= (unsigned int)length;
+		}
+	}
+	else
+		_deflatewriter_output(deflatewriter, src, bytes, Z_NO_FLUSH);
 	if (writer->error)
 		_xlog("deflatewriter.write : error\n");
 	return(writer->error);
@@ -211,6 +482,7 @@ struct _writer *deflatewriter_init(struct _writer *parent, unsigned char type) {
 	ret->stream.avail_in = 0;
 
 	ret->parent = parent;
+	ret->streams = NULL;
 
 	if (type == 255)
 		windowBits = -DEFLATEWRITER_WINDOW_BITS;
@@ -229,3 +501,39 @@ struct _writer *deflatewriter_init(struct _writer *parent, unsigned char type) {
 
 	return(CAST_DOWN(ret,base));
 }
+
+
+struct _writer *deflatewriter_initparallel(struct _writer *parent, unsigned char type, unsigned int threadcount) {
+	struct _deflatewriter *ret = (struct _deflatewriter*)_xalloc(sizeof(struct _deflatewriter));
+
+	ret->base.destroy = &deflatewriter_destroy;
+	ret->base.write = &deflatewriter_write;
+	ret->base.resize = &deflatewriter_resize;
+	ret->base.seek = &deflatewriter_seek;
+	ret->base.tell = &deflatewriter_tell;
+	ret->base.error = 0;
+
+	ret->parent = parent;
+
+	if (threadcount == 0)
+		threadcount = _xthread_hwcount();
+	ret->type = type;
+	ret->threadcount = threadcount;
+	// the streams, the input and the output of the blocks are allocated as the input grows
+	ret->streams = (z_stream*)_xalloc(sizeof(z_stream) * threadcount);
+	memset(ret->streams, 0, sizeof(z_stream) * threadcount);
+	ret->streamcount = 0;
+
+	ret->blockcount = threadcount * DEFLATEWRITER_THREADBLOCKS;
+	ret->in = NULL;
+	ret->incapacity = 0;
+	ret->dictlength = 0;
+	ret->inlength = 0;
+	ret->blocks = (struct _deflatewriter_block*)_xalloc(sizeof(struct _deflatewriter_block) * ret->blockcount);
+	memset(ret->blocks, 0, sizeof(struct _deflatewriter_block) * ret->blockcount);
+	ret->started = 0;
+	ret->check = (type == 1)? crc32(0, Z_NULL, 0): adler32(0, Z_NULL, 0);
+	ret->total = 0;
+
+	return(CAST_DOWN(ret,base));
+}
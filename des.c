@@ -124,14 +124,23 @@ static void BitConvert4(unsigned char* Src) {
 }
 
 void des_decode(unsigned char* buf, size_t len, int cycle) {
+	des_decode_blocks(buf, len, cycle, 0);
+}
+
+void des_decode_blocks(unsigned char* buf, size_t len, int cycle, size_t first) {
 	size_t lop,cnt=0;
 	int type = cycle == 0;
 	if(cycle<3) cycle=3;
 	else if(cycle<5) cycle++;
 	else if(cycle<7) cycle+=9;
 	else cycle+=15;
+
+	if(first>20 && type==0) { // resume the shuffle counter (1..7 after the first shuffled block)
+		size_t shuffled = (first-20) - ((first-1)/cycle - 19/cycle);
+		if(shuffled>0) cnt = (shuffled-1)%7+1;
+	}
     
-	for(lop=0; lop*8<len; lop++, buf+=8)
+	for(lop=first; (lop-first)*8<len; lop++, buf+=8)
 	{
 		if(lop<20 || (type==0 && lop%cycle==0)) { // des
 			BitConvert(buf,BitSwapTable1);
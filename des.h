@@ -30,5 +30,7 @@ void NibbleSwap(unsigned char* Src, int len);
 void BitConvert(unsigned char* Src, char* BitSwapTable);
 static void BitConvert4(unsigned char* Src);
 void des_decode(unsigned char* buf, size_t len, int cycle);
+// Decodes a part of the data starting at block "first" (8 byte blocks), so data can be decoded in pieces.
+void des_decode_blocks(unsigned char* buf, size_t len, int cycle, size_t first);
 
 #endif /* __ROINT_INTERNAL_DES_H */
@@ -0,0 +1,90 @@
+/*
+    ------------------------------------------------------------------------------------
+    LICENSE:
+    ------------------------------------------------------------------------------------
+    This file is part of The Open Ragnarok Project
+    Copyright 2007 - 2012 The Open Ragnarok Team
+    For the latest information visit http://www.open-ragnarok.org
+    ------------------------------------------------------------------------------------
+    This program is free software; you can redistribute it and/or modify it under
+    the terms of the GNU Lesser General Public License as published by the Free Software
+    Foundation; either version 2 of the License, or (at your option) any later
+    version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License along with
+    this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+    Place - Suite 330, Boston, MA 02111-1307, USA, or go to
+    http://www.gnu.org/copyleft/lesser.txt.
+    ------------------------------------------------------------------------------------
+*/
+#include "internal.h"
+#include "encoder.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// Size of the staging buffer.
+#define ENCODER_BUFSIZE 0x4000
+
+
+void _encoder_init(struct _encoder *encoder, struct _writer *writer) {
+	encoder->writer = writer;
+	encoder->buf = (unsigned char*)_xalloc(ENCODER_BUFSIZE);
+	encoder->ptr = encoder->buf;
+	encoder->end = encoder->buf + ENCODER_BUFSIZE;
+	encoder->error = (writer == NULL || writer->error);
+}
+
+
+int _encoder_destroy(struct _encoder *encoder) {
+	_encoder_flush(encoder);
+	_xfreesize(encoder->buf, (size_t)(encoder->end - encoder->buf));
+	encoder->buf = encoder->ptr = encoder->end = NULL;
+	return(encoder->error);
+}
+
+
+int _encoder_flush(struct _encoder *encoder) {
+	struct _writer *writer = encoder->writer;
+	unsigned long size = (unsigned long)(encoder->ptr - encoder->buf);
+
+	if (size > 0 && !encoder->error && writer->write(encoder->buf, 1, size, writer) != 0)
+		encoder->error = 1;
+	encoder->ptr = encoder->buf;
+	return(encoder->error);
+}
+
+
+int _encoder_reserve(struct _encoder *encoder, unsigned long size) {
+	if ((unsigned long)(encoder->end - encoder->ptr) >= size)
+		return(encoder->error);
+	_encoder_flush(encoder);
+	if ((unsigned long)(encoder->end - encoder->buf) < size) {// section bigger than the buffer
+		_xfreesize(encoder->buf, (size_t)(encoder->end - encoder->buf));
+		encoder->buf = (unsigned char*)_xalloc(size);
+		encoder->ptr = encoder->buf;
+		encoder->end = encoder->buf + size;
+	}
+	return(encoder->error);
+}
+
+
+int _encoder_write(struct _encoder *encoder, const void *src, unsigned long size) {
+	struct _writer *writer = encoder->writer;
+
+	if ((unsigned long)(encoder->end - encoder->ptr) >= size) {
+		_encoder_bytes(encoder, src, size);
+		return(encoder->error);
+	}
+	_encoder_flush(encoder);
+	if (size < ENCODER_BUFSIZE / 2)
+		_encoder_bytes(encoder, src, size);
+	else if (!encoder->error && writer->write(src, 1, size, writer) != 0)
+		encoder->error = 1;
+	return(encoder->error);
+}
@@ -0,0 +1,104 @@
+/*
+    ------------------------------------------------------------------------------------
+    LICENSE:
+    ------------------------------------------------------------------------------------
+    This file is part of The Open Ragnarok Project
+    Copyright 2007 - 2012 The Open Ragnarok Team
+    For the latest information visit http://www.open-ragnarok.org
+    ------------------------------------------------------------------------------------
+    This program is free software; you can redistribute it and/or modify it under
+    the terms of the GNU Lesser General Public License as published by the Free Software
+    Foundation; either version 2 of the License, or (at your option) any later
+    version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License along with
+    this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+    Place - Suite 330, Boston, MA 02111-1307, USA, or go to
+    http://www.gnu.org/copyleft/lesser.txt.
+    ------------------------------------------------------------------------------------
+*/
+#ifndef __ROINT_INTERNAL_ENCODER_H
+#define __ROINT_INTERNAL_ENCODER_H
+
+// For ROInt internal use only
+
+// Encoding buffer in front of a writer.
+// _encoder_reserve makes room for the next section of data with a single check,
+// then the inlined store functions encode the section without further checks.
+// The staged bytes are handed to the writer in big blocks.
+// Storing more than the section is a bug.
+
+#if defined(_MSC_VER)
+#	define _XENCODER_INLINE static __inline
+#else
+#	define _XENCODER_INLINE static __inline__
+#endif
+
+#include <string.h> // memcpy, memset
+
+struct _writer;
+
+struct _encoder {
+	struct _writer *writer;
+	unsigned char *buf;
+	unsigned char *ptr; // next byte of the section
+	unsigned char *end; // end of the buffer
+	int error; // error indicator (0 for success)
+};
+
+/// Start encoding at the current position of the writer.
+void _encoder_init(struct _encoder *encoder, struct _writer *writer);
+/// Hand the staged bytes to the writer and free the buffer.
+/// Returns the error indicator.
+int _encoder_destroy(struct _encoder *encoder);
+/// Hand the staged bytes to the writer. (updates error indicator)
+/// Returns 0 on success.
+int _encoder_flush(struct _encoder *encoder);
+/// Make room for the next 'size' bytes. (updates error indicator)
+/// Returns 0 on success.
+int _encoder_reserve(struct _encoder *encoder, unsigned long size);
+/// Encode a block of raw bytes of any size. (updates error indicator)
+/// Big blocks go directly to the writer.
+/// Returns 0 on success.
+int _encoder_write(struct _encoder *encoder, const void *src, unsigned long size);
+
+_XENCODER_INLINE void _encoder_u8(struct _encoder *encoder, unsigned char val) {
+	*encoder->ptr++ = val;
+}
+_XENCODER_INLINE void _encoder_u16(struct _encoder *encoder, unsigned short val) {
+	unsigned char *p = encoder->ptr;
+	encoder->ptr += 2;
+	p[0] = (unsigned char)val;
+	p[1] = (unsigned char)(val >> 8);
+}
+_XENCODER_INLINE void _encoder_u32(struct _encoder *encoder, unsigned int val) {
+	unsigned char *p = encoder->ptr;
+	encoder->ptr += 4;
+	p[0] = (unsigned char)val;
+	p[1] = (unsigned char)(val >> 8);
+	p[2] = (unsigned char)(val >> 16);
+	p[3] = (unsigned char)(val >> 24);
+}
+_XENCODER_INLINE void _encoder_i32(struct _encoder *encoder, int val) {
+	_encoder_u32(encoder, (unsigned int)val);
+}
+_XENCODER_INLINE void _encoder_f32(struct _encoder *encoder, float val) {
+	unsigned int u;
+	memcpy(&u, &val, 4);
+	_encoder_u32(encoder, u);
+}
+/// Store raw bytes. (structures must match the little-endian file layout)
+_XENCODER_INLINE void _encoder_bytes(struct _encoder *encoder, const void *src, unsigned long size) {
+	memcpy(encoder->ptr, src, size);
+	encoder->ptr += size;
+}
+_XENCODER_INLINE void _encoder_zeros(struct _encoder *encoder, unsigned long size) {
+	memset(encoder->ptr, 0, size);
+	encoder->ptr += size;
+}
+
+#endif /* __ROINT_INTERNAL_ENCODER_H */
@@ -34,17 +34,54 @@
 #include <stdlib.h>
 #include <string.h>
 
+// Mapped files (POSIX)
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_UNISTD_H)
+#	define FILEREADER_MMAP
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
+// Access pattern hints (POSIX)
+#if defined(HAVE_POSIX_FADVISE)
+#	include <fcntl.h>
+#endif
+
 
 #define CAST_UP(type, member, ptr) (type*)( (char*)ptr - offsetof(type,member) )
 #define CAST_DOWN(ptr, member) ( &ptr->member )
 
 
+/// Size of the buffer of ROINT_FILEMODE_BUFFERED.
+#define FILEREADER_BUFFER_SIZE 0x40000 // 256k
+
+
 struct _filereader {
 	struct _reader base;
 	FILE *fp;
+
+	// ROINT_FILEMODE_BUFFERED
+	unsigned char *buf;
+	unsigned long bufstart; // file offset of buf
+	unsigned long buflen; // bytes in buf
+	unsigned long bufpos; // read position in buf
+
+	unsigned long size; // file size when opened
 };
 
 
+struct _filemapreader {
+	struct _reader base;
+	const unsigned char *data;
+	unsigned long size;
+	unsigned long offset;
+};
+
+
+static unsigned char filereader_mode = ROINT_FILEMODE_STDIO;
+
+
 void _filereader_ferror(const char *funcname) {
 	_xlog("filereader.%s : %s\n", funcname, strerror(errno));
 }
@@ -53,7 +90,7 @@ void _filereader_ferror(const char *funcname) {
 void filereader_destroy(struct _reader *reader) {
 	struct _filereader *filereader = CAST_UP(struct _filereader,base,reader);
 
-	if (fclose(filereader->fp) != 0) {
+	if (filereader->fp != NULL && fclose(filereader->fp) != 0) {
 		_filereader_ferror("destroy");
 		reader->error = 1;
 	}
@@ -105,20 +142,328 @@ unsigned long filereader_tell(struct _reader *reader) {
 }
 
 
-struct _reader *filereader_init(const char *fn) {
-	struct _filereader *ret = (struct _filereader*)_xalloc(sizeof(struct _filereader));
+const unsigned char *filereader_borrow(struct _reader *reader, unsigned long size) {
+	reader->error = 0;
+	return(NULL); // not in memory
+}
+
+
+unsigned long filereader_remaining(struct _reader *reader) {
+	struct _filereader *filereader = CAST_UP(struct _filereader,base,reader);
+	int error = reader->error;
+	unsigned long pos = reader->tell(reader);
+
+	reader->error = error;
+	return((pos < filereader->size)? filereader->size - pos: 0);
+}
+
+
+void filereader_buffered_destroy(struct _reader *reader) {
+	struct _filereader *filereader = CAST_UP(struct _filereader,base,reader);
+
+	if (filereader->buf != NULL)
+		_xfree(filereader->buf);
+	filereader_destroy(reader);
+}
+
+
+int filereader_buffered_read(void *dest, unsigned long size, unsigned int count, struct _reader *reader) {
+	struct _filereader *filereader = CAST_UP(struct _filereader,base,reader);
+	unsigned long wanted = size * count;
+	unsigned char *ptr = (unsigned char*)dest;
+
+	reader->error = 0;
+	if (wanted <= filereader->buflen - filereader->bufpos) {// fast path
+		memcpy(ptr, filereader->buf + filereader->bufpos, wanted);
+		filereader->bufpos += wanted;
+		return(reader->error);
+	}
+
+	while (wanted > 0) {
+		unsigned long bytes = filereader->buflen - filereader->bufpos;
+		if (bytes == 0) {
+			filereader->bufstart += filereader->buflen;
+			filereader->buflen = 0;
+			filereader->bufpos = 0;
+			if (wanted >= FILEREADER_BUFFER_SIZE) {// big read, skip the buffer
+				bytes = (unsigned long)fread(ptr, 1, wanted, filereader->fp);
+				filereader->bufstart += bytes;
+				ptr += bytes;
+				wanted -= bytes;
+				break;
+			}
+			filereader->buflen = (unsigned long)fread(filereader->buf, 1, FILEREADER_BUFFER_SIZE, filereader->fp);
+			if (filereader->buflen == 0)
+				break;
+			bytes = filereader->buflen;
+		}
+		if (bytes > wanted)
+			bytes = wanted;
+		memcpy(ptr, filereader->buf + filereader->bufpos, bytes);
+		filereader->bufpos += bytes;
+		ptr += bytes;
+		wanted -= bytes;
+	}
+	if (wanted > 0) {
+		unsigned long complete = ((size * count - wanted) / size) * size;
+		memset((unsigned char*)dest + complete, 0, size * count - complete);
+		_xlog("filereader.read : not enough data\n");
+		reader->error = 1;
+	}
+	return(reader->error);
+}
+
+
+int filereader_buffered_seek(struct _reader *reader, long pos, int origin) {
+	struct _filereader *filereader = CAST_UP(struct _filereader,base,reader);
+	long target;
+
+	reader->error = 0;
+	switch(origin){
+		case SEEK_SET:
+			target = pos;
+			break;
+		case SEEK_CUR:
+			target = (long)(filereader->bufstart + filereader->bufpos) + pos;
+			break;
+		default:
+			target = -1; // let stdio handle it
+			break;
+	}
+	if (origin == SEEK_SET || origin == SEEK_CUR) {
+		if (target < 0) {
+			_xlog("filereader.seek : invalid position\n");
+			reader->error = 1;
+			return(reader->error);
+		}
+		if ((unsigned long)target >= filereader->bufstart && (unsigned long)target <= filereader->bufstart + filereader->buflen) {
+			filereader->bufpos = (unsigned long)target - filereader->bufstart; // inside the buffer
+			return(reader->error);
+		}
+		pos = target;
+		origin = SEEK_SET;
+	}
+	if (fseek(filereader->fp, pos, origin) != 0 || (target = ftell(filereader->fp)) == -1) {
+		_filereader_ferror("seek");
+		reader->error = 1;
+		return(reader->error);
+	}
+	filereader->bufstart = (unsigned long)target;
+	filereader->buflen = 0;
+	filereader->bufpos = 0;
+	return(reader->error);
+}
+
+
+unsigned long filereader_buffered_tell(struct _reader *reader) {
+	struct _filereader *filereader = CAST_UP(struct _filereader,base,reader);
+
+	reader->error = 0;
+	return(filereader->bufstart + filereader->bufpos);
+}
+
+
+#ifdef FILEREADER_MMAP
+void filereader_map_destroy(struct _reader *reader) {
+	struct _filemapreader *mapreader = CAST_UP(struct _filemapreader,base,reader);
+
+	if (mapreader->size > 0 && munmap((void*)mapreader->data, mapreader->size) != 0) {
+		_filereader_ferror("destroy");
+		reader->error = 1;
+	}
+	_xfree(mapreader);
+}
+
 
+int filereader_map_read(void *dest, unsigned long size, unsigned int count, struct _reader *reader) {
+	struct _filemapreader *mapreader = CAST_UP(struct _filemapreader,base,reader);
+	unsigned long remaining = (mapreader->offset < mapreader->size)? mapreader->size - mapreader->offset: 0;
+	unsigned long wanted = size * count;
+
+	if (wanted <= remaining) {
+		memcpy(dest, mapreader->data + mapreader->offset, wanted);
+		mapreader->offset += wanted;
+		reader->error = 0;
+	}
+	else {
+		unsigned long complete = (remaining / size) * size;
+		if (complete > 0)
+			memcpy(dest, mapreader->data + mapreader->offset, complete);
+		memset((unsigned char*)dest + complete, 0, wanted - complete);
+		mapreader->offset += remaining;
+		_xlog("filereader.read : not enough data\n");
+		reader->error = 1;
+	}
+	return(reader->error);
+}
+
+
+int filereader_map_seek(struct _reader *reader, long pos, int origin) {
+	struct _filemapreader *mapreader = CAST_UP(struct _filemapreader,base,reader);
+	long target;
+
+	reader->error = 0;
+	switch(origin){
+		case SEEK_SET:
+			target = pos;
+			break;
+		case SEEK_CUR:
+			target = (long)mapreader->offset + pos;
+			break;
+		case SEEK_END:
+			target = (long)mapreader->size + pos;
+			break;
+		default:
+			_xlog("filereader.seek : not supported (origin=%d)\n", origin);
+			reader->error = 1;
+			return(reader->error);
+	}
+	if (target < 0) {
+		_xlog("filereader.seek : invalid position\n");
+		reader->error = 1;
+		return(reader->error);
+	}
+	mapreader->offset = (unsigned long)target;
+	return(reader->error);
+}
+
+
+unsigned long filereader_map_tell(struct _reader *reader) {
+	struct _filemapreader *mapreader = CAST_UP(struct _filemapreader,base,reader);
+
+	reader->error = 0;
+	return(mapreader->offset);
+}
+
+
+unsigned long filereader_map_remaining(struct _reader *reader) {
+	struct _filemapreader *mapreader = CAST_UP(struct _filemapreader,base,reader);
+
+	return((mapreader->offset < mapreader->size)? mapreader->size - mapreader->offset: 0);
+}
+
+
+const unsigned char *filereader_map_borrow(struct _reader *reader, unsigned long size) {
+	struct _filemapreader *mapreader = CAST_UP(struct _filemapreader,base,reader);
+	const unsigned char *ret = mapreader->data + mapreader->offset;
+
+	if (mapreader->offset > mapreader->size || size > mapreader->size - mapreader->offset) {
+		_xlog("filereader.borrow : not enough data\n");
+		reader->error = 1;
+		return(NULL);
+	}
+	mapreader->offset += size;
+	reader->error = 0;
+	return(ret);
+}
+
+
+// Maps the file. Returns NULL if the file cannot be mapped.
+struct _reader *_filereader_map(const char *fn) {
+	struct _filemapreader *ret;
+	struct stat st;
+	void *data = NULL;
+	int fd;
+
+	fd = open(fn, O_RDONLY);
+	if (fd == -1)
+		return(NULL);
+	if (fstat(fd, &st) != 0 || (unsigned long long)st.st_size > (unsigned long)-1 / 2) {
+		close(fd);
+		return(NULL);
+	}
+	if (st.st_size > 0) {
+		data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED) {
+			close(fd);
+			return(NULL);
+		}
+	}
+	close(fd); // the mapping keeps the file
+
+	ret = (struct _filemapreader*)_xalloc(sizeof(struct _filemapreader));
+	ret->base.destroy = &filereader_map_destroy;
+	ret->base.read = &filereader_map_read;
+	ret->base.seek = &filereader_map_seek;
+	ret->base.tell = &filereader_map_tell;
+	ret->base.borrow = &filereader_map_borrow;
+	ret->base.remaining = &filereader_map_remaining;
+	ret->base.error = 0;
+
+	ret->data = (const unsigned char*)data;
+	ret->size = (unsigned long)st.st_size;
+	ret->offset = 0;
+
+	return(CAST_DOWN(ret,base));
+}
+#endif
+
+
+struct _reader *filereader_initmode(const char *fn, unsigned char mode) {
+	struct _filereader *ret;
+
+#ifdef FILEREADER_MMAP
+	if (mode == ROINT_FILEMODE_MAP) {
+		struct _reader *reader = _filereader_map(fn);
+		if (reader != NULL)
+			return(reader);
+	}
+#endif
+
+	ret = (struct _filereader*)_xalloc(sizeof(struct _filereader));
 	ret->base.destroy = &filereader_destroy;
 	ret->base.read = &filereader_read;
 	ret->base.seek = &filereader_seek;
 	ret->base.tell = &filereader_tell;
+	ret->base.borrow = &filereader_borrow;
+	ret->base.remaining = &filereader_remaining;
 	ret->base.error = 0;
 
+	ret->buf = NULL;
+	ret->bufstart = 0;
+	ret->buflen = 0;
+	ret->bufpos = 0;
+	ret->size = 0;
+
 	ret->fp = fopen(fn,"rb");
 	if (ret->fp == 0) {
 		_xlog("Cannot open file %s\n", fn);
 		ret->base.error = 1;
 	}
+	else if (mode != ROINT_FILEMODE_STDIO) {// ROINT_FILEMODE_BUFFERED or fallback
+		setvbuf(ret->fp, NULL, _IONBF, 0); // the reader does the buffering
+#ifdef HAVE_POSIX_FADVISE
+		posix_fadvise(fileno(ret->fp), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+		ret->base.destroy = &filereader_buffered_destroy;
+		ret->base.read = &filereader_buffered_read;
+		ret->base.seek = &filereader_buffered_seek;
+		ret->base.tell = &filereader_buffered_tell;
+		ret->buf = (unsigned char*)_xalloc(FILEREADER_BUFFER_SIZE);
+	}
+	if (ret->fp != NULL && fseek(ret->fp, 0, SEEK_END) == 0) {// size for remaining (after setvbuf)
+		long size = ftell(ret->fp);
+		if (size > 0)
+			ret->size = (unsigned long)size;
+		fseek(ret->fp, 0, SEEK_SET);
+	}
 
 	return(CAST_DOWN(ret,base));
 }
+
+
+struct _reader *filereader_init(const char *fn) {
+	return(filereader_initmode(fn, filereader_mode));
+}
+
+
+void roint_set_file_mode(unsigned char mode) {
+	if (mode > ROINT_FILEMODE_MAP)
+		mode = ROINT_FILEMODE_STDIO;
+	filereader_mode = mode;
+}
+
+
+unsigned char roint_get_file_mode(void) {
+	return(filereader_mode);
+}
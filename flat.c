@@ -0,0 +1,354 @@
+/*
+    ------------------------------------------------------------------------------------
+    LICENSE:
+    ------------------------------------------------------------------------------------
+    This file is part of The Open Ragnarok Project
+    Copyright 2007 - 2012 The Open Ragnarok Team
+    For the latest information visit http://www.open-ragnarok.org
+    ------------------------------------------------------------------------------------
+    This program is free software; you can redistribute it and/or modify it under
+    the terms of the GNU Lesser General Public License as published by the Free Software
+    Foundation; either version 2 of the License, or (at your option) any later
+    version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License along with
+    this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+    Place - Suite 330, Boston, MA 02111-1307, USA, or go to
+    http://www.gnu.org/copyleft/lesser.txt.
+    ------------------------------------------------------------------------------------
+*/
+#include "internal.h"
+#include "flat.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Flat block layout:
+//   header, the object and its arrays (FLAT_ALIGN aligned), relocation table
+// The pointers inside the block hold 'base + offset', where base is the address
+// the block was last relocated to (0 means the pointers hold plain offsets).
+// The relocation table lists the offsets of the non-NULL pointer fields.
+
+#define FLAT_MAGIC "ROFL"
+#define FLAT_VERSION 1
+/// Alignment of the data inside the block.
+#define FLAT_ALIGN 8
+/// Initial capacity of the buffer.
+#define FLAT_FIRSTSIZE 0x1000
+/// Offsets are 32-bit.
+#define FLAT_MAXSIZE 0xFFFFFFFFUL
+
+
+struct _flatheader {
+	char magic[4]; // FLAT_MAGIC
+	unsigned short version; // FLAT_VERSION (detects the byte order)
+	unsigned char format; // ROINT_FORMAT_*
+	unsigned char ptrsize; // sizeof(void*)
+	unsigned int size; // size of the block
+	unsigned int root; // offset of the object
+	unsigned int relocs; // offset of the relocation table
+	unsigned int reloccount; // number of pointer fields
+	unsigned long long base; // address the pointers assume
+};
+
+#define FLAT_HEADERSIZE ((sizeof(struct _flatheader) + FLAT_ALIGN - 1) & ~(unsigned long)(FLAT_ALIGN - 1))
+
+
+void _flat_init(struct _flat *flat, unsigned char format) {
+	memset(flat, 0, sizeof(struct _flat));
+	flat->format = format;
+	_flat_add(flat, NULL, FLAT_HEADERSIZE);
+}
+
+
+unsigned long _flat_add(struct _flat *flat, const void *src, unsigned long size) {
+	unsigned long offset, end;
+
+	if (flat->error)
+		return(0);
+	offset = (flat->size + FLAT_ALIGN - 1) & ~(unsigned long)(FLAT_ALIGN - 1);
+	end = offset + size;
+	if (end < offset || end > FLAT_MAXSIZE) {
+		_xlog("flat.add : block is too big\n");
+		flat->error = 1;
+		return(0);
+	}
+	if (end > flat->capacity) {
+		unsigned long capacity = (flat->capacity == 0)? FLAT_FIRSTSIZE: flat->capacity;
+		unsigned char *data;
+		while (capacity < end)
+			capacity *= 2;
+		data = (unsigned char*)_xrealloc(flat->data, flat->capacity, capacity);
+		if (data == NULL) {
+			_xlog("flat.add : out of memory\n");
+			flat->error = 1;
+			return(0);
+		}
+		flat->data = data;
+		flat->capacity = capacity;
+	}
+	memset(flat->data + flat->size, 0, offset - flat->size);
+	if (src != NULL)
+		memcpy(flat->data + offset, src, size);
+	else
+		memset(flat->data + offset, 0, size);
+	flat->size = end;
+	return(offset);
+}
+
+
+unsigned long _flat_addptr(struct _flat *flat, unsigned long field, const void *src, unsigned long size) {
+	unsigned long offset;
+	size_t value;
+
+	if (flat->error)
+		return(0);
+	offset = 0;
+	if (src != NULL && size > 0) {
+		offset = _flat_add(flat, src, size);
+		if (offset == 0)
+			return(0);
+		if (flat->reloccount == flat->reloccapacity) {
+			unsigned int capacity = (flat->reloccapacity == 0)? 64: flat->reloccapacity * 2;
+			unsigned int *relocs = (unsigned int*)_xrealloc(flat->relocs, sizeof(unsigned int) * flat->reloccapacity, sizeof(unsigned int) * capacity);
+			if (relocs == NULL) {
+				_xlog("flat.addptr : out of memory\n");
+				flat->error = 1;
+				return(0);
+			}
+			flat->relocs = relocs;
+			flat->reloccapacity = capacity;
+		}
+		flat->relocs[flat->reloccount++] = (unsigned int)field;
+	}
+	value = (size_t)offset;
+	memcpy(flat->data + field, &value, sizeof(size_t)); // the fields of packed structures are unaligned
+	return(offset);
+}
+
+
+// Move the pointers of a block from oldbase to newbase.
+// The table is checked before anything is changed. (0 on success)
+static int flat_relocate(unsigned char *data, const struct _flatheader *header, size_t oldbase, size_t newbase) {
+	const unsigned char *table = data + header->relocs;
+	unsigned int i;
+
+	for (i = 0; i < header->reloccount; i++) {
+		unsigned int field;
+		size_t value;
+		memcpy(&field, table + i * sizeof(unsigned int), sizeof(unsigned int));
+		if (field < FLAT_HEADERSIZE || field > header->relocs - sizeof(size_t)) {
+			_xlog("flat.relocate : invalid pointer field %u\n", field);
+			return(1);
+		}
+		memcpy(&value, data + field, sizeof(size_t));
+		if (value - oldbase < FLAT_HEADERSIZE || value - oldbase >= header->relocs) {
+			_xlog("flat.relocate : pointer field %u is out of the block\n", field);
+			return(1);
+		}
+	}
+	if (oldbase == newbase)
+		return(0);
+	for (i = 0; i < header->reloccount; i++) {
+		unsigned int field;
+		size_t value;
+		memcpy(&field, table + i * sizeof(unsigned int), sizeof(unsigned int));
+		memcpy(&value, data + field, sizeof(size_t));
+		value = value - oldbase + newbase;
+		memcpy(data + field, &value, sizeof(size_t));
+	}
+	return(0);
+}
+
+
+// Returns the header of a valid block, NULL otherwise.
+static struct _flatheader *flat_header(const void *data, unsigned long size) {
+	struct _flatheader *header = (struct _flatheader*)data;
+
+	if (data == NULL || size < FLAT_HEADERSIZE || ((size_t)data & (FLAT_ALIGN - 1)) != 0) {
+		_xlog("flat.header : invalid argument (data=%p size=%lu)\n", data, size);
+		return(NULL);
+	}
+	if (memcmp(header->magic, FLAT_MAGIC, 4) != 0 || header->version != FLAT_VERSION || header->ptrsize != sizeof(void*)) {
+		_xlog("flat.header : not a flat block of this library and system\n");
+		return(NULL);
+	}
+	if (header->size != size ||
+		header->relocs < FLAT_HEADERSIZE || header->relocs > size ||
+		header->reloccount > (size - header->relocs) / sizeof(unsigned int) ||
+		header->root < FLAT_HEADERSIZE || header->root >= header->relocs) {
+		_xlog("flat.header : invalid header\n");
+		return(NULL);
+	}
+	return(header);
+}
+
+
+int _flat_finish(struct _flat *flat, unsigned long root, unsigned char **data_out, unsigned long *size_out) {
+	struct _flatheader *header;
+	unsigned long relocs;
+	unsigned char *data;
+
+	relocs = _flat_add(flat, flat->relocs, sizeof(unsigned int) * flat->reloccount);
+	if (flat->error || root == 0 || (data = (unsigned char*)_xrealloc(flat->data, flat->capacity, flat->size)) == NULL) {
+		if (flat->data != NULL)
+			_xfreesize(flat->data, flat->capacity);
+		if (flat->relocs != NULL)
+			_xfreesize(flat->relocs, sizeof(unsigned int) * flat->reloccapacity);
+		return(1);
+	}
+	if (flat->relocs != NULL)
+		_xfreesize(flat->relocs, sizeof(unsigned int) * flat->reloccapacity);
+
+	header = (struct _flatheader*)data;
+	memcpy(header->magic, FLAT_MAGIC, 4);
+	header->version = FLAT_VERSION;
+	header->format = flat->format;
+	header->ptrsize = sizeof(void*);
+	header->size = (unsigned int)flat->size;
+	header->root = (unsigned int)root;
+	header->relocs = (unsigned int)relocs;
+	header->reloccount = flat->reloccount;
+	header->base = 0;
+	// ready to use where it is
+	flat_relocate(data, header, 0, (size_t)data);
+	header->base = (size_t)data;
+
+	_xhandover(data);
+	*data_out = data;
+	*size_out = flat->size;
+	return(0);
+}
+
+
+// Returns the header of a valid block of the format with an object of 'rootsize' bytes, NULL otherwise.
+static struct _flatheader *flat_rootheader(const void *data, unsigned long size, unsigned char format, unsigned long rootsize) {
+	struct _flatheader *header = flat_header(data, size);
+
+	if (header == NULL)
+		return(NULL);
+	if (header->format != format) {
+		_xlog("flat.rootheader : expected a block of format %u, found %u\n", format, header->format);
+		return(NULL);
+	}
+	if (rootsize > header->relocs - header->root) {
+		_xlog("flat.rootheader : object is out of the block\n");
+		return(NULL);
+	}
+	return(header);
+}
+
+
+void *_flat_attach(void *data, unsigned long size, unsigned char format, unsigned long rootsize, int *moved) {
+	struct _flatheader *header = flat_rootheader(data, size, format, rootsize);
+
+	*moved = 0;
+	if (header == NULL)
+		return(NULL);
+	if (header->base != (size_t)data) {
+		if (flat_relocate((unsigned char*)data, header, (size_t)header->base, (size_t)data) != 0)
+			return(NULL);
+		header->base = (size_t)data;
+		*moved = 1;
+	}
+	return((unsigned char*)data + header->root);
+}
+
+
+const void *_flat_verify(const void *data, unsigned long size, unsigned char format, unsigned long rootsize) {
+	const struct _flatheader *header = flat_rootheader(data, size, format, rootsize);
+
+	if (header == NULL)
+		return(NULL);
+	if (header->base != (size_t)data) {
+		_xlog("flat.verify : block is not at its address (attach or relocate it first)\n");
+		return(NULL);
+	}
+	return((const unsigned char*)data + header->root);
+}
+
+
+// Returns the offset of a pointer inside the data of an attached block, 0 if it is outside or misaligned.
+static unsigned long flat_offset(const void *data, const void *ptr) {
+	const struct _flatheader *header = (const struct _flatheader*)data;
+	size_t offset = (size_t)ptr - (size_t)data;
+
+	if (ptr == NULL || offset < FLAT_HEADERSIZE || offset >= header->relocs || (offset & (FLAT_ALIGN - 1)) != 0)
+		return(0);
+	return((unsigned long)offset);
+}
+
+
+int _flat_checkarray(const void *data, const void *ptr, unsigned long count, unsigned long elemsize) {
+	const struct _flatheader *header = (const struct _flatheader*)data;
+	unsigned long offset;
+
+	if (count == 0)
+		return(0);
+	offset = flat_offset(data, ptr);
+	if (offset == 0 || count > (header->relocs - offset) / elemsize) {
+		_xlog("flat.checkarray : array of %lu elements is out of the block\n", count);
+		return(1);
+	}
+	return(0);
+}
+
+
+int _flat_checkstring(const void *data, const char *str) {
+	const struct _flatheader *header = (const struct _flatheader*)data;
+	unsigned long offset = flat_offset(data, str);
+
+	if (offset == 0 || memchr(str, 0, header->relocs - offset) == NULL) {
+		_xlog("flat.checkstring : string is out of the block\n");
+		return(1);
+	}
+	return(0);
+}
+
+
+int roint_flat_relocate(void *data, unsigned long size, const void *base) {
+	struct _flatheader *header = flat_header(data, size);
+
+	if (header == NULL)
+		return(1);
+	if (flat_relocate((unsigned char*)data, header, (size_t)header->base, (size_t)base) != 0)
+		return(1);
+	header->base = (size_t)base;
+	return(0);
+}
+
+
+int roint_flat_verify(const void *data, unsigned long size) {
+	const struct _flatheader *header = flat_header(data, size);
+
+	if (header == NULL)
+		return(1);
+	switch(header->format) {
+		case ROINT_FORMAT_ACT:
+			return(act_verifyFlat(data, size));
+		case ROINT_FORMAT_SPR:
+			return(spr_verifyFlat(data, size));
+		case ROINT_FORMAT_GND:
+			return(gnd_verifyFlat(data, size));
+		case ROINT_FORMAT_STR:
+			return(str_verifyFlat(data, size));
+		case ROINT_FORMAT_RSM:
+			return(rsm_verifyFlat(data, size));
+		default:
+			_xlog("flat.verify : format %u has no flat blocks\n", header->format);
+			return(1);
+	}
+}
+
+
+int roint_flat_format(const void *data, unsigned long size) {
+	const struct _flatheader *header = flat_header(data, size);
+
+	if (header == NULL)
+		return(-1);
+	return(header->format);
+}
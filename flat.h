@@ -0,0 +1,74 @@
+/*
+    ------------------------------------------------------------------------------------
+    LICENSE:
+    ------------------------------------------------------------------------------------
+    This file is part of The Open Ragnarok Project
+    Copyright 2007 - 2012 The Open Ragnarok Team
+    For the latest information visit http://www.open-ragnarok.org
+    ------------------------------------------------------------------------------------
+    This program is free software; you can redistribute it and/or modify it under
+    the terms of the GNU Lesser General Public License as published by the Free Software
+    Foundation; either version 2 of the License, or (at your option) any later
+    version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License along with
+    this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+    Place - Suite 330, Boston, MA 02111-1307, USA, or go to
+    http://www.gnu.org/copyleft/lesser.txt.
+    ------------------------------------------------------------------------------------
+*/
+#ifndef __ROINT_INTERNAL_FLAT_H
+#define __ROINT_INTERNAL_FLAT_H
+
+// For ROInt internal use only
+
+// Builder of the flat blocks of roint/flat.h.
+// A saver copies the object with _flat_add and each array it points to with _flat_addptr,
+// which stores the offset of the copy in the pointer field and records the field in the
+// relocation table. Offsets are used because the buffer moves while it grows.
+// _flat_finish fixes the pointers for the address of the block and hands it over.
+
+#include <stddef.h> // size_t, offsetof
+
+struct _flat {
+	unsigned char *data;
+	unsigned long size;
+	unsigned long capacity;
+	unsigned int *relocs; // offsets of the pointer fields
+	unsigned int reloccount;
+	unsigned int reloccapacity;
+	unsigned char format;
+	int error;
+};
+
+/// Start a block of the ROINT_FORMAT_* format.
+void _flat_init(struct _flat *flat, unsigned char format);
+/// Copy data to the block and return its offset. (0 on error)
+unsigned long _flat_add(struct _flat *flat, const void *src, unsigned long size);
+/// Copy the array of a pointer field to the block and point the field to it.
+/// 'field' is the offset of the pointer field in the block.
+/// Without data (src NULL or size 0) the field is set to NULL and 0 is returned.
+/// Returns the offset of the copy.
+unsigned long _flat_addptr(struct _flat *flat, unsigned long field, const void *src, unsigned long size);
+/// Finish the block of the object at offset 'root'. (0 on success)
+/// On error, or if an earlier call failed, the block is freed and 1 is returned.
+int _flat_finish(struct _flat *flat, unsigned long root, unsigned char **data_out, unsigned long *size_out);
+/// Check the header of a block of the format and relocate it to its current address if needed.
+/// 'rootsize' is the size of the object. Sets 'moved' when the block was relocated,
+/// the caller must then verify it.
+/// Returns the object, or NULL if the block is invalid.
+void *_flat_attach(void *data, unsigned long size, unsigned char format, unsigned long rootsize, int *moved);
+/// Check the header of a block of the format that must be at its address.
+/// Returns the object, or NULL if the block is invalid.
+const void *_flat_verify(const void *data, unsigned long size, unsigned char format, unsigned long rootsize);
+/// Check that an array of 'count' elements fits in the block 'data'. (0 on success)
+/// The array can be NULL when it has no elements.
+int _flat_checkarray(const void *data, const void *ptr, unsigned long count, unsigned long elemsize);
+/// Check that a NUL-terminated string fits in the block 'data'. (0 on success)
+int _flat_checkstring(const void *data, const char *str);
+
+#endif /* __ROINT_INTERNAL_FLAT_H */
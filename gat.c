@@ -22,6 +22,7 @@
     ------------------------------------------------------------------------------------
 */
 #include "internal.h"
+#include "arena.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -62,6 +63,7 @@ unsigned short gat_inspect(const struct ROGat *gat) {
 
 struct ROGat *gat_load(struct _reader *reader) {
 	struct ROGat *ret;
+	struct _arena *arena;
 	unsigned int cellcount;
 	char magic[4];
 
@@ -70,7 +72,8 @@ struct ROGat *gat_load(struct _reader *reader) {
 		return(NULL);
 	}
 
-	ret = (struct ROGat*)_xalloc(sizeof(struct ROGat));
+	arena = _arena_loadinit(reader->remaining(reader));
+	ret = (struct ROGat*)_arena_newobject(arena, sizeof(struct ROGat));
 	memset(ret, 0, sizeof(struct ROGat));
 
 	reader->read(&magic, 4, 1, reader);
@@ -100,7 +103,7 @@ struct ROGat *gat_load(struct _reader *reader) {
 	}
 	cellcount = ret->width * ret->height;
 	if (cellcount > 0) {
-		ret->cells = (struct ROGatCell*)_xalloc(sizeof(struct ROGatCell) * cellcount);
+		ret->cells = (struct ROGatCell*)_arena_alloc(arena, sizeof(struct ROGatCell) * cellcount);
 		reader->read(ret->cells, sizeof(struct ROGatCell), cellcount, reader);
 	}
 
@@ -118,7 +121,7 @@ struct ROGat *gat_loadFromData(const unsigned char *data, unsigned long length)
 	struct ROGat *ret;
 	struct _reader *reader;
 
-	reader = memreader_init(data, length);
+	reader = statsreader_init(memreader_init(data, length), ROINT_FORMAT_GAT);
 	ret = gat_load(reader);
 	reader->destroy(reader);
 
@@ -130,7 +133,7 @@ struct ROGat *gat_loadFromFile(const char *fn) {
 	struct ROGat *ret;
 	struct _reader *reader;
 
-	reader = filereader_init(fn);
+	reader = statsreader_init(filereader_init(fn), ROINT_FORMAT_GAT);
 	ret = gat_load(reader);
 	reader->destroy(reader);
 
@@ -195,7 +198,7 @@ int gat_saveToData(const struct ROGat *gat, unsigned char **data_out, unsigned l
 	int ret;
 	struct _writer *writer;
 
-	writer = memwriter_init(data_out, size_out);
+	writer = statswriter_init(memwriter_init(data_out, size_out), ROINT_FORMAT_GAT);
 	ret = gat_save(gat, writer);
 	writer->destroy(writer);
 
@@ -205,10 +208,13 @@ int gat_saveToData(const struct ROGat *gat, unsigned char **data_out, unsigned l
 
 int gat_saveToFile(const struct ROGat *gat, const char *fn) {
 	int ret;
-	struct _writer *writer;
+	struct _writer *writer, *memwriter;
 
-	writer = filewriter_init(fn);
+	memwriter = memwriter_init(NULL, NULL);
+	writer = statswriter_init(memwriter, ROINT_FORMAT_GAT);
 	ret = gat_save(gat, writer);
+	if (ret == 0)
+		ret = memwriter_savefile(memwriter, fn);
 	writer->destroy(writer);
 
 	return(ret);
@@ -218,6 +224,8 @@ int gat_saveToFile(const struct ROGat *gat, const char *fn) {
 void gat_unload(struct ROGat *gat) {
 	if (gat == NULL)
 		return;
+	if (_arena_release(gat) == 0)
+		return;// loaded in arena mode, everything is released
 
 	if (gat->cells != NULL)
 		_xfree(gat->cells);
@@ -22,6 +22,10 @@
     ------------------------------------------------------------------------------------
 */
 #include "internal.h"
+#include "arena.h"
+#include "cursor.h"
+#include "encoder.h"
+#include "flat.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -108,86 +112,104 @@ unsigned short gnd_inspect(const struct ROGnd *gnd) {
 
 struct ROGnd *gnd_load(struct _reader *reader) {
 	struct ROGnd *ret;
+	struct _arena *arena;
 	unsigned int i;
 	unsigned int texturenamelen;
 	unsigned int cellcount;
+	struct _cursor cursor;
 	char magic[4];
+	int error;
 
 	if (reader == NULL || reader->error) {
 		_xlog("gnd.load : invalid argument (reader=%p reader.error=%d)\n", reader, reader->error);
 		return(NULL);
 	}
 
-	ret = (struct ROGnd*)_xalloc(sizeof(struct ROGnd));
+	arena = _arena_loadinit(reader->remaining(reader));
+	ret = (struct ROGnd*)_arena_newobject(arena, sizeof(struct ROGnd));
 	memset(ret, 0, sizeof(struct ROGnd));
 
-	reader->read(&magic, 4, 1, reader);
+	_cursor_init(&cursor, reader);
+	_cursor_need(&cursor, 26); // header + texture count
+	_cursor_bytes(&cursor, magic, 4);
 	if (memcmp(GND_MAGIC, magic, 4) != 0) {
 		_xlog("gnd.load : invalid header x%02X%02X%02X%02X (\"%-4s\")\n", magic[0], magic[1], magic[2], magic[3], magic);
+		_cursor_destroy(&cursor);
 		gnd_unload(ret);
 		return(NULL);
 	}
 
-	reader->read(&ret->vermajor, 1, 1, reader);
-	reader->read(&ret->verminor, 1, 1, reader);
+	ret->vermajor = _cursor_u8(&cursor);
+	ret->verminor = _cursor_u8(&cursor);
 	if (ret->version == 0x107) {
 		// supported
 	}
 	else if (ret->version == 0x106) {
 		_xlog("gnd.load : v1.6 not supported\n");
+		_cursor_destroy(&cursor);
 		gnd_unload(ret);
+		return(NULL);
 	}
 	else {
 		_xlog("gnd.load : unknown version v%u.%u\n", ret->vermajor, ret->verminor);
+		_cursor_destroy(&cursor);
 		gnd_unload(ret);
 		return(NULL);
 	}
 
-	reader->read(&ret->width, 4, 1, reader);
-	reader->read(&ret->height, 4, 1, reader);
-	reader->read(&ret->zoom, 4, 1, reader);
+	ret->width = _cursor_u32(&cursor);
+	ret->height = _cursor_u32(&cursor);
+	ret->zoom = _cursor_f32(&cursor);
 	if (_mul_over_limit(ret->width, ret->height, GND_MAX_CELL_COUNT)) {
 		_xlog("gnd.load : dimensions are too big (%ux%u)\n", ret->width, ret->height);
+		_cursor_destroy(&cursor);
 		gnd_unload(ret);
 		return(NULL);
 	}
 	// read textures
-	reader->read(&ret->texturecount, 4, 1, reader);
-	reader->read(&texturenamelen, 4, 1, reader);
-	if (ret->texturecount > 0) {
+	ret->texturecount = _cursor_u32(&cursor);
+	texturenamelen = _cursor_u32(&cursor);
+	if (ret->texturecount > 0 && _cursor_needarray(&cursor, texturenamelen, ret->texturecount) == 0) {
 		char *buf;
 		size_t len;
 
-		ret->textures = (char**)_xalloc(sizeof(char*) * ret->texturecount);
-		memset(ret->textures, 0, sizeof(char*) * ret->texturecount);
+		ret->textures = (char**)_arena_alloc(arena, sizeof(char*) * ret->texturecount);
 		buf = (char*)_xalloc(texturenamelen + 1);
 		buf[texturenamelen] = 0;
 		for (i = 0; i < ret->texturecount; i++) {
-			if (texturenamelen > 0)
-				reader->read(buf, 1, texturenamelen, reader);
+			_cursor_bytes(&cursor, buf, texturenamelen);
 			len = strlen(buf);
-			ret->textures[i] = (char*)_xalloc(len + 1);
+			ret->textures[i] = (char*)_arena_alloc(arena, len + 1);
 			memcpy(ret->textures[i], buf, len + 1);
 		}
 		_xfree(buf);
 	}
+	else
+		ret->texturecount = 0;
 	// read lightmaps
-	reader->read(&ret->lightmapcount, 4, 1, reader);
+	if (_cursor_need(&cursor, 4) == 0)
+		ret->lightmapcount = _cursor_u32(&cursor);
 	if (ret->version >= 0x107) {
 		unsigned int lightmapWidth; // width, must be 8
 		unsigned int lightmapHeight; // height, must be 8
 		unsigned int lightmapCells; // cells, must be 1
-		reader->read(&lightmapWidth, 4, 1, reader);
-		reader->read(&lightmapHeight, 4, 1, reader);
-		reader->read(&lightmapCells, 4, 1, reader);
-		if (lightmapWidth != 8 || lightmapHeight != 8 || lightmapCells != 1) {
+		_cursor_need(&cursor, 12);
+		lightmapWidth = _cursor_u32(&cursor);
+		lightmapHeight = _cursor_u32(&cursor);
+		lightmapCells = _cursor_u32(&cursor);
+		if (!cursor.error && (lightmapWidth != 8 || lightmapHeight != 8 || lightmapCells != 1)) {
 			_xlog("gnd.load : unsupported lightmap dimensions (width=%u height=%u cells=%u)\n", lightmapWidth, lightmapHeight, lightmapCells);
+			_cursor_destroy(&cursor);
 			gnd_unload(ret);
 			return(NULL);
 		}
 		if (ret->lightmapcount > 0) {
-			ret->lightmaps = (struct ROGndLightmap*)_xalloc(sizeof(struct ROGndLightmap) * ret->lightmapcount);
-			reader->read(ret->lightmaps, sizeof(struct ROGndLightmap), ret->lightmapcount, reader);
+			if (_cursor_needarray(&cursor, sizeof(struct ROGndLightmap), ret->lightmapcount) == 0) {
+				ret->lightmaps = (struct ROGndLightmap*)_arena_alloc(arena, sizeof(struct ROGndLightmap) * ret->lightmapcount);
+				_cursor_bytes(&cursor, ret->lightmaps, sizeof(struct ROGndLightmap) * ret->lightmapcount);
+			}
+			else
+				ret->lightmapcount = 0;
 		}
 	}
 	else {
@@ -197,17 +219,22 @@ struct ROGnd *gnd_load(struct _reader *reader) {
 		unsigned int colorchannelcount;
 		//unsigned char error = 0; // unused
 
-		if (ret->lightmapcount > 0) {
+		if (ret->lightmapcount > 0 && _cursor_needarray(&cursor, sizeof(struct ROGndLightmapIndex), ret->lightmapcount) == 0) {
 			lightmapIndexes = (struct ROGndLightmapIndex*)_xalloc(sizeof(struct ROGndLightmapIndex) * ret->lightmapcount);
-			reader->read(lightmapIndexes, sizeof(struct ROGndLightmapIndex), ret->lightmapcount, reader);
+			_cursor_bytes(&cursor, lightmapIndexes, sizeof(struct ROGndLightmapIndex) * ret->lightmapcount);
 		}
-		reader->read(&colorchannelcount, 4, 1, reader);
-		if (colorchannelcount > 0) {
+		colorchannelcount = 0;
+		if (_cursor_need(&cursor, 4) == 0)
+			colorchannelcount = _cursor_u32(&cursor);
+		if (colorchannelcount > 0 && _cursor_needarray(&cursor, sizeof(struct ROGndColorChannel), colorchannelcount) == 0) {
 			colorchannels = (struct ROGndColorChannel*)_xalloc(sizeof(struct ROGndColorChannel) * colorchannelcount);
-			reader->read(colorchannels, sizeof(struct ROGndColorChannel), colorchannelcount, reader);
+			_cursor_bytes(&cursor, colorchannels, sizeof(struct ROGndColorChannel) * colorchannelcount);
 		}
+		if (cursor.error)
+			ret->lightmapcount = 0;
+		i = 0;
 		if (ret->lightmapcount > 0) {
-			ret->lightmaps = (struct ROGndLightmap*)_xalloc(sizeof(struct ROGndLightmap) * ret->lightmapcount);
+			ret->lightmaps = (struct ROGndLightmap*)_arena_alloc(arena, sizeof(struct ROGndLightmap) * ret->lightmapcount);
 			for (i = 0; i < ret->lightmapcount; i++) {
 				struct ROGndLightmap *lightmap = &ret->lightmaps[i];
 				struct ROGndLightmapIndex *lightmapIndex = &lightmapIndexes[i];
@@ -264,35 +291,43 @@ struct ROGnd *gnd_load(struct _reader *reader) {
 		}
 	}
 	// read surfaces
-	reader->read(&ret->surfacecount, 4, 1, reader);
+	if (_cursor_need(&cursor, 4) == 0)
+		ret->surfacecount = _cursor_u32(&cursor);
 	if (ret->surfacecount > 0) {
-		ret->surfaces = (struct ROGndSurface*)_xalloc(sizeof(struct ROGndSurface) * ret->surfacecount);
-		reader->read(ret->surfaces, sizeof(struct ROGndSurface), ret->surfacecount, reader);
+		if (_cursor_needarray(&cursor, sizeof(struct ROGndSurface), ret->surfacecount) == 0) {
+			ret->surfaces = (struct ROGndSurface*)_arena_alloc(arena, sizeof(struct ROGndSurface) * ret->surfacecount);
+			_cursor_bytes(&cursor, ret->surfaces, sizeof(struct ROGndSurface) * ret->surfacecount);
+		}
+		else
+			ret->surfacecount = 0;
 	}
 	// read cells
 	cellcount = ret->width * ret->height;
-	if (cellcount > 0) {
-		ret->cells = (struct ROGndCell*)_xalloc(sizeof(struct ROGndCell) * cellcount);
-		if (ret->version >= 0x107)
-			reader->read(ret->cells, sizeof(struct ROGndCell), cellcount, reader);
-		else {
+	if (cellcount > 0 && !cursor.error) {
+		if (ret->version >= 0x107) {
+			if (_cursor_needarray(&cursor, sizeof(struct ROGndCell), cellcount) == 0) {
+				ret->cells = (struct ROGndCell*)_arena_alloc(arena, sizeof(struct ROGndCell) * cellcount);
+				_cursor_bytes(&cursor, ret->cells, sizeof(struct ROGndCell) * cellcount);
+			}
+		}
+		else if (_cursor_needarray(&cursor, 22, cellcount) == 0) {
+			ret->cells = (struct ROGndCell*)_arena_alloc(arena, sizeof(struct ROGndCell) * cellcount);
 			for (i = 0; i < cellcount; i++) {
 				struct ROGndCell *cell = &ret->cells[i];
-				short topSurfaceId;
-				short frontSurfaceId;
-				short rightSurfaceId;
-				reader->read(&cell->height, sizeof(cell->height), 1, reader);
-				reader->read(&topSurfaceId, 2, 1, reader);
-				reader->read(&frontSurfaceId, 2, 1, reader);
-				reader->read(&rightSurfaceId, 2, 1, reader);
-				cell->topSurfaceId = topSurfaceId;
-				cell->frontSurfaceId = frontSurfaceId;
-				cell->rightSurfaceId = rightSurfaceId;
+				cell->height[0] = _cursor_f32(&cursor);
+				cell->height[1] = _cursor_f32(&cursor);
+				cell->height[2] = _cursor_f32(&cursor);
+				cell->height[3] = _cursor_f32(&cursor);
+				cell->topSurfaceId = (short)_cursor_u16(&cursor);
+				cell->frontSurfaceId = (short)_cursor_u16(&cursor);
+				cell->rightSurfaceId = (short)_cursor_u16(&cursor);
 			}
 		}
 	}
 
-	if (reader->error) {
+	error = cursor.error;
+	_cursor_destroy(&cursor);
+	if (error) {
 		_xlog("gnd.load : read error\n");
 		gnd_unload(ret);
 		return(NULL);
@@ -306,7 +341,7 @@ struct ROGnd *gnd_loadFromData(const unsigned char *data, unsigned long length)
 	struct ROGnd *ret;
 	struct _reader *reader;
 
-	reader = memreader_init(data, length);
+	reader = statsreader_init(memreader_init(data, length), ROINT_FORMAT_GND);
 	ret = gnd_load(reader);
 	reader->destroy(reader);
 
@@ -318,7 +353,7 @@ struct ROGnd *gnd_loadFromFile(const char *fn) {
 	struct ROGnd *ret;
 	struct _reader *reader;
 
-	reader = filereader_init(fn);
+	reader = statsreader_init(filereader_init(fn), ROINT_FORMAT_GND);
 	ret = gnd_load(reader);
 	reader->destroy(reader);
 
@@ -355,6 +390,7 @@ int gnd_save(const struct ROGnd *gnd, struct _writer *writer) {
 	unsigned int lightmapHeight;
 	unsigned int lightmapCells;
 	unsigned int cellcount;
+	struct _encoder encoder;
 
 	if (gnd == NULL || writer == NULL || writer->error) {
 		_xlog("gnd.save : invalid argument (gnd=%p writer=%p writer.error=%d)\n", gnd, writer, writer->error);
@@ -370,14 +406,6 @@ int gnd_save(const struct ROGnd *gnd, struct _writer *writer) {
 		return(1);
 	}
 
-	writer->write(GND_MAGIC, 4, 1, writer);
-	writer->write(&gnd->vermajor, 1, 1, writer);
-	writer->write(&gnd->verminor, 1, 1, writer);
-	writer->write(&gnd->width, 4, 1, writer);
-	writer->write(&gnd->height, 4, 1, writer);
-	writer->write(&gnd->zoom, 4, 1, writer);
-	// write textures
-	writer->write(&gnd->texturecount, 4, 1, writer);
 	texturenamelen = 1;
 	for (i = 0; i < gnd->texturecount; i++) {
 		const char *texture = gnd->textures[i];
@@ -385,39 +413,48 @@ int gnd_save(const struct ROGnd *gnd, struct _writer *writer) {
 		if (texturenamelen < zlen)
 			texturenamelen = zlen;
 	}
-	writer->write(&texturenamelen, 4, 1, writer);
-	if (gnd->texturecount > 0) {
-		char *buf = (char*)_xalloc(sizeof(char) * texturenamelen);
-		for (i = 0; i < gnd->texturecount; i++) {
-			const char *texture = gnd->textures[i];
-			size_t len = strlen(texture);
-			memcpy(buf, texture, len);
-			memset(buf + len, 0, texturenamelen - len);
-			writer->write(buf, 1, texturenamelen, writer);
-		}
-		_xfree(buf);
+
+	_encoder_init(&encoder, writer);
+	_encoder_reserve(&encoder, 26);
+	_encoder_bytes(&encoder, GND_MAGIC, 4);
+	_encoder_u8(&encoder, gnd->vermajor);
+	_encoder_u8(&encoder, gnd->verminor);
+	_encoder_u32(&encoder, gnd->width);
+	_encoder_u32(&encoder, gnd->height);
+	_encoder_f32(&encoder, gnd->zoom);
+	// write textures
+	_encoder_u32(&encoder, gnd->texturecount);
+	_encoder_u32(&encoder, texturenamelen);
+	for (i = 0; i < gnd->texturecount && !encoder.error; i++) {
+		const char *texture = gnd->textures[i];
+		size_t len = strlen(texture);
+		_encoder_reserve(&encoder, texturenamelen);
+		_encoder_bytes(&encoder, texture, len);
+		_encoder_zeros(&encoder, texturenamelen - len);
 	}
 	// write lightmaps
-	writer->write(&gnd->lightmapcount, 4, 1, writer);
 	lightmapWidth = 8;
 	lightmapHeight = 8;
 	lightmapCells = 1;
-	writer->write(&lightmapWidth, 4, 1, writer);
-	writer->write(&lightmapHeight, 4, 1, writer);
-	writer->write(&lightmapCells, 4, 1, writer);
+	_encoder_reserve(&encoder, 16);
+	_encoder_u32(&encoder, gnd->lightmapcount);
+	_encoder_u32(&encoder, lightmapWidth);
+	_encoder_u32(&encoder, lightmapHeight);
+	_encoder_u32(&encoder, lightmapCells);
 	if (gnd->lightmapcount)
-		writer->write(gnd->lightmaps, sizeof(struct ROGndLightmap), gnd->lightmapcount, writer);
+		_encoder_write(&encoder, gnd->lightmaps, sizeof(struct ROGndLightmap) * gnd->lightmapcount);
 	// write surfaces
-	writer->write(&gnd->surfacecount, 4, 1, writer);
+	_encoder_reserve(&encoder, 4);
+	_encoder_u32(&encoder, gnd->surfacecount);
 	if (gnd->surfacecount > 0)
-		writer->write(gnd->surfaces, sizeof(struct ROGndSurface), gnd->surfacecount, writer);
+		_encoder_write(&encoder, gnd->surfaces, sizeof(struct ROGndSurface) * gnd->surfacecount);
 	// write cells
 	cellcount = gnd->width * gnd->height;
 	if (cellcount > 0) {
-		writer->write(gnd->cells, sizeof(struct ROGndCell), cellcount, writer);
+		_encoder_write(&encoder, gnd->cells, sizeof(struct ROGndCell) * cellcount);
 	}
 
-	if (writer->error) {
+	if (_encoder_destroy(&encoder)) {
 		_xlog("gnd.save : write error\n");
 		return(1);
 	}
@@ -430,7 +467,7 @@ int gnd_saveToData(const struct ROGnd *gnd, unsigned char **data_out, unsigned l
 	int ret;
 	struct _writer *writer;
 
-	writer = memwriter_init(data_out, size_out);
+	writer = statswriter_init(memwriter_init(data_out, size_out), ROINT_FORMAT_GND);
 	ret = gnd_save(gnd, writer);
 	writer->destroy(writer);
 
@@ -440,21 +477,90 @@ int gnd_saveToData(const struct ROGnd *gnd, unsigned char **data_out, unsigned l
 
 int gnd_saveToFile(const struct ROGnd *gnd, const char *fn) {
 	int ret;
-	struct _writer *writer;
+	struct _writer *writer, *memwriter;
 
-	writer = filewriter_init(fn);
+	memwriter = memwriter_init(NULL, NULL);
+	writer = statswriter_init(memwriter, ROINT_FORMAT_GND);
 	ret = gnd_save(gnd, writer);
+	if (ret == 0)
+		ret = memwriter_savefile(memwriter, fn);
 	writer->destroy(writer);
 
 	return(ret);
 }
 
 
+int gnd_saveToFlat(const struct ROGnd *gnd, unsigned char **data_out, unsigned long *size_out) {
+	struct _flat flat;
+	unsigned long root, textures;
+	unsigned int i;
+
+	if (gnd == NULL || data_out == NULL || size_out == NULL) {
+		_xlog("gnd.saveToFlat : invalid argument (gnd=%p data_out=%p size_out=%p)\n", gnd, data_out, size_out);
+		return(1);
+	}
+	if (gnd_inspect(gnd) == 0) {
+		_xlog("gnd.saveToFlat : invalid\n");
+		return(1);
+	}
+
+	_flat_init(&flat, ROINT_FORMAT_GND);
+	root = _flat_add(&flat, gnd, sizeof(struct ROGnd));
+	textures = _flat_addptr(&flat, root + offsetof(struct ROGnd, textures), gnd->textures, sizeof(char*) * gnd->texturecount);
+	for (i = 0; textures != 0 && i < gnd->texturecount; i++) {
+		const char *texture = gnd->textures[i];
+		_flat_addptr(&flat, textures + sizeof(char*) * i, texture, (texture != NULL)? (unsigned long)strlen(texture) + 1: 0);
+	}
+	_flat_addptr(&flat, root + offsetof(struct ROGnd, lightmaps), gnd->lightmaps, sizeof(struct ROGndLightmap) * gnd->lightmapcount);
+	_flat_addptr(&flat, root + offsetof(struct ROGnd, surfaces), gnd->surfaces, sizeof(struct ROGndSurface) * gnd->surfacecount);
+	_flat_addptr(&flat, root + offsetof(struct ROGnd, cells), gnd->cells, sizeof(struct ROGndCell) * gnd->width * gnd->height);
+
+	return(_flat_finish(&flat, root, data_out, size_out));
+}
+
+
+const struct ROGnd *gnd_attachFlat(void *data, unsigned long size) {
+	int moved;
+	const struct ROGnd *gnd = (const struct ROGnd*)_flat_attach(data, size, ROINT_FORMAT_GND, sizeof(struct ROGnd), &moved);
+
+	if (gnd != NULL && moved && gnd_verifyFlat(data, size) != 0)
+		return(NULL); // relocated from an unknown address, do not trust it
+	return(gnd);
+}
+
+
+int gnd_verifyFlat(const void *data, unsigned long size) {
+	const struct ROGnd *gnd = (const struct ROGnd*)_flat_verify(data, size, ROINT_FORMAT_GND, sizeof(struct ROGnd));
+	unsigned int i;
+
+	if (gnd == NULL)
+		return(1);
+	// every array must fit in the block
+	if (_mul_over_limit(gnd->width, gnd->height, GND_MAX_CELL_COUNT) ||
+		_flat_checkarray(data, gnd->textures, gnd->texturecount, sizeof(char*)) ||
+		_flat_checkarray(data, gnd->lightmaps, gnd->lightmapcount, sizeof(struct ROGndLightmap)) ||
+		_flat_checkarray(data, gnd->surfaces, gnd->surfacecount, sizeof(struct ROGndSurface)) ||
+		_flat_checkarray(data, gnd->cells, (unsigned long)gnd->width * gnd->height, sizeof(struct ROGndCell))) {
+		_xlog("gnd.verifyFlat : invalid\n");
+		return(1);
+	}
+	for (i = 0; i < gnd->texturecount; i++) {
+		if (_flat_checkstring(data, gnd->textures[i])) {
+			_xlog("gnd.verifyFlat : [%u] invalid texture\n", i);
+			return(1);
+		}
+	}
+	return(0);
+}
+
+
 void gnd_unload(struct ROGnd *gnd) {
 	unsigned int i;
 
 	if (gnd == NULL)
 		return;
+	if (_arena_release(gnd) == 0)
+		return;// loaded in arena mode, everything is released
 
 	if (gnd->textures != NULL) {
 		for (i = 0; i < gnd->texturecount; i++)
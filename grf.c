@@ -24,22 +24,141 @@
 #include "grf.h"
 #include "des.h"
 #include "avl.h"
+#include "atomic.h"
+#include "iostats.h"
+#include "thread.h"
 
 // Using this file in something that is NOT Open-Ragnarok?
-// Don't worry. If you don't have ROINT_INTERNAL defined, this file will automagically use the standard C malloc() and free() functions. You'll only need grf.{c,h} and des.{c.h} files.
+// Don't worry. If you don't have ROINT_INTERNAL defined, this file will automagically use the standard C malloc() and free() functions. You'll only need grf.{c,h}, des.{c.h}, avl.{c,h}, thread.{c,h} and atomic.h files.
 #ifdef ROINT_INTERNAL
 #	include "internal.h"
 #else
 #	define _xlog printf
 #	define _xalloc malloc
 #	define _xfree free
+static unsigned int _xalloc_subsystem(unsigned int subsystem) { return(0); }
 #endif
 
 #include <zlib.h>
 #include <stdlib.h>
 #include <string.h>
 
-void grf_btreesetup(struct ROGrf* grf);
+// Shared index support (POSIX shared memory)
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_SHM_OPEN) && defined(HAVE_UNISTD_H)
+#	define GRF_SHARED_INDEX
+#	include <errno.h>
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <signal.h>
+#	include <sys/stat.h>
+#	include <time.h>
+#	include <unistd.h>
+#endif
+
+// Seconds after which a shared index that is still not ready is considered abandoned
+#define GRF_SHARED_TIMEOUT 30
+
+// Positional reads (POSIX), used by snapshot readers
+#if defined(HAVE_UNISTD_H)
+#	define GRF_PREAD
+#	include <unistd.h>
+#endif
+
+// Mapped views of stored entries
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_UNISTD_H)
+#	define GRF_MMAP
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#endif
+
+// Stored bytes read at a time by grf_peek (multiple of the DES block size)
+#define GRF_PEEK_CHUNK 512
+
+// Bytes deflated by the writer to guess if a big entry compresses
+#define GRF_WRITER_SAMPLE 0x4000
+
+// Extensions of already compressed formats, stored by the writer without trying deflate
+static const char *const GRF_STORED_EXTS[] = {".jpg", ".jpeg", ".png", ".gif", ".wav", ".mp3", ".ogg", ".zip", ".gz", ".rar", ".7z", ".grf", ".gpf", ".rgz", NULL};
+
+// Minimum number of files below the candidate directories to glob them on several threads
+#define GRF_GLOB_PARALLEL 8192
+
+// Watch support (Linux inotify)
+#if defined(HAVE_SYS_INOTIFY_H) && defined(HAVE_UNISTD_H)
+#	define GRF_WATCH
+#	include <sys/inotify.h>
+#	include <unistd.h>
+// The directory is watched: replacing the archive with a rename never touches
+// the inode that is open, so a watch on the file itself would miss it.
+#	define GRF_WATCH_MASK (IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE_SELF | IN_MOVE_SELF)
+#endif
+
+static void grf__btreesetup(struct ROGrfSnapshot *snap);
+static void grf__freedirtree(struct ROGrfDirTree *tree);
+
+
+// Stored entries hold their data as-is, so every length must be the same. (0 if the entry is corrupt)
+static int grf__storedok(const struct ROGrfFile *file) {
+	return(file->compressedLength == file->uncompressedLength &&
+		file->compressedLengthAligned == file->uncompressedLength &&
+		file->uncompressedLength >= 0);
+}
+
+// Returns a pointer to the stored data of file in the mapped archive of snap. (NULL if not stored or not available)
+// The archive is mapped on first use, concurrent callers race to publish their mapping.
+static const void *grf__view(const struct ROGrfSnapshot *snap, const struct ROGrfFile *file) {
+#ifdef GRF_MMAP
+	struct ROGrfSnapshot *snap2 = (struct ROGrfSnapshot*)snap; // the mapping is not part of the immutable state
+	unsigned char *map;
+
+	if (!(file->flags & GRF_FLAG_STORED) || !grf__storedok(file))
+		return(NULL);
+
+	map = (unsigned char*)_xatomic_loadptr(&snap2->map);
+	if (map == NULL) {
+		// only the stored data is mapped, the archive might be growing after it
+		struct stat st;
+		if (fstat(fileno(snap->fp), &st) != 0 || (unsigned long long)st.st_size < snap->mapsize || snap->mapsize <= 46)
+			return(NULL);
+		map = (unsigned char*)mmap(NULL, snap->mapsize, PROT_READ, MAP_SHARED, fileno(snap->fp), 0);
+		if (map == (unsigned char*)MAP_FAILED) {
+			_xlog("grf.view : mmap failed\n");
+			return(NULL);
+		}
+		if (!_xatomic_casptr(&snap2->map, NULL, map)) {
+			munmap(map, snap->mapsize);
+			map = (unsigned char*)_xatomic_loadptr(&snap2->map);
+		}
+	}
+
+	if ((unsigned long)(unsigned int)file->offset + (unsigned int)file->uncompressedLength > snap->mapsize - 46)
+		return(NULL);
+	return(map + 46 + (unsigned int)file->offset);
+#else
+	(void)snap;
+	(void)file;
+	return(NULL);
+#endif
+}
+
+
+const void *grf_getview(const struct ROGrfFile *file) {
+	if (file == NULL || file->grf == NULL || file->grf->current == NULL)
+		return(NULL);
+
+	return(grf__view(file->grf->current, file));
+}
+
+
+const void *grf_snapshot_getview(const struct ROGrfSnapshot *snap, const struct ROGrfFile *file) {
+	if (snap == NULL || file == NULL)
+		return(NULL);
+
+	return(grf__view(snap, file));
+}
+
+int grf__btree_compare(const void* _snap, unsigned int a, unsigned int b);
+int grf__btree_find(const void* _snap, unsigned int a, const void *f);
 
 unsigned int grf_filecount(const struct ROGrf* grf) {
 	unsigned int ret;
@@ -52,14 +171,21 @@ unsigned int grf_filecount(const struct ROGrf* grf) {
 	return(ret);
 }
 
-struct ROGrf *grf_open(const char *fn) {
-	unsigned int compressedLength, uncompressedLength;
+// Reads the GRF header from the start of the file.
+static void grf__readheader(struct ROGrf *grf) {
+	fseek(grf->fp, 0, SEEK_SET);
+	fread(grf->header.signature, 16, 1, grf->fp);
+	fread(grf->header.allowencryption, 14, 1, grf->fp);
+	fread(&grf->header.filetableoffset, sizeof(unsigned int), 1, grf->fp);
+	fread(&grf->header.number1, sizeof(unsigned int), 1, grf->fp);
+	fread(&grf->header.number2, sizeof(unsigned int), 1, grf->fp);
+	fread(&grf->header.version, sizeof(unsigned int), 1, grf->fp);
+}
+
+// Opens the file and reads the GRF header.
+static struct ROGrf *grf__openheader(const char *fn) {
 	FILE *fp;
 	struct ROGrf *ret;
-	unsigned char *headerCompressedBody, *headerBody;
-	unsigned int i, offset;
-	unsigned long ul;
-	unsigned int filecount;
 
 	fp = fopen(fn, "rb");
 	if (fp == NULL) {
@@ -68,275 +194,1253 @@ struct ROGrf *grf_open(const char *fn) {
 	}
 
 	ret = (struct ROGrf*)_xalloc(sizeof(struct ROGrf));
-    ret->btree = NULL;
+	memset(ret, 0, sizeof(struct ROGrf));
+	ret->btree = NULL;
+	ret->watchfd = -1;
+	ret->epoch = 1;
 
 	ret->fp = fp;
+	ret->filename = (char*)_xalloc(strlen(fn) + 1);
+	strcpy(ret->filename, fn);
+
+	grf__readheader(ret);
 
-	// Read header
-	fread(ret->header.signature, 16, 1, ret->fp);
-	fread(ret->header.allowencryption, 14, 1, ret->fp);
-	fread(&ret->header.filetableoffset, sizeof(unsigned int), 1, ret->fp);
-	fread(&ret->header.number1, sizeof(unsigned int), 1, ret->fp);
-	fread(&ret->header.number2, sizeof(unsigned int), 1, ret->fp);
-	fread(&ret->header.version, sizeof(unsigned int), 1, ret->fp);
+	return(ret);
+}
+
+// Reads and uncompresses the file table. (NULL on error)
+static unsigned char *grf__readtable(struct ROGrf *grf) {
+	unsigned int compressedLength, uncompressedLength;
+	unsigned char *headerCompressedBody, *headerBody;
+	unsigned long ul;
 
 	// Start to read the index
-	fseek(fp, ret->header.filetableoffset, SEEK_CUR);
+	fseek(grf->fp, 46 + grf->header.filetableoffset, SEEK_SET);
 
 	// File table header
-	fread(&compressedLength, sizeof(unsigned int), 1, ret->fp);
-	fread(&uncompressedLength, sizeof(unsigned int), 1, ret->fp);
+	fread(&compressedLength, sizeof(unsigned int), 1, grf->fp);
+	fread(&uncompressedLength, sizeof(unsigned int), 1, grf->fp);
 	ul = uncompressedLength;
 
 	headerCompressedBody = (unsigned char*)_xalloc(compressedLength);
 	headerBody = (unsigned char*)_xalloc(uncompressedLength);
 
-	fread(headerCompressedBody, compressedLength, 1, ret->fp);
+	fread(headerCompressedBody, compressedLength, 1, grf->fp);
 	uncompress(headerBody, &ul, headerCompressedBody, compressedLength);
+	_xfree(headerCompressedBody);
 	
 	if (ul == 0) {
 		_xlog("Cannot uncompress FileTableHeader\n");
-		grf_close(ret);
+		_xfree(headerBody);
 		return(NULL);
 	}
 
-	_xfree(headerCompressedBody);
-	
-	// Alloc file array
-	filecount = grf_filecount(ret);
-	ret->files = (struct ROGrfFile*)_xalloc(sizeof(struct ROGrfFile) * filecount);
-	memset(ret->files, 0, sizeof(struct ROGrfFile) * filecount);
-	
-	// Load files from array...
-	offset = 0;
-	for (i = 0; i < filecount; i++) {
-		char c;
-		unsigned int pos;
-		char aux[512];
-
-		pos = 0;
-		memset(aux, 0, 512);
-
-		c = (char)headerBody[offset++];
-		while (c != 0) {
-			aux[pos++] = c;
-			c = (char)headerBody[offset++];
-		}
-
-		// Use string as-is
-		ret->files[i].fileName = (char*)_xalloc(sizeof(char) * (pos + 1));
-		strcpy(ret->files[i].fileName, aux);
-
-		// Load the rest of the file information
-		memcpy(&ret->files[i].compressedLength, headerBody+offset, sizeof(int));
-		offset += sizeof(int);
-		memcpy(&ret->files[i].compressedLengthAligned, headerBody+offset, sizeof(int));
-		offset += sizeof(int);
-		memcpy(&ret->files[i].uncompressedLength, headerBody+offset, sizeof(int));
-		offset += sizeof(int);
-		memcpy(&ret->files[i].flags, headerBody+offset, sizeof(char));
-		offset += sizeof(char);
-		memcpy(&ret->files[i].offset, headerBody+offset, sizeof(int));
-		offset += sizeof(int);
-
-		// Setup cycle for des decrypting purposes
-		if (ret->files[i].flags == 3) {
-			int lop;
-			int srccount;
-			int srclen = ret->files[i].compressedLength;
-			for (lop = 10, srccount = 1; srclen >= lop; lop = lop * 10, srccount++);
-			ret->files[i].cycle = srccount;
-		}
+	return(headerBody);
+}
 
-		// Setup GRF pointer
-		ret->files[i].grf = ret;
+// Parses the file table entry at offset, filling everything except fileName and grf.
+// Returns the name of the entry (points to the file table).
+static const char *grf__parseentry(const unsigned char *headerBody, unsigned int *offset, struct ROGrfFile *file) {
+	const char *name = (const char*)headerBody + *offset;
+
+	*offset += (unsigned int)strlen(name) + 1;
+
+	// Load the rest of the file information
+	memcpy(&file->compressedLength, headerBody + *offset, sizeof(int));
+	*offset += sizeof(int);
+	memcpy(&file->compressedLengthAligned, headerBody + *offset, sizeof(int));
+	*offset += sizeof(int);
+	memcpy(&file->uncompressedLength, headerBody + *offset, sizeof(int));
+	*offset += sizeof(int);
+	memcpy(&file->flags, headerBody + *offset, sizeof(char));
+	*offset += sizeof(char);
+	memcpy(&file->offset, headerBody + *offset, sizeof(int));
+	*offset += sizeof(int);
+
+	// Setup cycle for des decrypting purposes
+	file->cycle = 0;
+	if (file->flags == 3) {
+		int lop;
+		int srccount;
+		int srclen = file->compressedLength;
+		for (lop = 10, srccount = 1; srclen >= lop; lop = lop * 10, srccount++);
+		file->cycle = srccount;
 	}
 
-	_xfree(headerBody);
-    
-    // Setup Binary Tree
-	grf_btreesetup(ret);
+	return(name);
+}
 
-	return(ret);
+// Allocates a snapshot with filecount zeroed entries.
+static struct ROGrfSnapshot *grf__newsnapshot(struct ROGrf *grf, FILE *fp, unsigned int filecount, unsigned int filetableoffset) {
+	struct ROGrfSnapshot *snap = (struct ROGrfSnapshot*)_xalloc(sizeof(struct ROGrfSnapshot));
+
+	memset(snap, 0, sizeof(struct ROGrfSnapshot));
+	snap->grf = grf;
+	snap->fp = fp;
+	snap->filecount = filecount;
+	snap->mapsize = 46 + (unsigned long)filetableoffset; // header and stored data
+	snap->files = (struct ROGrfFile*)_xalloc(sizeof(struct ROGrfFile) * (filecount + 1));
+	memset(snap->files, 0, sizeof(struct ROGrfFile) * (filecount + 1));
+
+	return(snap);
 }
 
-int grf_getdata(struct ROGrfFile *file) {
-	unsigned char *body;
-	unsigned char *uncompressed;
-	unsigned long uncompressedLength;
-	int r;
+// Copies the file names into a single block owned by the snapshot.
+// The fileName of the entries must point to the names to copy.
+static void grf__ownnames(struct ROGrfSnapshot *snap) {
+	size_t size = 0;
+	unsigned int i;
 
-	if (file == NULL)
-		return(1);
+	for (i = 0; i < snap->filecount; i++)
+		size += strlen(snap->files[i].fileName) + 1;
+	snap->names = (char*)_xalloc(size + 1);
+	size = 0;
+	for (i = 0; i < snap->filecount; i++) {
+		size_t len = strlen(snap->files[i].fileName) + 1;
+		memcpy(snap->names + size, snap->files[i].fileName, len);
+		snap->files[i].fileName = snap->names + size;
+		size += len;
+	}
+}
 
-	if (file->grf == NULL)
-		return(1);
+// Releases snap and everything owned by it.
+static void grf__freesnapshot(struct ROGrfSnapshot *snap) {
+	unsigned int i;
 
-	if (file->data != NULL) {
-		_xfree(file->data);
-		file->data = NULL;
+	if (snap->files != NULL) {
+		for (i = 0; i < snap->filecount; i++) {
+			if (snap->files[i].data != NULL)
+				_xfree(snap->files[i].data);
+		}
+		_xfree(snap->files);
 	}
+	if (snap->names != NULL)
+		_xfree(snap->names);
+	if (snap->btree != NULL) {
+		if (snap->btree->nodes != NULL && snap->shared == NULL)
+			_xfree(snap->btree->nodes);
+		_xfree(snap->btree);
+	}
+#ifdef GRF_SHARED_INDEX
+	if (snap->shared != NULL)
+		munmap(snap->shared, snap->sharedsize);
+#endif
+#ifdef GRF_MMAP
+	if (snap->map != NULL)
+		munmap(snap->map, snap->mapsize);
+#endif
+	if (snap->dirtree != NULL)
+		grf__freedirtree(snap->dirtree);
+	if (snap->fp != NULL)
+		fclose(snap->fp);
+	_xfree(snap);
+}
 
-	body = (unsigned char*)_xalloc(file->compressedLengthAligned);
-	uncompressed = (unsigned char*)_xalloc(file->uncompressedLength);
+// Frees the retired snapshots that no reader can see anymore.
+// A reader that announced epoch E can only see snapshots retired in epoch E or later.
+static void grf__reclaim(struct ROGrf *grf) {
+	struct ROGrfSnapshot **link;
+	unsigned int i, oldest = 0;
+	int active = 0;
+
+	for (i = 0; i < GRF_MAX_READERS; i++) {
+		unsigned int epoch = _xatomic_load(&grf->readers[i]);
+		if (epoch != 0 && (!active || epoch < oldest)) {
+			oldest = epoch;
+			active = 1;
+		}
+	}
 
-	fseek(file->grf->fp, 46 + file->offset, SEEK_SET);
-	fread(body, file->compressedLengthAligned, 1, file->grf->fp);
+	link = &grf->retired;
+	while (*link != NULL) {
+		struct ROGrfSnapshot *snap = *link;
+		if (!active || snap->retired < oldest) {
+			*link = snap->next;
+			grf__freesnapshot(snap);
+		}
+		else
+			link = &snap->next;
+	}
+}
 
-	if ((file->flags == 3) || (file->flags == 5)) {
-		// Decode DES
-		des_decode(body, file->compressedLengthAligned, file->cycle);
+// Makes snap the current snapshot. The previous one is retired until its readers leave.
+static void grf__publish(struct ROGrf *grf, struct ROGrfSnapshot *snap) {
+	struct ROGrfSnapshot *old;
+	unsigned int epoch;
+
+	grf->fp = snap->fp;
+	grf->files = snap->files;
+	grf->btree = snap->btree;
+
+	old = (struct ROGrfSnapshot*)_xatomic_xchgptr((void*volatile*)&grf->current, snap);
+	if (old != NULL) {
+		// readers that see the new epoch also see the new snapshot
+		epoch = _xatomic_load(&grf->epoch);
+		old->retired = epoch;
+		old->next = grf->retired;
+		grf->retired = old;
+		if (++epoch == 0)
+			epoch = 1; // 0 marks free reader slots
+		_xatomic_store(&grf->epoch, epoch);
 	}
 
-	uncompressedLength = file->uncompressedLength;
+	grf__reclaim(grf);
+}
 
-	r = uncompress(uncompressed, &uncompressedLength, body, file->compressedLengthAligned);
-	if (r != Z_OK) {
-		_xfree(body);
-		_xfree(uncompressed);
+// Reads the file table and builds the first snapshot. Returns 0 on success.
+static int grf__loadtable(struct ROGrf *ret) {
+	struct ROGrfSnapshot *snap;
+	unsigned char *headerBody;
+	unsigned int i, offset;
 
-		switch(r) {
-			case Z_MEM_ERROR:
-				_xlog("Error uncompressing data Z_MEM_ERROR\n");
-				break;
-			case Z_BUF_ERROR:
-				_xlog("Error uncompressing data Z_BUF_ERROR\n");
-				break;
-			case Z_STREAM_ERROR:
-				_xlog("Error uncompressing data Z_STREAM_ERROR\n");
-				break;
-			case Z_DATA_ERROR:
-				_xlog("Error uncompressing data Z_DATA_ERROR\n");
-				break;
-			default:
-				_xlog("Unknown error when uncompressing data: %d\n", r);
-				break;
-		}
+	headerBody = grf__readtable(ret);
+	if (headerBody == NULL)
 		return(1);
+
+	snap = grf__newsnapshot(ret, ret->fp, grf_filecount(ret), ret->header.filetableoffset);
+
+	// Load files from array...
+	offset = 0;
+	for (i = 0; i < snap->filecount; i++) {
+		snap->files[i].fileName = (char*)grf__parseentry(headerBody, &offset, &snap->files[i]);
+
+		// Setup GRF pointer
+		snap->files[i].grf = ret;
 	}
+	grf__ownnames(snap);
 
-	file->data = uncompressed;
-	_xfree(body);
+	_xfree(headerBody);
+
+	// Setup Binary Tree
+	grf__btreesetup(snap);
+
+	grf__publish(ret, snap);
 
 	return(0);
 }
 
-void grf_freedata(struct ROGrfFile *file) {
-	if (file->data != NULL)
-		_xfree(file->data);
+static struct ROGrf *grf__open(const char *fn) {
+	struct ROGrf *ret;
 
-	file->data = NULL;
-}
+	ret = grf__openheader(fn);
+	if (ret == NULL)
+		return(NULL);
 
-struct ROGrfFile *grf_getfileinfo(const struct ROGrf* grf, unsigned int idx) {
-	if (idx >= grf_filecount(grf)) {
+	if (grf__loadtable(ret) != 0) {
+		grf_close(ret);
 		return(NULL);
 	}
 
-	return(&(grf->files[idx]));
+	return(ret);
 }
 
-int grf__btree_compare(const void* _grf, unsigned int a, unsigned int b) {
-	const struct ROGrf *grf = (const struct ROGrf*)_grf;
-	return(strcmp(grf->files[a].fileName, grf->files[b].fileName));
+
+struct ROGrf *grf_open(const char *fn) {
+	unsigned int subsystem = _xalloc_subsystem(ROINT_FORMAT_GRF);
+	struct ROGrf *ret = grf__open(fn);
+
+	_xalloc_subsystem(subsystem);
+	return(ret);
 }
 
-int grf__btree_find(const void* _grf, unsigned int a, const void *f) {
-	const char *fn = (const char*)f;
-	const struct ROGrf *grf = (const struct ROGrf*)_grf;
-	return(strcmp(grf->files[a].fileName, fn));
+
+// Two entries describe the same stored data.
+static int grf__samedata(const struct ROGrfFile *a, const struct ROGrfFile *b) {
+	return(a->compressedLength == b->compressedLength &&
+		a->compressedLengthAligned == b->compressedLengthAligned &&
+		a->uncompressedLength == b->uncompressedLength &&
+		a->flags == b->flags &&
+		a->offset == b->offset);
 }
 
-void grf_btreesetup(struct ROGrf* grf) {
-	unsigned int *path;
-	unsigned int i;
-	struct BTreeNode *nodes;
-	unsigned int filecount;
 
-	if (grf->btree != NULL) {
-		_xlog("Error trying to setup btree twice.");
-		return;
+static int grf__reload(struct ROGrf *grf) {
+	struct ROGrf next;
+	struct ROGrfSnapshot *old, *snap;
+	unsigned char *headerBody;
+	unsigned int oldcount, newcount, added, i, offset;
+	int *match;
+	unsigned char *used;
+	int rebuild;
+
+	if (grf == NULL || grf->filename == NULL || grf->current == NULL)
+		return(1);
+
+	// reopen, the archive might have been replaced instead of patched in place
+	memset(&next, 0, sizeof(next));
+	next.fp = fopen(grf->filename, "rb");
+	if (next.fp == NULL) {
+		_xlog("grf.reload : cannot open file %s\n", grf->filename);
+		return(1);
+	}
+	grf__readheader(&next);
+	headerBody = grf__readtable(&next);
+	if (headerBody == NULL) {
+		fclose(next.fp);
+		return(1);
 	}
 
-	filecount = grf_filecount(grf);
-	path = (unsigned int*)malloc(sizeof(unsigned int) * (filecount/2) + 2);
+	// match new entries with the current ones by name
+	old = grf->current; // only the writer changes it
+	oldcount = old->filecount;
+	newcount = grf_filecount(&next);
+	match = (int*)_xalloc(sizeof(int) * (newcount + 1));
+	used = (unsigned char*)_xalloc(oldcount + 1);
+	memset(used, 0, oldcount + 1);
+	added = 0;
+	rebuild = 0;
+	offset = 0;
+	for (i = 0; i < newcount; i++) {
+		struct ROGrfFile tmp;
+		const char *name = grf__parseentry(headerBody, &offset, &tmp);
+		match[i] = __btree_find(old->btree, name);
+		if (match[i] == -1)
+			added++;
+		else if (used[match[i]])
+			rebuild = 1; // duplicate name
+		else
+			used[match[i]] = 1;
+	}
+	if (newcount - added != oldcount)
+		rebuild = 1; // entries were removed
 
-	grf->btree = (struct BTree*)_xalloc(sizeof(struct BTree));
-	grf->btree->nodes = (struct BTreeNode*)_xalloc(sizeof(struct BTreeNode) * filecount);
-	nodes = grf->btree->nodes;
-	grf->btree->root = 0;
-	grf->btree->_internalData = grf;
-	grf->btree->compareFunc = &grf__btree_compare;
-	grf->btree->findFunc = &grf__btree_find;
-    
-    nodes[0].left = -1;
-    nodes[0].right = -1;
-    for (i = 1; i < filecount; i++) {
-        nodes[i].left = -1;
-        nodes[i].right = -1;
-		__btree_add(grf->btree, i, path);
+	// build the new snapshot, the old one is left untouched for its readers
+	snap = grf__newsnapshot(grf, next.fp, newcount, next.header.filetableoffset);
+	offset = 0;
+	added = 0;
+	for (i = 0; i < newcount; i++) {
+		struct ROGrfFile *file;
+		unsigned int idx;
+
+		// without a rebuild, existing entries keep their index and new entries are appended
+		if (rebuild)
+			idx = i;
+		else if (match[i] == -1)
+			idx = oldcount + added++;
+		else
+			idx = (unsigned int)match[i];
+		file = &snap->files[idx];
+		file->fileName = (char*)grf__parseentry(headerBody, &offset, file);
+		file->grf = grf;
+		if (match[i] != -1 && grf__samedata(&old->files[match[i]], file)) {
+			// the data cache is not part of the snapshot
+			file->data = old->files[match[i]].data;
+			old->files[match[i]].data = NULL;
+		}
+	}
+	grf__ownnames(snap);
+	_xfree(headerBody);
+	_xfree(match);
+	_xfree(used);
+
+	// drop the cached data of entries that changed or were removed
+	for (i = 0; i < oldcount; i++) {
+		if (old->files[i].data != NULL) {
+			_xfree(old->files[i].data);
+			old->files[i].data = NULL;
+		}
+	}
 
-    }
+	if (rebuild || oldcount == 0)
+		grf__btreesetup(snap);
+	else {
+		// copy the current tree and insert the new entries
+		unsigned int *path = (unsigned int*)_xalloc(sizeof(unsigned int) * (newcount/2 + 2));
+		snap->btree = (struct BTree*)_xalloc(sizeof(struct BTree));
+		snap->btree->nodes = (struct BTreeNode*)_xalloc(sizeof(struct BTreeNode) * newcount);
+		memcpy(snap->btree->nodes, old->btree->nodes, sizeof(struct BTreeNode) * oldcount);
+		snap->btree->root = old->btree->root;
+		snap->btree->_internalData = snap;
+		snap->btree->compareFunc = &grf__btree_compare;
+		snap->btree->findFunc = &grf__btree_find;
+		for (i = oldcount; i < newcount; i++) {
+			snap->btree->nodes[i].left = -1;
+			snap->btree->nodes[i].right = -1;
+			__btree_add(snap->btree, i, path);
+		}
+		_xfree(path);
+	}
 
-	free(path);
+	memcpy(&grf->header, &next.header, sizeof(grf->header));
+	grf__publish(grf, snap);
+
+	return(0);
+}
+
+
+int grf_reload(struct ROGrf *grf) {
+	unsigned int subsystem = _xalloc_subsystem(ROINT_FORMAT_GRF);
+	int ret = grf__reload(grf);
+
+	_xalloc_subsystem(subsystem);
+	return(ret);
+}
+
+
+#ifdef GRF_WATCH
+// Returns the name of the GRF file inside its directory.
+static const char *grf__watchname(const struct ROGrf *grf) {
+	const char *slash = strrchr(grf->filename, '/');
+	return((slash != NULL)? slash + 1: grf->filename);
+}
+
+
+// Adds (or updates) the watch on the directory of the GRF file. Returns the watch descriptor, -1 on error.
+static int grf__watchdir(const struct ROGrf *grf) {
+	const char *name = grf__watchname(grf);
+	size_t len = (size_t)(name - grf->filename);
+	char *dir;
+	int wd;
+
+	if (len == 0)
+		return(inotify_add_watch(grf->watchfd, ".", GRF_WATCH_MASK));
+	if (len == 1)
+		return(inotify_add_watch(grf->watchfd, "/", GRF_WATCH_MASK));
+	dir = (char*)_xalloc(len);
+	memcpy(dir, grf->filename, len - 1); // without the slash
+	dir[len - 1] = 0;
+	wd = inotify_add_watch(grf->watchfd, dir, GRF_WATCH_MASK);
+	_xfree(dir);
+	return(wd);
+}
+#endif
+
+
+int grf_watch(struct ROGrf *grf) {
+#ifdef GRF_WATCH
+	if (grf == NULL || grf->filename == NULL)
+		return(1);
+	if (grf->watchfd != -1)
+		return(0); // already watching
+
+	grf->watchfd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (grf->watchfd == -1) {
+		_xlog("grf.watch : inotify_init1 failed\n");
+		return(1);
+	}
+	grf->watchwd = grf__watchdir(grf);
+	if (grf->watchwd == -1) {
+		_xlog("grf.watch : inotify_add_watch failed\n");
+		close(grf->watchfd);
+		grf->watchfd = -1;
+		return(1);
+	}
+	return(0);
+#else
+	_xlog("grf.watch : not supported\n");
+	return(1);
+#endif
 }
 
-// Releases grf an all data allocated by it.
-void grf_close(struct ROGrf *grf) {
-	unsigned int i;
 
+int grf_watchfd(const struct ROGrf *grf) {
 	if (grf == NULL)
-		return;
+		return(-1);
+	return(grf->watchfd);
+}
 
-	if (grf->files != NULL) {
-		for (i = 0; i < grf_filecount(grf); i++) {
-			if (grf->files[i].fileName != NULL)
-				_xfree(grf->files[i].fileName);
-			if (grf->files[i].data != NULL)
-				_xfree(grf->files[i].data);
+
+int grf_poll(struct ROGrf *grf) {
+#ifdef GRF_WATCH
+	char buf[4096];
+	ssize_t len;
+	const char *name;
+	int changed = 0;
+	int wd;
+
+	if (grf == NULL || grf->watchfd == -1)
+		return(-1);
+
+	name = grf__watchname(grf);
+	while ((len = read(grf->watchfd, buf, sizeof(buf))) > 0) {
+		char *ptr = buf;
+		while (ptr < buf + len) {
+			const struct inotify_event *evt = (const struct inotify_event*)ptr;
+			if (evt->wd == grf->watchwd) {
+				if ((evt->mask & (IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE)) && evt->len > 0 && strcmp(evt->name, name) == 0)
+					changed = 1; // written in place, or replaced by a rename or a new file
+				if (evt->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))
+					changed = 1; // the directory itself was replaced
+			}
+			ptr += sizeof(struct inotify_event) + evt->len;
 		}
-		_xfree(grf->files);
 	}
+	if (!changed)
+		return(0);
 
-	if (grf->fp != NULL)
-		fclose(grf->fp);
-    
-    if (grf->btree != NULL) {
-		if (grf->btree->nodes != NULL)
-			_xfree(grf->btree->nodes);
-        _xfree(grf->btree);
+	// re-arm, the path might lead to another directory now
+	wd = grf__watchdir(grf);
+	if (wd != -1 && wd != grf->watchwd) {
+		inotify_rm_watch(grf->watchfd, grf->watchwd);
+		grf->watchwd = wd;
 	}
+	if (grf_reload(grf) != 0)
+		return(-1);
+	return(1);
+#else
+	return(-1);
+#endif
+}
 
-	_xfree(grf);
+
+#ifdef GRF_SHARED_INDEX
+// Layout of the shared index segment. Everything is addressed with offsets
+// from the start of the segment so each process can map it anywhere.
+//  [header][entries][btree nodes][file names]
+struct _grf_shared_header {
+	char magic[8]; // "ROGRFI2"
+	volatile unsigned int ready; // set to 1 by the publisher once everything else is written
+	unsigned int pid; // publisher, to detect a publisher that died before setting ready
+	unsigned int filecount;
+	int root;
+	unsigned int entriesoffset;
+	unsigned int nodesoffset;
+	unsigned int namesoffset;
+	unsigned int namessize;
+	unsigned int filetableoffset, number1, number2, version; // copy of the archive header
+};
+
+struct _grf_shared_entry {
+	unsigned int nameoffset; // relative to namesoffset
+	int compressedLength;
+	int compressedLengthAligned;
+	int uncompressedLength;
+	int offset;
+	int cycle;
+	char flags;
+};
+
+static const char GRF_SHARED_MAGIC[8] = {'R','O','G','R','F','I','2',0};
+
+
+// Builds the shared memory object name from the archive identity (device, inode, size and modification time).
+// A patched archive gets a different name, so stale indexes are never attached.
+static int grf__sharedname(const char *fn, char *name, size_t namelen) {
+	struct stat st;
+	unsigned long long key[4];
+	unsigned long long hash = 14695981039346656037ULL; // FNV-1a
+	const unsigned char *ptr = (const unsigned char*)key;
+	size_t i;
+
+	if (stat(fn, &st) != 0) {
+		_xlog("grf.sharedname : %s\n", strerror(errno));
+		return(1);
+	}
+	key[0] = (unsigned long long)st.st_dev;
+	key[1] = (unsigned long long)st.st_ino;
+	key[2] = (unsigned long long)st.st_size;
+	key[3] = (unsigned long long)st.st_mtime;
+	for (i = 0; i < sizeof(key); i++) {
+		hash ^= ptr[i];
+		hash *= 1099511628211ULL;
+	}
+	snprintf(name, namelen, "/roint-grf-%016llx", hash);
+	return(0);
 }
 
-// Searches the binary tree and retrieves the file information required (or NULL if not found)
-struct ROGrfFile *grf_getfileinfobyname(const struct ROGrf* grf, const char* fn) {
-    if (NULL == grf)
-        return(NULL);
 
-	int idx = __btree_find(grf->btree, fn);
+// Checks that every offset and index of a ready shared index stays inside the segment. Returns 0 if valid.
+// The search tree must be a tree (each node has one parent, the root none), or lookups could loop.
+static int grf__checkshared(const unsigned char *shm, size_t size) {
+	const struct _grf_shared_header *header = (const struct _grf_shared_header*)shm;
+	const struct _grf_shared_entry *entries;
+	const struct BTreeNode *nodes;
+	const char *names;
+	unsigned char *parents;
+	unsigned int filecount = header->filecount;
+	unsigned int i;
+	int ret = 0;
+
+	if (header->entriesoffset < sizeof(struct _grf_shared_header) ||
+		header->entriesoffset % sizeof(int) != 0 ||
+		(unsigned long long)header->entriesoffset + (unsigned long long)sizeof(struct _grf_shared_entry) * filecount > size ||
+		header->nodesoffset < sizeof(struct _grf_shared_header) ||
+		header->nodesoffset % sizeof(int) != 0 ||
+		(unsigned long long)header->nodesoffset + (unsigned long long)sizeof(struct BTreeNode) * filecount > size ||
+		(unsigned long long)header->namesoffset + header->namessize > size ||
+		(filecount == 0 && header->root != -1) ||
+		(filecount > 0 && (header->root < 0 || (unsigned int)header->root >= filecount)))
+		return(1);
+	if (filecount == 0)
+		return(0);
 
-	if (idx == -1)
-		return(NULL);
-    
-    return(&grf->files[idx]);
+	entries = (const struct _grf_shared_entry*)(shm + header->entriesoffset);
+	nodes = (const struct BTreeNode*)(shm + header->nodesoffset);
+	names = (const char*)(shm + header->namesoffset);
+	if (header->namessize == 0 || names[header->namessize - 1] != 0)
+		return(1); // the last name must be terminated inside the segment
+	for (i = 0; i < filecount; i++)
+		if (entries[i].nameoffset >= header->namessize)
+			return(1);
+
+	parents = (unsigned char*)_xalloc(filecount);
+	if (parents == NULL)
+		return(1);
+	memset(parents, 0, filecount);
+	parents[header->root] = 1;
+	for (i = 0; i < filecount && ret == 0; i++) {
+		int child[2];
+		int j;
+		child[0] = nodes[i].left;
+		child[1] = nodes[i].right;
+		for (j = 0; j < 2; j++) {
+			if (child[j] == -1)
+				continue;
+			if (child[j] < 0 || (unsigned int)child[j] >= filecount || parents[child[j]] != 0) {
+				ret = 1;
+				break;
+			}
+			parents[child[j]] = 1;
+		}
+	}
+	_xfree(parents);
+	return(ret);
 }
 
-void grf_walk_node(const struct ROGrf* grf, t_grf_walk_function_ptr fptr, int node, void* aux) {
-	if (node == -1)
-		return;
-
-	if (grf->btree->nodes[node].left != -1)
-		grf_walk_node(grf, fptr, grf->btree->nodes[node].left, aux);
 
-	fptr(&grf->files[node], aux);
+// Returns 1 if a shared index that is not ready was abandoned by its publisher.
+static int grf__staleshared(const unsigned char *shm, size_t size, const struct stat *st) {
+	const struct _grf_shared_header *header = (const struct _grf_shared_header*)shm;
 
-	if (grf->btree->nodes[node].right != -1)
-		grf_walk_node(grf, fptr, grf->btree->nodes[node].right, aux);
+	if (size >= sizeof(struct _grf_shared_header) && header->pid != 0 &&
+		kill((pid_t)header->pid, 0) != 0 && errno == ESRCH)
+		return(1); // the publisher is gone
+	return(time(NULL) - st->st_ctime > GRF_SHARED_TIMEOUT);
 }
 
-void grf_walk(const struct ROGrf* grf, t_grf_walk_function_ptr fptr, void* aux) {
+
+// Maps an existing shared index into grf.
+// Returns 0 on success, 1 if it can not be used now (being published or not ours),
+// 2 if it is ours and stale (abandoned, invalid or incompatible) and can be replaced.
+static int grf__attachshared(struct ROGrf *grf, int fd) {
+	struct stat st;
+	const struct _grf_shared_header *header;
+	const struct _grf_shared_entry *entries;
+	const char *names;
+	struct ROGrfSnapshot *snap;
+	unsigned char *shm;
+	size_t size;
+	unsigned int i;
+
+	if (fstat(fd, &st) != 0)
+		return(1);
+	if (st.st_uid != geteuid()) {
+		_xlog("grf.attachshared : index owned by another user (uid=%u)\n", (unsigned int)st.st_uid);
+		return(1);
+	}
+	size = (size_t)st.st_size;
+	if (size < sizeof(struct _grf_shared_header))
+		return((time(NULL) - st.st_ctime > GRF_SHARED_TIMEOUT)? 2: 1); // not sized yet
+	shm = (unsigned char*)mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	if (shm == (unsigned char*)MAP_FAILED)
+		return(1);
+
+	header = (const struct _grf_shared_header*)shm;
+	if (header->ready != 1) {
+		int stale = grf__staleshared(shm, size, &st);
+		munmap(shm, size);
+		return((stale)? 2: 1);
+	}
+	__sync_synchronize(); // read everything after the ready flag
+	if (memcmp(header->magic, GRF_SHARED_MAGIC, sizeof(GRF_SHARED_MAGIC)) != 0 ||
+		header->filecount != grf_filecount(grf) ||
+		header->filetableoffset != grf->header.filetableoffset ||
+		header->number1 != grf->header.number1 ||
+		header->number2 != grf->header.number2 ||
+		header->version != grf->header.version ||
+		grf__checkshared(shm, size) != 0) {
+		_xlog("grf.attachshared : invalid or incompatible index\n");
+		munmap(shm, size);
+		return(2);
+	}
+
+	entries = (const struct _grf_shared_entry*)(shm + header->entriesoffset);
+	names = (const char*)(shm + header->namesoffset);
+
+	snap = grf__newsnapshot(grf, grf->fp, header->filecount, grf->header.filetableoffset);
+	snap->shared = shm;
+	snap->sharedsize = (unsigned long)size;
+	for (i = 0; i < header->filecount; i++) {
+		struct ROGrfFile *file = &snap->files[i];
+		const struct _grf_shared_entry *entry = &entries[i];
+		file->fileName = (char*)(names + entry->nameoffset); // read-only, lives in the segment
+		file->compressedLength = entry->compressedLength;
+		file->compressedLengthAligned = entry->compressedLengthAligned;
+		file->uncompressedLength = entry->uncompressedLength;
+		file->flags = entry->flags;
+		file->offset = entry->offset;
+		file->cycle = entry->cycle;
+		file->grf = grf;
+	}
+
+	snap->btree = (struct BTree*)_xalloc(sizeof(struct BTree));
+	snap->btree->nodes = (struct BTreeNode*)(shm + header->nodesoffset); // read-only, lives in the segment
+	snap->btree->root = header->root;
+	snap->btree->_internalData = snap;
+	snap->btree->compareFunc = &grf__btree_compare;
+	snap->btree->findFunc = &grf__btree_find;
+
+	grf__publish(grf, snap);
+
+	return(0);
+}
+
+
+// Publishes the index of grf in a new shared memory object. Returns 0 on success.
+static int grf__publishshared(const struct ROGrf *grf, const char *name) {
+	struct _grf_shared_header *header;
+	struct _grf_shared_entry *entries;
+	unsigned char *shm;
+	char *names;
+	unsigned int filecount = grf_filecount(grf);
+	size_t namessize, size;
+	unsigned int i;
+	int fd;
+
+	namessize = 0;
+	for (i = 0; i < filecount; i++)
+		namessize += strlen(grf->files[i].fileName) + 1;
+	size = sizeof(struct _grf_shared_header) +
+		sizeof(struct _grf_shared_entry) * filecount +
+		sizeof(struct BTreeNode) * filecount +
+		namessize;
+	if (size > 0xFFFFFFFF) {
+		_xlog("grf.publishshared : index too big\n");
+		return(1);
+	}
+
+	fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd == -1)
+		return(1); // already published (or being published) by someone else
+	if (ftruncate(fd, (off_t)size) != 0) {
+		_xlog("grf.publishshared : %s\n", strerror(errno));
+		close(fd);
+		shm_unlink(name);
+		return(1);
+	}
+	shm = (unsigned char*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (shm == (unsigned char*)MAP_FAILED) {
+		_xlog("grf.publishshared : %s\n", strerror(errno));
+		shm_unlink(name);
+		return(1);
+	}
+
+	header = (struct _grf_shared_header*)shm;
+	header->pid = (unsigned int)getpid();
+	header->filecount = filecount;
+	header->root = grf->btree->root;
+	header->entriesoffset = sizeof(struct _grf_shared_header);
+	header->nodesoffset = header->entriesoffset + sizeof(struct _grf_shared_entry) * filecount;
+	header->namesoffset = header->nodesoffset + sizeof(struct BTreeNode) * filecount;
+	header->namessize = (unsigned int)namessize;
+	header->filetableoffset = grf->header.filetableoffset;
+	header->number1 = grf->header.number1;
+	header->number2 = grf->header.number2;
+	header->version = grf->header.version;
+
+	entries = (struct _grf_shared_entry*)(shm + header->entriesoffset);
+	names = (char*)(shm + header->namesoffset);
+	namessize = 0;
+	for (i = 0; i < filecount; i++) {
+		const struct ROGrfFile *file = &grf->files[i];
+		size_t len = strlen(file->fileName) + 1;
+		entries[i].nameoffset = (unsigned int)namessize;
+		entries[i].compressedLength = file->compressedLength;
+		entries[i].compressedLengthAligned = file->compressedLengthAligned;
+		entries[i].uncompressedLength = file->uncompressedLength;
+		entries[i].offset = file->offset;
+		entries[i].cycle = file->cycle;
+		entries[i].flags = file->flags;
+		memcpy(names + namessize, file->fileName, len);
+		namessize += len;
+	}
+	memcpy(shm + header->nodesoffset, grf->btree->nodes, sizeof(struct BTreeNode) * filecount);
+
+	// make everything visible before flagging the segment as ready
+	memcpy(header->magic, GRF_SHARED_MAGIC, sizeof(GRF_SHARED_MAGIC));
+	__sync_synchronize();
+	header->ready = 1;
+
+	munmap(shm, size);
+	return(0);
+}
+#endif
+
+
+static struct ROGrf *grf__open_shared(const char *fn) {
+#ifdef GRF_SHARED_INDEX
+	struct ROGrf *ret;
+	char name[64];
+	int fd;
+
+	if (grf__sharedname(fn, name, sizeof(name)) != 0)
+		return(grf_open(fn));
+
+	fd = shm_open(name, O_RDONLY, 0);
+	if (fd != -1) {
+		int attached;
+		ret = grf__openheader(fn);
+		if (ret == NULL) {
+			close(fd);
+			return(NULL);
+		}
+		attached = grf__attachshared(ret, fd);
+		close(fd);
+		if (attached == 0)
+			return(ret);
+		grf_close(ret);
+		if (attached == 1)
+			return(grf_open(fn)); // being published or not ours, build a private index
+		// stale, replace it
+		shm_unlink(name);
+	}
+
+	ret = grf_open(fn);
+	if (ret != NULL)
+		grf__publishshared(ret, name);
+	return(ret);
+#else
+	return(grf_open(fn));
+#endif
+}
+
+
+struct ROGrf *grf_open_shared(const char *fn) {
+	unsigned int subsystem = _xalloc_subsystem(ROINT_FORMAT_GRF);
+	struct ROGrf *ret = grf__open_shared(fn);
+
+	_xalloc_subsystem(subsystem);
+	return(ret);
+}
+
+
+int grf_unlink_shared(const char *fn) {
+#ifdef GRF_SHARED_INDEX
+	char name[64];
+
+	if (grf__sharedname(fn, name, sizeof(name)) != 0)
+		return(1);
+	if (shm_unlink(name) != 0) {
+		_xlog("grf.unlink_shared : %s\n", strerror(errno));
+		return(1);
+	}
+	return(0);
+#else
+	return(1);
+#endif
+}
+
+// Reads len bytes of stored data at offset (relative to the end of the GRF header). Returns 0 on success.
+// Uses positional reads when available so several threads can read from the same fp.
+static int grf__readat(FILE *fp, unsigned char *buf, size_t len, unsigned int offset) {
+#ifdef GRF_PREAD
+	if (pread(fileno(fp), buf, len, 46 + (off_t)offset) != (ssize_t)len)
+		return(1);
+#else
+	fseek(fp, 46 + offset, SEEK_SET);
+	if (fread(buf, len, 1, fp) != 1 && len != 0)
+		return(1);
+#endif
+	return(0);
+}
+
+// Same as grf__readat, counted in stats if not NULL.
+static int grf__readatcounted(FILE *fp, unsigned char *buf, size_t len, unsigned int offset, struct ROIoStats *stats) {
+	unsigned long long start;
+	int ret;
+
+	if (stats == NULL)
+		return(grf__readat(fp, buf, len, offset));
+	start = _iostats_now();
+	ret = grf__readat(fp, buf, len, offset);
+	stats->iotime += _iostats_now() - start;
+	stats->calls++;
+	if (ret == 0)
+		stats->bytes += len;
+	return(ret);
+}
+
+// Reads the stored data of file from fp and uncompresses it into uncompressed. Returns 0 on success.
+// The reads are counted in stats if not NULL.
+static int grf__readcounted(FILE *fp, const struct ROGrfFile *file, unsigned char *uncompressed, struct ROIoStats *stats) {
+	unsigned char *body;
+	unsigned long uncompressedLength;
+	int r;
+
+	if (file->flags & GRF_FLAG_STORED) {
+		// stored as-is, read straight into the destination
+		if (!grf__storedok(file)) {
+			_xlog("grf.read : bad lengths for stored file %s\n", file->fileName);
+			return(1);
+		}
+		if (grf__readatcounted(fp, uncompressed, file->uncompressedLength, (unsigned int)file->offset, stats) != 0) {
+			_xlog("grf.read : cannot read %s\n", file->fileName);
+			return(1);
+		}
+		return(0);
+	}
+
+	body = (unsigned char*)_xalloc(file->compressedLengthAligned);
+
+	if (grf__readatcounted(fp, body, file->compressedLengthAligned, (unsigned int)file->offset, stats) != 0) {
+		_xlog("grf.read : cannot read %s\n", file->fileName);
+		_xfree(body);
+		return(1);
+	}
+
+	if ((file->flags == 3) || (file->flags == 5)) {
+		// Decode DES
+		des_decode(body, file->compressedLengthAligned, file->cycle);
+	}
+
+	uncompressedLength = file->uncompressedLength;
+
+	r = uncompress(uncompressed, &uncompressedLength, body, file->compressedLengthAligned);
+	_xfree(body);
+	if (r != Z_OK) {
+		switch(r) {
+			case Z_MEM_ERROR:
+				_xlog("Error uncompressing data Z_MEM_ERROR\n");
+				break;
+			case Z_BUF_ERROR:
+				_xlog("Error uncompressing data Z_BUF_ERROR\n");
+				break;
+			case Z_STREAM_ERROR:
+				_xlog("Error uncompressing data Z_STREAM_ERROR\n");
+				break;
+			case Z_DATA_ERROR:
+				_xlog("Error uncompressing data Z_DATA_ERROR\n");
+				break;
+			default:
+				_xlog("Unknown error when uncompressing data: %d\n", r);
+				break;
+		}
+		return(1);
+	}
+
+	return(0);
+}
+
+// Reads the stored data of file from fp and uncompresses it into uncompressed. Returns 0 on success.
+// Adds the work to the ROINT_FORMAT_GRF load totals when the I/O counters are enabled.
+static int grf__read(FILE *fp, const struct ROGrfFile *file, unsigned char *uncompressed) {
+	struct ROIoStats stats;
+	unsigned long long start;
+	int ret;
+
+	if (!_iostats_enabled())
+		return(grf__readcounted(fp, file, uncompressed, NULL));
+	memset(&stats, 0, sizeof(struct ROIoStats));
+	start = _iostats_now();
+	ret = grf__readcounted(fp, file, uncompressed, &stats);
+	stats.count = 1;
+	stats.time = _iostats_now() - start;
+	_iostats_add(ROINT_FORMAT_GRF, 0, &stats);
+	return(ret);
+}
+
+// Uncompresses the first n bytes of file into buf, reading and decoding only the stored data that is needed.
+// Returns the number of bytes stored in buf or -1 on error.
+static int grf__peek(FILE *fp, const struct ROGrfFile *file, unsigned char *buf, unsigned int n) {
+	unsigned char body[GRF_PEEK_CHUNK];
+	unsigned int pos, len;
+	z_stream stream;
+	int r;
+
+	if (n > (unsigned int)file->uncompressedLength)
+		n = (unsigned int)file->uncompressedLength;
+	if (n == 0)
+		return(0);
+
+	if (file->flags & GRF_FLAG_STORED) {
+		if (!grf__storedok(file)) {
+			_xlog("grf.peek : bad lengths for stored file %s\n", file->fileName);
+			return(-1);
+		}
+		if (grf__readat(fp, buf, n, (unsigned int)file->offset) != 0) {
+			_xlog("grf.peek : cannot read %s\n", file->fileName);
+			return(-1);
+		}
+		return((int)n);
+	}
+
+	memset(&stream, 0, sizeof(stream));
+	if (inflateInit(&stream) != Z_OK) {
+		_xlog("grf.peek : inflateInit failed\n");
+		return(-1);
+	}
+	stream.next_out = buf;
+	stream.avail_out = n;
+
+	r = Z_OK;
+	for (pos = 0; pos < (unsigned int)file->compressedLengthAligned && stream.avail_out > 0 && r != Z_STREAM_END; pos += len) {
+		len = (unsigned int)file->compressedLengthAligned - pos;
+		if (len > GRF_PEEK_CHUNK)
+			len = GRF_PEEK_CHUNK;
+		if (grf__readat(fp, body, len, (unsigned int)file->offset + pos) != 0) {
+			_xlog("grf.peek : cannot read %s\n", file->fileName);
+			inflateEnd(&stream);
+			return(-1);
+		}
+		if ((file->flags == 3) || (file->flags == 5)) {
+			// Decode DES (chunks are a multiple of the block size)
+			des_decode_blocks(body, len, file->cycle, pos / 8);
+		}
+
+		stream.next_in = body;
+		stream.avail_in = len;
+		r = inflate(&stream, Z_SYNC_FLUSH);
+		if (r != Z_OK && r != Z_STREAM_END && r != Z_BUF_ERROR) {
+			_xlog("grf.peek : error uncompressing %s: %d\n", file->fileName, r);
+			inflateEnd(&stream);
+			return(-1);
+		}
+	}
+	inflateEnd(&stream);
+
+	return((int)(n - stream.avail_out));
+}
+
+static int grf__getdata(struct ROGrfFile *file) {
+	unsigned char *uncompressed;
+
+	if (file == NULL)
+		return(1);
+
+	if (file->grf == NULL)
+		return(1);
+
+	if (file->data != NULL) {
+		_xfree(file->data);
+		file->data = NULL;
+	}
+
+	uncompressed = (unsigned char*)_xalloc(file->uncompressedLength);
+	if (grf__read(file->grf->fp, file, uncompressed) != 0) {
+		_xfree(uncompressed);
+		return(1);
+	}
+
+	file->data = uncompressed;
+
+	return(0);
+}
+
+
+int grf_getdata(struct ROGrfFile *file) {
+	unsigned int subsystem = _xalloc_subsystem(ROINT_FORMAT_GRF);
+	int ret = grf__getdata(file);
+
+	_xalloc_subsystem(subsystem);
+	return(ret);
+}
+
+void grf_freedata(struct ROGrfFile *file) {
+	if (file->data != NULL)
+		_xfree(file->data);
+
+	file->data = NULL;
+}
+
+int grf_peek(const struct ROGrfFile *file, void *buf, unsigned int n) {
+	if (file == NULL || file->grf == NULL || buf == NULL)
+		return(-1);
+
+	return(grf__peek(file->grf->fp, file, (unsigned char*)buf, n));
+}
+
+struct ROGrfFile *grf_getfileinfo(const struct ROGrf* grf, unsigned int idx) {
+	if (idx >= grf_filecount(grf)) {
+		return(NULL);
+	}
+
+	return(&(grf->files[idx]));
+}
+
+
+const struct ROGrfSnapshot *grf_snapshot_acquire(struct ROGrf *grf, int *slot) {
+	unsigned int i, epoch;
+
+	if (grf == NULL || slot == NULL)
+		return(NULL);
+
+	// announce the epoch in a free slot before looking at the current snapshot,
+	// the writer will not free anything this reader can see
+	epoch = _xatomic_load(&grf->epoch);
+	for (i = 0; i < GRF_MAX_READERS; i++) {
+		if (_xatomic_load(&grf->readers[i]) == 0 && _xatomic_cas(&grf->readers[i], 0, epoch)) {
+			*slot = (int)i;
+			return((const struct ROGrfSnapshot*)_xatomic_loadptr((void*volatile*)&grf->current));
+		}
+	}
+
+	_xlog("grf.snapshot_acquire : too many readers\n");
+	return(NULL);
+}
+
+
+void grf_snapshot_release(struct ROGrf *grf, int slot) {
+	if (grf == NULL || slot < 0 || slot >= GRF_MAX_READERS)
+		return;
+
+	_xatomic_store(&grf->readers[slot], 0);
+}
+
+
+unsigned int grf_snapshot_filecount(const struct ROGrfSnapshot *snap) {
+	if (snap == NULL)
+		return(0);
+
+	return(snap->filecount);
+}
+
+
+const struct ROGrfFile *grf_snapshot_getfileinfo(const struct ROGrfSnapshot *snap, unsigned int idx) {
+	if (snap == NULL || idx >= snap->filecount)
+		return(NULL);
+
+	return(&snap->files[idx]);
+}
+
+
+const struct ROGrfFile *grf_snapshot_getfileinfobyname(const struct ROGrfSnapshot *snap, const char *fn) {
+	int idx;
+
+	if (snap == NULL || fn == NULL)
+		return(NULL);
+
+	idx = __btree_find(snap->btree, fn);
+	if (idx == -1)
+		return(NULL);
+
+	return(&snap->files[idx]);
+}
+
+
+int grf_snapshot_read(const struct ROGrfSnapshot *snap, const struct ROGrfFile *file, void *buf) {
+	if (snap == NULL || file == NULL || buf == NULL)
+		return(1);
+
+	return(grf__read(snap->fp, file, (unsigned char*)buf));
+}
+
+
+int grf_snapshot_readstored(const struct ROGrfSnapshot *snap, const struct ROGrfFile *file, void *buf) {
+	if (snap == NULL || file == NULL || buf == NULL)
+		return(1);
+
+	return(grf__readat(snap->fp, (unsigned char*)buf, file->compressedLengthAligned, (unsigned int)file->offset));
+}
+
+
+int grf_snapshot_peek(const struct ROGrfSnapshot *snap, const struct ROGrfFile *file, void *buf, unsigned int n) {
+	if (snap == NULL || file == NULL || buf == NULL)
+		return(-1);
+
+	return(grf__peek(snap->fp, file, (unsigned char*)buf, n));
+}
+
+int grf__btree_compare(const void* _snap, unsigned int a, unsigned int b) {
+	const struct ROGrfSnapshot *snap = (const struct ROGrfSnapshot*)_snap;
+	return(strcmp(snap->files[a].fileName, snap->files[b].fileName));
+}
+
+int grf__btree_find(const void* _snap, unsigned int a, const void *f) {
+	const char *fn = (const char*)f;
+	const struct ROGrfSnapshot *snap = (const struct ROGrfSnapshot*)_snap;
+	return(strcmp(snap->files[a].fileName, fn));
+}
+
+static void grf__btreesetup(struct ROGrfSnapshot *snap) {
+	unsigned int *path;
+	unsigned int i;
+	struct BTreeNode *nodes;
+	unsigned int filecount;
+
+	if (snap->btree != NULL) {
+		_xlog("Error trying to setup btree twice.");
+		return;
+	}
+
+	filecount = snap->filecount;
+	path = (unsigned int*)malloc(sizeof(unsigned int) * (filecount/2 + 2));
+
+	snap->btree = (struct BTree*)_xalloc(sizeof(struct BTree));
+	snap->btree->nodes = (struct BTreeNode*)_xalloc(sizeof(struct BTreeNode) * (filecount + 1));
+	nodes = snap->btree->nodes;
+	snap->btree->root = (filecount > 0)? 0: -1;
+	snap->btree->_internalData = snap;
+	snap->btree->compareFunc = &grf__btree_compare;
+	snap->btree->findFunc = &grf__btree_find;
+    
+    nodes[0].left = -1;
+    nodes[0].right = -1;
+    for (i = 1; i < filecount; i++) {
+        nodes[i].left = -1;
+        nodes[i].right = -1;
+		__btree_add(snap->btree, i, path);
+
+    }
+
+	free(path);
+}
+
+// Releases grf an all data allocated by it.
+// WARNING : no thread may hold a snapshot of grf.
+void grf_close(struct ROGrf *grf) {
+	if (grf == NULL)
+		return;
+
+	while (grf->retired != NULL) {
+		struct ROGrfSnapshot *snap = grf->retired;
+		grf->retired = snap->next;
+		grf__freesnapshot(snap);
+	}
+
+	if (grf->current != NULL)
+		grf__freesnapshot(grf->current);
+	else if (grf->fp != NULL)
+		fclose(grf->fp); // failed before the first snapshot
+
+#ifdef GRF_WATCH
+	if (grf->watchfd != -1)
+		close(grf->watchfd);
+#endif
+
+	if (grf->filename != NULL)
+		_xfree(grf->filename);
+
+	_xfree(grf);
+}
+
+// Searches the binary tree and retrieves the file information required (or NULL if not found)
+struct ROGrfFile *grf_getfileinfobyname(const struct ROGrf* grf, const char* fn) {
+    if (NULL == grf)
+        return(NULL);
+
+	int idx = __btree_find(grf->btree, fn);
+
+	if (idx == -1)
+		return(NULL);
+    
+    return(&grf->files[idx]);
+}
+
+void grf_walk_node(const struct ROGrf* grf, t_grf_walk_function_ptr fptr, int node, void* aux) {
+	if (node == -1)
+		return;
+
+	if (grf->btree->nodes[node].left != -1)
+		grf_walk_node(grf, fptr, grf->btree->nodes[node].left, aux);
+
+	fptr(&grf->files[node], aux);
+
+	if (grf->btree->nodes[node].right != -1)
+		grf_walk_node(grf, fptr, grf->btree->nodes[node].right, aux);
+}
+
+void grf_walk(const struct ROGrf* grf, t_grf_walk_function_ptr fptr, void* aux) {
 	if (NULL == grf)
 		return;
 
@@ -345,3 +1449,691 @@ void grf_walk(const struct ROGrf* grf, t_grf_walk_function_ptr fptr, void* aux)
 
 	grf_walk_node(grf, fptr, grf->btree->root, aux);
 }
+
+
+static struct ROGrfWriter *grf__writer_open(const char *fn, unsigned int options) {
+	struct ROGrfWriter *ret;
+	unsigned char header[46];
+	FILE *fp;
+
+	fp = fopen(fn, "wb");
+	if (fp == NULL) {
+		_xlog("grf.writer_open : cannot open file %s\n", fn);
+		return(NULL);
+	}
+
+	// reserve space for the header, it is written when closing
+	memset(header, 0, sizeof(header));
+	if (fwrite(header, sizeof(header), 1, fp) != 1) {
+		_xlog("grf.writer_open : cannot write to file %s\n", fn);
+		fclose(fp);
+		return(NULL);
+	}
+
+	ret = (struct ROGrfWriter*)_xalloc(sizeof(struct ROGrfWriter));
+	memset(ret, 0, sizeof(struct ROGrfWriter));
+	ret->fp = fp;
+	ret->options = options;
+
+	return(ret);
+}
+
+
+struct ROGrfWriter *grf_writer_open(const char *fn, unsigned int options) {
+	unsigned int subsystem = _xalloc_subsystem(ROINT_FORMAT_GRF);
+	struct ROGrfWriter *ret = grf__writer_open(fn, options);
+
+	_xalloc_subsystem(subsystem);
+	return(ret);
+}
+
+
+// Appends len bytes to the file table of the writer.
+static void grf__writer_table(struct ROGrfWriter *writer, const void *data, unsigned long len) {
+	if (writer->tablelength + len > writer->tablecapacity) {
+		unsigned char *table;
+		unsigned long capacity = writer->tablecapacity * 2 + len + 4096;
+		table = (unsigned char*)_xrealloc(writer->table, writer->tablecapacity, capacity);
+		if (table == NULL) {
+			_xlog("grf.writer_table : out of memory\n");
+			return;
+		}
+		writer->table = table;
+		writer->tablecapacity = capacity;
+	}
+	memcpy(writer->table + writer->tablelength, data, len);
+	writer->tablelength += len;
+}
+
+
+// Should the writer store the entry without trying deflate? (already compressed type or incompressible sample)
+static int grf__writer_skipdeflate(const char *name, const void *data, unsigned int length) {
+	unsigned char *sample;
+	unsigned long sampleLength;
+	size_t namelen = strlen(name);
+	unsigned int i;
+	int ret;
+
+	for (i = 0; GRF_STORED_EXTS[i] != NULL; i++) {
+		const char *ext = GRF_STORED_EXTS[i];
+		size_t extlen = strlen(ext);
+		size_t j;
+		if (namelen < extlen)
+			continue;
+		for (j = 0; j < extlen; j++) {
+			char c = name[namelen - extlen + j];
+			if (c >= 'A' && c <= 'Z')
+				c = c - 'A' + 'a';
+			if (c != ext[j])
+				break;
+		}
+		if (j == extlen)
+			return(1);
+	}
+
+	// small entries are deflated whole and checked afterwards
+	if (length <= 2 * GRF_WRITER_SAMPLE)
+		return(0);
+	sampleLength = compressBound(GRF_WRITER_SAMPLE);
+	sample = (unsigned char*)_xalloc(sampleLength);
+	ret = (compress2(sample, &sampleLength, (const unsigned char*)data, GRF_WRITER_SAMPLE, Z_BEST_SPEED) == Z_OK &&
+		sampleLength >= GRF_WRITER_SAMPLE - GRF_WRITER_SAMPLE / 32);
+	_xfree(sample);
+	return(ret);
+}
+
+
+static int grf__writer_add(struct ROGrfWriter *writer, const char *name, const void *data, unsigned int length) {
+	unsigned char *body = NULL;
+	unsigned long bodyLength = 0;
+	int compressedLength, compressedLengthAligned, uncompressedLength, offset;
+	int stored;
+	char flags;
+
+	if (writer == NULL || name == NULL || (data == NULL && length > 0))
+		return(1);
+
+	stored = ((writer->options & GRF_WRITER_STORED) && grf__writer_skipdeflate(name, data, length));
+	if (!stored) {
+		bodyLength = compressBound(length);
+		body = (unsigned char*)_xalloc(bodyLength + 8);
+		if (compress(body, &bodyLength, (const unsigned char*)data, length) != Z_OK) {
+			_xlog("grf.writer_add : cannot compress %s\n", name);
+			_xfree(body);
+			return(1);
+		}
+		if ((writer->options & GRF_WRITER_STORED) && bodyLength >= length - length / 32) {
+			// deflate gains (almost) nothing after all
+			stored = 1;
+			_xfree(body);
+			body = NULL;
+		}
+	}
+
+	if (stored) {
+		// store as-is
+		flags = GRF_FLAG_FILE | GRF_FLAG_STORED;
+		compressedLength = compressedLengthAligned = uncompressedLength = (int)length;
+	}
+	else {
+		flags = GRF_FLAG_FILE;
+		compressedLength = (int)bodyLength;
+		compressedLengthAligned = (int)((bodyLength + 7) & ~7UL); // aligned for DES, even if it is not used
+		uncompressedLength = (int)length;
+		memset(body + bodyLength, 0, compressedLengthAligned - bodyLength);
+	}
+
+	if ((unsigned long long)writer->offset + (unsigned int)compressedLengthAligned > 0x7FFFFFFF) {
+		_xlog("grf.writer_add : archive too big\n");
+		if (body != NULL)
+			_xfree(body);
+		return(1);
+	}
+	offset = (int)writer->offset;
+	if (compressedLengthAligned > 0 && fwrite((body != NULL)? body: (const unsigned char*)data, compressedLengthAligned, 1, writer->fp) != 1) {
+		_xlog("grf.writer_add : cannot write %s\n", name);
+		if (body != NULL)
+			_xfree(body);
+		return(1);
+	}
+	if (body != NULL)
+		_xfree(body);
+	writer->offset += (unsigned int)compressedLengthAligned;
+
+	grf__writer_table(writer, name, strlen(name) + 1);
+	grf__writer_table(writer, &compressedLength, sizeof(int));
+	grf__writer_table(writer, &compressedLengthAligned, sizeof(int));
+	grf__writer_table(writer, &uncompressedLength, sizeof(int));
+	grf__writer_table(writer, &flags, sizeof(char));
+	grf__writer_table(writer, &offset, sizeof(int));
+	writer->filecount++;
+
+	return(0);
+}
+
+
+int grf_writer_add(struct ROGrfWriter *writer, const char *name, const void *data, unsigned int length) {
+	unsigned int subsystem = _xalloc_subsystem(ROINT_FORMAT_GRF);
+	int ret = grf__writer_add(writer, name, data, length);
+
+	_xalloc_subsystem(subsystem);
+	return(ret);
+}
+
+
+static int grf__writer_close(struct ROGrfWriter *writer) {
+	unsigned char *body;
+	unsigned long bodyLength;
+	unsigned int number[4];
+	unsigned int tableLength[2];
+	int ret = 0;
+
+	if (writer == NULL)
+		return(1);
+
+	// file table
+	bodyLength = compressBound(writer->tablelength);
+	body = (unsigned char*)_xalloc(bodyLength);
+	if (compress(body, &bodyLength, writer->table, writer->tablelength) != Z_OK) {
+		_xlog("grf.writer_close : cannot compress the file table\n");
+		ret = 1;
+	}
+	else {
+		tableLength[0] = (unsigned int)bodyLength;
+		tableLength[1] = (unsigned int)writer->tablelength;
+		if (fwrite(tableLength, sizeof(tableLength), 1, writer->fp) != 1 ||
+			fwrite(body, bodyLength, 1, writer->fp) != 1)
+			ret = 1;
+	}
+	_xfree(body);
+
+	// header
+	number[0] = writer->offset; // filetableoffset
+	number[1] = 0; // number1 (seed)
+	number[2] = writer->filecount + 7; // number2
+	number[3] = 0x200; // version
+	if (ret == 0 &&
+		(fseek(writer->fp, 0, SEEK_SET) != 0 ||
+		fwrite("Master of Magic", 16, 1, writer->fp) != 1 ||
+		fseek(writer->fp, 30, SEEK_SET) != 0 ||
+		fwrite(number, sizeof(number), 1, writer->fp) != 1))
+		ret = 1;
+	if (ret != 0)
+		_xlog("grf.writer_close : cannot write the archive\n");
+
+	if (fclose(writer->fp) != 0)
+		ret = 1;
+	if (writer->table != NULL)
+		_xfree(writer->table);
+	_xfree(writer);
+
+	return(ret);
+}
+
+
+int grf_writer_close(struct ROGrfWriter *writer) {
+	unsigned int subsystem = _xalloc_subsystem(ROINT_FORMAT_GRF);
+	int ret = grf__writer_close(writer);
+
+	_xalloc_subsystem(subsystem);
+	return(ret);
+}
+
+
+// Directory tree of a snapshot, built on first use.
+// The directories are the '\\' separated prefixes of the file names.
+// Each directory has its subdirectories contiguous in dirs and its files contiguous in files.
+struct _grf_dir {
+	const char *name; // name of the directory level, not terminated (points to a file name)
+	unsigned int namelen;
+	unsigned int firstdir, dircount; // subdirectories in dirs
+	unsigned int firstfile, filecount; // direct files in files
+	unsigned int total; // files in the whole subtree
+};
+
+struct ROGrfDirTree {
+	struct _grf_dir *dirs; // dirs[0] is the root
+	unsigned int dircount;
+	unsigned int *files; // snapshot file indexes grouped by directory
+	unsigned int filecount;
+};
+
+
+static void grf__freedirtree(struct ROGrfDirTree *tree) {
+	_xfree(tree->dirs);
+	_xfree(tree->files);
+	_xfree(tree);
+}
+
+
+// Fills the directory dir with the sorted files order[start..end), which all start with the same prefix of prefixlen characters.
+static void grf__builddir(struct ROGrfDirTree *tree, const struct ROGrfSnapshot *snap, const unsigned int *order, unsigned int dir, unsigned int start, unsigned int end, size_t prefixlen) {
+	struct _grf_dir *d = &tree->dirs[dir];
+	unsigned int i, j, sub;
+
+	d->total = end - start;
+
+	// direct files first, names of the same subdirectory are next to each other
+	d->firstfile = tree->filecount;
+	d->dircount = 0;
+	for (i = start; i < end; ) {
+		const char *name = snap->files[order[i]].fileName + prefixlen;
+		const char *sep = strchr(name, '\\');
+		if (sep == NULL) {
+			tree->files[tree->filecount++] = order[i++];
+			continue;
+		}
+		for (i++; i < end && strncmp(snap->files[order[i]].fileName + prefixlen, name, sep - name + 1) == 0; i++);
+		d->dircount++;
+	}
+	d->filecount = tree->filecount - d->firstfile;
+	d->firstdir = tree->dircount;
+	tree->dircount += d->dircount;
+
+	// subdirectories
+	sub = d->firstdir;
+	for (i = start; i < end; i = j) {
+		const char *name = snap->files[order[i]].fileName + prefixlen;
+		const char *sep = strchr(name, '\\');
+		j = i + 1;
+		if (sep == NULL)
+			continue;
+		for (; j < end && strncmp(snap->files[order[j]].fileName + prefixlen, name, sep - name + 1) == 0; j++);
+		tree->dirs[sub].name = name;
+		tree->dirs[sub].namelen = (unsigned int)(sep - name);
+		grf__builddir(tree, snap, order, sub, i, j, prefixlen + (sep - name) + 1);
+		sub++;
+	}
+}
+
+
+// Returns the directory tree of snap, building it if needed.
+static const struct ROGrfDirTree *grf__dirtree(const struct ROGrfSnapshot *snap) {
+	struct ROGrfSnapshot *snap2 = (struct ROGrfSnapshot*)snap; // the tree is not part of the immutable state
+	struct ROGrfDirTree *tree;
+	unsigned int *order, *stack;
+	unsigned int i, n, sp, dircount;
+	int k;
+
+	tree = (struct ROGrfDirTree*)_xatomic_loadptr((void*volatile*)&snap2->dirtree);
+	if (tree != NULL)
+		return(tree);
+
+	// sorted order is the in-order walk of the search tree
+	order = (unsigned int*)_xalloc(sizeof(unsigned int) * (snap->filecount + 1));
+	stack = (unsigned int*)_xalloc(sizeof(unsigned int) * (snap->filecount + 1));
+	n = 0;
+	sp = 0;
+	k = (snap->filecount > 0)? snap->btree->root: -1;
+	while (k != -1 || sp > 0) {
+		while (k != -1) {
+			stack[sp++] = (unsigned int)k;
+			k = snap->btree->nodes[k].left;
+		}
+		k = (int)stack[--sp];
+		order[n++] = (unsigned int)k;
+		k = snap->btree->nodes[k].right;
+	}
+	_xfree(stack);
+
+	// every '\\' opens at most one directory
+	dircount = 1;
+	for (i = 0; i < n; i++) {
+		const char *ptr;
+		for (ptr = snap->files[i].fileName; *ptr != 0; ptr++)
+			if (*ptr == '\\')
+				dircount++;
+	}
+
+	tree = (struct ROGrfDirTree*)_xalloc(sizeof(struct ROGrfDirTree));
+	tree->dirs = (struct _grf_dir*)_xalloc(sizeof(struct _grf_dir) * dircount);
+	memset(tree->dirs, 0, sizeof(struct _grf_dir) * dircount);
+	tree->files = (unsigned int*)_xalloc(sizeof(unsigned int) * (n + 1));
+	tree->dircount = 1;
+	tree->filecount = 0;
+	tree->dirs[0].name = "";
+	grf__builddir(tree, snap, order, 0, 0, n, 0);
+	_xfree(order);
+
+	if (!_xatomic_casptr((void*volatile*)&snap2->dirtree, NULL, tree)) {
+		// someone else was faster
+		grf__freedirtree(tree);
+		tree = (struct ROGrfDirTree*)_xatomic_loadptr((void*volatile*)&snap2->dirtree);
+	}
+	return(tree);
+}
+
+
+// Matches one level of a name with one level of a pattern. '*' = any run of characters, '?' = any character, "[...]" = set ("[!...]" = not in set).
+static int grf__wildmatch(const char *pat, const char *patend, const char *str, const char *strend) {
+	const char *starpat = NULL, *starstr = NULL;
+
+	while (str < strend) {
+		if (pat < patend && *pat == '*') {
+			starpat = ++pat;
+			starstr = str;
+			continue;
+		}
+		if (pat < patend && *pat == '[') {
+			const char *ptr = pat + 1;
+			int negate = 0, found = 0;
+			if (ptr < patend && *ptr == '!') {
+				negate = 1;
+				ptr++;
+			}
+			for (; ptr < patend && (*ptr != ']' || ptr == pat + 1 + negate); ptr++) {
+				if (ptr + 2 < patend && ptr[1] == '-' && ptr[2] != ']') {
+					if ((unsigned char)*str >= (unsigned char)ptr[0] && (unsigned char)*str <= (unsigned char)ptr[2])
+						found = 1;
+					ptr += 2;
+				}
+				else if (*ptr == *str)
+					found = 1;
+			}
+			if (ptr < patend && found != negate) {
+				pat = ptr + 1;
+				str++;
+				continue;
+			}
+		}
+		else if (pat < patend && (*pat == '?' || *pat == *str)) {
+			pat++;
+			str++;
+			continue;
+		}
+		// mismatch, let the last '*' eat one more character
+		if (starpat == NULL)
+			return(0);
+		pat = starpat;
+		str = ++starstr;
+	}
+	while (pat < patend && *pat == '*')
+		pat++;
+	return(pat == patend);
+}
+
+
+struct _grf_globtask {
+	unsigned int dir;
+	unsigned int level; // pattern level to match against the subdirectories (or files if it is the last)
+};
+
+struct _grf_globresult {
+	unsigned int *files;
+	unsigned int count, capacity;
+};
+
+struct _grf_glob {
+	const struct ROGrfSnapshot *snap;
+	const struct ROGrfDirTree *tree;
+	const char **levels; // levelcount+1 pointers, level i is [levels[i], levels[i+1]-1)
+	unsigned int levelcount;
+	struct _grf_globtask *tasks;
+	unsigned int taskcount;
+	volatile unsigned int nexttask;
+	struct _grf_globresult *results; // one per thread
+};
+
+
+static int grf__globisany(const struct _grf_glob *glob, unsigned int level) {
+	return(glob->levels[level+1] - 1 - glob->levels[level] == 2 && glob->levels[level][0] == '*' && glob->levels[level][1] == '*');
+}
+
+
+static void grf__globadd(struct _grf_globresult *result, unsigned int file) {
+	if (result->count == result->capacity) {
+		unsigned int *files = (unsigned int*)_xrealloc(result->files, sizeof(unsigned int) * result->capacity, sizeof(unsigned int) * (result->capacity * 2 + 64));
+		if (files == NULL) {
+			_xlog("grf.globadd : out of memory\n");
+			return;
+		}
+		result->files = files;
+		result->capacity = result->capacity * 2 + 64;
+	}
+	result->files[result->count++] = file;
+}
+
+
+// Adds every file of the subtree.
+static void grf__globtree(const struct _grf_glob *glob, struct _grf_globresult *result, unsigned int dir) {
+	const struct _grf_dir *d = &glob->tree->dirs[dir];
+	unsigned int i;
+
+	for (i = 0; i < d->filecount; i++)
+		grf__globadd(result, glob->tree->files[d->firstfile + i]);
+	for (i = 0; i < d->dircount; i++)
+		grf__globtree(glob, result, d->firstdir + i);
+}
+
+
+static void grf__globdir(const struct _grf_glob *glob, struct _grf_globresult *result, unsigned int dir, unsigned int level) {
+	const struct _grf_dir *d = &glob->tree->dirs[dir];
+	const char *pat = glob->levels[level];
+	const char *patend = glob->levels[level+1] - 1;
+	unsigned int i;
+
+	if (grf__globisany(glob, level)) {
+		if (level + 1 == glob->levelcount) {
+			grf__globtree(glob, result, dir);
+			return;
+		}
+		// zero levels here, or one more level and still "**"
+		grf__globdir(glob, result, dir, level + 1);
+		for (i = 0; i < d->dircount; i++)
+			grf__globdir(glob, result, d->firstdir + i, level);
+		return;
+	}
+
+	if (level + 1 == glob->levelcount) {
+		for (i = 0; i < d->filecount; i++) {
+			unsigned int file = glob->tree->files[d->firstfile + i];
+			const char *name = glob->snap->files[file].fileName;
+			const char *base = strrchr(name, '\\');
+			base = (base != NULL)? base + 1: name;
+			if (grf__wildmatch(pat, patend, base, base + strlen(base)))
+				grf__globadd(result, file);
+		}
+		return;
+	}
+
+	for (i = 0; i < d->dircount; i++) {
+		const struct _grf_dir *sub = &glob->tree->dirs[d->firstdir + i];
+		if (grf__wildmatch(pat, patend, sub->name, sub->name + sub->namelen))
+			grf__globdir(glob, result, d->firstdir + i, level + 1);
+	}
+}
+
+
+static void grf__globthread(void *arg, unsigned int index) {
+	struct _grf_glob *glob = (struct _grf_glob*)arg;
+	unsigned int task;
+
+	while ((task = _xatomic_add(&glob->nexttask, 1) - 1) < glob->taskcount)
+		grf__globdir(glob, &glob->results[index], glob->tasks[task].dir, glob->tasks[task].level);
+}
+
+
+// Splits the search in independent subtrees until there is enough work for count threads.
+static void grf__globsplit(struct _grf_glob *glob, unsigned int count) {
+	unsigned int round;
+
+	for (round = 0; round < 4 && glob->taskcount < count * 8; round++) {
+		struct _grf_globtask *tasks;
+		unsigned int i, j, taskcount = 0, capacity = 0;
+		int split = 0;
+
+		for (i = 0; i < glob->taskcount; i++) {
+			const struct _grf_dir *d = &glob->tree->dirs[glob->tasks[i].dir];
+			capacity += (glob->tasks[i].level + 1 < glob->levelcount)? d->dircount + 1: 1;
+		}
+		tasks = (struct _grf_globtask*)_xalloc(sizeof(struct _grf_globtask) * (capacity + 1));
+		for (i = 0; i < glob->taskcount; i++) {
+			const struct _grf_globtask *task = &glob->tasks[i];
+			const struct _grf_dir *d = &glob->tree->dirs[task->dir];
+			if (task->level + 1 == glob->levelcount) {
+				tasks[taskcount++] = *task; // files, nothing to split
+			}
+			else if (grf__globisany(glob, task->level)) {
+				tasks[taskcount].dir = task->dir;
+				tasks[taskcount++].level = task->level + 1;
+				for (j = 0; j < d->dircount; j++) {
+					tasks[taskcount].dir = d->firstdir + j;
+					tasks[taskcount++].level = task->level;
+				}
+				split = 1;
+			}
+			else {
+				const char *pat = glob->levels[task->level];
+				const char *patend = glob->levels[task->level+1] - 1;
+				for (j = 0; j < d->dircount; j++) {
+					const struct _grf_dir *sub = &glob->tree->dirs[d->firstdir + j];
+					if (grf__wildmatch(pat, patend, sub->name, sub->name + sub->namelen)) {
+						tasks[taskcount].dir = d->firstdir + j;
+						tasks[taskcount++].level = task->level + 1;
+					}
+				}
+				split = 1;
+			}
+		}
+		_xfree(glob->tasks);
+		glob->tasks = tasks;
+		glob->taskcount = taskcount;
+		if (!split)
+			break;
+	}
+}
+
+
+static int grf__globcompare(const void *a, const void *b, const struct ROGrfSnapshot *snap) {
+	return(strcmp(snap->files[*(const unsigned int*)a].fileName, snap->files[*(const unsigned int*)b].fileName));
+}
+
+
+// Sorts file indexes by name (insertion sort on small runs, merge sort otherwise).
+static void grf__globsort(unsigned int *files, unsigned int *tmp, unsigned int count, const struct ROGrfSnapshot *snap) {
+	unsigned int i, j, k, half;
+
+	if (count < 16) {
+		for (i = 1; i < count; i++) {
+			unsigned int file = files[i];
+			for (j = i; j > 0 && grf__globcompare(&files[j-1], &file, snap) > 0; j--)
+				files[j] = files[j-1];
+			files[j] = file;
+		}
+		return;
+	}
+	half = count / 2;
+	grf__globsort(files, tmp, half, snap);
+	grf__globsort(files + half, tmp, count - half, snap);
+	memcpy(tmp, files, sizeof(unsigned int) * half);
+	for (i = 0, j = half, k = 0; i < half; ) {
+		if (j < count && grf__globcompare(&files[j], &tmp[i], snap) < 0)
+			files[k++] = files[j++];
+		else
+			files[k++] = tmp[i++];
+	}
+}
+
+
+int grf_snapshot_glob(const struct ROGrfSnapshot *snap, const char *pattern, t_grf_walk_function_ptr fptr, void *aux) {
+	struct _grf_glob glob;
+	struct _grf_globresult all;
+	const char *ptr;
+	unsigned int i, threads, work;
+	int any;
+
+	if (snap == NULL || pattern == NULL || fptr == NULL)
+		return(-1);
+
+	memset(&glob, 0, sizeof(glob));
+	glob.snap = snap;
+	glob.tree = grf__dirtree(snap);
+
+	// split the pattern in levels
+	glob.levelcount = 1;
+	for (ptr = pattern; *ptr != 0; ptr++)
+		if (*ptr == '\\')
+			glob.levelcount++;
+	glob.levels = (const char**)_xalloc(sizeof(const char*) * (glob.levelcount + 1));
+	glob.levels[0] = pattern;
+	for (i = 1, ptr = pattern; *ptr != 0; ptr++)
+		if (*ptr == '\\')
+			glob.levels[i++] = ptr + 1;
+	glob.levels[i] = ptr + 1;
+	// "**\\**" matches the same as "**", merge them so the search does not find files several times
+	any = grf__globisany(&glob, 0);
+	for (i = 1, work = 1; i < glob.levelcount; i++) {
+		int prevany = any;
+		any = grf__globisany(&glob, i);
+		if (any && prevany)
+			glob.levels[work - 1] = glob.levels[i];
+		else
+			glob.levels[work++] = glob.levels[i];
+	}
+	glob.levels[work] = glob.levels[glob.levelcount];
+	glob.levelcount = work;
+
+	glob.tasks = (struct _grf_globtask*)_xalloc(sizeof(struct _grf_globtask));
+	glob.tasks[0].dir = 0;
+	glob.tasks[0].level = 0;
+	glob.taskcount = 1;
+
+	// only go parallel if there is enough to search
+	threads = _xthread_hwcount();
+	if (threads > 1 && glob.tree->dirs[0].total >= GRF_GLOB_PARALLEL) {
+		grf__globsplit(&glob, threads);
+		work = 0;
+		for (i = 0; i < glob.taskcount; i++)
+			work += glob.tree->dirs[glob.tasks[i].dir].total;
+		if (work < GRF_GLOB_PARALLEL)
+			threads = 1;
+		if (threads > glob.taskcount)
+			threads = glob.taskcount;
+	}
+	else
+		threads = 1;
+	if (threads == 0)
+		threads = 1;
+
+	glob.results = (struct _grf_globresult*)_xalloc(sizeof(struct _grf_globresult) * threads);
+	memset(glob.results, 0, sizeof(struct _grf_globresult) * threads);
+	_xthread_parallel(threads, &grf__globthread, &glob);
+
+	// gather and report in name order from this thread
+	memset(&all, 0, sizeof(all));
+	for (i = 0; i < threads; i++) {
+		unsigned int j;
+		for (j = 0; j < glob.results[i].count; j++)
+			grf__globadd(&all, glob.results[i].files[j]);
+		if (glob.results[i].files != NULL)
+			_xfree(glob.results[i].files);
+	}
+	if (all.count > 1) {
+		unsigned int *tmp = (unsigned int*)_xalloc(sizeof(unsigned int) * all.count);
+		grf__globsort(all.files, tmp, all.count, snap);
+		_xfree(tmp);
+		// other ambiguous patterns (like "**\\*\\**") can still reach a file by several paths
+		for (i = 1, work = 1; i < all.count; i++)
+			if (all.files[i] != all.files[work - 1])
+				all.files[work++] = all.files[i];
+		all.count = work;
+	}
+	for (i = 0; i < all.count; i++)
+		fptr(&snap->files[all.files[i]], aux);
+
+	if (all.files != NULL)
+		_xfree(all.files);
+	_xfree(glob.results);
+	_xfree(glob.tasks);
+	_xfree(glob.levels);
+
+	return((int)all.count);
+}
+
+
+int grf_glob(const struct ROGrf *grf, const char *pattern, t_grf_walk_function_ptr fptr, void *aux) {
+	if (grf == NULL)
+		return(-1);
+
+	return(grf_snapshot_glob(grf->current, pattern, fptr, aux));
+}
@@ -22,6 +22,8 @@
     ------------------------------------------------------------------------------------
 */
 #include "internal.h"
+#include "arena.h"
+#include "encoder.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -96,6 +98,7 @@ float imf_inspect(const struct ROImf *imf) {
 
 struct ROImf *imf_load(struct _reader *reader) {
 	struct ROImf *ret;
+	struct _arena *arena;
 	unsigned int layerId, actionId;
 
 	if (reader == NULL || reader->error) {
@@ -103,7 +106,8 @@ struct ROImf *imf_load(struct _reader *reader) {
 		return(NULL);
 	}
 
-	ret = (struct ROImf*)_xalloc(sizeof(struct ROImf));
+	arena = _arena_loadinit(reader->remaining(reader));
+	ret = (struct ROImf*)_arena_newobject(arena, sizeof(struct ROImf));
 	memset(ret, 0, sizeof(struct ROImf));
 
 	reader->read(&ret->version, 4, 1, reader);
@@ -124,7 +128,7 @@ struct ROImf *imf_load(struct _reader *reader) {
 			imf_unload(ret);
 			return(NULL);
 		}
-		ret->layers = (struct ROImfLayer*)_xalloc(sizeof(struct ROImfLayer) * layercount);
+		ret->layers = (struct ROImfLayer*)_arena_alloc(arena, sizeof(struct ROImfLayer) * layercount);
 		memset(ret->layers, 0, sizeof(struct ROImfLayer) * layercount);
 		for (layerId = 0; layerId < layercount; layerId++) {
 			struct ROImfLayer *layer = &ret->layers[layerId];
@@ -135,7 +139,7 @@ struct ROImf *imf_load(struct _reader *reader) {
 				return(NULL);
 			}
 			if (layer->actioncount > 0) {
-				layer->actions = (struct ROImfAction*)_xalloc(sizeof(struct ROImfAction) * layer->actioncount);
+				layer->actions = (struct ROImfAction*)_arena_alloc(arena, sizeof(struct ROImfAction) * layer->actioncount);
 				memset(layer->actions, 0, sizeof(struct ROImfAction) * layer->actioncount);
 				for (actionId = 0; actionId < layer->actioncount; actionId++) {
 					struct ROImfAction *action = &layer->actions[actionId];
@@ -146,7 +150,7 @@ struct ROImf *imf_load(struct _reader *reader) {
 						return(NULL);
 					}
 					if (action->motioncount > 0) {
-						action->motions = (struct ROImfMotion*)_xalloc(sizeof(struct ROImfMotion) * action->motioncount);
+						action->motions = (struct ROImfMotion*)_arena_alloc(arena, sizeof(struct ROImfMotion) * action->motioncount);
 						reader->read(action->motions, sizeof(struct ROImfMotion), action->motioncount, reader);
 					}
 				}
@@ -168,7 +172,7 @@ struct ROImf *imf_loadFromData(const unsigned char *data, unsigned long length)
 	struct ROImf *ret;
 	struct _reader *reader;
 
-	reader = memreader_init(data, length);
+	reader = statsreader_init(memreader_init(data, length), ROINT_FORMAT_IMF);
 	ret = imf_load(reader);
 	reader->destroy(reader);
 
@@ -180,7 +184,7 @@ struct ROImf *imf_loadFromFile(const char *fn) {
 	struct ROImf *ret;
 	struct _reader *reader;
 
-	reader = filereader_init(fn);
+	reader = statsreader_init(filereader_init(fn), ROINT_FORMAT_IMF);
 	ret = imf_load(reader);
 	reader->destroy(reader);
 
@@ -209,6 +213,7 @@ struct ROImf *imf_loadFromGrf(struct ROGrfFile *file) {
 int imf_save(const struct ROImf *imf, struct _writer *writer) {
 	unsigned int layerId, actionId;
 	unsigned int layercount;
+	struct _encoder encoder;
 
 	if (imf == NULL || writer == NULL || writer->error) {
 		_xlog("imf.save : invalid argument (imf=%p writer=%p writer.error=%d)\n", imf, writer, writer->error);
@@ -224,21 +229,26 @@ int imf_save(const struct ROImf *imf, struct _writer *writer) {
 		return(1);
 	}
 
-	writer->write(&imf->version, 4, 1, writer);
-	writer->write(&imf->checksum, 4, 1, writer);
-	writer->write(&imf->lastlayer, 4, 1, writer);
+	_encoder_init(&encoder, writer);
+	_encoder_reserve(&encoder, 12);
+	_encoder_f32(&encoder, imf->version);
+	_encoder_u32(&encoder, imf->checksum);
+	_encoder_i32(&encoder, imf->lastlayer);
 	layercount = (unsigned int)(imf->lastlayer + 1);
-	for (layerId = 0; layerId < layercount; layerId++) {
+	for (layerId = 0; layerId < layercount && !encoder.error; layerId++) {
 		const struct ROImfLayer *layer = &imf->layers[layerId];
-		writer->write(&layer->actioncount, 4, 1, writer);
+		_encoder_reserve(&encoder, 4);
+		_encoder_u32(&encoder, layer->actioncount);
 		for (actionId = 0; actionId < layer->actioncount; actionId++) {
 			const struct ROImfAction *action = &layer->actions[actionId];
-			writer->write(&action->motioncount, 4, 1, writer);
-			writer->write(action->motions, sizeof(struct ROImfMotion), action->motioncount, writer);
+			_encoder_reserve(&encoder, 4);
+			_encoder_u32(&encoder, action->motioncount);
+			if (action->motioncount > 0)
+				_encoder_write(&encoder, action->motions, sizeof(struct ROImfMotion) * action->motioncount);
 		}
 	}
 
-	if (writer->error) {
+	if (_encoder_destroy(&encoder)) {
 		_xlog("imf.save : write error\n");
 		return(1);
 	}
@@ -251,7 +261,7 @@ int imf_saveToData(const struct ROImf *imf, unsigned char **data_out, unsigned l
 	int ret;
 	struct _writer *writer;
 
-	writer = memwriter_init(data_out, size_out);
+	writer = statswriter_init(memwriter_init(data_out, size_out), ROINT_FORMAT_IMF);
 	ret = imf_save(imf, writer);
 	writer->destroy(writer);
 
@@ -261,10 +271,13 @@ int imf_saveToData(const struct ROImf *imf, unsigned char **data_out, unsigned l
 
 int imf_saveToFile(const struct ROImf *imf, const char *fn) {
 	int ret;
-	struct _writer *writer;
+	struct _writer *writer, *memwriter;
 
-	writer = filewriter_init(fn);
+	memwriter = memwriter_init(NULL, NULL);
+	writer = statswriter_init(memwriter, ROINT_FORMAT_IMF);
 	ret = imf_save(imf, writer);
+	if (ret == 0)
+		ret = memwriter_savefile(memwriter, fn);
 	writer->destroy(writer);
 
 	return(ret);
@@ -276,6 +289,8 @@ void imf_unload(struct ROImf *imf) {
 
 	if (imf == NULL)
 		return;
+	if (_arena_release(imf) == 0)
+		return;// loaded in arena mode, everything is released
 
 	if (imf->layers != NULL) {
 		unsigned int layercount = (imf->lastlayer >= 0)? (unsigned int)imf->lastlayer + 1: 0;
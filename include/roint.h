@@ -34,6 +34,8 @@
 
 /// \defgroup UtilityHeaders  Utility Headers
 #include "roint/constant.h"
+#include "roint/flat.h"
+#include "roint/io.h"
 #include "roint/log.h"
 #include "roint/memory.h"
 #include "roint/text.h"
@@ -43,6 +45,7 @@
 /// \warning The original client uses <code>int</code> for most count fields,
 ///          so never go over <code>INT_MAX</code> if you want to be compatible.
 #include "roint/act.h" // sprite animations
+#include "roint/catalog.h" // asset metadata catalog
 #include "roint/gat.h" // ground info
 #include "roint/gnd.h" // 3d ground model
 #include "roint/grf.h" // archive
@@ -114,10 +114,20 @@ ROINT_DLLAPI struct ROAct *act_loadFromFile(const char *fn);
 /// Loads the act from a ROGrf file. (NULL on error)
 ROINT_DLLAPI struct ROAct *act_loadFromGrf(struct ROGrfFile*);
 /// Saves the act to a data buffer. (0 on success)
-/// WARNING : the 'data_out' data has to be released with the roint free function
+/// WARNING : the 'data_out' data has to be released with roint_free
 ROINT_DLLAPI int act_saveToData(const struct ROAct *act, unsigned char **data_out, unsigned long *size_out);
 /// Saves the act to a system file. (0 on success)
 ROINT_DLLAPI int act_saveToFile(const struct ROAct *act, const char *fn);
+/// Saves the act with everything it points to in a flat block. (0 on success)
+/// WARNING : the 'data_out' data has to be released with roint_free
+/// \sa roint/flat.h
+ROINT_DLLAPI int act_saveToFlat(const struct ROAct *act, unsigned char **data_out, unsigned long *size_out);
+/// Returns the act of a flat block, relocating and verifying the block if it moved. (NULL if invalid)
+/// Never pass the result to act_unload.
+ROINT_DLLAPI const struct ROAct *act_attachFlat(void *data, unsigned long size);
+/// Checks every array of the act of a flat block that is at its address. (0 if valid)
+/// \sa roint_flat_verify
+ROINT_DLLAPI int act_verifyFlat(const void *data, unsigned long size);
 /// Frees everything inside the ROAct structure allocated by us (including the act itself!)
 ROINT_DLLAPI void act_unload(struct ROAct*);
 
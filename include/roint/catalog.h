@@ -0,0 +1,123 @@
+/*
+    ------------------------------------------------------------------------------------
+    LICENSE:
+    ------------------------------------------------------------------------------------
+    This file is part of The Open Ragnarok Project
+    Copyright 2007 - 2011 The Open Ragnarok Team
+    For the latest information visit http://www.open-ragnarok.org
+    ------------------------------------------------------------------------------------
+    This program is free software; you can redistribute it and/or modify it under
+    the terms of the GNU Lesser General Public License as published by the Free Software
+    Foundation; either version 2 of the License, or (at your option) any later
+    version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License along with
+    this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+    Place - Suite 330, Boston, MA 02111-1307, USA, or go to
+    http://www.gnu.org/copyleft/lesser.txt.
+    ------------------------------------------------------------------------------------
+*/
+#ifndef __ROINT_CATALOG_H
+#define __ROINT_CATALOG_H
+
+#ifdef ROINT_INTERNAL
+#	include "config.h"
+#elif !defined(WITHOUT_ROINT_CONFIG)
+#	include "roint/config.h"
+#endif
+
+#ifndef ROINT_DLLAPI
+#	define ROINT_DLLAPI
+#endif
+struct ROGrf; // forward declaration
+
+#ifdef __cplusplus
+extern "C" {
+#endif 
+
+
+/// Types of catalog entries.
+#define ROCATALOG_UNKNOWN 0
+#define ROCATALOG_ACT 1 //< count=actions
+#define ROCATALOG_BMP 2 //< width/height in pixels
+#define ROCATALOG_GAT 3 //< width/height in cells
+#define ROCATALOG_GND 4 //< width/height in cells
+#define ROCATALOG_IMF 5
+#define ROCATALOG_JPG 6
+#define ROCATALOG_PAL 7
+#define ROCATALOG_RSM 8 //< count=nodes count2=textures
+#define ROCATALOG_RSW 9
+#define ROCATALOG_SPR 10 //< count=palette images count2=rgba images, width/height of the first image
+#define ROCATALOG_STR 11 //< count=layers count2=frames
+#define ROCATALOG_TGA 12 //< width/height in pixels
+#define ROCATALOG_WAV 13
+#define ROCATALOG_TYPECOUNT 14
+
+/// Catalog option: hash the uncompressed data instead of the stored data. (uncompresses every entry)
+#define ROCATALOG_HASH_DATA 0x01
+
+
+#pragma pack(push,1)
+/// Metadata of an archive entry, read from the header of the data.
+struct ROCatalogEntry {
+	unsigned int name; //< offset of the file name in ROCatalog::names
+	unsigned short archive; //< index of the archive
+	unsigned char type; //< ROCATALOG_*
+	unsigned char reserved;
+	unsigned short version; //< format version (major in the high byte), 0 if the format has none
+	unsigned int width;
+	unsigned int height;
+	unsigned int count;
+	unsigned int count2;
+	unsigned int size; //< uncompressed size
+	unsigned int hash; //< CRC-32 of the stored data (or of the uncompressed data with ROCATALOG_HASH_DATA)
+};
+
+/// Asset metadata catalog of one or more archives.
+struct ROCatalog {
+	unsigned short archivecount;
+	unsigned short options; //< ROCATALOG_* options it was built with
+	unsigned int entrycount;
+	unsigned int namessize;
+	unsigned int *archives; //< offset of the name of each archive in names
+	struct ROCatalogEntry *entries; //< sorted by name, then archive
+	unsigned int *bytype; //< entry indexes sorted by type, then name
+	unsigned int typeoffsets[ROCATALOG_TYPECOUNT + 1]; //< entries of type T are bytype[typeoffsets[T]..typeoffsets[T+1])
+	char *names;
+};
+#pragma pack(pop)
+
+
+/// Builds the catalog of the archives, scanning the entries on threadcount threads (0 = one per core).
+/// Only the headers of the entries are uncompressed. (NULL on error)
+ROINT_DLLAPI struct ROCatalog *catalog_build(struct ROGrf **grfs, unsigned int grfcount, unsigned int threadcount, unsigned int options);
+/// Returns the first entry with that name (entries of the same name in other archives follow it). (NULL if not found)
+ROINT_DLLAPI const struct ROCatalogEntry *catalog_find(const struct ROCatalog *catalog, const char *name);
+/// Returns the entry indexes of a type and stores how many there are in count. (NULL if none)
+ROINT_DLLAPI const unsigned int *catalog_findtype(const struct ROCatalog *catalog, unsigned char type, unsigned int *count);
+/// Returns the file name of the entry.
+ROINT_DLLAPI const char *catalog_name(const struct ROCatalog *catalog, const struct ROCatalogEntry *entry);
+/// Returns the file name of the archive.
+ROINT_DLLAPI const char *catalog_archive(const struct ROCatalog *catalog, unsigned short archive);
+/// Loads the catalog from a data buffer. (NULL on error)
+ROINT_DLLAPI struct ROCatalog *catalog_loadFromData(const unsigned char *data, unsigned long len);
+/// Loads the catalog from a system file. (NULL on error)
+ROINT_DLLAPI struct ROCatalog *catalog_loadFromFile(const char *fn);
+/// Saves the catalog to a data buffer. (0 on success)
+/// WARNING : the 'data_out' data has to be released with roint_free
+ROINT_DLLAPI int catalog_saveToData(const struct ROCatalog *catalog, unsigned char **data_out, unsigned long *size_out);
+/// Saves the catalog to a system file. (0 on success)
+ROINT_DLLAPI int catalog_saveToFile(const struct ROCatalog *catalog, const char *fn);
+/// Frees everything inside the ROCatalog structure allocated by us (including the catalog itself!)
+ROINT_DLLAPI void catalog_unload(struct ROCatalog *catalog);
+
+
+#ifdef __cplusplus
+}
+#endif 
+
+#endif /* __ROINT_CATALOG_H */
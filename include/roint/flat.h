@@ -0,0 +1,78 @@
+/*
+    ------------------------------------------------------------------------------------
+    LICENSE:
+    ------------------------------------------------------------------------------------
+    This file is part of The Open Ragnarok Project
+    Copyright 2007 - 2012 The Open Ragnarok Team
+    For the latest information visit http://www.open-ragnarok.org
+    ------------------------------------------------------------------------------------
+    This program is free software; you can redistribute it and/or modify it under
+    the terms of the GNU Lesser General Public License as published by the Free Software
+    Foundation; either version 2 of the License, or (at your option) any later
+    version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License along with
+    this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+    Place - Suite 330, Boston, MA 02111-1307, USA, or go to
+    http://www.gnu.org/copyleft/lesser.txt.
+    ------------------------------------------------------------------------------------
+*/
+#ifndef __ROINT_FLAT_H
+#define __ROINT_FLAT_H
+
+#ifdef ROINT_INTERNAL
+#	include "config.h"
+#elif !defined(WITHOUT_ROINT_CONFIG)
+#	include "roint/config.h"
+#endif
+
+#ifndef ROINT_DLLAPI
+#	define ROINT_DLLAPI
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Flat blocks.
+/// The *_saveToFlat functions copy a loaded object and everything it points to
+/// into a single block, and the *_attachFlat functions return the object inside
+/// a block without parsing or allocating anything.
+/// A block can be copied, written to a file and mapped back, or placed in shared memory.
+///
+/// The pointers inside a block are fixed for the address the block was last
+/// attached or relocated to. Attaching a block at that address takes constant time
+/// and trusts the block.
+/// Attaching it anywhere else verifies the block and fixes the pointers in place,
+/// which needs a writable block and breaks the views of the block at the old address.
+/// A block that did not come from this process and is already at its address
+/// (shared memory, a file mapped at a fixed address) must be checked once with
+/// roint_flat_verify before it is attached.
+/// To share a block between processes, relocate it to the address where every
+/// process maps it (roint_flat_relocate) before publishing it.
+///
+/// The block belongs to the caller and must be aligned to 8 bytes.
+/// Never pass the object of a block to the *_unload functions or change the arrays it points to.
+/// Blocks only work on systems with the same pointer size and byte order.
+
+/// Fix the pointers of a block for when it is at address 'base'.
+/// The block can be anywhere when this is called. (0 on success)
+ROINT_DLLAPI int roint_flat_relocate(void *data, unsigned long size, const void *base);
+/// Returns the ROINT_FORMAT_* format of the object of a block. (-1 if invalid)
+ROINT_DLLAPI int roint_flat_format(const void *data, unsigned long size);
+/// Check that every pointer and count of the object of a block stays inside the block,
+/// so a damaged or hostile block is rejected instead of read out of bounds.
+/// Values such as texture indexes are not checked, the same as in a loaded object.
+/// The block must be at the address it was last attached or relocated to. (0 if valid)
+/// \sa act_verifyFlat, spr_verifyFlat, gnd_verifyFlat, str_verifyFlat, rsm_verifyFlat
+ROINT_DLLAPI int roint_flat_verify(const void *data, unsigned long size);
+
+#ifdef __cplusplus
+}
+#endif 
+
+#endif /* __ROINT_FLAT_H */
@@ -136,10 +136,20 @@ ROINT_DLLAPI struct ROGnd *gnd_loadFromFile(const char *fn);
 /// Loads the gnd from a ROGrf file. (NULL on error)
 ROINT_DLLAPI struct ROGnd *gnd_loadFromGrf(struct ROGrfFile*);
 /// Saves the gnd to a data buffer. Discards incompatible information. (0 on success)
-/// WARNING : the 'data_out' data has to be released with the roint free function
+/// WARNING : the 'data_out' data has to be released with roint_free
 ROINT_DLLAPI int gnd_saveToData(const struct ROGnd *gnd, unsigned char **data_out, unsigned long *size_out);
 /// Saves the gnd to a system file. Discards incompatible information. (0 on success)
 ROINT_DLLAPI int gnd_saveToFile(const struct ROGnd *gnd, const char *fn);
+/// Saves the gnd with everything it points to in a flat block. (0 on success)
+/// WARNING : the 'data_out' data has to be released with roint_free
+/// \sa roint/flat.h
+ROINT_DLLAPI int gnd_saveToFlat(const struct ROGnd *gnd, unsigned char **data_out, unsigned long *size_out);
+/// Returns the gnd of a flat block, relocating and verifying the block if it moved. (NULL if invalid)
+/// Never pass the result to gnd_unload.
+ROINT_DLLAPI const struct ROGnd *gnd_attachFlat(void *data, unsigned long size);
+/// Checks every array of the gnd of a flat block that is at its address. (0 if valid)
+/// \sa roint_flat_verify
+ROINT_DLLAPI int gnd_verifyFlat(const void *data, unsigned long size);
 /// Frees everything inside the ROGnd structure allocated by us (including the gnd itself!)
 ROINT_DLLAPI void gnd_unload(struct ROGnd *gnd);
 
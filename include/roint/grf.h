@@ -17,17 +17,81 @@ extern "C" {
 
 struct ROGrf;
 struct ROGrfFile;
+struct ROGrfSnapshot;
+struct ROGrfWriter;
+struct ROGrfDirTree;
+
+/// Flag of entries that are files.
+#define GRF_FLAG_FILE 0x01
+/// Flag of entries stored without compression. (roint extension, other readers do not support it)
+#define GRF_FLAG_STORED 0x08
+
+/// Writer option: store entries that do not compress without compression.
+/// Already compressed types (jpg, png, wav, mp3, ogg, ...) and big entries whose first
+/// 16k do not compress are stored without trying deflate.
+#define GRF_WRITER_STORED 0x01
 
 typedef void (*t_grf_walk_function_ptr)(const struct ROGrfFile*, void* aux);
 
 ROINT_DLLAPI struct ROGrf *grf_open(const char *fn);
+/**
+  * Opens the GRF using an index shared between processes.
+  * The parsed file table and search tree are published in a named shared memory
+  * object keyed on the archive identity (device, inode, size and modification time).
+  * The first process builds and publishes the index, later processes attach to it read-only.
+  * The index is only readable by the user that published it, and indexes of other users are ignored.
+  * Indexes are checked before use; invalid ones and ones abandoned by a publisher that died are replaced.
+  * Falls back to grf_open() when shared memory is not available.
+  */
+ROINT_DLLAPI struct ROGrf *grf_open_shared(const char *fn);
+/**
+  * Removes the shared index of the GRF file, if any. Processes that are attached keep their mapping.
+  * Returns 0 on success.
+  */
+ROINT_DLLAPI int grf_unlink_shared(const char *fn);
 ROINT_DLLAPI void grf_close(struct ROGrf *grf);
+/**
+  * Re-reads the file table of a GRF that was patched and updates the index incrementally.
+  * Entries are matched by name: unchanged entries keep their cached data, changed entries lose it,
+  * new entries are appended and inserted in the existing search tree.
+  * The search tree is only rebuilt when entries were removed.
+  * The new index is published as a new snapshot, readers of the previous snapshot are not disturbed.
+  * WARNING : ROGrfFile pointers obtained before the reload are invalidated. (except the ones of a snapshot)
+  * WARNING : only one thread may reload/poll the GRF at a time.
+  * Returns 0 on success.
+  */
+ROINT_DLLAPI int grf_reload(struct ROGrf *grf);
+/**
+  * Starts watching the GRF file for changes (inotify, Linux only).
+  * The directory of the file is watched, so both writes in place and a new
+  * file renamed over the GRF are noticed.
+  * Returns 0 on success.
+  */
+ROINT_DLLAPI int grf_watch(struct ROGrf *grf);
+/// Returns the descriptor that becomes readable when the watched GRF changes. (-1 if not watching)
+ROINT_DLLAPI int grf_watchfd(const struct ROGrf *grf);
+/**
+  * Handles pending change notifications without blocking, reloading the GRF if it was written or replaced.
+  * Returns 1 if the GRF was reloaded, 0 if nothing changed, -1 on error.
+  */
+ROINT_DLLAPI int grf_poll(struct ROGrf *grf);
 ROINT_DLLAPI unsigned int grf_filecount(const struct ROGrf* grf);
 
 ROINT_DLLAPI struct ROGrfFile *grf_getfileinfo(const struct ROGrf* grf, unsigned int idx);
 ROINT_DLLAPI struct ROGrfFile *grf_getfileinfobyname(const struct ROGrf* grf, const char* fn);
 
 ROINT_DLLAPI void grf_walk(const struct ROGrf* grf, t_grf_walk_function_ptr fptr, void *aux);
+/**
+  * Calls fptr for every file whose name matches pattern, in name order.
+  * The pattern is matched level by level ('\\' separated) on a directory tree of the GRF (built on first use):
+  * '*' matches any run of characters and '?' any character inside a level, "[...]" matches a set of characters,
+  * and a "**" level matches any number of levels. Matching is case sensitive, like grf_getfileinfobyname.
+  * Large searches are split over independent subtrees and run on several threads,
+  * fptr is always called from the calling thread.
+  * Example: grf_glob(grf, "data\\sprite\\*\\*.act", fptr, aux)
+  * Returns the number of matches or -1 on error.
+  */
+ROINT_DLLAPI int grf_glob(const struct ROGrf *grf, const char *pattern, t_grf_walk_function_ptr fptr, void *aux);
 
 /**
   * Retrieves data from the GRF file and stores in the data pointer.
@@ -35,6 +99,64 @@ ROINT_DLLAPI void grf_walk(const struct ROGrf* grf, t_grf_walk_function_ptr fptr
   */
 ROINT_DLLAPI int grf_getdata(struct ROGrfFile *file);
 ROINT_DLLAPI void grf_freedata(struct ROGrfFile *file);
+/**
+  * Retrieves the first n bytes of the file into buf, without uncompressing the whole file.
+  * Only the stored data needed for those bytes is read and decoded. (useful to check headers)
+  * Returns the number of bytes stored in buf (less than n if the file is smaller) or -1 on error.
+  */
+ROINT_DLLAPI int grf_peek(const struct ROGrfFile *file, void *buf, unsigned int n);
+/**
+  * Returns a read-only pointer to the data of a stored (GRF_FLAG_STORED) file, straight from the mapped archive.
+  * Nothing is copied or allocated, the pointer is valid until the GRF is reloaded or closed.
+  * Returns NULL if the file is compressed or the archive cannot be mapped; use grf_getdata() then.
+  */
+ROINT_DLLAPI const void *grf_getview(const struct ROGrfFile *file);
+
+/**
+  * Acquires the current snapshot of the GRF index, for reading from any thread while the GRF is reloaded.
+  * A snapshot is immutable and stays valid until it is released, even if a reload replaces it.
+  * Acquiring and releasing never block and never wait for the writer.
+  * slot receives the reader slot that must be passed to grf_snapshot_release().
+  * Returns NULL if all reader slots (GRF_MAX_READERS) are in use.
+  */
+ROINT_DLLAPI const struct ROGrfSnapshot *grf_snapshot_acquire(struct ROGrf *grf, int *slot);
+/// Releases a snapshot. Snapshots that were replaced are freed by the next reload once nobody can see them.
+ROINT_DLLAPI void grf_snapshot_release(struct ROGrf *grf, int slot);
+ROINT_DLLAPI unsigned int grf_snapshot_filecount(const struct ROGrfSnapshot *snap);
+ROINT_DLLAPI const struct ROGrfFile *grf_snapshot_getfileinfo(const struct ROGrfSnapshot *snap, unsigned int idx);
+ROINT_DLLAPI const struct ROGrfFile *grf_snapshot_getfileinfobyname(const struct ROGrfSnapshot *snap, const char *fn);
+/**
+  * Reads the data of a file of the snapshot into buf, which must hold file->uncompressedLength bytes.
+  * Reads from the archive as it was when the snapshot was taken and does not touch the file data cache,
+  * so it can be called from several threads at the same time.
+  * Returns 0 on success.
+  */
+ROINT_DLLAPI int grf_snapshot_read(const struct ROGrfSnapshot *snap, const struct ROGrfFile *file, void *buf);
+/// Same as grf_peek, for a file of the snapshot. (can be called from several threads at the same time)
+ROINT_DLLAPI int grf_snapshot_peek(const struct ROGrfSnapshot *snap, const struct ROGrfFile *file, void *buf, unsigned int n);
+/// Reads the stored data of a file of the snapshot into buf, which must hold file->compressedLengthAligned bytes.
+/// The data is not decoded nor uncompressed. (same thread safety as grf_snapshot_read) Returns 0 on success.
+ROINT_DLLAPI int grf_snapshot_readstored(const struct ROGrfSnapshot *snap, const struct ROGrfFile *file, void *buf);
+/// Same as grf_getview, for a file of the snapshot. The pointer is valid until the snapshot is released.
+ROINT_DLLAPI const void *grf_snapshot_getview(const struct ROGrfSnapshot *snap, const struct ROGrfFile *file);
+/// Same as grf_glob, on the snapshot. (can be called from several threads at the same time)
+ROINT_DLLAPI int grf_snapshot_glob(const struct ROGrfSnapshot *snap, const char *pattern, t_grf_walk_function_ptr fptr, void *aux);
+
+/**
+  * Creates a new GRF file (version 0x200).
+  * options is a combination of GRF_WRITER_* flags.
+  */
+ROINT_DLLAPI struct ROGrfWriter *grf_writer_open(const char *fn, unsigned int options);
+/**
+  * Adds a file to the GRF being written. The data is written immediately.
+  * Returns 0 on success.
+  */
+ROINT_DLLAPI int grf_writer_add(struct ROGrfWriter *writer, const char *name, const void *data, unsigned int length);
+/**
+  * Writes the file table and header and releases the writer.
+  * Returns 0 on success.
+  */
+ROINT_DLLAPI int grf_writer_close(struct ROGrfWriter *writer);
 
 #ifdef __cplusplus
 }
@@ -62,6 +184,31 @@ struct ROGrfFile {
 	unsigned char *data;
 };
 
+/// Number of threads that can hold a snapshot of the same GRF at a time.
+#ifndef GRF_MAX_READERS
+#	define GRF_MAX_READERS 64
+#endif
+
+/// Immutable view of the GRF index.
+struct ROGrfSnapshot {
+	struct ROGrf *grf;
+	FILE *fp; //< archive as it was when the snapshot was made
+	unsigned int filecount;
+	struct ROGrfFile *files;
+	struct BTree *btree;
+	char *names; //< file names (NULL if they live in the shared index)
+
+	void *shared; //< mapped shared index (file names and btree nodes live there), NULL if private
+	unsigned long sharedsize;
+
+	void *volatile map; //< mapped archive for views of stored files (mapped on first use)
+	unsigned long mapsize; //< size of the header and stored data
+	struct ROGrfDirTree *volatile dirtree; //< directory tree for grf_glob (built on first use)
+
+	unsigned int retired; //< epoch in which the snapshot was replaced
+	struct ROGrfSnapshot *next; //< next retired snapshot
+};
+
 struct ROGrf {
 	struct {
 	    char signature[16];
@@ -74,6 +221,26 @@ struct ROGrf {
 	FILE *fp;
 	struct ROGrfFile *files;
     struct BTree *btree;
+
+	struct ROGrfSnapshot *volatile current; //< published snapshot (fp, files and btree above are the ones of this snapshot)
+	struct ROGrfSnapshot *retired; //< replaced snapshots waiting for their readers to leave
+	volatile unsigned int epoch; //< incremented every time a snapshot is replaced
+	volatile unsigned int readers[GRF_MAX_READERS]; //< epoch seen by each reader when it acquired a snapshot (0 if the slot is free)
+
+	char *filename;
+	int watchfd; //< inotify descriptor (-1 if not watching)
+	int watchwd;
+};
+
+struct ROGrfWriter {
+	FILE *fp;
+	unsigned int options;
+	unsigned int filecount;
+	unsigned int offset; //< end of the stored data (relative to the end of the header)
+
+	unsigned char *table; //< uncompressed file table
+	unsigned long tablelength;
+	unsigned long tablecapacity;
 };
 
 #ifdef __cplusplus
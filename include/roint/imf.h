@@ -94,7 +94,7 @@ ROINT_DLLAPI struct ROImf *imf_loadFromFile(const char *fn);
 /// Loads the str from a ROGrf file. (NULL on error)
 ROINT_DLLAPI struct ROImf *imf_loadFromGrf(struct ROGrfFile*);
 /// Saves the imf to a data buffer. (0 on success)
-/// \warning the 'data_out' data has to be released with the roint free function
+/// \warning the 'data_out' data has to be released with roint_free
 ROINT_DLLAPI int imf_saveToData(const struct ROImf *imf, unsigned char **data_out, unsigned long *size_out);
 /// Saves the imf to a system file. (0 on success)
 ROINT_DLLAPI int imf_saveToFile(const struct ROImf *imf, const char *fn);
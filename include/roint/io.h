@@ -0,0 +1,101 @@
+/*
+    ------------------------------------------------------------------------------------
+    LICENSE:
+    ------------------------------------------------------------------------------------
+    This file is part of The Open Ragnarok Project
+    Copyright 2007 - 2012 The Open Ragnarok Team
+    For the latest information visit http://www.open-ragnarok.org
+    ------------------------------------------------------------------------------------
+    This program is free software; you can redistribute it and/or modify it under
+    the terms of the GNU Lesser General Public License as published by the Free Software
+    Foundation; either version 2 of the License, or (at your option) any later
+    version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License along with
+    this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+    Place - Suite 330, Boston, MA 02111-1307, USA, or go to
+    http://www.gnu.org/copyleft/lesser.txt.
+    ------------------------------------------------------------------------------------
+*/
+#ifndef __ROINT_IO_H
+#define __ROINT_IO_H
+
+#ifdef ROINT_INTERNAL
+#	include "config.h"
+#elif !defined(WITHOUT_ROINT_CONFIG)
+#	include "roint/config.h"
+#endif
+
+#ifndef ROINT_DLLAPI
+#	define ROINT_DLLAPI
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// File mode: stdio stream with the default buffering. (default)
+#define ROINT_FILEMODE_STDIO 0
+/// File mode: large buffer filled in big reads, with a sequential access hint.
+#define ROINT_FILEMODE_BUFFERED 1
+/// File mode: the whole file is mapped in memory. (falls back to ROINT_FILEMODE_BUFFERED)
+#define ROINT_FILEMODE_MAP 2
+
+/// Set how the *_loadFromFile functions read files.
+/// Takes effect on the files opened afterwards.
+ROINT_DLLAPI void roint_set_file_mode(unsigned char mode);
+/// Get the file mode.
+ROINT_DLLAPI unsigned char roint_get_file_mode(void);
+
+
+/// Formats with their own I/O totals.
+#define ROINT_FORMAT_ACT 0
+#define ROINT_FORMAT_CATALOG 1
+#define ROINT_FORMAT_GAT 2
+#define ROINT_FORMAT_GND 3
+#define ROINT_FORMAT_GRF 4 //< reads of archived files (inflate included)
+#define ROINT_FORMAT_IMF 5
+#define ROINT_FORMAT_PAL 6
+#define ROINT_FORMAT_RGZ 7
+#define ROINT_FORMAT_RSM 8
+#define ROINT_FORMAT_RSW 9
+#define ROINT_FORMAT_SPR 10
+#define ROINT_FORMAT_STR 11
+/// Number of formats.
+#define ROINT_FORMAT_COUNT 12
+
+/// I/O totals of the loads or the saves of a format.
+/// The difference between time and iotime is the time spent decoding,
+/// encoding and allocating.
+struct ROIoStats {
+	unsigned long long count; ///< Number of loads or saves.
+	unsigned long long bytes; ///< Bytes read or written.
+	unsigned long long calls; ///< Read, borrow or write calls.
+	unsigned long long seeks; ///< Seek calls.
+	unsigned long long iotime; ///< Nanoseconds spent inside the read/write/seek calls.
+	unsigned long long time; ///< Nanoseconds spent in the loads or saves, I/O included.
+};
+
+/// Enable or disable the I/O counters. (disabled by default)
+/// When enabled, the *_loadFrom* and *_saveTo* functions count the I/O of each
+/// call and add it to the totals of the format.
+ROINT_DLLAPI void roint_set_io_stats(int enable);
+/// Returns non-zero if the I/O counters are enabled.
+ROINT_DLLAPI int roint_get_io_stats_enabled(void);
+/// Get the totals of a format. (load or save can be NULL)
+/// Returns 0 on success.
+ROINT_DLLAPI int roint_get_io_stats(unsigned int format, struct ROIoStats *load, struct ROIoStats *save);
+/// Set all the totals to zero.
+ROINT_DLLAPI void roint_reset_io_stats(void);
+/// Returns the name of a format. ("act", "gnd", ...; NULL if unknown)
+ROINT_DLLAPI const char *roint_format_name(unsigned int format);
+
+#ifdef __cplusplus
+}
+#endif 
+
+#endif /* __ROINT_IO_H */
@@ -48,8 +48,102 @@ ROINT_DLLAPI void set_roint_malloc_func(roint_alloc_func);
 ROINT_DLLAPI void set_roint_free_func(roint_free_func);
     
 ROINT_DLLAPI roint_alloc_func get_roint_malloc_func();
+/// Returns the function set with set_roint_free_func,
+/// or roint_free if an allocator was set with roint_set_allocator or roint_set_thread_allocator.
 ROINT_DLLAPI roint_free_func get_roint_free_func();
 
+/// Free memory handed over by the library (saved data, converted strings)
+/// with the allocator of the current thread, or the library-wide one.
+ROINT_DLLAPI void roint_free(void *ptr);
+
+/// Allocator with a user context.
+/// alloc and free are required, the other functions are optional (NULL).
+/// The size passed to the free functions is the size that was requested,
+/// or 0 when the library does not know it.
+struct ROAllocator {
+	void *ctx; ///< Passed to every function.
+	void *(*alloc)(void *ctx, size_t size);
+	void (*free)(void *ctx, void *ptr, size_t size);
+	/// Resize a block. (NULL: alloc, copy and free)
+	void *(*realloc)(void *ctx, void *ptr, size_t oldsize, size_t size);
+	/// Allocate a block aligned to a power of two. (NULL: over-allocates with alloc)
+	void *(*aligned_alloc)(void *ctx, size_t alignment, size_t size);
+	/// Free a block from aligned_alloc. (required with aligned_alloc)
+	void (*aligned_free)(void *ctx, void *ptr, size_t size);
+};
+
+/// Set the allocator used throughout ROInt engine. (the structure is copied)
+/// Pass NULL to return to the default allocator.
+/// Replaces the functions set with set_roint_malloc_func and set_roint_free_func.
+ROINT_DLLAPI void roint_set_allocator(const struct ROAllocator *allocator);
+/// Get the allocator used throughout ROInt engine.
+ROINT_DLLAPI void roint_get_allocator(struct ROAllocator *allocator);
+/// Set the allocator of the current thread, which overrides the library-wide one.
+/// The structure is not copied and must stay valid while it is set.
+/// Pass NULL to use the library-wide allocator again.
+/// Returns the previous allocator of the thread, so an operation can be wrapped:
+///   prev = roint_set_thread_allocator(&mine); ... roint_set_thread_allocator(prev);
+/// Memory must be freed with the allocator that allocated it,
+/// so an object must be unloaded with the same allocator it was loaded with.
+/// Worker threads started by the library use the allocator of the thread that started them.
+ROINT_DLLAPI const struct ROAllocator *roint_set_thread_allocator(const struct ROAllocator *allocator);
+
+/// Pool allocator for the small blocks, with a cache of free blocks per thread.
+/// Blocks of up to 1024 bytes come from size classes carved in big slabs,
+/// bigger blocks come from malloc. The slabs are kept until the process ends.
+/// Install it with set_roint_malloc_func(roint_pool_malloc) and
+/// set_roint_free_func(roint_pool_free), or with roint_set_allocator(roint_pool_allocator()).
+/// Each thread that used the pool must return its cached blocks before it ends:
+///   roint_set_allocator(roint_pool_allocator());
+///   ... // in every thread that loads or frees with the pool, before the thread ends:
+///   roint_pool_flush_thread();
+ROINT_DLLAPI void *roint_pool_malloc(size_t size);
+ROINT_DLLAPI void roint_pool_free(void *ptr);
+/// Get the pool allocator as a ROAllocator. (with realloc)
+ROINT_DLLAPI const struct ROAllocator *roint_pool_allocator(void);
+/// Return the free blocks cached by the current thread to the pool.
+/// Call it before a thread that used the pool ends, or the blocks are lost.
+ROINT_DLLAPI void roint_pool_flush_thread(void);
+
+/// Allocation subsystems: the ROINT_FORMAT_* formats of roint/io.h and these.
+#define ROINT_ALLOC_TEXT 12 //< string conversions of roint/text.h
+#define ROINT_ALLOC_OTHER 13 //< everything else (file buffers, calls outside of a load, a save or a grf call)
+/// Number of subsystems.
+#define ROINT_ALLOC_COUNT 14
+/// Totals of all the subsystems.
+#define ROINT_ALLOC_ALL 14
+
+/// Allocation totals of a subsystem.
+/// A realloc counts as a free and an allocation.
+/// Memory handed over to the caller (saved data, converted strings) stops being live.
+struct ROAllocStats {
+	unsigned long long live; ///< Bytes allocated and not freed yet.
+	unsigned long long peak; ///< Highest value of live.
+	unsigned long long count; ///< Number of allocations.
+	unsigned long long frees; ///< Number of frees.
+	unsigned long long bytes; ///< Bytes allocated in total.
+};
+
+/// Get the allocation totals of a subsystem, or of all of them with ROINT_ALLOC_ALL.
+/// Allocations are attributed to the subsystem of the call that made them.
+/// Returns 0 on success, 1 if the library was built without ROINT_ENABLE_ALLOC_STATS.
+ROINT_DLLAPI int roint_get_alloc_stats(unsigned int subsystem, struct ROAllocStats *stats);
+/// Set the peaks to the current live bytes, to measure the peak of the next operations.
+ROINT_DLLAPI void roint_reset_alloc_peaks(void);
+
+/// Load mode: every array of a loaded object is a separate allocation. (default)
+#define ROINT_LOADMODE_HEAP 0
+/// Load mode: each loaded object is carved from a few big blocks,
+/// which the *_unload function releases all at once.
+#define ROINT_LOADMODE_ARENA 1
+
+/// Set how the *_loadFrom* functions allocate the objects.
+/// Takes effect on the objects loaded afterwards.
+/// Objects loaded in any mode are released with the *_unload functions.
+ROINT_DLLAPI void roint_set_load_mode(unsigned char mode);
+/// Get the load mode.
+ROINT_DLLAPI unsigned char roint_get_load_mode(void);
+
 #ifdef __cplusplus
 }
 #endif 
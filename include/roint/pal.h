@@ -63,7 +63,7 @@ ROINT_DLLAPI struct ROPal *pal_loadFromFile(const char *fn);
 /// Loads the pal from a ROGrf file. (NULL on error)
 ROINT_DLLAPI struct ROPal *pal_loadFromGrf(struct ROGrfFile*);
 /// Saves the pal to a data buffer. (0 on success)
-/// WARNING : the 'data_out' data has to be released with the roint free function
+/// WARNING : the 'data_out' data has to be released with roint_free
 ROINT_DLLAPI int pal_saveToData(const struct ROPal *pal, unsigned char **data, unsigned long *len);
 /// Saves the pal to a system file. (0 on success)
 ROINT_DLLAPI int pal_saveToFile(const struct ROPal *pal, const char *fn);
@@ -63,6 +63,20 @@ struct RORgz {
 };
 #pragma pack(pop)
 
+/// Rgz archive opened for random access.
+/// The entries are listed when opening and the file data is read on demand.
+/// Seeks resume from checkpoints so reading any entry does not uncompress everything before it.
+/// Not thread safe.
+struct RORgzStream {
+	unsigned int entrycount;
+	struct RORgzEntry *entries; //< entries without data (data is NULL)
+	unsigned int *offsets; //< offset of the file data of each entry in the uncompressed data
+	void *file; //< internal
+	void *reader; //< internal
+	unsigned long long mtime; //< internal (modification time of the file, checked by the index)
+	unsigned int trailer[2]; //< internal (CRC32 and ISIZE of the gzip trailer, checked by the index)
+};
+
 
 /// Inspects the rgz data and returns 1 if valid. (0 if invalid)
 ROINT_DLLAPI unsigned short rgz_inspect(const struct RORgz *rgz);
@@ -72,7 +86,7 @@ ROINT_DLLAPI struct RORgz *rgz_loadFromData(const unsigned char *data, unsigned
 ROINT_DLLAPI struct RORgz *rgz_loadFromFile(const char *fn);
 /// Saves the rgz to a data buffer. (0 on success)
 /// Ignores everything after the end entry.
-/// WARNING : the 'data_out' data has to be released with the roint free function
+/// WARNING : the 'data_out' data has to be released with roint_free
 ROINT_DLLAPI int rgz_saveToData(const struct RORgz *rgz, unsigned char **data_out, unsigned long *size_out);
 /// Saves the rgz to a system file. (0 on success)
 /// Ignores everything after the end entry.
@@ -80,6 +94,17 @@ ROINT_DLLAPI int rgz_saveToFile(const struct RORgz *rgz, const char *fn);
 /// Frees everything inside the RORgz structure allocated by us (including the rgz itself!)
 ROINT_DLLAPI void rgz_unload(struct RORgz *rgz);
 
+/// Opens the rgz system file for random access. (NULL on error)
+/// If indexfn is not NULL and is an index of this file saved by rgz_saveIndex, the entries are not scanned.
+/// The index must match the size, modification time and gzip trailer of the file.
+ROINT_DLLAPI struct RORgzStream *rgz_open(const char *fn, const char *indexfn);
+/// Reads 'length' bytes of the data of a file entry, starting at 'offset', into buf. (0 on success)
+ROINT_DLLAPI int rgz_read(struct RORgzStream *rgz, unsigned int entry, unsigned int offset, void *buf, unsigned int length);
+/// Saves the entries and seek checkpoints to a system file, to open the rgz faster next time. (0 on success)
+ROINT_DLLAPI int rgz_saveIndex(struct RORgzStream *rgz, const char *indexfn);
+/// Closes the rgz.
+ROINT_DLLAPI void rgz_close(struct RORgzStream *rgz);
+
 
 #ifdef __cplusplus
 }
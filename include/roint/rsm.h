@@ -131,6 +131,16 @@ struct RORsm {
 ROINT_DLLAPI struct RORsm *rsm_loadFromData(const unsigned char *data, unsigned int len);
 // Loads the rsm from the ROGrf structure file. -- This is only a wrapper to the rsm_load() function
 ROINT_DLLAPI struct RORsm *rsm_loadFromGrf(struct ROGrfFile*);
+// Saves the rsm with everything it points to in a flat block. (0 on success)
+// WARNING : the 'data_out' data has to be released with roint_free
+// See roint/flat.h
+ROINT_DLLAPI int rsm_saveToFlat(const struct RORsm *rsm, unsigned char **data_out, unsigned long *size_out);
+// Returns the rsm of a flat block, relocating and verifying the block if it moved. (NULL if invalid)
+// Never pass the result to rsm_unload.
+ROINT_DLLAPI const struct RORsm *rsm_attachFlat(void *data, unsigned long size);
+// Checks every array of the rsm of a flat block that is at its address. (0 if valid)
+// \sa roint_flat_verify
+ROINT_DLLAPI int rsm_verifyFlat(const void *data, unsigned long size);
 // Frees everything inside the RORsm structure allocated by us (including the rsm itself!)
 ROINT_DLLAPI void rsm_unload(struct RORsm*);
 
@@ -82,6 +82,76 @@ struct ROSpr {
 #pragma pack(pop)
 
 
+/// Frame of a sprite loaded with spr_loadLazyFrom*.
+struct ROSprLazyFrame {
+	unsigned short width;
+	unsigned short height;
+	unsigned int offset; ///< Offset of the pixels in ROSprLazy.data. (as stored in the file)
+	unsigned int length; ///< Length of the pixels in ROSprLazy.data.
+};
+
+/// Start of a row in the RLE pixels of a v2.1 pal image.
+struct ROSprLazyRow {
+	unsigned short offset; ///< Offset of the token with the first pixel of the row, from ROSprLazyFrame.offset.
+	unsigned short skip; ///< Pixels of that token that belong to the previous rows. (runs of index 0 span rows)
+};
+
+/// Sprite with the pal images decoded on first access.
+/// Keeps the frames as they are stored in the file (RLE pal images in v2.1),
+/// so a sprite only pays for the decoded frames that are used.
+/// spr_lazy_decoderect decodes parts of the frames without decoding or caching whole frames.
+/// Not thread-safe: spr_lazy_getpalimage, spr_lazy_decoderect, spr_lazy_indexrows and spr_lazy_flush modify the cache.
+struct ROSprLazy {
+	unsigned short version;//< 0x100 or 0x101 or 0x200 or 0x201
+	unsigned short palimagecount;
+	struct ROSprLazyFrame *palimages;
+	unsigned short rgbaimagecount;
+	struct ROSprLazyFrame *rgbaimages;
+	struct ROPal *pal;
+	unsigned char *data; ///< Frames as stored in the file.
+	unsigned long datasize;
+	unsigned char **palcache; ///< Decoded pal images. (NULL until first accessed)
+	struct ROSprLazyRow **rowindex; ///< Row index of the v2.1 pal images. (NULL until first needed)
+	unsigned long cachesize; ///< Bytes in palcache and rowindex.
+};
+
+/// Atlas option: pack only the rectangle of the non-transparent pixels of each frame.
+#define SPR_ATLAS_TRIM 1
+
+/// Frame of a sprite atlas.
+struct ROSprAtlasFrame {
+	unsigned int spr; ///< Index of the spr in the list given to spr_atlas_pack.
+	unsigned int type; ///< 0=pal image, 1=rgba image (same as ROActSprClip.sprType)
+	unsigned int image; ///< Index in palimages or rgbaimages.
+	unsigned int page; ///< Atlas page.
+	/// Rectangle in the page. (0x0 if the frame is empty or, when trimmed, fully transparent)
+	unsigned int x, y, width, height;
+	/// Position of the rectangle in the frame; left to right, top to bottom ordering. (0,0 if not trimmed)
+	unsigned int trimx, trimy;
+	/// Texture coordinates of the rectangle in the page. (top-left u0,v0; bottom-right u1,v1)
+	/// A frame coordinate (fx,fy) in pixels maps to
+	/// u = u0 + (fx - trimx) * (u1 - u0) / width, v = v0 + (fy - trimy) * (v1 - v0) / height.
+	float u0, v0, u1, v1;
+};
+
+/// Page of a sprite atlas.
+struct ROSprAtlasPage {
+	unsigned int width;
+	unsigned int height;
+	unsigned char *rgba; ///< r,g,b,a per pixel; left to right, top to bottom ordering. (transparent is 0,0,0,0)
+};
+
+/// Sprite atlas.
+/// The frames of each spr are in order, pal images first, so the frame of
+/// rgba image i of the first spr is frames[spr->palimagecount + i].
+struct ROSprAtlas {
+	unsigned int framecount;
+	struct ROSprAtlasFrame *frames;
+	unsigned int pagecount;
+	struct ROSprAtlasPage *pages;
+};
+
+
 /// Inspects the gat data and returns the first compatible version. (0 if invalid)
 ROINT_DLLAPI unsigned short spr_inspect(const struct ROSpr *spr);
 /// Loads the spr from a data buffer. (NULL on error)
@@ -91,10 +161,64 @@ ROINT_DLLAPI struct ROSpr *spr_loadFromFile(const char *fn);
 /// Loads the spr from a ROGrf file. (NULL on error)
 ROINT_DLLAPI struct ROSpr *spr_loadFromGrf(struct ROGrfFile*);
 /// Saves the spr to a data buffer. (0 on success)
-/// WARNING : the 'data_out' data has to be released with the roint free function
+/// WARNING : the 'data_out' data has to be released with roint_free
 ROINT_DLLAPI int spr_saveToData(const struct ROSpr *spr, unsigned char **data_out, unsigned long *size_out);
 /// Saves the spr to a system file. (0 on success)
 ROINT_DLLAPI int spr_saveToFile(const struct ROSpr *spr, const char *fn);
+/// Saves the spr with everything it points to in a flat block. (0 on success)
+/// WARNING : the 'data_out' data has to be released with roint_free
+/// \sa roint/flat.h
+ROINT_DLLAPI int spr_saveToFlat(const struct ROSpr *spr, unsigned char **data_out, unsigned long *size_out);
+/// Returns the spr of a flat block, relocating and verifying the block if it moved. (NULL if invalid)
+/// Never pass the result to spr_unload.
+ROINT_DLLAPI const struct ROSpr *spr_attachFlat(void *data, unsigned long size);
+/// Checks every array of the spr of a flat block that is at its address. (0 if valid)
+/// \sa roint_flat_verify
+ROINT_DLLAPI int spr_verifyFlat(const void *data, unsigned long size);
+/// Expands a pal image to RGBA pixels with the palette. (0 on success)
+/// 'rgba' receives width * height * 4 bytes; r,g,b,a per pixel; left to right, top to bottom ordering.
+/// Index 0 is transparent (0,0,0,0), the other indexes are opaque.
+ROINT_DLLAPI int spr_palimage_to_rgba(const struct ROSprPalImage *image, const struct ROPal *pal, unsigned char *rgba);
+/// Expands all the pal images of the spr to RGBA pixels. (0 on success)
+/// Uses the palette of the spr if 'pal' is NULL.
+/// The images are stored one after the other, in the format of spr_palimage_to_rgba.
+/// WARNING : the 'data_out' data has to be released with roint_free
+ROINT_DLLAPI int spr_pal_to_rgba(const struct ROSpr *spr, const struct ROPal *pal, unsigned char **data_out, unsigned long *size_out);
+/// Packs all the frames of the sprs in atlas pages of up to pagesize x pagesize pixels. (NULL on error)
+/// Pal images are expanded with the palette of their spr, index 0 is transparent.
+/// 'padding' transparent pixels are kept between the frames.
+/// 'flags' is 0 or SPR_ATLAS_TRIM.
+/// Frames that do not fit in a page are an error.
+ROINT_DLLAPI struct ROSprAtlas *spr_atlas_pack(const struct ROSpr *const *sprs, unsigned int sprcount, unsigned int pagesize, unsigned int padding, unsigned int flags);
+/// Frees the atlas, its frames and its pages.
+ROINT_DLLAPI void spr_atlas_unload(struct ROSprAtlas *atlas);
+/// Loads the spr from a data buffer without decoding the pal images. (NULL on error)
+/// The frames are checked when they are decoded.
+ROINT_DLLAPI struct ROSprLazy *spr_loadLazyFromData(const unsigned char *data, unsigned int len);
+/// Loads the spr from a system file without decoding the pal images. (NULL on error)
+ROINT_DLLAPI struct ROSprLazy *spr_loadLazyFromFile(const char *fn);
+/// Loads the spr from a ROGrf file without decoding the pal images. (NULL on error)
+ROINT_DLLAPI struct ROSprLazy *spr_loadLazyFromGrf(struct ROGrfFile*);
+/// Decodes a pal image in the caller buffer. (0 on success)
+/// 'data' receives width * height palette indexes; left to right, top to bottom ordering.
+ROINT_DLLAPI int spr_lazy_decodepalimage(const struct ROSprLazy *spr, unsigned int image, unsigned char *data);
+/// Decodes a rectangle of a pal image in the caller buffer. (0 on success)
+/// 'data' receives width * height palette indexes, the rows are 'pitch' bytes apart.
+/// v2.1 rows are found with the row index, built on first use.
+ROINT_DLLAPI int spr_lazy_decoderect(struct ROSprLazy *spr, unsigned int image, unsigned int x, unsigned int y, unsigned int width, unsigned int height, unsigned char *data, unsigned int pitch);
+/// Builds the row index of every v2.1 pal image, checking the RLE data. (0 on success)
+/// Otherwise each row index is built when spr_lazy_decoderect first needs it.
+ROINT_DLLAPI int spr_lazy_indexrows(struct ROSprLazy *spr);
+/// Returns the palette indexes of a pal image, decoding it on first access. (NULL on error or if empty)
+/// The pixels stay valid until spr_lazy_flush or spr_lazy_unload.
+ROINT_DLLAPI const unsigned char *spr_lazy_getpalimage(struct ROSprLazy *spr, unsigned int image);
+/// Returns the pixels of a rgba image; left to right, bottom to top ordering. (NULL on error or if empty)
+/// The pixels point inside spr->data, there is nothing to decode.
+ROINT_DLLAPI const struct ROSprColor *spr_lazy_getrgbaimage(const struct ROSprLazy *spr, unsigned int image);
+/// Frees the decoded pal images and the row indexes.
+ROINT_DLLAPI void spr_lazy_flush(struct ROSprLazy *spr);
+/// Frees the ROSprLazy structure and everything inside it.
+ROINT_DLLAPI void spr_lazy_unload(struct ROSprLazy *spr);
 /// Frees everything inside the ROSpr structure allocated by us (including the spr itself!)
 ROINT_DLLAPI void spr_unload(struct ROSpr *spr);
 
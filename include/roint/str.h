@@ -228,10 +228,20 @@ ROINT_DLLAPI struct ROStr *str_loadFromFile(const char *fn);
 /// Loads the str from a ROGrf file. (NULL on error)
 ROINT_DLLAPI struct ROStr *str_loadFromGrf(struct ROGrfFile*);
 /// Saves the str to a data buffer. (0 on success)
-/// WARNING : the 'data_out' data has to be released with the roint free function
+/// WARNING : the 'data_out' data has to be released with roint_free
 ROINT_DLLAPI int str_saveToData(const struct ROStr *str, unsigned char **data_out, unsigned long *size_out);
 /// Saves the str to a system file. (0 on success)
 ROINT_DLLAPI int str_saveToFile(const struct ROStr *str, const char *fn);
+/// Saves the str with everything it points to in a flat block. (0 on success)
+/// WARNING : the 'data_out' data has to be released with roint_free
+/// \sa roint/flat.h
+ROINT_DLLAPI int str_saveToFlat(const struct ROStr *str, unsigned char **data_out, unsigned long *size_out);
+/// Returns the str of a flat block, relocating and verifying the block if it moved. (NULL if invalid)
+/// Never pass the result to str_unload.
+ROINT_DLLAPI const struct ROStr *str_attachFlat(void *data, unsigned long size);
+/// Checks every array of the str of a flat block that is at its address. (0 if valid)
+/// \sa roint_flat_verify
+ROINT_DLLAPI int str_verifyFlat(const void *data, unsigned long size);
 /// Frees everything inside the ROStr structure allocated by us (including the str itself!)
 ROINT_DLLAPI void str_unload(struct ROStr *str);
 
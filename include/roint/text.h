@@ -39,6 +39,8 @@
 extern "C" {
 #endif
 
+// WARNING : the converted strings have to be released with roint_free
+
 // UNICODE int code points (20 bits used)
 // CP949 1/2-byte code points
 
@@ -34,8 +34,26 @@
 
 extern roint_log_func _xlog;
 
-extern roint_alloc_func _xalloc;
-extern roint_free_func _xfree;
+// memory (see struct ROAllocator)
+extern void *_xalloc(size_t size);
+extern void _xfree(void *ptr);
+extern void _xfreesize(void *ptr, size_t size);
+extern void *_xrealloc(void *ptr, size_t oldsize, size_t size);
+extern void *_xalloc_aligned(size_t alignment, size_t size);
+extern void _xfree_aligned(void *ptr, size_t size);
+// library-wide allocator, for state that outlives the thread allocators
+extern void *_xalloc_global(size_t size);
+extern void _xfree_global(void *ptr, size_t size);
+// allocation statistics (no-ops without ROINT_ENABLE_ALLOC_STATS)
+extern void _xhandover(const void *ptr); // memory given to the caller, stops being live
+extern unsigned int _xalloc_subsystem(unsigned int subsystem); // set the ROINT_ALLOC_* subsystem of the thread, returns the previous one
+// allocation state of a thread, copied to the worker threads
+struct _xalloc_state {
+	const struct ROAllocator *allocator;
+	unsigned int subsystem;
+};
+extern void _xalloc_getstate(struct _xalloc_state *state);
+extern void _xalloc_setstate(const struct _xalloc_state *state);
 
 extern struct ROPal *pal_load(struct _reader *reader);
 extern int pal_save(const struct ROPal *, struct _writer *writer);
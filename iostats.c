@@ -0,0 +1,339 @@
+/*
+    ------------------------------------------------------------------------------------
+    LICENSE:
+    ------------------------------------------------------------------------------------
+    This file is part of The Open Ragnarok Project
+    Copyright 2007 - 2012 The Open Ragnarok Team
+    For the latest information visit http://www.open-ragnarok.org
+    ------------------------------------------------------------------------------------
+    This program is free software; you can redistribute it and/or modify it under
+    the terms of the GNU Lesser General Public License as published by the Free Software
+    Foundation; either version 2 of the License, or (at your option) any later
+    version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License along with
+    this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+    Place - Suite 330, Boston, MA 02111-1307, USA, or go to
+    http://www.gnu.org/copyleft/lesser.txt.
+    ------------------------------------------------------------------------------------
+*/
+#include "internal.h"
+#include "atomic.h"
+#include "iostats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(_WIN32)
+#	define WIN32_LEAN_AND_MEAN
+#	include <windows.h>
+#endif
+
+
+#define CAST_UP(type, member, ptr) (type*)( (char*)ptr - offsetof(type,member) )
+#define CAST_DOWN(ptr, member) ( &ptr->member )
+
+
+static const char *iostats_names[ROINT_FORMAT_COUNT] = {
+	"act", "catalog", "gat", "gnd", "grf", "imf", "pal", "rgz", "rsm", "rsw", "spr", "str"
+};
+
+static volatile unsigned int iostats_enabled = 0;
+static volatile unsigned int iostats_lock = 0;
+static struct ROIoStats iostats_totals[ROINT_FORMAT_COUNT][2]; // [format][save]
+
+
+unsigned long long _iostats_now(void) {
+#if defined(_WIN32)
+	LARGE_INTEGER counter, frequency;
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+	return((unsigned long long)counter.QuadPart / (unsigned long long)frequency.QuadPart * 1000000000ULL +
+		(unsigned long long)counter.QuadPart % (unsigned long long)frequency.QuadPart * 1000000000ULL / (unsigned long long)frequency.QuadPart);
+#elif defined(HAVE_CLOCK_GETTIME)
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return((unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec);
+#else
+	return((unsigned long long)clock() * (1000000000ULL / CLOCKS_PER_SEC));
+#endif
+}
+
+
+int _iostats_enabled(void) {
+	return(_xatomic_load(&iostats_enabled) != 0);
+}
+
+
+void _iostats_add(unsigned int format, int save, const struct ROIoStats *stats) {
+	struct ROIoStats *total;
+
+	if (format >= ROINT_FORMAT_COUNT)
+		return;
+	total = &iostats_totals[format][save? 1: 0];
+	while (!_xatomic_cas(&iostats_lock, 0, 1))
+		;// merges are short and rare
+	total->count += stats->count;
+	total->bytes += stats->bytes;
+	total->calls += stats->calls;
+	total->seeks += stats->seeks;
+	total->iotime += stats->iotime;
+	total->time += stats->time;
+	_xatomic_store(&iostats_lock, 0);
+}
+
+
+void roint_set_io_stats(int enable) {
+	_xatomic_store(&iostats_enabled, enable? 1: 0);
+}
+
+
+int roint_get_io_stats_enabled(void) {
+	return(_iostats_enabled());
+}
+
+
+int roint_get_io_stats(unsigned int format, struct ROIoStats *load, struct ROIoStats *save) {
+	if (format >= ROINT_FORMAT_COUNT)
+		return(1);
+	while (!_xatomic_cas(&iostats_lock, 0, 1))
+		;
+	if (load != NULL)
+		memcpy(load, &iostats_totals[format][0], sizeof(struct ROIoStats));
+	if (save != NULL)
+		memcpy(save, &iostats_totals[format][1], sizeof(struct ROIoStats));
+	_xatomic_store(&iostats_lock, 0);
+	return(0);
+}
+
+
+void roint_reset_io_stats(void) {
+	while (!_xatomic_cas(&iostats_lock, 0, 1))
+		;
+	memset(iostats_totals, 0, sizeof(iostats_totals));
+	_xatomic_store(&iostats_lock, 0);
+}
+
+
+const char *roint_format_name(unsigned int format) {
+	if (format >= ROINT_FORMAT_COUNT)
+		return(NULL);
+	return(iostats_names[format]);
+}
+
+
+struct _statsreader {
+	struct _reader base;
+	struct _reader *parent;
+	unsigned int format;
+	unsigned int subsystem; // previous allocation subsystem of the thread
+	int counted; // I/O counters enabled
+	unsigned long long start;
+	struct ROIoStats stats;
+};
+
+
+void statsreader_destroy(struct _reader *reader) {
+	struct _statsreader *statsreader = CAST_UP(struct _statsreader,base,reader);
+
+	statsreader->parent->destroy(statsreader->parent);
+	_xalloc_subsystem(statsreader->subsystem);
+	if (statsreader->counted) {
+		statsreader->stats.count = 1;
+		statsreader->stats.time = _iostats_now() - statsreader->start;
+		_iostats_add(statsreader->format, 0, &statsreader->stats);
+	}
+	_xfree(statsreader);
+}
+
+
+int statsreader_read(void *dest, unsigned long size, unsigned int count, struct _reader *reader) {
+	struct _statsreader *statsreader = CAST_UP(struct _statsreader,base,reader);
+	struct _reader *parent = statsreader->parent;
+	unsigned long long start = _iostats_now();
+
+	reader->error = parent->read(dest, size, count, parent);
+	statsreader->stats.iotime += _iostats_now() - start;
+	statsreader->stats.calls++;
+	statsreader->stats.bytes += (unsigned long long)size * count;
+	return(reader->error);
+}
+
+
+int statsreader_seek(struct _reader *reader, long pos, int origin) {
+	struct _statsreader *statsreader = CAST_UP(struct _statsreader,base,reader);
+	struct _reader *parent = statsreader->parent;
+	unsigned long long start = _iostats_now();
+
+	reader->error = parent->seek(parent, pos, origin);
+	statsreader->stats.iotime += _iostats_now() - start;
+	statsreader->stats.seeks++;
+	return(reader->error);
+}
+
+
+unsigned long statsreader_tell(struct _reader *reader) {
+	struct _statsreader *statsreader = CAST_UP(struct _statsreader,base,reader);
+	struct _reader *parent = statsreader->parent;
+	unsigned long ret;
+
+	ret = parent->tell(parent);
+	reader->error = parent->error;
+	return(ret);
+}
+
+
+const unsigned char *statsreader_borrow(struct _reader *reader, unsigned long size) {
+	struct _statsreader *statsreader = CAST_UP(struct _statsreader,base,reader);
+	struct _reader *parent = statsreader->parent;
+	const unsigned char *ret;
+	unsigned long long start = _iostats_now();
+
+	ret = parent->borrow(parent, size);
+	reader->error = parent->error;
+	statsreader->stats.iotime += _iostats_now() - start;
+	statsreader->stats.calls++;
+	if (ret != NULL)
+		statsreader->stats.bytes += size;
+	return(ret);
+}
+
+
+unsigned long statsreader_remaining(struct _reader *reader) {
+	struct _statsreader *statsreader = CAST_UP(struct _statsreader,base,reader);
+	struct _reader *parent = statsreader->parent;
+
+	return(parent->remaining(parent));
+}
+
+
+struct _reader *statsreader_init(struct _reader *parent, unsigned int format) {
+	struct _statsreader *ret;
+
+#ifndef ROINT_ENABLE_ALLOC_STATS
+	if (!_iostats_enabled())
+		return(parent);
+#endif
+
+	ret = (struct _statsreader*)_xalloc(sizeof(struct _statsreader));
+	memset(ret, 0, sizeof(struct _statsreader));
+	ret->base.destroy = &statsreader_destroy;
+	ret->base.read = &statsreader_read;
+	ret->base.seek = &statsreader_seek;
+	ret->base.tell = &statsreader_tell;
+	ret->base.borrow = &statsreader_borrow;
+	ret->base.remaining = &statsreader_remaining;
+	ret->base.error = parent->error;
+
+	ret->parent = parent;
+	ret->format = format;
+	ret->subsystem = _xalloc_subsystem(format);
+	ret->counted = _iostats_enabled();
+	ret->start = _iostats_now();
+
+	return(CAST_DOWN(ret,base));
+}
+
+
+struct _statswriter {
+	struct _writer base;
+	struct _writer *parent;
+	unsigned int format;
+	unsigned int subsystem; // previous allocation subsystem of the thread
+	int counted; // I/O counters enabled
+	unsigned long long start;
+	struct ROIoStats stats;
+};
+
+
+void statswriter_destroy(struct _writer *writer) {
+	struct _statswriter *statswriter = CAST_UP(struct _statswriter,base,writer);
+
+	statswriter->parent->destroy(statswriter->parent);
+	_xalloc_subsystem(statswriter->subsystem);
+	if (statswriter->counted) {
+		statswriter->stats.count = 1;
+		statswriter->stats.time = _iostats_now() - statswriter->start;
+		_iostats_add(statswriter->format, 1, &statswriter->stats);
+	}
+	_xfree(statswriter);
+}
+
+
+int statswriter_write(const void *src, unsigned long size, unsigned int count, struct _writer *writer) {
+	struct _statswriter *statswriter = CAST_UP(struct _statswriter,base,writer);
+	struct _writer *parent = statswriter->parent;
+	unsigned long long start = _iostats_now();
+
+	writer->error = parent->write(src, size, count, parent);
+	statswriter->stats.iotime += _iostats_now() - start;
+	statswriter->stats.calls++;
+	statswriter->stats.bytes += (unsigned long long)size * count;
+	return(writer->error);
+}
+
+
+int statswriter_resize(unsigned long size, struct _writer *writer) {
+	struct _statswriter *statswriter = CAST_UP(struct _statswriter,base,writer);
+	struct _writer *parent = statswriter->parent;
+	unsigned long long start = _iostats_now();
+
+	writer->error = parent->resize(size, parent);
+	statswriter->stats.iotime += _iostats_now() - start;
+	return(writer->error);
+}
+
+
+int statswriter_seek(struct _writer *writer, long pos, int origin) {
+	struct _statswriter *statswriter = CAST_UP(struct _statswriter,base,writer);
+	struct _writer *parent = statswriter->parent;
+	unsigned long long start = _iostats_now();
+
+	writer->error = parent->seek(parent, pos, origin);
+	statswriter->stats.iotime += _iostats_now() - start;
+	statswriter->stats.seeks++;
+	return(writer->error);
+}
+
+
+unsigned long statswriter_tell(struct _writer *writer) {
+	struct _statswriter *statswriter = CAST_UP(struct _statswriter,base,writer);
+	struct _writer *parent = statswriter->parent;
+	unsigned long ret;
+
+	ret = parent->tell(parent);
+	writer->error = parent->error;
+	return(ret);
+}
+
+
+struct _writer *statswriter_init(struct _writer *parent, unsigned int format) {
+	struct _statswriter *ret;
+
+#ifndef ROINT_ENABLE_ALLOC_STATS
+	if (!_iostats_enabled())
+		return(parent);
+#endif
+
+	ret = (struct _statswriter*)_xalloc(sizeof(struct _statswriter));
+	memset(ret, 0, sizeof(struct _statswriter));
+	ret->base.destroy = &statswriter_destroy;
+	ret->base.write = &statswriter_write;
+	ret->base.resize = &statswriter_resize;
+	ret->base.seek = &statswriter_seek;
+	ret->base.tell = &statswriter_tell;
+	ret->base.error = parent->error;
+
+	ret->parent = parent;
+	ret->format = format;
+	ret->subsystem = _xalloc_subsystem(format);
+	ret->counted = _iostats_enabled();
+	ret->start = _iostats_now();
+
+	return(CAST_DOWN(ret,base));
+}
@@ -0,0 +1,42 @@
+/*
+    ------------------------------------------------------------------------------------
+    LICENSE:
+    ------------------------------------------------------------------------------------
+    This file is part of The Open Ragnarok Project
+    Copyright 2007 - 2012 The Open Ragnarok Team
+    For the latest information visit http://www.open-ragnarok.org
+    ------------------------------------------------------------------------------------
+    This program is free software; you can redistribute it and/or modify it under
+    the terms of the GNU Lesser General Public License as published by the Free Software
+    Foundation; either version 2 of the License, or (at your option) any later
+    version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License along with
+    this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+    Place - Suite 330, Boston, MA 02111-1307, USA, or go to
+    http://www.gnu.org/copyleft/lesser.txt.
+    ------------------------------------------------------------------------------------
+*/
+#ifndef __ROINT_INTERNAL_IOSTATS_H
+#define __ROINT_INTERNAL_IOSTATS_H
+
+// For ROInt internal use only
+
+// I/O counters behind roint_get_io_stats.
+// statsreader_init and statswriter_init count the calls of the entry points;
+// the functions below are for the code that does its own I/O.
+
+struct ROIoStats;
+
+/// Returns a monotonic time in nanoseconds.
+unsigned long long _iostats_now(void);
+/// Returns non-zero if the I/O counters are enabled.
+int _iostats_enabled(void);
+/// Add 'stats' to the load (save=0) or save (save=1) totals of a ROINT_FORMAT_* format.
+void _iostats_add(unsigned int format, int save, const struct ROIoStats *stats);
+
+#endif /* __ROINT_INTERNAL_IOSTATS_H */
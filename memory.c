@@ -21,31 +21,463 @@
     http://www.gnu.org/copyleft/lesser.txt.
     ------------------------------------------------------------------------------------
 */
-#include "memory.h"
+#include "internal.h"
+#include "atomic.h"
+#include "thread.h"
 
 #include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#	include <malloc.h> // _aligned_malloc, _aligned_free
+#endif
 
-roint_alloc_func _xalloc = &malloc;
-roint_free_func _xfree = &free;
+#ifdef _XTHREADLOCAL
+#	define MEMORY_THREADLOCAL _XTHREADLOCAL
+#else
+#	define MEMORY_THREADLOCAL // no thread-local storage, shared by all threads
+#endif
 
-void set_roint_malloc_func(roint_alloc_func x) {
-	if (x == NULL)
-		_xalloc = &malloc;
+
+static roint_alloc_func memory_malloc = &malloc;
+static roint_free_func memory_free = &free;
+
+
+static void *_memory_alloc(void *ctx, size_t size) {
+	return(memory_malloc(size));
+}
+
+
+static void _memory_free(void *ctx, void *ptr, size_t size) {
+	memory_free(ptr);
+}
+
+
+static void *_memory_realloc(void *ctx, void *ptr, size_t oldsize, size_t size) {
+	return(realloc(ptr, size));
+}
+
+
+#if defined(HAVE_POSIX_MEMALIGN) || defined(_WIN32)
+static void *_memory_aligned_alloc(void *ctx, size_t alignment, size_t size) {
+#ifdef _WIN32
+	return(_aligned_malloc(size, alignment));
+#else
+	void *ret;
+	if (alignment < sizeof(void*))
+		alignment = sizeof(void*);
+	if (posix_memalign(&ret, alignment, size) != 0)
+		return(NULL);
+	return(ret);
+#endif
+}
+
+
+static void _memory_aligned_free(void *ctx, void *ptr, size_t size) {
+#ifdef _WIN32
+	_aligned_free(ptr);
+#else
+	free(ptr);
+#endif
+}
+#	define MEMORY_ALIGNED_ALLOC &_memory_aligned_alloc
+#	define MEMORY_ALIGNED_FREE &_memory_aligned_free
+#else
+#	define MEMORY_ALIGNED_ALLOC NULL
+#	define MEMORY_ALIGNED_FREE NULL
+#endif
+
+
+/// Library-wide allocator.
+static struct ROAllocator memory_allocator = {
+	NULL,
+	&_memory_alloc,
+	&_memory_free,
+	&_memory_realloc,
+	MEMORY_ALIGNED_ALLOC,
+	MEMORY_ALIGNED_FREE
+};
+/// Allocator of the current thread. (overrides memory_allocator if not NULL)
+static MEMORY_THREADLOCAL const struct ROAllocator *memory_threadallocator = NULL;
+
+
+static __inline const struct ROAllocator *_memory_current(void) {
+	const struct ROAllocator *ret = memory_threadallocator;
+	if (ret == NULL)
+		ret = &memory_allocator;
+	return(ret);
+}
+
+
+#ifdef ROINT_ENABLE_ALLOC_STATS
+// Accounting of the live blocks, keyed by pointer. (open addressing, linear probing)
+// Blocks handed over to the caller (saved data, converted strings) are removed,
+// since the caller might release them with the plain free function.
+// The table is allocated with malloc so it does not count itself.
+struct _memoryentry {
+	const void *ptr;
+	size_t size;
+	unsigned int subsystem;
+};
+
+static volatile unsigned int memory_lock = 0;
+static unsigned int memory_count = 0;
+static unsigned int memory_capacity = 0;
+static struct _memoryentry *memory_entries = NULL;
+static struct ROAllocStats memory_stats[ROINT_ALLOC_COUNT + 1]; // [subsystem], ROINT_ALLOC_ALL last
+/// Subsystem of the allocations of the current thread.
+static MEMORY_THREADLOCAL unsigned int memory_subsystem = ROINT_ALLOC_OTHER;
+
+
+static unsigned int _memory_hash(const void *ptr) {
+	size_t h = (size_t)ptr / 16;
+	h ^= h >> 15;
+	return((unsigned int)(h * 2654435761u));
+}
+
+
+// Insert without growing. The lock must be held.
+static void _memory_insert(struct _memoryentry *entries, unsigned int capacity, const struct _memoryentry *entry) {
+	unsigned int i = _memory_hash(entry->ptr) & (capacity - 1);
+
+	while (entries[i].ptr != NULL)
+		i = (i + 1) & (capacity - 1);
+	entries[i] = *entry;
+}
+
+
+static void _memory_count(unsigned int subsystem, size_t size, int alloc) {
+	struct ROAllocStats *stats[2];
+	unsigned int i;
+
+	stats[0] = &memory_stats[subsystem];
+	stats[1] = &memory_stats[ROINT_ALLOC_ALL];
+	for (i = 0; i < 2; i++) {
+		if (alloc) {
+			stats[i]->live += size;
+			if (stats[i]->peak < stats[i]->live)
+				stats[i]->peak = stats[i]->live;
+			stats[i]->count++;
+			stats[i]->bytes += size;
+		}
+		else
+			stats[i]->live -= size;
+	}
+}
+
+
+// Remove the block from the table and uncount it. The lock must be held.
+// Returns the subsystem of the block, or ROINT_ALLOC_COUNT if not found.
+static unsigned int _memory_remove(const void *ptr) {
+	unsigned int i, j, ret;
+
+	if (memory_capacity == 0)
+		return(ROINT_ALLOC_COUNT);
+	i = _memory_hash(ptr) & (memory_capacity - 1);
+	while (memory_entries[i].ptr != NULL && memory_entries[i].ptr != ptr)
+		i = (i + 1) & (memory_capacity - 1);
+	if (memory_entries[i].ptr == NULL)
+		return(ROINT_ALLOC_COUNT);
+	ret = memory_entries[i].subsystem;
+	_memory_count(ret, memory_entries[i].size, 0);
+	memory_entries[i].ptr = NULL;
+	// shift back the entries of the cluster so lookups never stop early
+	for (j = (i + 1) & (memory_capacity - 1); memory_entries[j].ptr != NULL; j = (j + 1) & (memory_capacity - 1)) {
+		unsigned int k = _memory_hash(memory_entries[j].ptr) & (memory_capacity - 1);
+		if ((j > i && (k <= i || k > j)) || (j < i && (k <= i && k > j))) {
+			memory_entries[i] = memory_entries[j];
+			memory_entries[j].ptr = NULL;
+			i = j;
+		}
+	}
+	memory_count--;
+	return(ret);
+}
+
+
+static void _memory_track(const void *ptr, size_t size, unsigned int subsystem) {
+	struct _memoryentry entry;
+
+	if (ptr == NULL)
+		return;
+	if (subsystem >= ROINT_ALLOC_COUNT)
+		subsystem = memory_subsystem;
+	while (!_xatomic_cas(&memory_lock, 0, 1))
+		;
+	if ((memory_count + 1) * 2 > memory_capacity) {// keep the load factor under 1/2
+		unsigned int capacity = (memory_capacity == 0)? 1024: memory_capacity * 2;
+		struct _memoryentry *entries = (struct _memoryentry*)calloc(capacity, sizeof(struct _memoryentry));
+		unsigned int i;
+		for (i = 0; i < memory_capacity; i++) {
+			if (memory_entries[i].ptr != NULL)
+				_memory_insert(entries, capacity, &memory_entries[i]);
+		}
+		free(memory_entries);
+		memory_entries = entries;
+		memory_capacity = capacity;
+	}
+	_memory_remove(ptr);// stale block, released outside of the library
+	entry.ptr = ptr;
+	entry.size = size;
+	entry.subsystem = subsystem;
+	_memory_insert(memory_entries, memory_capacity, &entry);
+	memory_count++;
+	_memory_count(subsystem, size, 1);
+	_xatomic_store(&memory_lock, 0);
+}
+
+
+// Returns the subsystem of the block, or ROINT_ALLOC_COUNT if not found.
+static unsigned int _memory_untrack(const void *ptr, int isfree) {
+	unsigned int ret;
+
+	if (ptr == NULL)
+		return(ROINT_ALLOC_COUNT);
+	while (!_xatomic_cas(&memory_lock, 0, 1))
+		;
+	ret = _memory_remove(ptr);
+	if (ret < ROINT_ALLOC_COUNT && isfree) {
+		memory_stats[ret].frees++;
+		memory_stats[ROINT_ALLOC_ALL].frees++;
+	}
+	_xatomic_store(&memory_lock, 0);
+	return(ret);
+}
+#else
+static __inline void _memory_track(const void *ptr, size_t size, unsigned int subsystem) {
+}
+
+
+static __inline unsigned int _memory_untrack(const void *ptr, int isfree) {
+	return(ROINT_ALLOC_COUNT);
+}
+#endif
+
+
+void *_xalloc(size_t size) {
+	const struct ROAllocator *allocator = _memory_current();
+	void *ret = allocator->alloc(allocator->ctx, size);
+
+	_memory_track(ret, size, ROINT_ALLOC_COUNT);
+	return(ret);
+}
+
+
+void _xfree(void *ptr) {
+	const struct ROAllocator *allocator = _memory_current();
+
+	_memory_untrack(ptr, 1);
+	allocator->free(allocator->ctx, ptr, 0);
+}
+
+
+void _xfreesize(void *ptr, size_t size) {
+	const struct ROAllocator *allocator = _memory_current();
+
+	_memory_untrack(ptr, 1);
+	allocator->free(allocator->ctx, ptr, size);
+}
+
+
+void *_xrealloc(void *ptr, size_t oldsize, size_t size) {
+	const struct ROAllocator *allocator = _memory_current();
+	unsigned int subsystem;
+	void *ret;
+
+	if (ptr == NULL)
+		return(_xalloc(size));
+	subsystem = _memory_untrack(ptr, 1);
+	if (allocator->realloc != NULL)
+		ret = allocator->realloc(allocator->ctx, ptr, oldsize, size);
+	else {
+		ret = allocator->alloc(allocator->ctx, size);
+		if (ret != NULL) {
+			memcpy(ret, ptr, (oldsize < size)? oldsize: size);
+			allocator->free(allocator->ctx, ptr, oldsize);
+		}
+	}
+	if (ret != NULL)
+		_memory_track(ret, size, subsystem);
 	else
-		_xalloc = x;
+		_memory_track(ptr, oldsize, subsystem);
+	return(ret);
 }
 
-void set_roint_free_func(roint_free_func x) {
-	if (x == NULL)
-		_xfree = &free;
+
+void *_xalloc_global(size_t size) {
+	void *ret = memory_allocator.alloc(memory_allocator.ctx, size);
+
+	_memory_track(ret, size, ROINT_ALLOC_OTHER);
+	return(ret);
+}
+
+
+void _xfree_global(void *ptr, size_t size) {
+	_memory_untrack(ptr, 1);
+	memory_allocator.free(memory_allocator.ctx, ptr, size);
+}
+
+
+// Without an aligned_alloc function, the block is over-allocated with alloc
+// and the raw pointer and size are stored right before the aligned memory.
+void *_xalloc_aligned(size_t alignment, size_t size) {
+	const struct ROAllocator *allocator = _memory_current();
+	unsigned char *raw, *ret;
+	size_t rawsize;
+
+	if (allocator->aligned_alloc != NULL) {
+		ret = (unsigned char*)allocator->aligned_alloc(allocator->ctx, alignment, size);
+		_memory_track(ret, size, ROINT_ALLOC_COUNT);
+		return(ret);
+	}
+	if (alignment < sizeof(size_t) * 2)
+		alignment = sizeof(size_t) * 2;
+	rawsize = size + alignment + sizeof(size_t) * 2;
+	raw = (unsigned char*)allocator->alloc(allocator->ctx, rawsize);
+	if (raw == NULL)
+		return(NULL);
+	ret = raw + sizeof(size_t) * 2;
+	ret += (alignment - (size_t)ret % alignment) % alignment;
+	((size_t*)ret)[-2] = (size_t)raw;
+	((size_t*)ret)[-1] = rawsize;
+	_memory_track(ret, size, ROINT_ALLOC_COUNT);
+	return(ret);
+}
+
+
+void _xfree_aligned(void *ptr, size_t size) {
+	const struct ROAllocator *allocator = _memory_current();
+
+	if (ptr == NULL)
+		return;
+	_memory_untrack(ptr, 1);
+	if (allocator->aligned_alloc != NULL)
+		allocator->aligned_free(allocator->ctx, ptr, size);
 	else
-		_xfree = x;
+		allocator->free(allocator->ctx, (void*)((size_t*)ptr)[-2], ((size_t*)ptr)[-1]);
+}
+
+
+void _xhandover(const void *ptr) {
+	_memory_untrack(ptr, 0);
+}
+
+
+unsigned int _xalloc_subsystem(unsigned int subsystem) {
+#ifdef ROINT_ENABLE_ALLOC_STATS
+	unsigned int ret = memory_subsystem;
+	if (subsystem < ROINT_ALLOC_COUNT)
+		memory_subsystem = subsystem;
+	return(ret);
+#else
+	return(ROINT_ALLOC_OTHER);
+#endif
+}
+
+
+void _xalloc_getstate(struct _xalloc_state *state) {
+	state->allocator = memory_threadallocator;
+	state->subsystem = _xalloc_subsystem(ROINT_ALLOC_COUNT);
+}
+
+
+void _xalloc_setstate(const struct _xalloc_state *state) {
+	memory_threadallocator = state->allocator;
+	_xalloc_subsystem(state->subsystem);
+}
+
+
+// Point the library-wide allocator back at the plain functions.
+static void _memory_setfuncs(roint_alloc_func alloc, roint_free_func free_) {
+	int isdefault;
+
+	memory_malloc = (alloc == NULL)? &malloc: alloc;
+	memory_free = (free_ == NULL)? &free: free_;
+	isdefault = (memory_malloc == &malloc && memory_free == &free);
+	memory_allocator.ctx = NULL;
+	memory_allocator.alloc = &_memory_alloc;
+	memory_allocator.free = &_memory_free;
+	memory_allocator.realloc = isdefault? &_memory_realloc: NULL;
+	memory_allocator.aligned_alloc = isdefault? MEMORY_ALIGNED_ALLOC: NULL;
+	memory_allocator.aligned_free = isdefault? MEMORY_ALIGNED_FREE: NULL;
+}
+
+
+void set_roint_malloc_func(roint_alloc_func x) {
+	_memory_setfuncs(x, memory_free);
+}
+
+void set_roint_free_func(roint_free_func x) {
+	_memory_setfuncs(memory_malloc, x);
 }
 
 roint_alloc_func get_roint_malloc_func() {
-    return(_xalloc);
+    return(memory_malloc);
 }
 
 roint_free_func get_roint_free_func() {
-    return(_xfree);
+	if (memory_threadallocator == NULL && memory_allocator.free == &_memory_free)
+		return(memory_free);
+	return(&roint_free);// a ROAllocator, which the plain function would bypass
+}
+
+
+void roint_free(void *ptr) {
+	const struct ROAllocator *allocator = _memory_current();
+
+	if (ptr != NULL)
+		allocator->free(allocator->ctx, ptr, 0);
+}
+
+
+void roint_set_allocator(const struct ROAllocator *allocator) {
+	if (allocator == NULL || allocator->alloc == NULL || allocator->free == NULL ||
+		(allocator->aligned_alloc != NULL && allocator->aligned_free == NULL))
+		_memory_setfuncs(NULL, NULL);
+	else
+		memcpy(&memory_allocator, allocator, sizeof(struct ROAllocator));
+}
+
+
+void roint_get_allocator(struct ROAllocator *allocator) {
+	memcpy(allocator, &memory_allocator, sizeof(struct ROAllocator));
+}
+
+
+const struct ROAllocator *roint_set_thread_allocator(const struct ROAllocator *allocator) {
+	const struct ROAllocator *ret = memory_threadallocator;
+
+	if (allocator != NULL && (allocator->alloc == NULL || allocator->free == NULL ||
+		(allocator->aligned_alloc != NULL && allocator->aligned_free == NULL)))
+		allocator = NULL;
+	memory_threadallocator = allocator;
+	return(ret);
+}
+
+
+int roint_get_alloc_stats(unsigned int subsystem, struct ROAllocStats *stats) {
+#ifdef ROINT_ENABLE_ALLOC_STATS
+	if (subsystem > ROINT_ALLOC_ALL)
+		return(1);
+	while (!_xatomic_cas(&memory_lock, 0, 1))
+		;
+	memcpy(stats, &memory_stats[subsystem], sizeof(struct ROAllocStats));
+	_xatomic_store(&memory_lock, 0);
+	return(0);
+#else
+	memset(stats, 0, sizeof(struct ROAllocStats));
+	return(1);
+#endif
+}
+
+
+void roint_reset_alloc_peaks(void) {
+#ifdef ROINT_ENABLE_ALLOC_STATS
+	unsigned int i;
+
+	while (!_xatomic_cas(&memory_lock, 0, 1))
+		;
+	for (i = 0; i <= ROINT_ALLOC_ALL; i++)
+		memory_stats[i].peak = memory_stats[i].live;
+	_xatomic_store(&memory_lock, 0);
+#endif
 }
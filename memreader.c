@@ -129,6 +129,29 @@ unsigned long memreader_tell(struct _reader *reader) {
 }
 
 
+unsigned long memreader_remaining(struct _reader *reader) {
+	struct _memreader *memreader = CAST_UP(struct _memreader,base,reader);
+
+	return((memreader->offset < memreader->size)? memreader->size - memreader->offset: 0);
+}
+
+
+const unsigned char *memreader_borrow(struct _reader *reader, unsigned long size) {
+	struct _memreader *memreader = CAST_UP(struct _memreader,base,reader);
+	const unsigned char *ret = memreader->ptr;
+
+	if (size > memreader->size - memreader->offset) {
+		_xlog("memreader.borrow : not enough data\n");
+		reader->error = 1;
+		return(NULL);
+	}
+	memreader->ptr += size;
+	memreader->offset += size;
+	reader->error = 0;
+	return(ret);
+}
+
+
 struct _reader *memreader_init(const unsigned char *ptr, unsigned long size) {
 	struct _memreader *ret = (struct _memreader*)_xalloc(sizeof(struct _memreader));
 
@@ -136,6 +159,8 @@ struct _reader *memreader_init(const unsigned char *ptr, unsigned long size) {
 	ret->base.read = &memreader_read;
 	ret->base.seek = &memreader_seek;
 	ret->base.tell = &memreader_tell;
+	ret->base.borrow = &memreader_borrow;
+	ret->base.remaining = &memreader_remaining;
 	ret->base.error = 0;
 
 	ret->data = ptr;
@@ -28,73 +28,159 @@
 #	define _xlog printf
 #	define _xalloc malloc
 #	define _xfree free
+#	define _xfreesize(ptr,size) free(ptr)
+#	define _xrealloc(ptr,oldsize,size) realloc(ptr,size)
+#	define _xhandover(ptr)
 #endif
 
+#include <errno.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(HAVE_WRITEV) && defined(HAVE_SYS_UIO_H)
+#include <fcntl.h> // open
+#include <sys/uio.h> // writev
+#include <unistd.h> // close
+#define MEMWRITER_WRITEV
+#endif
+
 
 #define CAST_UP(type, member, ptr) (type*)( (char*)ptr - offsetof(type,member) )
 #define CAST_DOWN(ptr, member) ( &ptr->member )
 
 
+/// Size of the chunks.
+#define MEMWRITER_CHUNKSIZE 0x10000
+/// Maximum number of chunks in a writev call.
+#define MEMWRITER_IOVCOUNT 64
+
+
+/// Data is kept in a chain of chunks so growing never copies it.
+/// The first chunk starts small and grows up to 'firstlimit',
+/// the other chunks have MEMWRITER_CHUNKSIZE bytes.
+/// When the caller wants contiguous data the first chunk has no limit,
+/// so the data doesn't have to be joined at the end.
 struct _memwriter {
 	struct _writer base;
 	unsigned char **data_out;
 	unsigned long *size_out;
 
-	unsigned char *buf;
-	unsigned long bufsize;
+	unsigned char **chunks;
+	unsigned long chunkcount;
+	unsigned long chunklimit;
+	unsigned long firstsize; // size of the first chunk
+	unsigned long firstlimit; // maximum size of the first chunk
 	unsigned long size;
 
 	unsigned long offset;
-	unsigned char *ptr;
 };
 
 
-/// Initial size of the memwriter buffer.
+/// Initial size of the first chunk.
 const unsigned long MEMWRITER_BUFSIZE = 1023;
 
 
-/// Ensures the buffer is big enough.
+/// Ensures the chunks can hold 'size' bytes.
 void _memwriter_reserve(unsigned long size, struct _memwriter *memwriter) {
-	unsigned long bufsize = memwriter->bufsize;
-	while (bufsize < size)
-		bufsize = bufsize * 4 + 3;
-	if (bufsize != memwriter->bufsize) {
-		unsigned char *buf = (unsigned char*)_xalloc(bufsize);
-		memcpy(buf, memwriter->buf, memwriter->bufsize);
-		_xfree(memwriter->buf);
-		memwriter->buf = buf;
-		memwriter->bufsize = bufsize;
-		memwriter->ptr = memwriter->buf + memwriter->offset;
+	unsigned long chunkcount;
+
+	if (size <= memwriter->firstsize)
+		return;
+	if (memwriter->firstsize < memwriter->firstlimit) {
+		unsigned long bufsize = memwriter->firstsize;
+		unsigned char *buf;
+		while (bufsize < size && bufsize < memwriter->firstlimit)
+			bufsize = bufsize * 4 + 3;
+		if (bufsize > memwriter->firstlimit)
+			bufsize = memwriter->firstlimit;
+		buf = (unsigned char*)_xrealloc(memwriter->chunks[0], memwriter->firstsize, bufsize);
+		memwriter->chunks[0] = buf;
+		memwriter->firstsize = bufsize;
+		if (size <= bufsize)
+			return;
+	}
+
+	chunkcount = (size + MEMWRITER_CHUNKSIZE - 1) / MEMWRITER_CHUNKSIZE;
+	if (chunkcount > memwriter->chunklimit) {
+		unsigned long chunklimit = memwriter->chunklimit * 2;
+		unsigned char **chunks;
+		if (chunklimit < chunkcount)
+			chunklimit = chunkcount;
+		chunks = (unsigned char**)_xrealloc(memwriter->chunks, sizeof(unsigned char*) * memwriter->chunklimit, sizeof(unsigned char*) * chunklimit);
+		memwriter->chunks = chunks;
+		memwriter->chunklimit = chunklimit;
+	}
+	while (memwriter->chunkcount < chunkcount)
+		memwriter->chunks[memwriter->chunkcount++] = (unsigned char*)_xalloc(MEMWRITER_CHUNKSIZE);
+}
+
+
+/// Returns the data at 'offset' and the number of contiguous bytes in 'len'.
+unsigned char *_memwriter_at(unsigned long offset, unsigned long *len, struct _memwriter *memwriter) {
+	if (offset < memwriter->firstsize) {
+		*len = memwriter->firstsize - offset;
+		return(memwriter->chunks[0] + offset);
+	}
+	*len = MEMWRITER_CHUNKSIZE - offset % MEMWRITER_CHUNKSIZE;
+	return(memwriter->chunks[offset / MEMWRITER_CHUNKSIZE] + offset % MEMWRITER_CHUNKSIZE);
+}
+
+
+/// Copies 'size' bytes of 'src' to the chunks at 'offset'. (NULL 'src' for zeros)
+/// The chunks must already hold the data.
+void _memwriter_copy(unsigned long offset, const unsigned char *src, unsigned long size, struct _memwriter *memwriter) {
+	while (size > 0) {
+		unsigned long len;
+		unsigned char *dest = _memwriter_at(offset, &len, memwriter);
+		if (len > size)
+			len = size;
+		if (src != NULL) {
+			memcpy(dest, src, len);
+			src += len;
+		}
+		else
+			memset(dest, 0, len);
+		offset += len;
+		size -= len;
 	}
 }
 
 
 void memwriter_destroy(struct _writer *writer) {
 	struct _memwriter *memwriter = CAST_UP(struct _memwriter,base,writer);
+	unsigned long i;
+
 	if (memwriter->data_out != NULL) {
 		if (memwriter->size == 0) {
 			*memwriter->data_out = NULL;
 		}
-		else if (memwriter->size == memwriter->bufsize) {
-			*memwriter->data_out = memwriter->buf;
-			memwriter->buf = NULL;
+		else if (memwriter->size == memwriter->firstsize) {
+			*memwriter->data_out = memwriter->chunks[0];
+			memwriter->chunks[0] = NULL;
 		}
 		else {
 			unsigned char *buf = (unsigned char*)_xalloc(memwriter->size);
-			memcpy(buf, memwriter->buf, memwriter->size);
+			unsigned long offset, len;
+			for (offset = 0; offset < memwriter->size; offset += len) {
+				const unsigned char *src = _memwriter_at(offset, &len, memwriter);
+				if (len > memwriter->size - offset)
+					len = memwriter->size - offset;
+				memcpy(buf + offset, src, len);
+			}
 			*memwriter->data_out = buf;
 		}
+		_xhandover(*memwriter->data_out);
 	}
 	if (memwriter->size_out != NULL)
 		*memwriter->size_out = memwriter->size;
 
-	if (memwriter->buf != NULL)
-		_xfree(memwriter->buf);
-	_xfree(memwriter);
+	for (i = 0; i < memwriter->chunkcount; i++)
+		if (memwriter->chunks[i] != NULL)
+			_xfreesize(memwriter->chunks[i], (i == 0)? memwriter->firstsize: MEMWRITER_CHUNKSIZE);
+	_xfreesize(memwriter->chunks, sizeof(unsigned char*) * memwriter->chunklimit);
+	_xfreesize(memwriter, sizeof(struct _memwriter));
 }
 
 
@@ -104,8 +190,9 @@ int memwriter_write(const void *src, unsigned long size, unsigned int count, str
 
 	writer->error = 0;
 	_memwriter_reserve(memwriter->offset + total, memwriter);
-	memcpy(memwriter->ptr, src, total);
-	memwriter->ptr += total;
+	if (memwriter->offset > memwriter->size)
+		_memwriter_copy(memwriter->size, NULL, memwriter->offset - memwriter->size, memwriter);
+	_memwriter_copy(memwriter->offset, (const unsigned char*)src, total, memwriter);
 	memwriter->offset += total;
 	if (memwriter->size < memwriter->offset)
 		memwriter->size = memwriter->offset;
@@ -119,7 +206,7 @@ int memwriter_resize(unsigned long size, struct _writer *writer) {
 	writer->error = 0;
 	_memwriter_reserve(size, memwriter);
 	if (size > memwriter->size)
-		memset(memwriter->buf + memwriter->size, 0, size - memwriter->size);
+		_memwriter_copy(memwriter->size, NULL, size - memwriter->size, memwriter);
 	memwriter->size = size;
 	return(writer->error);
 }
@@ -160,8 +247,6 @@ int memwriter_seek(struct _writer *writer, long pos, int origin) {
 			break;
 	}
 
-	memwriter->ptr = memwriter->buf + memwriter->offset;
-
 	return(writer->error);
 }
 
@@ -174,6 +259,111 @@ unsigned long memwriter_tell(struct _writer *writer) {
 }
 
 
+// Moves the complete temporary file over fn. Returns 0 on success.
+static int _memwriter_replace(const char *tmpfn, const char *fn) {
+#if defined(_WIN32)
+	remove(fn); // rename does not replace on windows
+#endif
+	if (rename(tmpfn, fn) != 0) {
+		_xlog("memwriter.savefile : %s\n", strerror(errno));
+		remove(tmpfn);
+		return(1);
+	}
+	return(0);
+}
+
+
+int memwriter_savefile(struct _writer *writer, const char *fn) {
+	struct _memwriter *memwriter = CAST_UP(struct _memwriter,base,writer);
+	unsigned long done = 0;
+	char *tmpfn = (char*)_xalloc(strlen(fn) + 32);
+	int ret;
+#if defined(MEMWRITER_WRITEV)
+	struct iovec iov[MEMWRITER_IOVCOUNT];
+	int fd, attempt;
+
+	// write next to fn and rename, so a failed save keeps the old file
+	fd = -1;
+	for (attempt = 0; attempt < 100 && fd == -1; attempt++) {
+		sprintf(tmpfn, "%s.%ld.%d.tmp", fn, (long)getpid(), attempt);
+		fd = open(tmpfn, O_WRONLY | O_CREAT | O_EXCL, 0666);
+		if (fd == -1 && errno != EEXIST)
+			break;
+	}
+	if (fd == -1) {
+		_xlog("memwriter.savefile : %s\n", strerror(errno));
+		_xfree(tmpfn);
+		return(1);
+	}
+	while (done < memwriter->size) {// gather the chunks from where the last call stopped
+		unsigned long offset = done;
+		int iovcount = 0;
+		ssize_t n;
+		while (iovcount < MEMWRITER_IOVCOUNT && offset < memwriter->size) {
+			unsigned long len;
+			iov[iovcount].iov_base = _memwriter_at(offset, &len, memwriter);
+			if (len > memwriter->size - offset)
+				len = memwriter->size - offset;
+			iov[iovcount].iov_len = len;
+			iovcount++;
+			offset += len;
+		}
+		n = writev(fd, iov, iovcount);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0) {
+			_xlog("memwriter.savefile : %s\n", strerror(errno));
+			close(fd);
+			unlink(tmpfn);
+			_xfree(tmpfn);
+			return(1);
+		}
+		done += (unsigned long)n;
+	}
+	if (close(fd) != 0) {
+		_xlog("memwriter.savefile : %s\n", strerror(errno));
+		unlink(tmpfn);
+		_xfree(tmpfn);
+		return(1);
+	}
+#else
+	FILE *fp;
+
+	// write next to fn and rename, so a failed save keeps the old file
+	sprintf(tmpfn, "%s.tmp", fn);
+	fp = fopen(tmpfn, "wb");
+	if (fp == NULL) {
+		_xlog("memwriter.savefile : %s\n", strerror(errno));
+		_xfree(tmpfn);
+		return(1);
+	}
+	while (done < memwriter->size) {
+		unsigned long len;
+		const unsigned char *src = _memwriter_at(done, &len, memwriter);
+		if (len > memwriter->size - done)
+			len = memwriter->size - done;
+		if (fwrite(src, 1, len, fp) != len) {
+			_xlog("memwriter.savefile : %s\n", strerror(errno));
+			fclose(fp);
+			remove(tmpfn);
+			_xfree(tmpfn);
+			return(1);
+		}
+		done += len;
+	}
+	if (fclose(fp) != 0) {
+		_xlog("memwriter.savefile : %s\n", strerror(errno));
+		remove(tmpfn);
+		_xfree(tmpfn);
+		return(1);
+	}
+#endif
+	ret = _memwriter_replace(tmpfn, fn);
+	_xfree(tmpfn);
+	return(ret);
+}
+
+
 struct _writer *memwriter_init(unsigned char **data_out, unsigned long *size_out) {
 	struct _memwriter *ret = (struct _memwriter*)_xalloc(sizeof(struct _memwriter));
 
@@ -187,12 +377,15 @@ struct _writer *memwriter_init(unsigned char **data_out, unsigned long *size_out
 	ret->data_out = data_out;
 	ret->size_out = size_out;
 
-	ret->buf = (unsigned char*)_xalloc(MEMWRITER_BUFSIZE);
-	ret->bufsize = MEMWRITER_BUFSIZE;
+	ret->chunks = (unsigned char**)_xalloc(sizeof(unsigned char*) * 4);
+	ret->chunks[0] = (unsigned char*)_xalloc(MEMWRITER_BUFSIZE);
+	ret->chunkcount = 1;
+	ret->chunklimit = 4;
+	ret->firstsize = MEMWRITER_BUFSIZE;
+	ret->firstlimit = (data_out != NULL)? (unsigned long)-1: MEMWRITER_CHUNKSIZE;
 	ret->size = 0;
 
 	ret->offset = 0;
-	ret->ptr = ret->buf;
 
 	return(CAST_DOWN(ret,base));
 }
@@ -50,5 +50,8 @@
 // output log messages to the console
 #define ROINT_ENABLE_CONSOLE_LOG_FUNC
 
+// count the allocations of each subsystem (roint_get_alloc_stats)
+//#define ROINT_ENABLE_ALLOC_STATS
+
 
 #endif /* __ROINT_CONFIG_H */
@@ -46,7 +46,7 @@ struct ROPal *pal_loadFromData(const unsigned char *data, unsigned long length)
 	struct ROPal *ret;
 	struct _reader *reader;
 
-	reader = memreader_init(data, length);
+	reader = statsreader_init(memreader_init(data, length), ROINT_FORMAT_PAL);
 	ret = pal_load(reader);
 	reader->destroy(reader);
 
@@ -58,7 +58,7 @@ struct ROPal *pal_loadFromFile(const char *fn) {
 	struct ROPal *ret;
 	struct _reader *reader;
 
-	reader = filereader_init(fn);
+	reader = statsreader_init(filereader_init(fn), ROINT_FORMAT_PAL);
 	ret = pal_load(reader);
 	reader->destroy(reader);
 
@@ -98,7 +98,7 @@ int pal_saveToData(const struct ROPal *pal, unsigned char **data, unsigned long
 	int ret;
 	struct _writer *writer;
 
-	writer = memwriter_init(data, length);
+	writer = statswriter_init(memwriter_init(data, length), ROINT_FORMAT_PAL);
 	ret = pal_save(pal, writer);
 	writer->destroy(writer);
 
@@ -108,10 +108,13 @@ int pal_saveToData(const struct ROPal *pal, unsigned char **data, unsigned long
 
 int pal_saveToFile(const struct ROPal *pal, const char *fn) {
 	int ret;
-	struct _writer *writer;
+	struct _writer *writer, *memwriter;
 
-	writer = filewriter_init(fn);
+	memwriter = memwriter_init(NULL, NULL);
+	writer = statswriter_init(memwriter, ROINT_FORMAT_PAL);
 	ret = pal_save(pal, writer);
+	if (ret == 0)
+		ret = memwriter_savefile(memwriter, fn);
 	writer->destroy(writer);
 
 	return(ret);
@@ -0,0 +1,93 @@
+/*
+    ------------------------------------------------------------------------------------
+    LICENSE:
+    ------------------------------------------------------------------------------------
+    This file is part of The Open Ragnarok Project
+    Copyright 2007 - 2012 The Open Ragnarok Team
+    For the latest information visit http://www.open-ragnarok.org
+    ------------------------------------------------------------------------------------
+    This program is free software; you can redistribute it and/or modify it under
+    the terms of the GNU Lesser General Public License as published by the Free Software
+    Foundation; either version 2 of the License, or (at your option) any later
+    version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License along with
+    this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+    Place - Suite 330, Boston, MA 02111-1307, USA, or go to
+    http://www.gnu.org/copyleft/lesser.txt.
+    ------------------------------------------------------------------------------------
+*/
+#include "internal.h"
+#include "pixel.h"
+
+#include <string.h>
+#if defined(HAVE_TARGET_AVX2) && (defined(__x86_64__) || defined(__i386__))
+#	include <immintrin.h>
+#	define PIXEL_AVX2
+#endif
+
+
+void _pixel_pallut(const struct ROPal *pal, unsigned int lut[256]) {
+	unsigned int i;
+
+	for (i = 0; i < 256; i++) {
+		unsigned char *rgba = (unsigned char*)&lut[i];
+		rgba[0] = pal->pal[i].r;
+		rgba[1] = pal->pal[i].g;
+		rgba[2] = pal->pal[i].b;
+		rgba[3] = 0xFF;
+	}
+	lut[0] = 0; // transparent
+}
+
+
+// One table load and one 4-byte store per pixel.
+static void pixel_pal_to_rgba_scalar(const unsigned char *indexes, size_t count, const unsigned int lut[256], unsigned char *rgba) {
+	size_t i;
+
+	for (i = 0; i + 4 <= count; i += 4) {
+		unsigned int c0 = lut[indexes[i]];
+		unsigned int c1 = lut[indexes[i + 1]];
+		unsigned int c2 = lut[indexes[i + 2]];
+		unsigned int c3 = lut[indexes[i + 3]];
+		memcpy(rgba + i * 4, &c0, 4);
+		memcpy(rgba + i * 4 + 4, &c1, 4);
+		memcpy(rgba + i * 4 + 8, &c2, 4);
+		memcpy(rgba + i * 4 + 12, &c3, 4);
+	}
+	for (; i < count; i++)
+		memcpy(rgba + i * 4, &lut[indexes[i]], 4);
+}
+
+
+#ifdef PIXEL_AVX2
+// 16 pixels per iteration: the indexes are widened to 32-bit and the colors are gathered from the table.
+__attribute__((target("avx2")))
+static void pixel_pal_to_rgba_avx2(const unsigned char *indexes, size_t count, const unsigned int lut[256], unsigned char *rgba) {
+	size_t i;
+
+	for (i = 0; i + 16 <= count; i += 16) {
+		__m128i idx = _mm_loadu_si128((const __m128i*)(indexes + i));
+		__m256i lo = _mm256_i32gather_epi32((const int*)lut, _mm256_cvtepu8_epi32(idx), 4);
+		__m256i hi = _mm256_i32gather_epi32((const int*)lut, _mm256_cvtepu8_epi32(_mm_srli_si128(idx, 8)), 4);
+		_mm256_storeu_si256((__m256i*)(rgba + i * 4), lo);
+		_mm256_storeu_si256((__m256i*)(rgba + i * 4 + 32), hi);
+	}
+	pixel_pal_to_rgba_scalar(indexes + i, count - i, lut, rgba + i * 4);
+}
+#endif
+
+
+void _pixel_pal_to_rgba(const unsigned char *indexes, size_t count, const unsigned int lut[256], unsigned char *rgba) {
+#ifdef PIXEL_AVX2
+	if (__builtin_cpu_supports("avx2")) {
+		pixel_pal_to_rgba_avx2(indexes, count, lut, rgba);
+		return;
+	}
+#endif
+	pixel_pal_to_rgba_scalar(indexes, count, lut, rgba);
+}
@@ -0,0 +1,42 @@
+/*
+    ------------------------------------------------------------------------------------
+    LICENSE:
+    ------------------------------------------------------------------------------------
+    This file is part of The Open Ragnarok Project
+    Copyright 2007 - 2012 The Open Ragnarok Team
+    For the latest information visit http://www.open-ragnarok.org
+    ------------------------------------------------------------------------------------
+    This program is free software; you can redistribute it and/or modify it under
+    the terms of the GNU Lesser General Public License as published by the Free Software
+    Foundation; either version 2 of the License, or (at your option) any later
+    version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License along with
+    this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+    Place - Suite 330, Boston, MA 02111-1307, USA, or go to
+    http://www.gnu.org/copyleft/lesser.txt.
+    ------------------------------------------------------------------------------------
+*/
+#ifndef __ROINT_INTERNAL_PIXEL_H
+#define __ROINT_INTERNAL_PIXEL_H
+
+// For ROInt internal use only
+
+// Pixel conversion kernels.
+// The kernel is picked at run time among the ones the CPU supports.
+
+#include <stddef.h> // size_t
+
+struct ROPal; // forward declaration
+
+/// Fill the table of RGBA colors of a palette.
+/// Each entry holds the bytes r,g,b,a in memory order. Index 0 is transparent (0,0,0,0).
+void _pixel_pallut(const struct ROPal *pal, unsigned int lut[256]);
+/// Expand 'count' palette indexes to RGBA pixels with a table from _pixel_pallut.
+void _pixel_pal_to_rgba(const unsigned char *indexes, size_t count, const unsigned int lut[256], unsigned char *rgba);
+
+#endif /* __ROINT_INTERNAL_PIXEL_H */
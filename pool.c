@@ -0,0 +1,359 @@
+/*
+    ------------------------------------------------------------------------------------
+    LICENSE:
+    ------------------------------------------------------------------------------------
+    This file is part of The Open Ragnarok Project
+    Copyright 2007 - 2011 The Open Ragnarok Team
+    For the latest information visit http://www.open-ragnarok.org
+    ------------------------------------------------------------------------------------
+    This program is free software; you can redistribute it and/or modify it under
+    the terms of the GNU Lesser General Public License as published by the Free Software
+    Foundation; either version 2 of the License, or (at your option) any later
+    version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License along with
+    this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+    Place - Suite 330, Boston, MA 02111-1307, USA, or go to
+    http://www.gnu.org/copyleft/lesser.txt.
+    ------------------------------------------------------------------------------------
+*/
+#include "internal.h"
+#include "atomic.h"
+#include "thread.h"
+
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#	include <malloc.h> // _aligned_malloc
+#endif
+
+// Size-class pool allocator.
+// Small blocks are carved from slabs of a single size class. The slabs are parts of
+// superblocks aligned to their size, so the superblock of a block is found by masking
+// its address. The superblock bases are kept in an append-only table that is read
+// without locking, which tells the pool blocks apart from the malloc ones.
+// Each thread caches free blocks of each class and exchanges them in batches with
+// the shared lists. Superblocks are never returned to the system.
+
+/// Number of size classes.
+#define POOL_CLASSCOUNT 20
+/// Biggest pool block, bigger blocks come from malloc.
+#define POOL_MAXSIZE 1024
+/// Size and alignment of a superblock.
+#define POOL_SUPERSIZE 0x100000
+/// Size of a slab.
+#define POOL_SLABSIZE 0x10000
+/// Number of slabs in a superblock.
+#define POOL_SLABCOUNT (POOL_SUPERSIZE / POOL_SLABSIZE)
+/// Size of the superblock header, at the start of the first slab.
+#define POOL_HEADERSIZE 64
+/// Capacity of the superblock table. (power of 2, at most half full)
+#define POOL_TABLESIZE 8192
+/// Blocks moved at a time between a thread cache and the shared lists.
+#define POOL_BATCH 32
+/// Blocks of a class a thread caches before returning a batch.
+#define POOL_CACHEMAX 64
+
+
+struct _poolblock {
+	struct _poolblock *next;
+};
+
+struct _poolsuper {
+	unsigned char classes[POOL_SLABCOUNT]; // size class of each slab
+};
+
+struct _poolclass {
+	volatile unsigned int lock;
+	struct _poolblock *free; // shared free list
+	unsigned char *ptr; // bump region of the current slab
+	unsigned char *end;
+};
+
+#ifdef _XTHREADLOCAL
+struct _poolcache {
+	struct _poolblock *free[POOL_CLASSCOUNT];
+	unsigned int count[POOL_CLASSCOUNT];
+};
+static _XTHREADLOCAL struct _poolcache pool_cache;
+#endif
+
+static const unsigned short pool_sizes[POOL_CLASSCOUNT] = {
+	16, 32, 48, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 448, 512, 640, 768, 896, 1024
+};
+static struct _poolclass pool_classes[POOL_CLASSCOUNT];
+static volatile unsigned int pool_lock = 0; // superblocks
+static unsigned char *pool_super = NULL; // current superblock
+static unsigned int pool_superslab = POOL_SLABCOUNT; // next free slab of the current superblock
+static unsigned int pool_supercount = 0;
+static volatile unsigned int pool_table[POOL_TABLESIZE]; // superblock base / POOL_SUPERSIZE, 0 if empty
+
+
+static unsigned int _pool_class(size_t size) {
+	unsigned int i;
+
+	if (size <= 128)
+		return((size == 0)? 0: (unsigned int)((size - 1) / 16));
+	for (i = 8; pool_sizes[i] < size; i++)
+		;
+	return(i);
+}
+
+
+static unsigned int _pool_hash(unsigned int key) {
+	return((key * 2654435761u) >> 16);
+}
+
+
+// Returns 1 if the address is inside a superblock.
+static int _pool_owns(const void *ptr) {
+	size_t key = (size_t)ptr / POOL_SUPERSIZE;
+	unsigned int i, k;
+
+	if (key == 0 || key > 0xFFFFFFFF)
+		return(0);
+	i = _pool_hash((unsigned int)key) & (POOL_TABLESIZE - 1);
+	while ((k = _xatomic_load(&pool_table[i])) != 0) {
+		if (k == (unsigned int)key)
+			return(1);
+		i = (i + 1) & (POOL_TABLESIZE - 1);
+	}
+	return(0);
+}
+
+
+static unsigned char *_pool_newsuper(void) {
+	unsigned char *ret;
+	size_t key;
+	unsigned int i;
+
+	if (pool_supercount * 2 >= POOL_TABLESIZE)
+		return(NULL);
+#if defined(_WIN32)
+	ret = (unsigned char*)_aligned_malloc(POOL_SUPERSIZE, POOL_SUPERSIZE);
+#elif defined(HAVE_POSIX_MEMALIGN)
+	if (posix_memalign((void**)&ret, POOL_SUPERSIZE, POOL_SUPERSIZE) != 0)
+		ret = NULL;
+#else
+	ret = (unsigned char*)malloc(POOL_SUPERSIZE * 2);// never freed, align by hand
+	if (ret != NULL)
+		ret += (POOL_SUPERSIZE - (size_t)ret % POOL_SUPERSIZE) % POOL_SUPERSIZE;
+#endif
+	if (ret == NULL)
+		return(NULL);
+	key = (size_t)ret / POOL_SUPERSIZE;
+	if (key > 0xFFFFFFFF)
+		return(NULL);// cannot be registered, leave it
+	memset(ret, 0, POOL_HEADERSIZE);
+	i = _pool_hash((unsigned int)key) & (POOL_TABLESIZE - 1);
+	while (_xatomic_load(&pool_table[i]) != 0)
+		i = (i + 1) & (POOL_TABLESIZE - 1);
+	_xatomic_store(&pool_table[i], (unsigned int)key);
+	pool_supercount++;
+	return(ret);
+}
+
+
+// Give a new slab to the class. The class lock must be held.
+static int _pool_newslab(struct _poolclass *cls, unsigned int index) {
+	unsigned char *slab;
+
+	while (!_xatomic_cas(&pool_lock, 0, 1))
+		;
+	if (pool_superslab == POOL_SLABCOUNT) {
+		unsigned char *super = _pool_newsuper();
+		if (super == NULL) {
+			_xatomic_store(&pool_lock, 0);
+			return(1);
+		}
+		pool_super = super;
+		pool_superslab = 0;
+	}
+	((struct _poolsuper*)pool_super)->classes[pool_superslab] = (unsigned char)index;
+	slab = pool_super + POOL_SLABSIZE * pool_superslab;
+	cls->ptr = (pool_superslab == 0)? slab + POOL_HEADERSIZE: slab;
+	cls->end = slab + POOL_SLABSIZE;
+	pool_superslab++;
+	_xatomic_store(&pool_lock, 0);
+	return(0);
+}
+
+
+// Take up to 'count' blocks from the shared list or the slab of the class.
+// Returns the number of blocks linked in 'list'.
+static unsigned int _pool_take(unsigned int index, struct _poolblock **list, unsigned int count) {
+	struct _poolclass *cls = &pool_classes[index];
+	size_t size = pool_sizes[index];
+	unsigned int ret = 0;
+
+	*list = NULL;
+	while (!_xatomic_cas(&cls->lock, 0, 1))
+		;
+	while (ret < count && cls->free != NULL) {
+		struct _poolblock *block = cls->free;
+		cls->free = block->next;
+		block->next = *list;
+		*list = block;
+		ret++;
+	}
+	while (ret < count) {
+		struct _poolblock *block;
+		if ((size_t)(cls->end - cls->ptr) < size && _pool_newslab(cls, index) != 0)
+			break;
+		block = (struct _poolblock*)cls->ptr;
+		cls->ptr += size;
+		block->next = *list;
+		*list = block;
+		ret++;
+	}
+	_xatomic_store(&cls->lock, 0);
+	return(ret);
+}
+
+
+// Return a list of blocks to the shared list of the class.
+static void _pool_give(unsigned int index, struct _poolblock *first, struct _poolblock *last) {
+	struct _poolclass *cls = &pool_classes[index];
+
+	while (!_xatomic_cas(&cls->lock, 0, 1))
+		;
+	last->next = cls->free;
+	cls->free = first;
+	_xatomic_store(&cls->lock, 0);
+}
+
+
+static void *_pool_get(unsigned int index) {
+	struct _poolblock *block;
+#ifdef _XTHREADLOCAL
+	struct _poolcache *cache = &pool_cache;
+
+	block = cache->free[index];
+	if (block == NULL) {
+		cache->count[index] = _pool_take(index, &cache->free[index], POOL_BATCH);
+		block = cache->free[index];
+		if (block == NULL)
+			return(NULL);
+	}
+	cache->free[index] = block->next;
+	cache->count[index]--;
+#else
+	if (_pool_take(index, &block, 1) == 0)
+		return(NULL);
+#endif
+	return(block);
+}
+
+
+static void _pool_put(unsigned int index, void *ptr) {
+	struct _poolblock *block = (struct _poolblock*)ptr;
+#ifdef _XTHREADLOCAL
+	struct _poolcache *cache = &pool_cache;
+
+	block->next = cache->free[index];
+	cache->free[index] = block;
+	if (++cache->count[index] > POOL_CACHEMAX) {
+		struct _poolblock *last = block;
+		unsigned int i;
+		for (i = 1; i < POOL_BATCH; i++)
+			last = last->next;
+		cache->free[index] = last->next;
+		cache->count[index] -= POOL_BATCH;
+		_pool_give(index, block, last);
+	}
+#else
+	_pool_give(index, block, block);
+#endif
+}
+
+
+void *roint_pool_malloc(size_t size) {
+	void *ret;
+
+	if (size > POOL_MAXSIZE)
+		return(malloc(size));
+	ret = _pool_get(_pool_class(size));
+	if (ret == NULL)
+		ret = malloc(size);// out of superblocks
+	return(ret);
+}
+
+
+void roint_pool_free(void *ptr) {
+	size_t base;
+
+	if (ptr == NULL)
+		return;
+	if (!_pool_owns(ptr)) {
+		free(ptr);
+		return;
+	}
+	base = (size_t)ptr & ~(size_t)(POOL_SUPERSIZE - 1);
+	_pool_put(((struct _poolsuper*)base)->classes[((size_t)ptr - base) / POOL_SLABSIZE], ptr);
+}
+
+
+void roint_pool_flush_thread(void) {
+#ifdef _XTHREADLOCAL
+	struct _poolcache *cache = &pool_cache;
+	unsigned int i;
+
+	for (i = 0; i < POOL_CLASSCOUNT; i++) {
+		struct _poolblock *last = cache->free[i];
+		if (last == NULL)
+			continue;
+		while (last->next != NULL)
+			last = last->next;
+		_pool_give(i, cache->free[i], last);
+		cache->free[i] = NULL;
+		cache->count[i] = 0;
+	}
+#endif
+}
+
+
+static void *_pool_alloc(void *ctx, size_t size) {
+	return(roint_pool_malloc(size));
+}
+
+
+static void _pool_free(void *ctx, void *ptr, size_t size) {
+	roint_pool_free(ptr);
+}
+
+
+static void *_pool_realloc(void *ctx, void *ptr, size_t oldsize, size_t size) {
+	void *ret;
+
+	if (!_pool_owns(ptr)) {
+		if (size > POOL_MAXSIZE)
+			return(realloc(ptr, size));
+	}
+	else if (size <= POOL_MAXSIZE && size > 0 && _pool_class(size) == _pool_class(oldsize))
+		return(ptr);// same class
+	ret = roint_pool_malloc(size);
+	if (ret != NULL) {
+		memcpy(ret, ptr, (oldsize < size)? oldsize: size);
+		roint_pool_free(ptr);
+	}
+	return(ret);
+}
+
+
+static const struct ROAllocator pool_allocator = {
+	NULL,
+	&_pool_alloc,
+	&_pool_free,
+	&_pool_realloc,
+	NULL,
+	NULL
+};
+
+
+const struct ROAllocator *roint_pool_allocator(void) {
+	return(&pool_allocator);
+}
@@ -26,6 +26,8 @@
 
 // For ROInt internal use only
 
+struct _writer;
+
 struct _reader {
 	/// Destructor.
 	void (*destroy)(struct _reader *reader);
@@ -44,6 +46,17 @@ struct _reader {
 	/// Get position indicator. (updates error indicator)
 	unsigned long (*tell)(struct _reader *reader);
 
+	/// Borrow the next 'size' bytes without copying them. (updates error indicator)
+	/// Returns a pointer to the bytes and moves the position indicator past them.
+	/// Returns NULL if the data is not contiguous in memory (error indicator is 0)
+	/// or if there is not enough data (error indicator is 1, position unchanged).
+	/// The bytes stay valid until the reader is destroyed.
+	const unsigned char *(*borrow)(struct _reader *reader, unsigned long size);
+
+	/// Number of bytes left after the position indicator, if known without reading them.
+	/// Returns 0 if unknown. (error indicator unchanged)
+	unsigned long (*remaining)(struct _reader *reader);
+
 	/// Error indicator. (0 for success)
 	int error;
 };
@@ -56,7 +69,27 @@ struct _reader {
 /// type=2 : zlib and gzip decoding with automatic header detection
 /// type=255 : process raw deflate data
 struct _reader *deflatereader_init(struct _reader *parent, unsigned char type);
+/// Record seek checkpoints in a deflatereader every 'span' bytes of output. (0 to stop)
+/// Seeks resume inflating from the closest checkpoint instead of the start.
+/// Each checkpoint holds a 32k window.
+void deflatereader_setcheckpoints(struct _reader *deflatereader, unsigned long span);
+/// Save the checkpoints of a deflatereader. Returns 0 on success.
+int deflatereader_saveindex(struct _reader *deflatereader, struct _writer *writer);
+/// Replace the checkpoints of a deflatereader with the ones saved by deflatereader_saveindex.
+/// The index must come from the same compressed data. Returns 0 on success.
+int deflatereader_loadindex(struct _reader *deflatereader, struct _reader *index);
 struct _reader *memreader_init(const unsigned char *ptr, unsigned long size);
+/// Reader that takes input from a file, in the mode set with roint_set_file_mode.
 struct _reader *filereader_init(const char *fn);
+/// Reader that takes input from a file.
+/// mode=ROINT_FILEMODE_STDIO : stdio stream
+/// mode=ROINT_FILEMODE_BUFFERED : big buffered reads
+/// mode=ROINT_FILEMODE_MAP : mapped file, supports borrow (falls back to ROINT_FILEMODE_BUFFERED)
+struct _reader *filereader_initmode(const char *fn, unsigned char mode);
+/// Reader that counts the calls to 'parent' and adds them to the ROINT_FORMAT_* 'format'
+/// totals when destroyed. Destroys 'parent' when destroyed.
+/// Until then, the allocations of the thread are attributed to 'format'. (ROINT_ENABLE_ALLOC_STATS)
+/// Returns 'parent' itself if the I/O counters are disabled and there are no allocation statistics.
+struct _reader *statsreader_init(struct _reader *parent, unsigned int format);
 
 #endif /* __ROINT_INTERNAL_READER_H */
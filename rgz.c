@@ -22,9 +22,18 @@
     ------------------------------------------------------------------------------------
 */
 #include "internal.h"
+#include "arena.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+
+const char RGZ_INDEX_MAGIC[4] = {'R','G','Z','I'};
+const unsigned short RGZ_INDEX_VERSION = 0x101;
+/// Uncompressed bytes between the seek checkpoints of rgz_open.
+#define RGZ_CHECKPOINT_SPAN 0x100000 // 1M
 
 
 unsigned short rgz_inspect(const struct RORgz *rgz) {
@@ -82,8 +91,37 @@ unsigned short rgz_inspect(const struct RORgz *rgz) {
 }
 
 
+// Reads the entry up to the file data. Returns 0 on success.
+int _rgz_readheader(struct _reader *gzipreader, struct RORgzEntry *entry) {
+	unsigned char pathlen;
+
+	gzipreader->read(&entry->type, 1, 1, gzipreader);
+	if (gzipreader->error)
+		return(1);
+
+	gzipreader->read(&pathlen, 1, 1, gzipreader);
+	if (gzipreader->error)
+		return(1);
+
+	if (pathlen > 0) {
+		gzipreader->read(&entry->path, 1, pathlen, gzipreader);
+		if (gzipreader->error)
+			return(1);
+		entry->path[pathlen - 1] = 0;
+	}
+
+	if (entry->type == 'f') {
+		gzipreader->read(&entry->datalength, 4, 1, gzipreader);
+		if (gzipreader->error)
+			return(1);
+	}
+	return(0);
+}
+
+
 struct RORgz *rgz_load(struct _reader *reader) {
 	struct RORgz *ret;
+	struct _arena *arena;
 	unsigned int entrylimit;
 	struct _reader *gzipreader;
 
@@ -99,48 +137,28 @@ struct RORgz *rgz_load(struct _reader *reader) {
 		return(NULL);
 	}
 
-	ret = (struct RORgz*)_xalloc(sizeof(struct RORgz));
+	arena = _arena_loadinit(reader->remaining(reader));
+	ret = (struct RORgz*)_arena_newobject(arena, sizeof(struct RORgz));
 	ret->entries = NULL;
 	ret->entrycount = entrylimit = 0;
 	for (;;) {
 		struct RORgzEntry *entry;
-		unsigned char pathlen;
 
 		if (ret->entrycount == entrylimit) {
-			struct RORgzEntry *tmp = ret->entries;
+			unsigned int oldlimit = entrylimit;
 			entrylimit = entrylimit * 4 + 3;
-			ret->entries = (struct RORgzEntry*)_xalloc(sizeof(struct RORgzEntry) * entrylimit);
-			if (tmp != NULL) {
-				memcpy(ret->entries, tmp, sizeof(struct RORgzEntry) * ret->entrycount);
-				_xfree(tmp);
-			}
+			ret->entries = (struct RORgzEntry*)_arena_realloc(arena, ret->entries, sizeof(struct RORgzEntry) * oldlimit, sizeof(struct RORgzEntry) * entrylimit);
 		}
 		entry = &ret->entries[ret->entrycount];
 		ret->entrycount++;
 		memset(entry, 0, sizeof(struct RORgzEntry));
 
-		gzipreader->read(&entry->type, 1, 1, gzipreader);
-		if (gzipreader->error)
-			break;
-
-		gzipreader->read(&pathlen, 1, 1, gzipreader);
-		if (gzipreader->error)
+		if (_rgz_readheader(gzipreader, entry) != 0)
 			break;
 
-		if (pathlen > 0) {
-			gzipreader->read(&entry->path, 1, pathlen, gzipreader);
-			if (gzipreader->error)
-				break;
-			entry->path[pathlen - 1] = 0;
-		}
-
 		if (entry->type == 'f') {
-			gzipreader->read(&entry->datalength, 4, 1, gzipreader);
-			if (gzipreader->error)
-				break;
-
 			if (entry->datalength > 0) {
-				entry->data = (unsigned char*)_xalloc(sizeof(unsigned char) * entry->datalength);
+				entry->data = (unsigned char*)_arena_alloc(arena, sizeof(unsigned char) * entry->datalength);
 				gzipreader->read(entry->data, 1, entry->datalength, gzipreader);
 				if (gzipreader->error)
 					break;
@@ -163,12 +181,8 @@ struct RORgz *rgz_load(struct _reader *reader) {
 		rgz_unload(ret);
 		ret = NULL;
 	}
-	if (ret != NULL && ret->entrycount != entrylimit) {
-		struct RORgzEntry *tmp = ret->entries;
-		ret->entries = (struct RORgzEntry*)_xalloc(sizeof(struct RORgzEntry) * ret->entrycount);
-		memcpy(ret->entries, tmp, sizeof(struct RORgzEntry) * ret->entrycount);
-		_xfree(tmp);
-	}
+	if (ret != NULL && arena == NULL && ret->entrycount != entrylimit)// trim
+		ret->entries = (struct RORgzEntry*)_xrealloc(ret->entries, sizeof(struct RORgzEntry) * entrylimit, sizeof(struct RORgzEntry) * ret->entrycount);
 	gzipreader->destroy(gzipreader);
 
 	return(ret);
@@ -179,7 +193,7 @@ struct RORgz *rgz_loadFromData(const unsigned char *data, unsigned int length) {
 	struct RORgz *ret;
 	struct _reader *reader;
 
-	reader = memreader_init(data, length);
+	reader = statsreader_init(memreader_init(data, length), ROINT_FORMAT_RGZ);
 	ret = rgz_load(reader);
 	reader->destroy(reader);
 
@@ -191,7 +205,7 @@ struct RORgz *rgz_loadFromFile(const char *fn) {
 	struct RORgz *ret;
 	struct _reader *reader;
 
-	reader = filereader_init(fn);
+	reader = statsreader_init(filereader_init(fn), ROINT_FORMAT_RGZ);
 	ret = rgz_load(reader);
 	reader->destroy(reader);
 
@@ -214,7 +228,7 @@ int rgz_save(const struct RORgz *rgz, struct _writer *writer) {
 		return(1);
 	}
 
-	gzipwriter = deflatewriter_init(writer, 1); // gzip
+	gzipwriter = deflatewriter_initparallel(writer, 1, 0); // gzip
 	if (gzipwriter->error) {
 		_xlog("rgz.save : gzipwriter init failed\n");
 		gzipwriter->destroy(gzipwriter);
@@ -245,7 +259,7 @@ int rgz_saveToData(const struct RORgz *rgz, unsigned char **data_out, unsigned l
 	int ret;
 	struct _writer *writer;
 
-	writer = memwriter_init(data_out, size_out);
+	writer = statswriter_init(memwriter_init(data_out, size_out), ROINT_FORMAT_RGZ);
 	ret = rgz_save(rgz, writer);
 	writer->destroy(writer);
 
@@ -255,10 +269,13 @@ int rgz_saveToData(const struct RORgz *rgz, unsigned char **data_out, unsigned l
 
 int rgz_saveToFile(const struct RORgz *rgz, const char *fn) {
 	int ret;
-	struct _writer *writer;
+	struct _writer *writer, *memwriter;
 
-	writer = filewriter_init(fn);
+	memwriter = memwriter_init(NULL, NULL);
+	writer = statswriter_init(memwriter, ROINT_FORMAT_RGZ);
 	ret = rgz_save(rgz, writer);
+	if (ret == 0)
+		ret = memwriter_savefile(memwriter, fn);
 	writer->destroy(writer);
 
 	return(ret);
@@ -270,6 +287,8 @@ void rgz_unload(struct RORgz* rgz) {
 
 	if (rgz == NULL)
 		return;
+	if (_arena_release(rgz) == 0)
+		return;// loaded in arena mode, everything is released
 
 	for (i = 0; i < rgz->entrycount; i++)
 		if (rgz->entries[i].data != NULL)
@@ -278,3 +297,238 @@ void rgz_unload(struct RORgz* rgz) {
 		_xfree(rgz->entries);
 	_xfree(rgz);
 }
+
+
+// Loads the index saved by rgz_saveIndex. Returns 0 on success.
+int _rgz_loadindex(struct RORgzStream *rgz, struct _reader *index, unsigned int filesize) {
+	unsigned short version;
+	unsigned long long mtime;
+	unsigned int size, trailer[2], i;
+	char magic[4];
+
+	index->read(magic, 4, 1, index);
+	index->read(&version, 2, 1, index);
+	index->read(&size, 4, 1, index);
+	index->read(&mtime, 8, 1, index);
+	index->read(trailer, 4, 2, index);
+	index->read(&rgz->entrycount, 4, 1, index);
+	if (index->error || memcmp(RGZ_INDEX_MAGIC, magic, 4) != 0 || version != RGZ_INDEX_VERSION || size != filesize ||
+		mtime != rgz->mtime || trailer[0] != rgz->trailer[0] || trailer[1] != rgz->trailer[1] ||
+		_mul_over_limit(rgz->entrycount, sizeof(struct RORgzEntry), 0x7FFFFFFF)) {
+		_xlog("rgz.open : index does not match\n");
+		rgz->entrycount = 0;
+		return(1);
+	}
+
+	rgz->entries = (struct RORgzEntry*)_xalloc(sizeof(struct RORgzEntry) * (rgz->entrycount + 1));
+	rgz->offsets = (unsigned int*)_xalloc(sizeof(unsigned int) * (rgz->entrycount + 1));
+	memset(rgz->entries, 0, sizeof(struct RORgzEntry) * (rgz->entrycount + 1));
+	for (i = 0; i < rgz->entrycount; i++) {
+		struct RORgzEntry *entry = &rgz->entries[i];
+		unsigned char pathlen;
+		index->read(&entry->type, 1, 1, index);
+		index->read(&pathlen, 1, 1, index);
+		index->read(entry->path, 1, pathlen, index);
+		index->read(&entry->datalength, 4, 1, index);
+		index->read(&rgz->offsets[i], 4, 1, index);
+		if (index->error)
+			break;
+		entry->path[255] = 0;
+	}
+	if (index->error || deflatereader_loadindex((struct _reader*)rgz->reader, index) != 0) {
+		_xlog("rgz.open : invalid index\n");
+		return(1);
+	}
+	return(0);
+}
+
+
+// Lists the entries, recording seek checkpoints along the way. Returns 0 on success.
+int _rgz_scan(struct RORgzStream *rgz) {
+	struct _reader *gzipreader = (struct _reader*)rgz->reader;
+	unsigned int entrylimit = 0;
+
+	for (;;) {
+		struct RORgzEntry *entry;
+
+		if (rgz->entrycount == entrylimit) {
+			unsigned int oldlimit = entrylimit;
+			entrylimit = entrylimit * 4 + 3;
+			rgz->entries = (struct RORgzEntry*)_xrealloc(rgz->entries, sizeof(struct RORgzEntry) * oldlimit, sizeof(struct RORgzEntry) * entrylimit);
+			rgz->offsets = (unsigned int*)_xrealloc(rgz->offsets, sizeof(unsigned int) * oldlimit, sizeof(unsigned int) * entrylimit);
+		}
+		entry = &rgz->entries[rgz->entrycount];
+		memset(entry, 0, sizeof(struct RORgzEntry));
+
+		if (_rgz_readheader(gzipreader, entry) != 0)
+			return(1);
+		rgz->offsets[rgz->entrycount] = (unsigned int)gzipreader->tell(gzipreader);
+		rgz->entrycount++;
+
+		if (entry->type == 'f') {
+			if (entry->datalength > 0 && gzipreader->seek(gzipreader, (long)entry->datalength, SEEK_CUR) != 0)
+				return(1);
+		}
+		else if (entry->type == 'd') {
+		}
+		else if (entry->type == 'e') {
+			return(0); // ignore rest of data
+		}
+		else {
+			_xlog("Unknown entry type '%c' (%s)\n", entry->type, entry->path);
+			return(1);
+		}
+	}
+}
+
+
+static struct RORgzStream *rgz__open(const char *fn, const char *indexfn) {
+	struct RORgzStream *ret;
+	struct _reader *reader, *gzipreader;
+	struct stat st;
+	unsigned int filesize, trailer[2];
+
+	reader = filereader_init(fn);
+	if (reader->error || stat(fn, &st) != 0) {
+		_xlog("rgz.open : cannot open file\n");
+		reader->destroy(reader);
+		return(NULL);
+	}
+	reader->seek(reader, 0, SEEK_END);
+	filesize = (unsigned int)reader->tell(reader);
+	// CRC32 and ISIZE of the last gzip member, changes with the content
+	if (filesize < 8 || reader->seek(reader, (long)filesize - 8, SEEK_SET) != 0 ||
+		reader->read(trailer, 4, 2, reader) != 0 || reader->seek(reader, 0, SEEK_SET) != 0) {
+		_xlog("rgz.open : read error\n");
+		reader->destroy(reader);
+		return(NULL);
+	}
+	gzipreader = deflatereader_init(reader, 1); // gzip only
+	if (gzipreader->error) {
+		_xlog("rgz.open : gzipreader init failed\n");
+		gzipreader->destroy(gzipreader);
+		reader->destroy(reader);
+		return(NULL);
+	}
+	deflatereader_setcheckpoints(gzipreader, RGZ_CHECKPOINT_SPAN);
+
+	ret = (struct RORgzStream*)_xalloc(sizeof(struct RORgzStream));
+	memset(ret, 0, sizeof(struct RORgzStream));
+	ret->file = reader;
+	ret->reader = gzipreader;
+	ret->mtime = (unsigned long long)st.st_mtime;
+	ret->trailer[0] = trailer[0];
+	ret->trailer[1] = trailer[1];
+
+	if (indexfn != NULL) {
+		struct _reader *index = filereader_init(indexfn);
+		int err = 1;
+		if (!index->error)
+			err = _rgz_loadindex(ret, index, filesize);
+		index->destroy(index);
+		if (err == 0)
+			return(ret);
+		// scan instead
+		if (ret->entries != NULL)
+			_xfree(ret->entries);
+		if (ret->offsets != NULL)
+			_xfree(ret->offsets);
+		ret->entries = NULL;
+		ret->offsets = NULL;
+		ret->entrycount = 0;
+	}
+
+	if (_rgz_scan(ret) != 0) {
+		_xlog("rgz.open : read error\n");
+		rgz_close(ret);
+		return(NULL);
+	}
+	return(ret);
+}
+
+
+struct RORgzStream *rgz_open(const char *fn, const char *indexfn) {
+	unsigned int subsystem = _xalloc_subsystem(ROINT_FORMAT_RGZ);
+	struct RORgzStream *ret = rgz__open(fn, indexfn);
+
+	_xalloc_subsystem(subsystem);
+	return(ret);
+}
+
+
+int rgz_read(struct RORgzStream *rgz, unsigned int entry, unsigned int offset, void *buf, unsigned int length) {
+	struct _reader *gzipreader;
+
+	if (rgz == NULL || entry >= rgz->entrycount || buf == NULL ||
+		offset > rgz->entries[entry].datalength || length > rgz->entries[entry].datalength - offset) {
+		_xlog("rgz.read : invalid argument (rgz=%p entry=%u offset=%u buf=%p length=%u)\n", rgz, entry, offset, buf, length);
+		return(1);
+	}
+
+	gzipreader = (struct _reader*)rgz->reader;
+	if (gzipreader->seek(gzipreader, (long)(rgz->offsets[entry] + offset), SEEK_SET) != 0 ||
+		gzipreader->read(buf, 1, length, gzipreader) != 0) {
+		_xlog("rgz.read : read error\n");
+		return(1);
+	}
+	return(0);
+}
+
+
+int rgz_saveIndex(struct RORgzStream *rgz, const char *indexfn) {
+	struct _writer *writer;
+	unsigned int filesize, i;
+	int ret;
+
+	if (rgz == NULL || indexfn == NULL) {
+		_xlog("rgz.saveIndex : invalid argument (rgz=%p indexfn=%p)\n", rgz, indexfn);
+		return(1);
+	}
+
+	{// file size (the gzip reader expects the file position to stay the same)
+		struct _reader *reader = (struct _reader*)rgz->file;
+		long pos = (long)reader->tell(reader);
+		reader->seek(reader, 0, SEEK_END);
+		filesize = (unsigned int)reader->tell(reader);
+		reader->seek(reader, pos, SEEK_SET);
+	}
+
+	writer = filewriter_init(indexfn);
+	writer->write(RGZ_INDEX_MAGIC, 4, 1, writer);
+	writer->write(&RGZ_INDEX_VERSION, 2, 1, writer);
+	writer->write(&filesize, 4, 1, writer);
+	writer->write(&rgz->mtime, 8, 1, writer);
+	writer->write(rgz->trailer, 4, 2, writer);
+	writer->write(&rgz->entrycount, 4, 1, writer);
+	for (i = 0; i < rgz->entrycount; i++) {
+		const struct RORgzEntry *entry = &rgz->entries[i];
+		unsigned char pathlen = (unsigned char)strlen(entry->path) + 1;
+		writer->write(&entry->type, 1, 1, writer);
+		writer->write(&pathlen, 1, 1, writer);
+		writer->write(entry->path, 1, pathlen, writer);
+		writer->write(&entry->datalength, 4, 1, writer);
+		writer->write(&rgz->offsets[i], 4, 1, writer);
+	}
+	ret = deflatereader_saveindex((struct _reader*)rgz->reader, writer);
+	if (writer->error)
+		ret = 1;
+	writer->destroy(writer);
+
+	return(ret);
+}
+
+
+void rgz_close(struct RORgzStream *rgz) {
+	if (rgz == NULL)
+		return;
+
+	if (rgz->reader != NULL)
+		((struct _reader*)rgz->reader)->destroy((struct _reader*)rgz->reader);
+	if (rgz->file != NULL)
+		((struct _reader*)rgz->file)->destroy((struct _reader*)rgz->file);
+	if (rgz->entries != NULL)
+		_xfree(rgz->entries);
+	if (rgz->offsets != NULL)
+		_xfree(rgz->offsets);
+	_xfree(rgz);
+}
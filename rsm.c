@@ -26,6 +26,8 @@
 
 #ifdef ROINT_INTERNAL
 #	include "internal.h"
+#	include "arena.h"
+#	include "flat.h"
 #else
 #	define _xlog printf
 #	define _xalloc malloc
@@ -39,15 +41,18 @@
 
 struct RORsm *rsm_load(struct _reader *reader) {
 	struct RORsm *ret;
+	struct _arena *arena;
 
-	ret = (struct RORsm*)_xalloc(sizeof(struct RORsm));
+	arena = _arena_loadinit(reader->remaining(reader));
+	ret = (struct RORsm*)_arena_newobject(arena, sizeof(struct RORsm));
 
 	reader->read(ret->magic, 4, 1, reader);
 	reader->read(&ret->version, 2, 1, reader);
 
 	if (strncmp("GRSM", ret->magic, 4) != 0) {
 		_xlog("Invalid RSM header: '%c%c%c%c'\n", ret->magic[0], ret->magic[1], ret->magic[2], ret->magic[3]);
-		_xfree(ret);
+		if (_arena_release(ret))
+			_xfree(ret);
 		return(NULL);
 	}
 
@@ -69,11 +74,11 @@ struct RORsm *rsm_load(struct _reader *reader) {
 	if (ret->texture_count > 0) {
 		int i;
 		char texname[40];
-		ret->textures = (char**)_xalloc(sizeof(char*) * ret->texture_count);
+		ret->textures = (char**)_arena_alloc(arena, sizeof(char*) * ret->texture_count);
 		for (i = 0; i < ret->texture_count; i++) {
 			reader->read(texname, 40, 1, reader);
 			texname[39] = 0;
-			ret->textures[i] = (char*)_xalloc(sizeof(char) * (strlen(texname) + 1));
+			ret->textures[i] = (char*)_arena_alloc(arena, sizeof(char) * (strlen(texname) + 1));
 			strcpy(ret->textures[i], texname);
 		}
 	}
@@ -89,7 +94,7 @@ struct RORsm *rsm_load(struct _reader *reader) {
 		int i;
 		struct RORsmNode *currentNode;
 
-		ret->nodes = (struct RORsmNode*)_xalloc(sizeof(struct RORsmNode) * ret->node_count);
+		ret->nodes = (struct RORsmNode*)_arena_alloc(arena, sizeof(struct RORsmNode) * ret->node_count);
 
 		for (i = 0; i < ret->node_count; i++) {
 			currentNode = &ret->nodes[i];
@@ -99,7 +104,7 @@ struct RORsm *rsm_load(struct _reader *reader) {
 			reader->read(&currentNode->texture_count, sizeof(int), 1, reader);
 
 			if (currentNode->texture_count > 0) {
-				currentNode->textures = (int*)_xalloc(sizeof(int) * currentNode->texture_count);
+				currentNode->textures = (int*)_arena_alloc(arena, sizeof(int) * currentNode->texture_count);
 				reader->read(currentNode->textures, sizeof(int), currentNode->texture_count, reader);
 			}
 			else {
@@ -116,7 +121,7 @@ struct RORsm *rsm_load(struct _reader *reader) {
 			// Node vertexes
 			reader->read(&currentNode->vertice_count, sizeof(int), 1, reader);
 			if (currentNode->vertice_count > 0) {
-				currentNode->vertices = (struct RORsmVertex*)_xalloc(sizeof(struct RORsmVertex) * currentNode->vertice_count);
+				currentNode->vertices = (struct RORsmVertex*)_arena_alloc(arena, sizeof(struct RORsmVertex) * currentNode->vertice_count);
 				reader->read(currentNode->vertices, sizeof(struct RORsmVertex), currentNode->vertice_count, reader);
 			}
 			else {
@@ -126,7 +131,7 @@ struct RORsm *rsm_load(struct _reader *reader) {
 			// Texture vertices
 			reader->read(&currentNode->texv_count, sizeof(int), 1, reader);
 			if (currentNode->texv_count > 0) {
-				currentNode->texv = (struct RORsmTexture*)_xalloc(sizeof(struct RORsmTexture) * currentNode->texv_count);
+				currentNode->texv = (struct RORsmTexture*)_arena_alloc(arena, sizeof(struct RORsmTexture) * currentNode->texv_count);
 				if (ret->v.major > 1 || (ret->v.major == 1 && ret->v.minor >= 2)) {
 					// Versions 1.2 and up
 					reader->read(currentNode->texv, sizeof(struct RORsmTexture), currentNode->texv_count, reader);
@@ -146,7 +151,7 @@ struct RORsm *rsm_load(struct _reader *reader) {
 			// Faces
 			reader->read(&currentNode->face_count, sizeof(int), 1, reader);
 			if (currentNode->face_count > 0) {
-				currentNode->faces = (struct RORsmFace*)_xalloc(sizeof(struct RORsmFace) * currentNode->face_count);
+				currentNode->faces = (struct RORsmFace*)_arena_alloc(arena, sizeof(struct RORsmFace) * currentNode->face_count);
 				if (ret->v.major > 1 || (ret->v.major == 1 && ret->v.minor >= 2)) {
 					// Versions 1.2 and up
 					reader->read(currentNode->faces, sizeof(struct RORsmFace), currentNode->face_count, reader);
@@ -173,7 +178,7 @@ struct RORsm *rsm_load(struct _reader *reader) {
 			}
 
 			if (currentNode->poskey_count > 0) {
-				currentNode->poskeys = (struct RORsmPosKeyframe*)_xalloc(sizeof(struct RORsmPosKeyframe) * currentNode->poskey_count);
+				currentNode->poskeys = (struct RORsmPosKeyframe*)_arena_alloc(arena, sizeof(struct RORsmPosKeyframe) * currentNode->poskey_count);
 				reader->read(currentNode->poskeys, sizeof(struct RORsmPosKeyframe), currentNode->poskey_count, reader);
 			}
 			else {
@@ -184,7 +189,7 @@ struct RORsm *rsm_load(struct _reader *reader) {
 			if (currentNode->rotkey_count > 0) {
 				struct RORsmRotKeyframe* x;
 				int rotkeyframe_size = sizeof(struct RORsmRotKeyframe) * currentNode->rotkey_count;
-				x = _xalloc(rotkeyframe_size);
+				x = _arena_alloc(arena, rotkeyframe_size);
 				currentNode->rotkeys = x;
 				reader->read(currentNode->rotkeys, sizeof(struct RORsmRotKeyframe), currentNode->rotkey_count, reader);
 			}
@@ -212,7 +217,7 @@ struct RORsm *rsm_loadFromData(const unsigned char *data, unsigned int length) {
 	struct RORsm *ret;
 	struct _reader *reader;
 
-	reader = memreader_init(data, length);
+	reader = statsreader_init(memreader_init(data, length), ROINT_FORMAT_RSM);
 	ret = rsm_load(reader);
 	reader->destroy(reader);
 
@@ -224,7 +229,7 @@ struct RORsm *rsm_loadFromFile(const char *fn) {
 	struct RORsm *ret;
 	struct _reader *reader;
 
-	reader = filereader_init(fn);
+	reader = statsreader_init(filereader_init(fn), ROINT_FORMAT_RSM);
 	ret = rsm_load(reader);
 	reader->destroy(reader);
 
@@ -250,6 +255,92 @@ struct RORsm *rsm_loadFromGrf(struct ROGrfFile *file) {
 }
 
 
+int rsm_saveToFlat(const struct RORsm *rsm, unsigned char **data_out, unsigned long *size_out) {
+	struct _flat flat;
+	unsigned long root, textures, nodes;
+	int i;
+
+	if (rsm == NULL || data_out == NULL || size_out == NULL || rsm->texture_count < 0 || rsm->node_count < 0) {
+		_xlog("rsm.saveToFlat : invalid argument (rsm=%p data_out=%p size_out=%p)\n", rsm, data_out, size_out);
+		return(1);
+	}
+
+	_flat_init(&flat, ROINT_FORMAT_RSM);
+	root = _flat_add(&flat, rsm, sizeof(struct RORsm));
+	textures = _flat_addptr(&flat, root + offsetof(struct RORsm, textures), rsm->textures, sizeof(char*) * rsm->texture_count);
+	for (i = 0; textures != 0 && i < rsm->texture_count; i++) {
+		const char *texture = rsm->textures[i];
+		_flat_addptr(&flat, textures + sizeof(char*) * i, texture, (texture != NULL)? (unsigned long)strlen(texture) + 1: 0);
+	}
+	nodes = _flat_addptr(&flat, root + offsetof(struct RORsm, nodes), rsm->nodes, sizeof(struct RORsmNode) * rsm->node_count);
+	for (i = 0; nodes != 0 && i < rsm->node_count; i++) {
+		const struct RORsmNode *node = &rsm->nodes[i];
+		unsigned long nodeAt = nodes + sizeof(struct RORsmNode) * i;
+		if (node->texture_count < 0 || node->vertice_count < 0 || node->texv_count < 0 ||
+			node->face_count < 0 || node->poskey_count < 0 || node->rotkey_count < 0) {
+			_xlog("rsm.saveToFlat : negative count in node %d\n", i);
+			flat.error = 1;
+			break;
+		}
+		_flat_addptr(&flat, nodeAt + offsetof(struct RORsmNode, textures), node->textures, sizeof(int) * node->texture_count);
+		_flat_addptr(&flat, nodeAt + offsetof(struct RORsmNode, vertices), node->vertices, sizeof(struct RORsmVertex) * node->vertice_count);
+		_flat_addptr(&flat, nodeAt + offsetof(struct RORsmNode, texv), node->texv, sizeof(struct RORsmTexture) * node->texv_count);
+		_flat_addptr(&flat, nodeAt + offsetof(struct RORsmNode, faces), node->faces, sizeof(struct RORsmFace) * node->face_count);
+		_flat_addptr(&flat, nodeAt + offsetof(struct RORsmNode, poskeys), node->poskeys, sizeof(struct RORsmPosKeyframe) * node->poskey_count);
+		_flat_addptr(&flat, nodeAt + offsetof(struct RORsmNode, rotkeys), node->rotkeys, sizeof(struct RORsmRotKeyframe) * node->rotkey_count);
+	}
+
+	return(_flat_finish(&flat, root, data_out, size_out));
+}
+
+
+const struct RORsm *rsm_attachFlat(void *data, unsigned long size) {
+	int moved;
+	const struct RORsm *rsm = (const struct RORsm*)_flat_attach(data, size, ROINT_FORMAT_RSM, sizeof(struct RORsm), &moved);
+
+	if (rsm != NULL && moved && rsm_verifyFlat(data, size) != 0)
+		return(NULL); // relocated from an unknown address, do not trust it
+	return(rsm);
+}
+
+
+int rsm_verifyFlat(const void *data, unsigned long size) {
+	const struct RORsm *rsm = (const struct RORsm*)_flat_verify(data, size, ROINT_FORMAT_RSM, sizeof(struct RORsm));
+	int i;
+
+	if (rsm == NULL)
+		return(1);
+	// every array must fit in the block (negative counts never fit)
+	if (rsm->texture_count < 0 || rsm->node_count < 0 ||
+		_flat_checkarray(data, rsm->textures, (unsigned long)rsm->texture_count, sizeof(char*)) ||
+		_flat_checkarray(data, rsm->nodes, (unsigned long)rsm->node_count, sizeof(struct RORsmNode))) {
+		_xlog("rsm.verifyFlat : invalid\n");
+		return(1);
+	}
+	for (i = 0; i < rsm->texture_count; i++) {
+		if (_flat_checkstring(data, rsm->textures[i])) {
+			_xlog("rsm.verifyFlat : [%d] invalid texture\n", i);
+			return(1);
+		}
+	}
+	for (i = 0; i < rsm->node_count; i++) {
+		const struct RORsmNode *node = &rsm->nodes[i];
+		if (node->texture_count < 0 || node->vertice_count < 0 || node->texv_count < 0 ||
+			node->face_count < 0 || node->poskey_count < 0 || node->rotkey_count < 0 ||
+			_flat_checkarray(data, node->textures, (unsigned long)node->texture_count, sizeof(int)) ||
+			_flat_checkarray(data, node->vertices, (unsigned long)node->vertice_count, sizeof(struct RORsmVertex)) ||
+			_flat_checkarray(data, node->texv, (unsigned long)node->texv_count, sizeof(struct RORsmTexture)) ||
+			_flat_checkarray(data, node->faces, (unsigned long)node->face_count, sizeof(struct RORsmFace)) ||
+			_flat_checkarray(data, node->poskeys, (unsigned long)node->poskey_count, sizeof(struct RORsmPosKeyframe)) ||
+			_flat_checkarray(data, node->rotkeys, (unsigned long)node->rotkey_count, sizeof(struct RORsmRotKeyframe))) {
+			_xlog("rsm.verifyFlat : [%d] invalid node\n", i);
+			return(1);
+		}
+	}
+	return(0);
+}
+
+
 void rsm_nodedelete(struct RORsmNode *node) {
 	if (node->textures != NULL) {
 		_xfree(node->textures);
@@ -286,6 +377,8 @@ void rsm_nodedelete(struct RORsmNode *node) {
 void rsm_unload(struct RORsm* rsm) {
 	if (rsm == NULL)
 		return;
+	if (_arena_release(rsm) == 0)
+		return;// loaded in arena mode, everything is released
 
 	if (rsm->textures != NULL) {
 		int i;
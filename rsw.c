@@ -22,6 +22,8 @@
     ------------------------------------------------------------------------------------
 */
 #include "internal.h"
+#include "arena.h"
+#include "cursor.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -29,34 +31,41 @@
 
 const char RSW_MAGIC[4] = {'G','R','S','W'};
 
-void RswReadQuadtree(struct RORswQuadTreeNode* quadtree, struct _reader *reader, unsigned int level, unsigned int *i);
+void RswReadQuadtree(struct RORswQuadTreeNode* quadtree, struct _cursor *cursor, unsigned int level, unsigned int *i);
 struct RORsw *rsw_load(struct _reader *reader);
 
 struct RORsw *rsw_load(struct _reader *reader) {
 	int i;
 	struct RORsw *ret;
+	struct _arena *arena;
+	struct _cursor cursor;
 	char magic[4];
 	struct RORswObject* rswobj;
+	int error;
 
 	if (reader == NULL || reader->error) {
 		_xlog("rsw.load : invalid argument (reader=%p reader.error=%d)\n", reader, reader->error);
 		return(NULL);
 	}
 
-	ret = (struct RORsw*)_xalloc(sizeof(struct RORsw));
+	arena = _arena_loadinit(reader->remaining(reader));
+	ret = (struct RORsw*)_arena_newobject(arena, sizeof(struct RORsw));
 	ret->objects = NULL; // Just to be sure
 	ret->quadtree = NULL;
 	memset(ret, 0, sizeof(struct RORsw));
 
-	reader->read(&magic, 4, 1, reader);
+	_cursor_init(&cursor, reader);
+	_cursor_need(&cursor, 6);
+	_cursor_bytes(&cursor, magic, 4);
 	if (memcmp(RSW_MAGIC, magic, 4) != 0) {
 		_xlog("rsw.load : invalid header x%02X%02X%02X%02X (\"%-4s\")\n", magic[0], magic[1], magic[2], magic[3], magic);
+		_cursor_destroy(&cursor);
 		rsw_unload(ret);
 		return(NULL);
 	}
 
-	reader->read(&ret->vermajor, 1, 1, reader);
-	reader->read(&ret->verminor, 1, 1, reader);
+	ret->vermajor = _cursor_u8(&cursor);
+	ret->verminor = _cursor_u8(&cursor);
 
 	if (ret->vermajor == 1 && ret->verminor >= 2 && ret->verminor <= 9) {
 		// supported [1.2 1.9]
@@ -68,31 +77,38 @@ struct RORsw *rsw_load(struct _reader *reader) {
 		_xlog("I don't know how to properly read rsw version %d.%d, but i'm gonna try...\n", ret->vermajor, ret->verminor);
 	}
 
-	reader->read(ret->m_iniFile, 40, 1, reader);
-	reader->read(ret->m_gndFile, 40, 1, reader);
+	_cursor_need(&cursor, 80);
+	_cursor_bytes(&cursor, ret->m_iniFile, 40);
+	_cursor_bytes(&cursor, ret->m_gndFile, 40);
 	if (ret->vermajor >= 2 || (ret->vermajor == 1 && ret->verminor >= 4)) { // v > 1.4
-		reader->read(ret->m_gatFile, 40, 1, reader);
+		_cursor_need(&cursor, 40);
+		_cursor_bytes(&cursor, ret->m_gatFile, 40);
 	}
 	else {
 		memset(ret->m_gatFile, 0, 40);
 	}
 
-	reader->read(ret->m_scrFile, 40, 1, reader);
+	_cursor_need(&cursor, 40);
+	_cursor_bytes(&cursor, ret->m_scrFile, 40);
 
 	// make strings finish where they are supposed to.
 	ret->m_iniFile[39] = ret->m_gndFile[39] = ret->m_gatFile[39] = ret->m_scrFile[39] = 0;
 
 	// == == == WATER == == ==
 	if (ret->vermajor >= 2 || (ret->vermajor == 1 && ret->verminor >= 3)) { // v > 1.3
-		reader->read(&(ret->water), sizeof(float), 1, reader);
+		_cursor_need(&cursor, 4);
+		ret->water.level = _cursor_f32(&cursor);
 	}
 	else {
 		ret->water.level = 0.0f;
 	}
 
 	if (ret->vermajor >= 2 || (ret->vermajor == 1 && ret->verminor >= 8)) { // v > 1.8
-		reader->read(&ret->water.type, sizeof(int), 1, reader);
-		reader->read(&ret->water.waveHeight, sizeof(float), 3, reader); // reads waveHeight, waveSpeed and wavePitch
+		_cursor_need(&cursor, 16);
+		ret->water.type = _cursor_i32(&cursor);
+		ret->water.waveHeight = _cursor_f32(&cursor);
+		ret->water.waveSpeed = _cursor_f32(&cursor);
+		ret->water.wavePitch = _cursor_f32(&cursor);
 	}
 	else {
 		ret->water.type = 0;
@@ -102,7 +118,8 @@ struct RORsw *rsw_load(struct _reader *reader) {
 	}
 	
 	if (ret->vermajor >= 2 || (ret->vermajor == 1 && ret->verminor >= 9)) { // v > 1.9
-		reader->read(&ret->water.animSpeed, sizeof(int), 1, reader);
+		_cursor_need(&cursor, 4);
+		ret->water.animSpeed = _cursor_i32(&cursor);
 	}
 	else {
 		ret->water.animSpeed = 3;
@@ -111,8 +128,11 @@ struct RORsw *rsw_load(struct _reader *reader) {
 
 	// == == == LIGHT == == ==
 	if (ret->vermajor >= 2 || (ret->vermajor == 1 && ret->verminor >= 5)) { // v > 1.5
-		reader->read(&ret->light.longitude, sizeof(int), 2, reader); // longitude & latitude
-		reader->read(&ret->light.diffuse, sizeof(float), 6, reader); // diffuse[3] & ambient[3]
+		_cursor_need(&cursor, 32);
+		ret->light.longitude = _cursor_i32(&cursor);
+		ret->light.latitude = _cursor_i32(&cursor);
+		_cursor_bytes(&cursor, ret->light.diffuse, 12);
+		_cursor_bytes(&cursor, ret->light.ambient, 12);
 	}
 	else {
 		ret->light.longitude = 45;
@@ -122,12 +142,14 @@ struct RORsw *rsw_load(struct _reader *reader) {
 	}
 
 	if (ret->vermajor >= 2 || (ret->vermajor == 1 && ret->verminor >= 7)) { // v > 1.7
-		reader->read(&ret->light.ignored, sizeof(float), 1, reader);
+		_cursor_need(&cursor, 4);
+		ret->light.ignored = _cursor_f32(&cursor);
 	}
 
 	// == == == GROUND == == ==
 	if (ret->vermajor >= 2 || (ret->vermajor == 1 && ret->verminor >= 6)) { // v > 1.6
-		reader->read(ret->ground.gnd, sizeof(int), 4, reader);
+		_cursor_need(&cursor, 16);
+		_cursor_bytes(&cursor, ret->ground.gnd, 16);
 	}
 	else {
 		ret->ground.top = -500;
@@ -137,18 +159,29 @@ struct RORsw *rsw_load(struct _reader *reader) {
 	}
 
 	// == == == OBJECTS == == ==
-	reader->read(&ret->obj_count, sizeof(int), 1, reader);
-	ret->objects = (struct RORswObject*)_xalloc(sizeof(struct RORswObject) * ret->obj_count);
-	for (i = 0; i < ret->obj_count; i++) {
+	_cursor_need(&cursor, 4);
+	ret->obj_count = _cursor_i32(&cursor);
+	if (ret->obj_count < 0 || _mul_over_limit(ret->obj_count, sizeof(struct RORswObject), 0x7FFFFFFF)) {
+		_xlog("rsw.load : invalid object count %d\n", ret->obj_count);
+		ret->obj_count = 0;
+		cursor.error = 1;
+	}
+	if (ret->obj_count > 0) {
+		ret->objects = (struct RORswObject*)_arena_alloc(arena, sizeof(struct RORswObject) * ret->obj_count);
+		memset(ret->objects, 0, sizeof(struct RORswObject) * ret->obj_count);
+	}
+	for (i = 0; i < ret->obj_count && !cursor.error; i++) {
 		rswobj = &ret->objects[i];
-		reader->read(&rswobj->type, sizeof(int), 1, reader);
+		_cursor_need(&cursor, 4);
+		rswobj->type = _cursor_i32(&cursor);
 		switch(rswobj->type) {
 		case RORSW_OBJECT_MODEL:	// Model
 			if (ret->vermajor >= 2 || (ret->vermajor == 1 && ret->verminor >= 3)) { // v > 1.3
-				reader->read(rswobj->model.name, 40, 1, reader);
-				reader->read(&rswobj->model.animType, sizeof(int), 1, reader);
-				reader->read(&rswobj->model.animSpeed, sizeof(float), 1, reader);
-				reader->read(&rswobj->model.blockType, sizeof(int), 1, reader);
+				_cursor_need(&cursor, 52);
+				_cursor_bytes(&cursor, rswobj->model.name, 40);
+				rswobj->model.animType = _cursor_i32(&cursor);
+				rswobj->model.animSpeed = _cursor_f32(&cursor);
+				rswobj->model.blockType = _cursor_i32(&cursor);
 				// Sanity settings
 				rswobj->model.name[39] = 0;
 				if (rswobj->model.animSpeed < 0.0f || rswobj->model.animSpeed >= 100.0f)
@@ -160,31 +193,34 @@ struct RORsw *rsw_load(struct _reader *reader) {
 				rswobj->model.animSpeed = 1.0f;
 				rswobj->model.blockType = 0;
 			}
-			reader->read(rswobj->model.modelName, 80, 1, reader);
-			reader->read(rswobj->model.nodeName, 80, 1, reader);
-			reader->read(&rswobj->model.pos, sizeof(float), 3, reader);
-			reader->read(&rswobj->model.rot, sizeof(float), 3, reader);
-			reader->read(&rswobj->model.scale, sizeof(float), 3, reader);
+			_cursor_need(&cursor, 196);
+			_cursor_bytes(&cursor, rswobj->model.modelName, 80);
+			_cursor_bytes(&cursor, rswobj->model.nodeName, 80);
+			_cursor_bytes(&cursor, rswobj->model.pos, 12);
+			_cursor_bytes(&cursor, rswobj->model.rot, 12);
+			_cursor_bytes(&cursor, rswobj->model.scale, 12);
 			break;
 		case RORSW_OBJECT_LIGHT:	// Light
-			reader->read(rswobj->light.name, 80, 1, reader);
-			reader->read(rswobj->light.pos, sizeof(float), 3, reader);
-			reader->read(rswobj->light.color, sizeof(int), 3, reader);
-			reader->read(&rswobj->light.range, sizeof(float), 1, reader);
+			_cursor_need(&cursor, 108);
+			_cursor_bytes(&cursor, rswobj->light.name, 80);
+			_cursor_bytes(&cursor, rswobj->light.pos, 12);
+			_cursor_bytes(&cursor, rswobj->light.color, 12);
+			rswobj->light.range = _cursor_f32(&cursor);
 
 			// Sanity
 			rswobj->light.name[39] = 0;
 			break;
 		case RORSW_OBJECT_SOUND:	// Sound
-			reader->read(rswobj->sound.name, 80, 1, reader);
-			reader->read(rswobj->sound.waveName, 80, 1, reader);
-			reader->read(rswobj->sound.pos, sizeof(float), 3, reader);
-			reader->read(&rswobj->sound.vol, sizeof(float), 1, reader);
-			reader->read(&rswobj->sound.width, sizeof(int), 1, reader);
-			reader->read(&rswobj->sound.height, sizeof(int), 1, reader);
-			reader->read(&rswobj->sound.range, sizeof(float), 1, reader);
+			_cursor_need(&cursor, (ret->vermajor >= 2)? 192: 188);
+			_cursor_bytes(&cursor, rswobj->sound.name, 80);
+			_cursor_bytes(&cursor, rswobj->sound.waveName, 80);
+			_cursor_bytes(&cursor, rswobj->sound.pos, 12);
+			rswobj->sound.vol = _cursor_f32(&cursor);
+			rswobj->sound.width = _cursor_i32(&cursor);
+			rswobj->sound.height = _cursor_i32(&cursor);
+			rswobj->sound.range = _cursor_f32(&cursor);
 			if (ret->vermajor >= 2) { // v > 2.0
-				reader->read(&rswobj->sound.cycle, sizeof(float), 1, reader);
+				rswobj->sound.cycle = _cursor_f32(&cursor);
 			}
 			else {
 				rswobj->sound.cycle = 4.0f;
@@ -195,11 +231,12 @@ struct RORsw *rsw_load(struct _reader *reader) {
 			rswobj->sound.waveName[39] = 0;
 			break;
 		case RORSW_OBJECT_EFFECT:	// Effect
-			reader->read(rswobj->effect.name, 80, 1, reader);
-			reader->read(rswobj->effect.pos, sizeof(float), 3, reader);
-			reader->read(&rswobj->effect.type, sizeof(int), 1, reader);
-			reader->read(&rswobj->effect.emitSpeed, sizeof(float), 1, reader);
-			reader->read(rswobj->effect.param, sizeof(float), 4, reader);
+			_cursor_need(&cursor, 116);
+			_cursor_bytes(&cursor, rswobj->effect.name, 80);
+			_cursor_bytes(&cursor, rswobj->effect.pos, 12);
+			rswobj->effect.type = _cursor_i32(&cursor);
+			rswobj->effect.emitSpeed = _cursor_f32(&cursor);
+			_cursor_bytes(&cursor, rswobj->effect.param, 16);
 
 			// Sanity
 			rswobj->effect.name[39] = 0;
@@ -214,30 +251,40 @@ struct RORsw *rsw_load(struct _reader *reader) {
 	if (ret->vermajor >= 3 || (ret->vermajor == 2 && ret->verminor >= 1)) { // v > 2.1
 		unsigned int i = 0;
 
-		ret->quadtree = (struct RORswQuadTreeNode*)_xalloc(sizeof(struct RORswQuadTreeNode) * 1365);
-		
-		RswReadQuadtree(ret->quadtree, reader, 0, &i);
+		if (_cursor_needarray(&cursor, 48, 1365) == 0) {
+			ret->quadtree = (struct RORswQuadTreeNode*)_arena_alloc(arena, sizeof(struct RORswQuadTreeNode) * 1365);
+
+			RswReadQuadtree(ret->quadtree, &cursor, 0, &i);
+		}
+	}
+
+	error = cursor.error;
+	_cursor_destroy(&cursor);
+	if (error) {
+		_xlog("rsw.load : read error\n");
+		rsw_unload(ret);
+		return(NULL);
 	}
 
 	return(ret);
 }
 
-void RswReadQuadtree(struct RORswQuadTreeNode* quadtree, struct _reader *reader, unsigned int level, unsigned int *i) {
+void RswReadQuadtree(struct RORswQuadTreeNode* quadtree, struct _cursor *cursor, unsigned int level, unsigned int *i) {
 	struct RORswQuadTreeNode* node;
 	int k;
 
 	node = &quadtree[*i];
-	reader->read(node->max, sizeof(float), 3, reader);
-	reader->read(node->min, sizeof(float), 3, reader);
-	reader->read(node->halfSize, sizeof(float), 3, reader);
-	reader->read(node->center, sizeof(float), 3, reader);
+	_cursor_bytes(cursor, node->max, 12);
+	_cursor_bytes(cursor, node->min, 12);
+	_cursor_bytes(cursor, node->halfSize, 12);
+	_cursor_bytes(cursor, node->center, 12);
 
 	*i = *i + 1;
 
 	if (level < 5) {
 		for (k = 0; k < 4; k++) {
 			node->child[k] = *i;
-			RswReadQuadtree(quadtree, reader, level + 1, i);
+			RswReadQuadtree(quadtree, cursor, level + 1, i);
 		}
 	}
 	else {
@@ -253,7 +300,7 @@ struct RORsw *rsw_loadFromData(const unsigned char *data, unsigned long length)
 	struct RORsw *ret;
 	struct _reader *reader;
 
-	reader = memreader_init(data, length);
+	reader = statsreader_init(memreader_init(data, length), ROINT_FORMAT_RSW);
 	ret = rsw_load(reader);
 	reader->destroy(reader);
 
@@ -265,7 +312,7 @@ struct RORsw *rsw_loadFromFile(const char *fn) {
 	struct RORsw *ret;
 	struct _reader *reader;
 
-	reader = filereader_init(fn);
+	reader = statsreader_init(filereader_init(fn), ROINT_FORMAT_RSW);
 	ret = rsw_load(reader);
 	reader->destroy(reader);
 
@@ -293,6 +340,8 @@ struct RORsw *rsw_loadFromGrf(struct ROGrfFile *file) {
 void rsw_unload(struct RORsw *rsw) {
 	if (rsw == NULL)
 		return;
+	if (_arena_release(rsw) == 0)
+		return;// loaded in arena mode, everything is released
 
 	_xfree(rsw->objects);
 	if (NULL != rsw->quadtree)
@@ -22,6 +22,11 @@
     ------------------------------------------------------------------------------------
 */
 #include "internal.h"
+#include "arena.h"
+#include "cursor.h"
+#include "encoder.h"
+#include "flat.h"
+#include "pixel.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -31,6 +36,269 @@
 const char SPR_MAGIC[] = {'S','P'};
 
 
+/// Pixels encoded per encoder section by spr_rle_encode.
+#define SPR_RLE_CHUNK 0x1000
+/// Non-zero if a word of 8 bytes has a zero byte. (the lowest flagged byte is the first zero)
+#define SPR_HASZERO(w) (((w) - 0x0101010101010101ULL) & ~(w) & 0x8080808080808080ULL)
+
+
+// Pal images of v2.1 are run-length encoded:
+// index 0 is stored as a (0,len) pair that covers len pixels (1-255, 0 means 1),
+// every other index is stored as is.
+// The runs are scanned 8 bytes at a time. Where there is room, the copies are done
+// in words of 8 bytes that may go past the run; the extra bytes are overwritten
+// by the next run.
+
+
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+/// Index of the first zero byte of a word with SPR_HASZERO(w) != 0.
+#	define SPR_FIRSTZERO(w,bytes) ((unsigned int)__builtin_ctzll(SPR_HASZERO(w)) >> 3)
+/// Index of the first non-zero byte of a word with w != 0.
+#	define SPR_FIRSTNONZERO(w,bytes) ((unsigned int)__builtin_ctzll(w) >> 3)
+#else
+static unsigned int spr_firstzero(const unsigned char *bytes) {
+	unsigned int i = 0;
+	while (bytes[i] != 0)
+		i++;
+	return(i);
+}
+static unsigned int spr_firstnonzero(const unsigned char *bytes) {
+	unsigned int i = 0;
+	while (bytes[i] == 0)
+		i++;
+	return(i);
+}
+#	define SPR_FIRSTZERO(w,bytes) spr_firstzero(bytes)
+#	define SPR_FIRSTNONZERO(w,bytes) spr_firstnonzero(bytes)
+#endif
+
+
+// Length of the run of non-zero bytes at the start of data.
+static unsigned int spr_rle_literal(const unsigned char *data, unsigned int count) {
+	unsigned int len = 0;
+	unsigned long long w;
+
+	while (count - len >= 8) {
+		memcpy(&w, data + len, 8);
+		if (SPR_HASZERO(w))
+			return(len + SPR_FIRSTZERO(w, data + len));
+		len += 8;
+	}
+	while (len < count && data[len] != 0)
+		len++;
+	return(len);
+}
+
+
+// Length of the run of index 0 at the start of data. (up to 255)
+static unsigned int spr_rle_zerorun(const unsigned char *data, unsigned int count) {
+	unsigned int len = 1;
+	unsigned long long w;
+
+	if (count > 255)
+		count = 255;
+	while (count - len >= 8) {
+		memcpy(&w, data + len, 8);
+		if (w != 0)
+			return(len + SPR_FIRSTNONZERO(w, data + len));
+		len += 8;
+	}
+	while (len < count && data[len] == 0)
+		len++;
+	return(len);
+}
+
+
+// Decode a pal image.
+// Returns 0 on success, 1 if the encoded data does not match the number of pixels.
+static int spr_rle_decode(const unsigned char *src, unsigned int encoded, unsigned char *dst, unsigned int pixels) {
+	const unsigned char *end = src + encoded;
+	unsigned char *dstend = dst + pixels;
+	unsigned long long w;
+	unsigned int len;
+
+	while (src < end) {
+		// literal run
+		while (end - src >= 8 && dstend - dst >= 8) {
+			memcpy(&w, src, 8);
+			memcpy(dst, &w, 8);
+			if (SPR_HASZERO(w)) {
+				len = SPR_FIRSTZERO(w, src);
+				src += len;
+				dst += len;
+				break;
+			}
+			src += 8;
+			dst += 8;
+		}
+		while (src < end && *src != 0) {
+			if (dst == dstend)
+				return(1);
+			*dst++ = *src++;
+		}
+		if (src == end)
+			break;
+		// run of index 0
+		if (end - src < 2)
+			return(1); // missing length
+		len = (src[1] != 0)? src[1]: 1;
+		if (len > (unsigned int)(dstend - dst))
+			return(1);
+		if (len <= 16 && dstend - dst >= 16)
+			memset(dst, 0, 16);
+		else
+			memset(dst, 0, len);
+		dst += len;
+		src += 2;
+	}
+	return((dst == dstend)? 0: 1);
+}
+
+
+// Index the rows of a pal image: rows[y] is the token holding pixel y * width
+// and the number of pixels of that token that belong to the previous rows.
+// Returns 0 on success, 1 if the encoded data does not match the number of pixels.
+static int spr_rle_rows(const unsigned char *src, unsigned int encoded, unsigned int width, unsigned int height, struct ROSprLazyRow *rows) {
+	const unsigned char *start = src;
+	const unsigned char *end = src + encoded;
+	unsigned int pixels = width * height;
+	unsigned int pos = 0; // pixel of the current token
+	unsigned int y = 0;
+
+	while (src < end) {
+		unsigned int len;
+		if (*src != 0) {// literal run, one byte per pixel
+			const unsigned char *literal = src;
+			len = spr_rle_literal(src, (unsigned int)(end - src));
+			src += len;
+			if (len > pixels - pos)
+				return(1);
+			for (; y < height && y * width < pos + len; y++) {
+				rows[y].offset = (unsigned short)(literal - start + (y * width - pos));
+				rows[y].skip = 0;
+			}
+		}
+		else {// run of index 0
+			if (end - src < 2)
+				return(1); // missing length
+			len = (src[1] != 0)? src[1]: 1;
+			if (len > pixels - pos)
+				return(1);
+			for (; y < height && y * width < pos + len; y++) {
+				rows[y].offset = (unsigned short)(src - start);
+				rows[y].skip = (unsigned short)(y * width - pos);
+			}
+			src += 2;
+		}
+		pos += len;
+	}
+	return((pos == pixels)? 0: 1);
+}
+
+
+// Decode 'pixels' pixels from inside a pal image, starting 'skip' pixels after the token at 'src'.
+// Returns 0 on success, 1 if the encoded data ends first.
+static int spr_rle_decodepart(const unsigned char *src, const unsigned char *end, unsigned int skip, unsigned char *dst, unsigned int pixels) {
+	unsigned int len;
+
+	while (src < end && pixels > 0) {
+		if (*src != 0) {// literal run
+			const unsigned char *literal = src;
+			len = spr_rle_literal(src, (unsigned int)(end - src));
+			src += len;
+			if (skip >= len) {
+				skip -= len;
+				continue;
+			}
+			len -= skip;
+			if (len > pixels)
+				len = pixels;
+			memcpy(dst, literal + skip, len);
+		}
+		else {// run of index 0
+			if (end - src < 2)
+				return(1); // missing length
+			len = (src[1] != 0)? src[1]: 1;
+			src += 2;
+			if (skip >= len) {
+				skip -= len;
+				continue;
+			}
+			len -= skip;
+			if (len > pixels)
+				len = pixels;
+			memset(dst, 0, len);
+		}
+		skip = 0;
+		dst += len;
+		pixels -= len;
+	}
+	return((pixels == 0)? 0: 1);
+}
+
+
+// Size of the encoded pal image. (stops counting after 0xFFFF)
+static unsigned long spr_rle_size(const unsigned char *data, unsigned int pixels) {
+	unsigned long size = 0;
+	unsigned int next = 0;
+
+	while (next < pixels && size <= 0xFFFF) {
+		unsigned int literal = spr_rle_literal(data + next, pixels - next);
+		size += literal;
+		next += literal;
+		if (next < pixels) {
+			next += spr_rle_zerorun(data + next, pixels - next);
+			size += 2;
+		}
+	}
+	return(size);
+}
+
+
+// Encode a pal image, a chunk of pixels per encoder section.
+// A chunk never takes more than 2 bytes per pixel: a literal byte covers one pixel
+// and a (0,len) pair covers at least one. (the last run may go past the chunk)
+// The section has 8 more bytes for the word copies.
+static void spr_rle_encode(struct _encoder *encoder, const unsigned char *data, unsigned int pixels) {
+	unsigned int next = 0;
+	unsigned long long w;
+
+	while (next < pixels && !encoder->error) {
+		unsigned int chunkend = (pixels - next > SPR_RLE_CHUNK)? next + SPR_RLE_CHUNK: pixels;
+		unsigned char *out;
+		if (_encoder_reserve(encoder, 2 * (chunkend - next) + 8) != 0)
+			break;
+		out = encoder->ptr;
+		while (next < chunkend) {
+			unsigned int len;
+			// literal run
+			while (chunkend - next >= 8) {
+				memcpy(&w, data + next, 8);
+				memcpy(out, &w, 8);
+				if (SPR_HASZERO(w)) {
+					len = SPR_FIRSTZERO(w, data + next);
+					next += len;
+					out += len;
+					break;
+				}
+				next += 8;
+				out += 8;
+			}
+			while (next < chunkend && data[next] != 0)
+				*out++ = data[next++];
+			if (next == chunkend)
+				break;
+			// run of index 0
+			len = spr_rle_zerorun(data + next, pixels - next);
+			*out++ = 0;
+			*out++ = (unsigned char)len;
+			next += len;
+		}
+		encoder->ptr = out;
+	}
+}
+
+
 unsigned short spr_inspect(const struct ROSpr *spr) {
 	unsigned int i;
 	unsigned int pixels;
@@ -88,30 +356,38 @@ unsigned short spr_inspect(const struct ROSpr *spr) {
 
 struct ROSpr *spr_load(struct _reader *reader) {
 	struct ROSpr *ret;
+	struct _arena *arena;
 	unsigned int i;
 	char magic[2];
 	unsigned int pixels;
+	struct _cursor cursor;
+	int error;
 
 	if (reader == NULL || reader->error) {
 		_xlog("spr.load : invalid argument (reader=%p reader.error=%d)\n", reader, reader->error);
 		return(NULL);
 	}
 
-	ret = (struct ROSpr*)_xalloc(sizeof(struct ROSpr));
+	arena = _arena_loadinit(reader->remaining(reader));
+	ret = (struct ROSpr*)_arena_newobject(arena, sizeof(struct ROSpr));
 	memset(ret, 0, sizeof(struct ROSpr));
 
-	reader->read(&magic, 2, 1, reader);
+	_cursor_init(&cursor, reader);
+	_cursor_need(&cursor, 4);
+	_cursor_bytes(&cursor, magic, 2);
 	if (memcmp(SPR_MAGIC, magic, 2) != 0) {
 		_xlog("spr.load : invalid header x%02X%02X (\"%-2s\")\n", magic[0], magic[1], magic);
+		_cursor_destroy(&cursor);
 		spr_unload(ret);
 		return(NULL);
 	}
 
-	reader->read(&ret->version, 2, 1, reader);
+	ret->version = _cursor_u16(&cursor);
 	//_xlog("SPR Version: %u.%u\n", (ret->version >> 8) & 0xFF, ret->version & 0xFF);
 	switch (ret->version) {
 		default:
 			_xlog("spr.load : unknown version 0x%X (v%u.%u)\n", ret->version, (ret->version >> 8) & 0xFF, ret->version & 0xFF);
+			_cursor_destroy(&cursor);
 			spr_unload(ret);
 			return(NULL);
 		case 0x100:
@@ -121,86 +397,80 @@ struct ROSpr *spr_load(struct _reader *reader) {
 			break;// supported
 	}
 
-	reader->read(&ret->palimagecount, 2, 1, reader);
+	_cursor_need(&cursor, (ret->version >= 0x200)? 4: 2);
+	ret->palimagecount = _cursor_u16(&cursor);
 	if (ret->version >= 0x200)
-		reader->read(&ret->rgbaimagecount, 2, 1, reader);
+		ret->rgbaimagecount = _cursor_u16(&cursor);
 
 	if (ret->palimagecount > 0) {
-		ret->palimages = (struct ROSprPalImage*)_xalloc(sizeof(struct ROSprPalImage) * ret->palimagecount);
+		ret->palimages = (struct ROSprPalImage*)_arena_alloc(arena, sizeof(struct ROSprPalImage) * ret->palimagecount);
 		memset(ret->palimages, 0, sizeof(struct ROSprPalImage) * ret->palimagecount);
-		for (i = 0; i < ret->palimagecount; i++) {
+		for (i = 0; i < ret->palimagecount && !cursor.error; i++) {
 			struct ROSprPalImage *image = &ret->palimages[i];
-			reader->read(&image->width, 2, 1, reader);
-			reader->read(&image->height, 2, 1, reader);
+			_cursor_need(&cursor, 4);
+			image->width = _cursor_u16(&cursor);
+			image->height = _cursor_u16(&cursor);
 			if (_mul_over_limit(image->width, image->height, 0xFFFFFFFF)) {
 				_xlog("spr.load : [%u] pal image too big (width=%u height=%u)\n", i, image->width, image->height);
+				_cursor_destroy(&cursor);
 				spr_unload(ret);
 				return(NULL);
 			}
 			pixels = image->width * image->height;
-			if (pixels > 0) {
-				image->data = (unsigned char*)_xalloc(sizeof(unsigned char) * pixels);
-				if (ret->version >= 0x201) {
-					unsigned int next = 0;
-					unsigned short encoded;
-					reader->read(&encoded, 2, 1, reader);
-					while (next < pixels && encoded > 0) {
-						unsigned char c;
-						reader->read(&c, 1, 1, reader);
-						encoded--;
-						if (c == 0) {// index 0 is rle-encoded (invisible/background palette index)
-							unsigned char len;
-							reader->read(&len, 1, 1, reader);
-							encoded--;
-							if (len == 0)
-								len = 1;
-							if (next + len > pixels) {
-								_xlog("spr.load : [%u] too much encoded data for pal image (next=%u, len=%u, pixels=%u remaining_data=%u)\n", i, next, len, pixels, encoded);
-								spr_unload(ret);
-								return(NULL);
-							}
-							memset(image->data + next, 0, len);
-							next += len;
-						}
-						else
-							image->data[next++] = c;
-					}
-					if (next != pixels || encoded > 0) {
-						_xlog("spr.load : [%u] bad encoded pal image (width=%u, height=%u, pixels_left=%u, remaining_data=%u)\n", i, image->width, image->height, pixels - next, encoded);
-						spr_unload(ret);
-						return(NULL);
-					}
+			if (pixels > 0)
+				image->data = (unsigned char*)_arena_alloc(arena, sizeof(unsigned char) * pixels);
+			if (ret->version >= 0x201) {// the encoded length is present for empty images too
+				unsigned short encoded;
+				_cursor_need(&cursor, 2);
+				encoded = _cursor_u16(&cursor);
+				if (_cursor_need(&cursor, encoded) != 0) {
+					_xlog("spr.load : [%u] not enough encoded data for pal image\n", i);
+					_cursor_destroy(&cursor);
+					spr_unload(ret);
+					return(NULL);
+				}
+				// decoded in place
+				if ((pixels == 0)? encoded != 0: spr_rle_decode(cursor.ptr, encoded, image->data, pixels) != 0) {
+					_xlog("spr.load : [%u] bad encoded pal image (width=%u, height=%u, encoded=%u)\n", i, image->width, image->height, encoded);
+					_cursor_destroy(&cursor);
+					spr_unload(ret);
+					return(NULL);
 				}
-				else
-					reader->read(image->data, 1, pixels, reader);
+				_cursor_skip(&cursor, encoded);
 			}
+			else if (pixels > 0 && _cursor_need(&cursor, pixels) == 0)
+				_cursor_bytes(&cursor, image->data, pixels);
 		}
 	}
 
 	if (ret->rgbaimagecount > 0) {
-		ret->rgbaimages = (struct ROSprRgbaImage*)_xalloc(sizeof(struct ROSprRgbaImage) * ret->rgbaimagecount);
+		ret->rgbaimages = (struct ROSprRgbaImage*)_arena_alloc(arena, sizeof(struct ROSprRgbaImage) * ret->rgbaimagecount);
 		memset(ret->rgbaimages, 0, sizeof(struct ROSprRgbaImage) * ret->rgbaimagecount);
-		for (i = 0; i < ret->rgbaimagecount; i++) {
+		for (i = 0; i < ret->rgbaimagecount && !cursor.error; i++) {
 			struct ROSprRgbaImage *image = &ret->rgbaimages[i];
-			reader->read(&image->width, 2, 1, reader);
-			reader->read(&image->height, 2, 1, reader);
+			_cursor_need(&cursor, 4);
+			image->width = _cursor_u16(&cursor);
+			image->height = _cursor_u16(&cursor);
 			pixels = image->width * image->height;
-			if (pixels > 0) {
-				image->data = (struct ROSprColor*)_xalloc(sizeof(struct ROSprColor) * pixels);
-				reader->read(image->data, sizeof(struct ROSprColor), pixels, reader);
+			if (pixels > 0 && _cursor_needarray(&cursor, sizeof(struct ROSprColor), pixels) == 0) {
+				image->data = (struct ROSprColor*)_arena_alloc(arena, sizeof(struct ROSprColor) * pixels);
+				_cursor_bytes(&cursor, image->data, sizeof(struct ROSprColor) * pixels);
 			}
 		}
 	}
 
-	if (reader->error) {
+	error = cursor.error;
+	_cursor_destroy(&cursor); // the palette is read from the reader
+	if (error) {
 		_xlog("spr.load : read error\n");
 		spr_unload(ret);
 		return(NULL);
 	}
 
 	if (ret->version >= 0x101) {
-		ret->pal = pal_load(reader);
-		if (ret->pal == NULL) {
+		// the palette is part of the object (same arena)
+		ret->pal = (struct ROPal*)_arena_alloc(arena, sizeof(struct ROPal));
+		if (reader->read(ret->pal, sizeof(struct ROPal), 1, reader) != 0) {
 			_xlog("spr.load : failed to read palette\n");
 			spr_unload(ret);
 			return(NULL);
@@ -215,7 +485,7 @@ struct ROSpr *spr_loadFromData(const unsigned char *data, unsigned int length) {
 	struct ROSpr *ret;
 	struct _reader *reader;
 
-	reader = memreader_init(data, length);
+	reader = statsreader_init(memreader_init(data, length), ROINT_FORMAT_SPR);
 	ret = spr_load(reader);
 	reader->destroy(reader);
 
@@ -227,7 +497,7 @@ struct ROSpr *spr_loadFromFile(const char *fn) {
 	struct ROSpr *ret;
 	struct _reader *reader;
 
-	reader = filereader_init(fn);
+	reader = statsreader_init(filereader_init(fn), ROINT_FORMAT_SPR);
 	ret = spr_load(reader);
 	reader->destroy(reader);
 
@@ -253,12 +523,361 @@ struct ROSpr *spr_loadFromGrf(struct ROGrfFile *file) {
 }
 
 
+static struct ROSprLazy *spr_loadLazy(struct _reader *reader) {
+	struct ROSprLazy *ret;
+	struct _arena *arena;
+	unsigned int i;
+	unsigned char head[6];
+	unsigned long start, offset;
+
+	if (reader == NULL || reader->error) {
+		_xlog("spr.loadLazy : invalid argument (reader=%p reader.error=%d)\n", reader, reader->error);
+		return(NULL);
+	}
+
+	arena = _arena_loadinit(reader->remaining(reader));
+	ret = (struct ROSprLazy*)_arena_newobject(arena, sizeof(struct ROSprLazy));
+	memset(ret, 0, sizeof(struct ROSprLazy));
+
+	if (reader->read(head, 4, 1, reader) != 0 || memcmp(SPR_MAGIC, head, 2) != 0) {
+		_xlog("spr.loadLazy : invalid header x%02X%02X\n", head[0], head[1]);
+		spr_lazy_unload(ret);
+		return(NULL);
+	}
+	ret->version = (unsigned short)(head[2] | (head[3] << 8));
+	switch (ret->version) {
+		default:
+			_xlog("spr.loadLazy : unknown version 0x%X (v%u.%u)\n", ret->version, (ret->version >> 8) & 0xFF, ret->version & 0xFF);
+			spr_lazy_unload(ret);
+			return(NULL);
+		case 0x100:
+		case 0x101:
+		case 0x200:
+		case 0x201:
+			break;// supported
+	}
+
+	if (reader->read(head, (ret->version >= 0x200)? 4: 2, 1, reader) != 0) {
+		_xlog("spr.loadLazy : read error\n");
+		spr_lazy_unload(ret);
+		return(NULL);
+	}
+	ret->palimagecount = (unsigned short)(head[0] | (head[1] << 8));
+	if (ret->version >= 0x200)
+		ret->rgbaimagecount = (unsigned short)(head[2] | (head[3] << 8));
+	if (ret->palimagecount > 0) {
+		ret->palimages = (struct ROSprLazyFrame*)_arena_alloc(arena, sizeof(struct ROSprLazyFrame) * ret->palimagecount);
+		ret->palcache = (unsigned char**)_arena_alloc(arena, sizeof(unsigned char*) * ret->palimagecount);
+		ret->rowindex = (struct ROSprLazyRow**)_arena_alloc(arena, sizeof(struct ROSprLazyRow*) * ret->palimagecount);
+		memset(ret->palimages, 0, sizeof(struct ROSprLazyFrame) * ret->palimagecount);
+		memset(ret->palcache, 0, sizeof(unsigned char*) * ret->palimagecount);
+		memset(ret->rowindex, 0, sizeof(struct ROSprLazyRow*) * ret->palimagecount);
+	}
+	if (ret->rgbaimagecount > 0) {
+		ret->rgbaimages = (struct ROSprLazyFrame*)_arena_alloc(arena, sizeof(struct ROSprLazyFrame) * ret->rgbaimagecount);
+		memset(ret->rgbaimages, 0, sizeof(struct ROSprLazyFrame) * ret->rgbaimagecount);
+	}
+
+	// index the frames, skipping the pixels
+	start = reader->tell(reader);
+	offset = 0;
+	for (i = 0; i < (unsigned int)ret->palimagecount + ret->rgbaimagecount; i++) {
+		struct ROSprLazyFrame *frame = (i < ret->palimagecount)? &ret->palimages[i]: &ret->rgbaimages[i - ret->palimagecount];
+		unsigned int headsize = (i < ret->palimagecount && ret->version >= 0x201)? 6: 4;
+		unsigned long length, remaining;
+		if (reader->read(head, headsize, 1, reader) != 0) {
+			_xlog("spr.loadLazy : [%u] read error\n", i);
+			spr_lazy_unload(ret);
+			return(NULL);
+		}
+		frame->width = (unsigned short)(head[0] | (head[1] << 8));
+		frame->height = (unsigned short)(head[2] | (head[3] << 8));
+		if (headsize == 6)
+			length = (unsigned long)(head[4] | (head[5] << 8));
+		else
+			length = (unsigned long)frame->width * frame->height * ((i < ret->palimagecount)? 1: sizeof(struct ROSprColor));
+		if (_add_over_limit(offset + headsize, length, 0x7FFFFFFF)) {
+			_xlog("spr.loadLazy : [%u] too much data\n", i);
+			spr_lazy_unload(ret);
+			return(NULL);
+		}
+		frame->offset = (unsigned int)(offset + headsize);
+		frame->length = (unsigned int)length;
+		offset += headsize + length;
+		// check the length instead of seeking to the end, the last frame of v1.0 ends the data
+		remaining = reader->remaining(reader);
+		if (length > remaining || (length > 0 && length == remaining &&
+			(i + 1 < (unsigned int)ret->palimagecount + ret->rgbaimagecount || ret->version >= 0x101))) {
+			_xlog("spr.loadLazy : [%u] not enough data\n", i);
+			spr_lazy_unload(ret);
+			return(NULL);
+		}
+		if (length > 0 && length < remaining && reader->seek(reader, (long)length, SEEK_CUR) != 0) {
+			_xlog("spr.loadLazy : [%u] seek error\n", i);
+			spr_lazy_unload(ret);
+			return(NULL);
+		}
+	}
+
+	// keep the frames as they are
+	ret->datasize = offset;
+	if (offset > 0) {
+		ret->data = (unsigned char*)_arena_alloc(arena, offset);
+		if (reader->seek(reader, (long)start, SEEK_SET) != 0 || reader->read(ret->data, offset, 1, reader) != 0) {
+			_xlog("spr.loadLazy : read error\n");
+			spr_lazy_unload(ret);
+			return(NULL);
+		}
+	}
+
+	if (ret->version >= 0x101) {
+		ret->pal = (struct ROPal*)_arena_alloc(arena, sizeof(struct ROPal));
+		if (reader->read(ret->pal, sizeof(struct ROPal), 1, reader) != 0) {
+			_xlog("spr.loadLazy : failed to read palette\n");
+			spr_lazy_unload(ret);
+			return(NULL);
+		}
+	}
+
+	return(ret);
+}
+
+
+struct ROSprLazy *spr_loadLazyFromData(const unsigned char *data, unsigned int length) {
+	struct ROSprLazy *ret;
+	struct _reader *reader;
+
+	reader = statsreader_init(memreader_init(data, length), ROINT_FORMAT_SPR);
+	ret = spr_loadLazy(reader);
+	reader->destroy(reader);
+
+	return(ret);
+}
+
+
+struct ROSprLazy *spr_loadLazyFromFile(const char *fn) {
+	struct ROSprLazy *ret;
+	struct _reader *reader;
+
+	reader = statsreader_init(filereader_init(fn), ROINT_FORMAT_SPR);
+	ret = spr_loadLazy(reader);
+	reader->destroy(reader);
+
+	return(ret);
+}
+
+
+struct ROSprLazy *spr_loadLazyFromGrf(struct ROGrfFile *file) {
+	struct ROSprLazy *ret = NULL;
+	if (file->data == NULL) {
+		grf_getdata(file);
+		if (file->data != NULL) {
+			ret = spr_loadLazyFromData(file->data, file->uncompressedLength);
+		}
+		_xfree(file->data);
+		file->data = NULL;
+	}
+	else {
+		ret = spr_loadLazyFromData(file->data, file->uncompressedLength);
+	}
+
+	return(ret);
+}
+
+
+int spr_lazy_decodepalimage(const struct ROSprLazy *spr, unsigned int image, unsigned char *data) {
+	const struct ROSprLazyFrame *frame;
+	unsigned int pixels;
+
+	if (spr == NULL || image >= spr->palimagecount || data == NULL) {
+		_xlog("spr.lazy_decodepalimage : invalid argument (spr=%p image=%u data=%p)\n", spr, image, data);
+		return(1);
+	}
+
+	frame = &spr->palimages[image];
+	pixels = (unsigned int)frame->width * frame->height;
+	if (spr->version >= 0x201) {
+		if ((pixels == 0)? frame->length != 0: spr_rle_decode(spr->data + frame->offset, frame->length, data, pixels) != 0) {
+			_xlog("spr.lazy_decodepalimage : [%u] bad encoded pal image (width=%u, height=%u, encoded=%u)\n", image, frame->width, frame->height, frame->length);
+			return(1);
+		}
+	}
+	else if (pixels > 0)
+		memcpy(data, spr->data + frame->offset, pixels);
+	return(0);
+}
+
+
+// Returns the row index of a v2.1 pal image, building it on first use. (NULL on error)
+static const struct ROSprLazyRow *spr_lazy_rows(struct ROSprLazy *spr, unsigned int image) {
+	const struct ROSprLazyFrame *frame = &spr->palimages[image];
+	struct ROSprLazyRow *rows;
+
+	if (spr->rowindex[image] != NULL)
+		return(spr->rowindex[image]);
+	rows = (struct ROSprLazyRow*)_xalloc(sizeof(struct ROSprLazyRow) * frame->height);
+	if (rows == NULL) {
+		_xlog("spr.lazy_rows : out of memory\n");
+		return(NULL);
+	}
+	if (spr_rle_rows(spr->data + frame->offset, frame->length, frame->width, frame->height, rows) != 0) {
+		_xlog("spr.lazy_rows : [%u] bad encoded pal image (width=%u, height=%u, encoded=%u)\n", image, frame->width, frame->height, frame->length);
+		_xfreesize(rows, sizeof(struct ROSprLazyRow) * frame->height);
+		return(NULL);
+	}
+	spr->rowindex[image] = rows;
+	spr->cachesize += sizeof(struct ROSprLazyRow) * frame->height;
+	return(rows);
+}
+
+
+int spr_lazy_decoderect(struct ROSprLazy *spr, unsigned int image, unsigned int x, unsigned int y, unsigned int width, unsigned int height, unsigned char *data, unsigned int pitch) {
+	const struct ROSprLazyFrame *frame;
+	const struct ROSprLazyRow *rows;
+	const unsigned char *pixels;
+	unsigned int row;
+
+	if (spr == NULL || image >= spr->palimagecount || data == NULL || pitch < width) {
+		_xlog("spr.lazy_decoderect : invalid argument (spr=%p image=%u data=%p width=%u pitch=%u)\n", spr, image, data, width, pitch);
+		return(1);
+	}
+	frame = &spr->palimages[image];
+	if (x > frame->width || width > frame->width - x || y > frame->height || height > frame->height - y) {
+		_xlog("spr.lazy_decoderect : [%u] rectangle (x=%u y=%u width=%u height=%u) outside of the image (width=%u height=%u)\n", image, x, y, width, height, frame->width, frame->height);
+		return(1);
+	}
+	if (width == 0 || height == 0)
+		return(0);
+
+	pixels = spr->data + frame->offset;
+	if (spr->version < 0x201) {// stored as they are
+		for (row = 0; row < height; row++)
+			memcpy(data + (size_t)row * pitch, pixels + (size_t)(y + row) * frame->width + x, width);
+		return(0);
+	}
+
+	rows = spr_lazy_rows(spr, image);
+	if (rows == NULL)
+		return(1);
+	for (row = 0; row < height; row++) {
+		const struct ROSprLazyRow *start = &rows[y + row];
+		if (spr_rle_decodepart(pixels + start->offset, pixels + frame->length, start->skip + x, data + (size_t)row * pitch, width) != 0) {
+			_xlog("spr.lazy_decoderect : [%u] bad encoded row %u\n", image, y + row);
+			return(1);
+		}
+	}
+	return(0);
+}
+
+
+int spr_lazy_indexrows(struct ROSprLazy *spr) {
+	unsigned int i;
+
+	if (spr == NULL) {
+		_xlog("spr.lazy_indexrows : invalid argument (spr=%p)\n", spr);
+		return(1);
+	}
+	if (spr->version < 0x201)
+		return(0);// no index needed
+	for (i = 0; i < spr->palimagecount; i++) {
+		const struct ROSprLazyFrame *frame = &spr->palimages[i];
+		if (frame->width > 0 && frame->height > 0 && spr_lazy_rows(spr, i) == NULL)
+			return(1);
+	}
+	return(0);
+}
+
+
+const unsigned char *spr_lazy_getpalimage(struct ROSprLazy *spr, unsigned int image) {
+	unsigned int pixels;
+	unsigned char *data;
+
+	if (spr == NULL || image >= spr->palimagecount) {
+		_xlog("spr.lazy_getpalimage : invalid argument (spr=%p image=%u)\n", spr, image);
+		return(NULL);
+	}
+	if (spr->palcache[image] != NULL)
+		return(spr->palcache[image]);
+	pixels = (unsigned int)spr->palimages[image].width * spr->palimages[image].height;
+	if (pixels == 0)
+		return(NULL);
+
+	data = (unsigned char*)_xalloc(pixels);
+	if (data == NULL) {
+		_xlog("spr.lazy_getpalimage : out of memory\n");
+		return(NULL);
+	}
+	if (spr_lazy_decodepalimage(spr, image, data) != 0) {
+		_xfreesize(data, pixels);
+		return(NULL);
+	}
+	spr->palcache[image] = data;
+	spr->cachesize += pixels;
+	return(data);
+}
+
+
+const struct ROSprColor *spr_lazy_getrgbaimage(const struct ROSprLazy *spr, unsigned int image) {
+	const struct ROSprLazyFrame *frame;
+
+	if (spr == NULL || image >= spr->rgbaimagecount) {
+		_xlog("spr.lazy_getrgbaimage : invalid argument (spr=%p image=%u)\n", spr, image);
+		return(NULL);
+	}
+	frame = &spr->rgbaimages[image];
+	if (frame->length == 0)
+		return(NULL);
+	return((const struct ROSprColor*)(spr->data + frame->offset));
+}
+
+
+void spr_lazy_flush(struct ROSprLazy *spr) {
+	unsigned int i;
+
+	if (spr == NULL || spr->palcache == NULL)
+		return;
+	for (i = 0; i < spr->palimagecount; i++) {
+		if (spr->palcache[i] != NULL) {
+			_xfreesize(spr->palcache[i], (size_t)spr->palimages[i].width * spr->palimages[i].height);
+			spr->palcache[i] = NULL;
+		}
+		if (spr->rowindex[i] != NULL) {
+			_xfreesize(spr->rowindex[i], sizeof(struct ROSprLazyRow) * spr->palimages[i].height);
+			spr->rowindex[i] = NULL;
+		}
+	}
+	spr->cachesize = 0;
+}
+
+
+void spr_lazy_unload(struct ROSprLazy *spr) {
+	if (spr == NULL)
+		return;
+	spr_lazy_flush(spr); // the cache is never in the arena
+	if (_arena_release(spr) == 0)
+		return;// loaded in arena mode, everything else is released
+
+	if (spr->palimages != NULL)
+		_xfree(spr->palimages);
+	if (spr->palcache != NULL)
+		_xfree(spr->palcache);
+	if (spr->rowindex != NULL)
+		_xfree(spr->rowindex);
+	if (spr->rgbaimages != NULL)
+		_xfree(spr->rgbaimages);
+	if (spr->data != NULL)
+		_xfree(spr->data);
+	if (spr->pal != NULL)
+		pal_unload(spr->pal);
+	_xfree(spr);
+}
+
+
 int spr_save(const struct ROSpr *spr, struct _writer *writer) {
-	unsigned int i,j;
+	unsigned int i;
 	unsigned int pixels;
 	unsigned short minimumver;
-	unsigned short encodedlen;
-	unsigned char encodeddata[0xFFFF];
+	struct _encoder encoder;
 
 	if (spr == NULL || writer == NULL || writer->error) {
 		_xlog("spr.save : invalid argument (spr=%p writer=%p writer.error=%d)\n", spr, writer, writer->error);
@@ -285,60 +904,48 @@ int spr_save(const struct ROSpr *spr, struct _writer *writer) {
 		return(1);
 	}
 
-	writer->write(SPR_MAGIC, 2, 1, writer);
-	writer->write(&spr->version, 2, 1, writer);
-	writer->write(&spr->palimagecount, 2, 1, writer);
+	_encoder_init(&encoder, writer);
+	_encoder_reserve(&encoder, 8);
+	_encoder_bytes(&encoder, SPR_MAGIC, 2);
+	_encoder_u16(&encoder, spr->version);
+	_encoder_u16(&encoder, spr->palimagecount);
 	if (spr->version >= 0x200)
-		writer->write(&spr->rgbaimagecount, 2, 1, writer);
+		_encoder_u16(&encoder, spr->rgbaimagecount);
 
-	for (i = 0; i < spr->palimagecount; i++) {
+	for (i = 0; i < spr->palimagecount && !encoder.error; i++) {
 		const struct ROSprPalImage *image = &spr->palimages[i];
-		writer->write(&image->width, 2, 1, writer);
-		writer->write(&image->height, 2, 1, writer);
 		pixels = image->width * image->height;
+		_encoder_reserve(&encoder, 6);
+		_encoder_u16(&encoder, image->width);
+		_encoder_u16(&encoder, image->height);
 		if (spr->version >= 0x201) {
-			encodedlen = 0;
-			j = 0;
-			while (j < pixels) {
-				unsigned char c = image->data[j];
-				j++;
-
-				if (_add_over_limit(encodedlen, (c == 0)? 2: 1, 0xFFFF)) {
-					_xlog("spr.save : [%u] failed to encode pal image data, use version v2.0 instead\n");
-					return(1);
-				}
-				encodeddata[encodedlen] = c;
-				encodedlen++;
-				if (c == 0) {
-					unsigned char len = 1;
-					while (j < pixels && len < 255 && image->data[j] == 0) {
-						j++;
-						len++;
-					}
-					encodeddata[encodedlen] = len;
-					encodedlen++;
-				}
+			// the length goes first, so the size is measured before the data is streamed
+			unsigned long encodedlen = spr_rle_size(image->data, pixels);
+			if (encodedlen > 0xFFFF) {
+				_xlog("spr.save : [%u] failed to encode pal image data, use version v2.0 instead\n", i);
+				_encoder_destroy(&encoder);
+				return(1);
 			}
-			writer->write(&encodedlen, 2, 1, writer);
-			if (encodedlen > 0)
-				writer->write(encodeddata, 1, encodedlen, writer);
+			_encoder_u16(&encoder, (unsigned short)encodedlen);
+			spr_rle_encode(&encoder, image->data, pixels);
 		}
 		else if (pixels > 0)
-			writer->write(image->data, 1, pixels, writer);
+			_encoder_write(&encoder, image->data, pixels);
 	}
 
 	if (spr->version >= 0x200) {
-		for (i = 0; i < spr->rgbaimagecount; i++) {
+		for (i = 0; i < spr->rgbaimagecount && !encoder.error; i++) {
 			const struct ROSprRgbaImage *image = &spr->rgbaimages[i];
-			writer->write(&image->width, 2, 1, writer);
-			writer->write(&image->height, 2, 1, writer);
+			_encoder_reserve(&encoder, 4);
+			_encoder_u16(&encoder, image->width);
+			_encoder_u16(&encoder, image->height);
 			pixels = image->width * image->height;
 			if (pixels > 0)
-				writer->write(image->data, sizeof(struct ROSprColor), pixels, writer);
+				_encoder_write(&encoder, image->data, sizeof(struct ROSprColor) * pixels);
 		}
 	}
 	
-	if (writer->error) {
+	if (_encoder_destroy(&encoder)) {
 		_xlog("spr.save : write error\n");
 		return(1);
 	}
@@ -353,7 +960,7 @@ int spr_saveToData(const struct ROSpr *spr, unsigned char **data_out, unsigned l
 	int ret;
 	struct _writer *writer;
 
-	writer = memwriter_init(data_out, size_out);
+	writer = statswriter_init(memwriter_init(data_out, size_out), ROINT_FORMAT_SPR);
 	ret = spr_save(spr, writer);
 	writer->destroy(writer);
 
@@ -363,21 +970,578 @@ int spr_saveToData(const struct ROSpr *spr, unsigned char **data_out, unsigned l
 
 int spr_saveToFile(const struct ROSpr *spr, const char *fn) {
 	int ret;
-	struct _writer *writer;
+	struct _writer *writer, *memwriter;
 
-	writer = filewriter_init(fn);
+	memwriter = memwriter_init(NULL, NULL);
+	writer = statswriter_init(memwriter, ROINT_FORMAT_SPR);
 	ret = spr_save(spr, writer);
+	if (ret == 0)
+		ret = memwriter_savefile(memwriter, fn);
 	writer->destroy(writer);
 
 	return(ret);
 }
 
 
+int spr_saveToFlat(const struct ROSpr *spr, unsigned char **data_out, unsigned long *size_out) {
+	struct _flat flat;
+	unsigned long root, images;
+	unsigned int i;
+
+	if (spr == NULL || data_out == NULL || size_out == NULL) {
+		_xlog("spr.saveToFlat : invalid argument (spr=%p data_out=%p size_out=%p)\n", spr, data_out, size_out);
+		return(1);
+	}
+	if (spr_inspect(spr) == 0) {
+		_xlog("spr.saveToFlat : invalid\n");
+		return(1);
+	}
+
+	_flat_init(&flat, ROINT_FORMAT_SPR);
+	root = _flat_add(&flat, spr, sizeof(struct ROSpr));
+	images = _flat_addptr(&flat, root + offsetof(struct ROSpr, palimages), spr->palimages, sizeof(struct ROSprPalImage) * spr->palimagecount);
+	for (i = 0; images != 0 && i < spr->palimagecount; i++) {
+		const struct ROSprPalImage *image = &spr->palimages[i];
+		_flat_addptr(&flat, images + sizeof(struct ROSprPalImage) * i + offsetof(struct ROSprPalImage, data), image->data, (unsigned long)image->width * image->height);
+	}
+	images = _flat_addptr(&flat, root + offsetof(struct ROSpr, rgbaimages), spr->rgbaimages, sizeof(struct ROSprRgbaImage) * spr->rgbaimagecount);
+	for (i = 0; images != 0 && i < spr->rgbaimagecount; i++) {
+		const struct ROSprRgbaImage *image = &spr->rgbaimages[i];
+		_flat_addptr(&flat, images + sizeof(struct ROSprRgbaImage) * i + offsetof(struct ROSprRgbaImage, data), image->data, sizeof(struct ROSprColor) * image->width * image->height);
+	}
+	_flat_addptr(&flat, root + offsetof(struct ROSpr, pal), spr->pal, sizeof(struct ROPal));
+
+	return(_flat_finish(&flat, root, data_out, size_out));
+}
+
+
+const struct ROSpr *spr_attachFlat(void *data, unsigned long size) {
+	int moved;
+	const struct ROSpr *spr = (const struct ROSpr*)_flat_attach(data, size, ROINT_FORMAT_SPR, sizeof(struct ROSpr), &moved);
+
+	if (spr != NULL && moved && spr_verifyFlat(data, size) != 0)
+		return(NULL); // relocated from an unknown address, do not trust it
+	return(spr);
+}
+
+
+int spr_verifyFlat(const void *data, unsigned long size) {
+	const struct ROSpr *spr = (const struct ROSpr*)_flat_verify(data, size, ROINT_FORMAT_SPR, sizeof(struct ROSpr));
+	unsigned int i;
+
+	if (spr == NULL)
+		return(1);
+	// every array must fit in the block
+	if (_flat_checkarray(data, spr->palimages, spr->palimagecount, sizeof(struct ROSprPalImage)) ||
+		_flat_checkarray(data, spr->rgbaimages, spr->rgbaimagecount, sizeof(struct ROSprRgbaImage)) ||
+		(spr->pal != NULL && _flat_checkarray(data, spr->pal, 1, sizeof(struct ROPal)))) {
+		_xlog("spr.verifyFlat : invalid\n");
+		return(1);
+	}
+	for (i = 0; i < spr->palimagecount; i++) {
+		const struct ROSprPalImage *image = &spr->palimages[i];
+		if (_flat_checkarray(data, image->data, (unsigned long)image->width * image->height, 1)) {
+			_xlog("spr.verifyFlat : [%u] invalid pal image\n", i);
+			return(1);
+		}
+	}
+	for (i = 0; i < spr->rgbaimagecount; i++) {
+		const struct ROSprRgbaImage *image = &spr->rgbaimages[i];
+		if (_flat_checkarray(data, image->data, (unsigned long)image->width * image->height, sizeof(struct ROSprColor))) {
+			_xlog("spr.verifyFlat : [%u] invalid rgba image\n", i);
+			return(1);
+		}
+	}
+	return(0);
+}
+
+
+int spr_palimage_to_rgba(const struct ROSprPalImage *image, const struct ROPal *pal, unsigned char *rgba) {
+	unsigned int lut[256];
+
+	if (image == NULL || pal == NULL || rgba == NULL || (image->data == NULL && image->width > 0 && image->height > 0)) {
+		_xlog("spr.palimage_to_rgba : invalid argument (image=%p pal=%p rgba=%p)\n", image, pal, rgba);
+		return(1);
+	}
+
+	_pixel_pallut(pal, lut);
+	_pixel_pal_to_rgba(image->data, (size_t)image->width * image->height, lut, rgba);
+	return(0);
+}
+
+
+int spr_pal_to_rgba(const struct ROSpr *spr, const struct ROPal *pal, unsigned char **data_out, unsigned long *size_out) {
+	unsigned int lut[256];
+	unsigned long size;
+	unsigned char *data, *rgba;
+	unsigned int i;
+
+	if (spr == NULL || data_out == NULL || size_out == NULL) {
+		_xlog("spr.pal_to_rgba : invalid argument (spr=%p data_out=%p size_out=%p)\n", spr, data_out, size_out);
+		return(1);
+	}
+	if (pal == NULL)
+		pal = spr->pal;
+	if (pal == NULL) {
+		_xlog("spr.pal_to_rgba : no palette\n");
+		return(1);
+	}
+
+	size = 0;
+	for (i = 0; i < spr->palimagecount; i++) {
+		const struct ROSprPalImage *image = &spr->palimages[i];
+		if (image->data == NULL && image->width > 0 && image->height > 0) {
+			_xlog("spr.pal_to_rgba : [%u] expected non-NULL data in pal image\n", i);
+			return(1);
+		}
+		size += (unsigned long)image->width * image->height * 4;
+	}
+	data = (unsigned char*)_xalloc((size > 0)? size: 1);
+	if (data == NULL) {
+		_xlog("spr.pal_to_rgba : out of memory\n");
+		return(1);
+	}
+
+	_pixel_pallut(pal, lut);
+	rgba = data;
+	for (i = 0; i < spr->palimagecount; i++) {
+		const struct ROSprPalImage *image = &spr->palimages[i];
+		size_t pixels = (size_t)image->width * image->height;
+		_pixel_pal_to_rgba(image->data, pixels, lut, rgba);
+		rgba += pixels * 4;
+	}
+
+	_xhandover(data);
+	*data_out = data;
+	*size_out = size;
+	return(0);
+}
+
+
+/// Skyline segment of an atlas page.
+struct _spr_skyline {
+	unsigned int x;
+	unsigned int y;
+	unsigned int width;
+};
+
+
+/// Atlas page being packed.
+struct _spr_atlaspage {
+	struct _spr_skyline *nodes; // left to right, covers the whole page width
+	unsigned int nodecount;
+};
+
+
+/// Trims a frame to the rectangle of its non-transparent pixels.
+/// Finds the first and last non-transparent rows, then scans the rows in
+/// between only from the edges to the current bounds.
+static void spr_atlas_trim(const struct ROSpr *spr, struct ROSprAtlasFrame *frame) {
+	const unsigned char *first; // palette index or alpha of the top-left pixel
+	long pitch; // bytes to the next row (top to bottom)
+	unsigned int step; // bytes to the next pixel
+	unsigned int width, height, minx, miny, maxx, maxy, x, y;
+
+	if (frame->type == 0) {
+		const struct ROSprPalImage *image = &spr->palimages[frame->image];
+		width = image->width;
+		height = image->height;
+		first = image->data;
+		pitch = (long)width;
+		step = 1;
+	}
+	else {
+		const struct ROSprRgbaImage *image = &spr->rgbaimages[frame->image];
+		width = image->width;
+		height = image->height;
+		first = &image->data[(size_t)(height - 1) * width].a; // bottom to top
+		pitch = -(long)(width * sizeof(struct ROSprColor));
+		step = sizeof(struct ROSprColor);
+	}
+#define SPR_TRIM_PIXEL(x,y) (first[(long)(y) * pitch + (long)(x) * step])
+
+	// rows
+	minx = width;
+	for (miny = 0; miny < height; miny++) {
+		for (x = 0; x < width && SPR_TRIM_PIXEL(x, miny) == 0; x++);
+		if (x < width) {
+			minx = x;
+			break;
+		}
+	}
+	if (miny == height) {// fully transparent
+		frame->width = 0;
+		frame->height = 0;
+		return;
+	}
+	for (maxy = height - 1; maxy > miny; maxy--) {
+		for (x = 0; x < width && SPR_TRIM_PIXEL(x, maxy) == 0; x++);
+		if (x < width) {
+			if (x < minx)
+				minx = x;
+			break;
+		}
+	}
+
+	// columns
+	maxx = minx;
+	for (y = miny; y <= maxy; y++) {
+		for (x = 0; x < minx && SPR_TRIM_PIXEL(x, y) == 0; x++);
+		minx = x;
+		for (x = width - 1; x > maxx && SPR_TRIM_PIXEL(x, y) == 0; x--);
+		maxx = x;
+	}
+#undef SPR_TRIM_PIXEL
+
+	frame->trimx = minx;
+	frame->trimy = miny;
+	frame->width = maxx - minx + 1;
+	frame->height = maxy - miny + 1;
+}
+
+
+/// Sorts the frames by decreasing height, then decreasing width.
+static int spr_atlas_cmp(const void *a, const void *b) {
+	const struct ROSprAtlasFrame *frame1 = *(const struct ROSprAtlasFrame *const*)a;
+	const struct ROSprAtlasFrame *frame2 = *(const struct ROSprAtlasFrame *const*)b;
+
+	if (frame1->height != frame2->height)
+		return((frame1->height > frame2->height)? -1: 1);
+	if (frame1->width != frame2->width)
+		return((frame1->width > frame2->width)? -1: 1);
+	return((frame1 < frame2)? -1: (frame1 > frame2)? 1: 0);// stable
+}
+
+
+/// Finds the bottom-left position of a width x height rectangle in the skyline.
+/// The padding is kept to the right and bottom of the rectangle, except at the page edges.
+/// Returns the node index, or -1 if it does not fit.
+static int spr_atlas_find(const struct _spr_atlaspage *page, unsigned int pagesize, unsigned int width, unsigned int height, unsigned int padding, unsigned int *x_out, unsigned int *y_out) {
+	unsigned int i, j, bestbottom = 0, bestwidth = 0;
+	int best = -1;
+
+	for (i = 0; i < page->nodecount; i++) {
+		unsigned int x = page->nodes[i].x;
+		unsigned int y = 0;
+		unsigned int covered = 0;
+		unsigned int padded;
+		if (x + width > pagesize)
+			break;// nodes to the right are worse
+		padded = (x + width + padding < pagesize)? width + padding: pagesize - x;
+		for (j = i; covered < padded; j++) {// highest node under the rectangle
+			if (page->nodes[j].y > y)
+				y = page->nodes[j].y;
+			covered += page->nodes[j].width;
+		}
+		if (y + height > pagesize)
+			continue;
+		if (best < 0 || y + height < bestbottom || (y + height == bestbottom && page->nodes[i].width < bestwidth)) {
+			best = (int)i;
+			bestbottom = y + height;
+			bestwidth = page->nodes[i].width;
+			*x_out = x;
+			*y_out = y;
+		}
+	}
+	return(best);
+}
+
+
+/// Raises the skyline over a rectangle placed at node 'index'.
+static void spr_atlas_place(struct _spr_atlaspage *page, unsigned int index, unsigned int width, unsigned int bottom) {
+	struct _spr_skyline *nodes = page->nodes;
+	unsigned int x = nodes[index].x;
+	unsigned int i;
+
+	// insert the new node
+	memmove(&nodes[index + 1], &nodes[index], sizeof(struct _spr_skyline) * (page->nodecount - index));
+	page->nodecount++;
+	nodes[index].x = x;
+	nodes[index].y = bottom;
+	nodes[index].width = width;
+
+	// shrink or remove the nodes under it
+	i = index + 1;
+	while (i < page->nodecount && nodes[i].x < x + width) {
+		unsigned int shrink = x + width - nodes[i].x;
+		if (shrink < nodes[i].width) {
+			nodes[i].x += shrink;
+			nodes[i].width -= shrink;
+			break;
+		}
+		memmove(&nodes[i], &nodes[i + 1], sizeof(struct _spr_skyline) * (page->nodecount - i - 1));
+		page->nodecount--;
+	}
+
+	// merge nodes of the same height
+	for (i = 0; i + 1 < page->nodecount; ) {
+		if (nodes[i].y == nodes[i + 1].y) {
+			nodes[i].width += nodes[i + 1].width;
+			memmove(&nodes[i + 1], &nodes[i + 2], sizeof(struct _spr_skyline) * (page->nodecount - i - 2));
+			page->nodecount--;
+		}
+		else
+			i++;
+	}
+}
+
+
+/// Copies the pixels of a frame to its page.
+static void spr_atlas_blit(const struct ROSpr *spr, const unsigned int *lut, const struct ROSprAtlasFrame *frame, struct ROSprAtlasPage *page) {
+	unsigned int y;
+
+	for (y = 0; y < frame->height; y++) {
+		unsigned char *dst = page->rgba + ((size_t)(frame->y + y) * page->width + frame->x) * 4;
+		if (frame->type == 0) {
+			const struct ROSprPalImage *image = &spr->palimages[frame->image];
+			_pixel_pal_to_rgba(image->data + (size_t)(frame->trimy + y) * image->width + frame->trimx, frame->width, lut, dst);
+		}
+		else {
+			const struct ROSprRgbaImage *image = &spr->rgbaimages[frame->image];
+			const struct ROSprColor *src = image->data + (size_t)(image->height - 1 - frame->trimy - y) * image->width + frame->trimx; // bottom to top
+			unsigned int x;
+			for (x = 0; x < frame->width; x++, dst += 4) {
+				dst[0] = src[x].r;
+				dst[1] = src[x].g;
+				dst[2] = src[x].b;
+				dst[3] = src[x].a;
+			}
+		}
+	}
+}
+
+
+struct ROSprAtlas *spr_atlas_pack(const struct ROSpr *const *sprs, unsigned int sprcount, unsigned int pagesize, unsigned int padding, unsigned int flags) {
+	struct ROSprAtlas *atlas;
+	struct ROSprAtlasFrame **sorted = NULL;
+	struct _spr_atlaspage *packing = NULL;
+	unsigned int pagecapacity = 0;
+	unsigned int lut[256];
+	unsigned int i, n;
+	int ok = 1;
+
+	if (sprs == NULL || pagesize == 0 || pagesize > 0x10000) {
+		_xlog("spr.atlas_pack : invalid argument (sprs=%p pagesize=%u)\n", sprs, pagesize);
+		return(NULL);
+	}
+
+	atlas = (struct ROSprAtlas*)_xalloc(sizeof(struct ROSprAtlas));
+	if (atlas == NULL) {
+		_xlog("spr.atlas_pack : out of memory\n");
+		return(NULL);
+	}
+	memset(atlas, 0, sizeof(struct ROSprAtlas));
+
+	// frames
+	for (i = 0; i < sprcount; i++) {
+		const struct ROSpr *spr = sprs[i];
+		if (spr == NULL) {
+			_xlog("spr.atlas_pack : [%u] NULL spr\n", i);
+			spr_atlas_unload(atlas);
+			return(NULL);
+		}
+		if (spr->palimagecount > 0 && spr->pal == NULL) {
+			_xlog("spr.atlas_pack : [%u] pal images without a palette\n", i);
+			spr_atlas_unload(atlas);
+			return(NULL);
+		}
+		atlas->framecount += spr->palimagecount + spr->rgbaimagecount;
+	}
+	if (atlas->framecount > 0) {
+		atlas->frames = (struct ROSprAtlasFrame*)_xalloc(sizeof(struct ROSprAtlasFrame) * atlas->framecount);
+		sorted = (struct ROSprAtlasFrame**)_xalloc(sizeof(struct ROSprAtlasFrame*) * atlas->framecount);
+		if (atlas->frames == NULL || sorted == NULL) {
+			_xlog("spr.atlas_pack : out of memory\n");
+			if (sorted != NULL)
+				_xfree(sorted);
+			spr_atlas_unload(atlas);
+			return(NULL);
+		}
+		memset(atlas->frames, 0, sizeof(struct ROSprAtlasFrame) * atlas->framecount);
+	}
+	n = 0;
+	for (i = 0; i < sprcount; i++) {
+		const struct ROSpr *spr = sprs[i];
+		unsigned int imagecount = spr->palimagecount + spr->rgbaimagecount;
+		unsigned int j;
+		for (j = 0; j < imagecount; j++) {
+			struct ROSprAtlasFrame *frame = &atlas->frames[n];
+			int haspixels;
+			frame->spr = i;
+			if (j < spr->palimagecount) {
+				const struct ROSprPalImage *image = &spr->palimages[j];
+				frame->type = 0;
+				frame->image = j;
+				frame->width = image->width;
+				frame->height = image->height;
+				haspixels = (image->data != NULL);
+			}
+			else {
+				const struct ROSprRgbaImage *image = &spr->rgbaimages[j - spr->palimagecount];
+				frame->type = 1;
+				frame->image = j - spr->palimagecount;
+				frame->width = image->width;
+				frame->height = image->height;
+				haspixels = (image->data != NULL);
+			}
+			if (frame->width == 0 || frame->height == 0) {
+				frame->width = 0;
+				frame->height = 0;
+			}
+			else if (!haspixels) {
+				_xlog("spr.atlas_pack : [%u] expected non-NULL data in %s image %u\n", i, (frame->type == 0)? "pal": "rgba", frame->image);
+				ok = 0;
+			}
+			else if (flags & SPR_ATLAS_TRIM)
+				spr_atlas_trim(spr, frame);
+			if (frame->width > pagesize || frame->height > pagesize) {
+				_xlog("spr.atlas_pack : [%u] %s image %u (%ux%u) does not fit in a page of %ux%u\n", i, (frame->type == 0)? "pal": "rgba", frame->image, frame->width, frame->height, pagesize, pagesize);
+				ok = 0;
+			}
+			sorted[n] = frame;
+			n++;
+		}
+	}
+	if (!ok) {
+		if (sorted != NULL)
+			_xfree(sorted);
+		spr_atlas_unload(atlas);
+		return(NULL);
+	}
+
+	// skyline bottom-left packing, tallest frames first
+	if (n > 0)
+		qsort(sorted, n, sizeof(struct ROSprAtlasFrame*), spr_atlas_cmp);
+	for (i = 0; ok && i < n; i++) {
+		struct ROSprAtlasFrame *frame = sorted[i];
+		unsigned int width, height, x = 0, y = 0, p;
+		int index = -1;
+		if (frame->width == 0)
+			continue;// empty
+		width = frame->width;
+		height = frame->height;
+		for (p = 0; p < atlas->pagecount; p++) {
+			index = spr_atlas_find(&packing[p], pagesize, width, height, padding, &x, &y);
+			if (index >= 0)
+				break;
+		}
+		if (index < 0) {// new page
+			if (atlas->pagecount == pagecapacity) {
+				unsigned int capacity = (pagecapacity > 0)? pagecapacity * 2: 4;
+				struct _spr_atlaspage *packing2 = (struct _spr_atlaspage*)_xrealloc(packing, sizeof(struct _spr_atlaspage) * pagecapacity, sizeof(struct _spr_atlaspage) * capacity);
+				struct ROSprAtlasPage *pages2 = (struct ROSprAtlasPage*)_xrealloc(atlas->pages, sizeof(struct ROSprAtlasPage) * pagecapacity, sizeof(struct ROSprAtlasPage) * capacity);
+				if (packing2 != NULL)
+					packing = packing2;
+				if (pages2 != NULL)
+					atlas->pages = pages2;
+				if (packing2 == NULL || pages2 == NULL) {
+					_xlog("spr.atlas_pack : out of memory\n");
+					ok = 0;
+					break;
+				}
+				pagecapacity = capacity;
+			}
+			p = atlas->pagecount;
+			memset(&atlas->pages[p], 0, sizeof(struct ROSprAtlasPage));
+			packing[p].nodes = (struct _spr_skyline*)_xalloc(sizeof(struct _spr_skyline) * (pagesize + 1));
+			if (packing[p].nodes == NULL) {
+				_xlog("spr.atlas_pack : out of memory\n");
+				ok = 0;
+				break;
+			}
+			packing[p].nodes[0].x = 0;
+			packing[p].nodes[0].y = 0;
+			packing[p].nodes[0].width = pagesize;
+			packing[p].nodecount = 1;
+			atlas->pagecount++;
+			index = spr_atlas_find(&packing[p], pagesize, width, height, padding, &x, &y);
+		}
+		frame->page = p;
+		frame->x = x;
+		frame->y = y;
+		if (x + width > atlas->pages[p].width)
+			atlas->pages[p].width = x + width;
+		if (y + height > atlas->pages[p].height)
+			atlas->pages[p].height = y + height;
+		// padding to the right and bottom, except at the page edges
+		width = (x + width + padding < pagesize)? width + padding: pagesize - x;
+		height = (y + height + padding < pagesize)? height + padding: pagesize - y;
+		spr_atlas_place(&packing[p], (unsigned int)index, width, y + height);
+	}
+	for (i = 0; i < atlas->pagecount; i++)
+		_xfree(packing[i].nodes);
+	if (packing != NULL)
+		_xfree(packing);
+	if (sorted != NULL)
+		_xfree(sorted);
+
+	// pages, shrunk to the used area
+	for (i = 0; ok && i < atlas->pagecount; i++) {
+		struct ROSprAtlasPage *page = &atlas->pages[i];
+		size_t size = (size_t)page->width * page->height * 4;
+		page->rgba = (unsigned char*)_xalloc(size);
+		if (page->rgba == NULL) {
+			_xlog("spr.atlas_pack : out of memory\n");
+			ok = 0;
+			break;
+		}
+		memset(page->rgba, 0, size);
+	}
+	if (!ok) {
+		spr_atlas_unload(atlas);
+		return(NULL);
+	}
+	n = 0;
+	for (i = 0; i < sprcount; i++) {
+		const struct ROSpr *spr = sprs[i];
+		unsigned int imagecount = spr->palimagecount + spr->rgbaimagecount;
+		unsigned int j;
+		if (spr->pal != NULL)
+			_pixel_pallut(spr->pal, lut);
+		for (j = 0; j < imagecount; j++, n++) {
+			struct ROSprAtlasFrame *frame = &atlas->frames[n];
+			struct ROSprAtlasPage *page;
+			if (frame->width == 0)
+				continue;// empty
+			page = &atlas->pages[frame->page];
+			spr_atlas_blit(spr, lut, frame, page);
+			frame->u0 = (float)frame->x / page->width;
+			frame->v0 = (float)frame->y / page->height;
+			frame->u1 = (float)(frame->x + frame->width) / page->width;
+			frame->v1 = (float)(frame->y + frame->height) / page->height;
+		}
+	}
+	return(atlas);
+}
+
+
+void spr_atlas_unload(struct ROSprAtlas *atlas) {
+	unsigned int i;
+
+	if (atlas == NULL)
+		return;
+
+	if (atlas->pages != NULL) {
+		for (i = 0; i < atlas->pagecount; i++)
+			if (atlas->pages[i].rgba != NULL)
+				_xfree(atlas->pages[i].rgba);
+		_xfree(atlas->pages);
+	}
+
+	if (atlas->frames != NULL)
+		_xfree(atlas->frames);
+
+	_xfree(atlas);
+}
+
+
 void spr_unload(struct ROSpr* spr) {
 	unsigned int i;
 
 	if (spr == NULL)
 		return;
+	if (_arena_release(spr) == 0)
+		return;// loaded in arena mode, everything is released
 
 	if (spr->palimages != NULL) {
 		for (i = 0; i < spr->palimagecount; i++)
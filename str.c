@@ -22,6 +22,9 @@
     ------------------------------------------------------------------------------------
 */
 #include "internal.h"
+#include "arena.h"
+#include "encoder.h"
+#include "flat.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -87,6 +90,7 @@ unsigned int str_inspect(const struct ROStr *str) {
 
 struct ROStr *str_load(struct _reader *reader) {
 	struct ROStr *ret;
+	struct _arena *arena;
 	unsigned int layerId;
 	char magic[4];
 
@@ -95,7 +99,8 @@ struct ROStr *str_load(struct _reader *reader) {
 		return(NULL);
 	}
 
-	ret = (struct ROStr*)_xalloc(sizeof(struct ROStr));
+	arena = _arena_loadinit(reader->remaining(reader));
+	ret = (struct ROStr*)_arena_newobject(arena, sizeof(struct ROStr));
 	memset(ret, 0, sizeof(struct ROStr));
 
 	reader->read(&magic, 4, 1, reader);
@@ -124,7 +129,7 @@ struct ROStr *str_load(struct _reader *reader) {
 	}
 	reader->read(ret->reserved, 16, 1, reader);
 	if (ret->layercount > 0) {
-		ret->layers = (struct ROStrLayer*)_xalloc(sizeof(struct ROStrLayer) * ret->layercount);
+		ret->layers = (struct ROStrLayer*)_arena_alloc(arena, sizeof(struct ROStrLayer) * ret->layercount);
 		memset(ret->layers, 0, sizeof(struct ROStrLayer) * ret->layercount);
 		for (layerId = 0; layerId < ret->layercount; layerId++) {
 			struct ROStrLayer *layer = &ret->layers[layerId];
@@ -135,7 +140,7 @@ struct ROStr *str_load(struct _reader *reader) {
 				return(NULL);
 			}
 			if (layer->texturecount > 0) {
-				layer->textures = (struct ROStrTexture*)_xalloc(sizeof(struct ROStrTexture) * layer->texturecount);
+				layer->textures = (struct ROStrTexture*)_arena_alloc(arena, sizeof(struct ROStrTexture) * layer->texturecount);
 				reader->read(layer->textures, sizeof(struct ROStrTexture), layer->texturecount, reader);
 			}
 			reader->read(&layer->keyframecount, 4, 1, reader);
@@ -145,7 +150,7 @@ struct ROStr *str_load(struct _reader *reader) {
 				return(NULL);
 			}
 			if (layer->keyframecount > 0) {
-				layer->keyframes = (struct ROStrKeyFrame*)_xalloc(sizeof(struct ROStrKeyFrame) * layer->keyframecount);
+				layer->keyframes = (struct ROStrKeyFrame*)_arena_alloc(arena, sizeof(struct ROStrKeyFrame) * layer->keyframecount);
 				reader->read(layer->keyframes, sizeof(struct ROStrKeyFrame), layer->keyframecount, reader);
 			}
 		}
@@ -165,7 +170,7 @@ struct ROStr *str_loadFromData(const unsigned char *data, unsigned long length)
 	struct ROStr *ret;
 	struct _reader *reader;
 
-	reader = memreader_init(data, length);
+	reader = statsreader_init(memreader_init(data, length), ROINT_FORMAT_STR);
 	ret = str_load(reader);
 	reader->destroy(reader);
 
@@ -177,7 +182,7 @@ struct ROStr *str_loadFromFile(const char *fn) {
 	struct ROStr *ret;
 	struct _reader *reader;
 
-	reader = filereader_init(fn);
+	reader = statsreader_init(filereader_init(fn), ROINT_FORMAT_STR);
 	ret = str_load(reader);
 	reader->destroy(reader);
 
@@ -205,6 +210,7 @@ struct ROStr *str_loadFromGrf(struct ROGrfFile *file) {
 
 int str_save(const struct ROStr *str, struct _writer *writer) {
 	unsigned int layerId, textureId;
+	struct _encoder encoder;
 
 	if (str == NULL || writer == NULL || writer->error) {
 		_xlog("str.save : invalid argument (str=%p writer=%p writer.error=%d)\n", str, writer, writer->error);
@@ -220,27 +226,32 @@ int str_save(const struct ROStr *str, struct _writer *writer) {
 		return(1);
 	}
 
-	writer->write(STR_MAGIC, 4, 1, writer);
-	writer->write(&str->version, 4, 1, writer);
-	writer->write(&str->framecount, 4, 1, writer);
-	writer->write(&str->fps, 4, 1, writer);
-	writer->write(&str->layercount, 4, 1, writer);
-	writer->write(str->reserved, 16, 1, writer);
-	for (layerId = 0; layerId < str->layercount; layerId++) {
+	_encoder_init(&encoder, writer);
+	_encoder_reserve(&encoder, 36);
+	_encoder_bytes(&encoder, STR_MAGIC, 4);
+	_encoder_u32(&encoder, str->version);
+	_encoder_u32(&encoder, str->framecount);
+	_encoder_u32(&encoder, str->fps);
+	_encoder_u32(&encoder, str->layercount);
+	_encoder_bytes(&encoder, str->reserved, 16);
+	for (layerId = 0; layerId < str->layercount && !encoder.error; layerId++) {
 		const struct ROStrLayer *layer = &str->layers[layerId];
-		writer->write(&layer->texturecount, 4, 1, writer);
+		_encoder_reserve(&encoder, 4);
+		_encoder_u32(&encoder, layer->texturecount);
 		for (textureId = 0; textureId < layer->texturecount; textureId++) {
-			struct ROStrTexture texture;
-			memset(&texture, 0, sizeof(struct ROStrTexture));
-			strcpy(texture.name, layer->textures[textureId].name);
-			writer->write(&texture, sizeof(struct ROStrTexture), 1, writer);
+			const char *name = layer->textures[textureId].name;
+			size_t len = strlen(name);
+			_encoder_reserve(&encoder, sizeof(struct ROStrTexture));
+			_encoder_bytes(&encoder, name, len);
+			_encoder_zeros(&encoder, sizeof(struct ROStrTexture) - len);
 		}
-		writer->write(&layer->keyframecount, 4, 1, writer);
+		_encoder_reserve(&encoder, 4);
+		_encoder_u32(&encoder, layer->keyframecount);
 		if (layer->keyframecount > 0)
-			writer->write(layer->keyframes, sizeof(struct ROStrKeyFrame), layer->keyframecount, writer);
+			_encoder_write(&encoder, layer->keyframes, sizeof(struct ROStrKeyFrame) * layer->keyframecount);
 	}
 
-	if (writer->error) {
+	if (_encoder_destroy(&encoder)) {
 		_xlog("str.save : write error\n");
 		return(1);
 	}
@@ -253,7 +264,7 @@ int str_saveToData(const struct ROStr *str, unsigned char **data_out, unsigned l
 	int ret;
 	struct _writer *writer;
 
-	writer = memwriter_init(data_out, size_out);
+	writer = statswriter_init(memwriter_init(data_out, size_out), ROINT_FORMAT_STR);
 	ret = str_save(str, writer);
 	writer->destroy(writer);
 
@@ -263,21 +274,87 @@ int str_saveToData(const struct ROStr *str, unsigned char **data_out, unsigned l
 
 int str_saveToFile(const struct ROStr *str, const char *fn) {
 	int ret;
-	struct _writer *writer;
+	struct _writer *writer, *memwriter;
 
-	writer = filewriter_init(fn);
+	memwriter = memwriter_init(NULL, NULL);
+	writer = statswriter_init(memwriter, ROINT_FORMAT_STR);
 	ret = str_save(str, writer);
+	if (ret == 0)
+		ret = memwriter_savefile(memwriter, fn);
 	writer->destroy(writer);
 
 	return(ret);
 }
 
 
+int str_saveToFlat(const struct ROStr *str, unsigned char **data_out, unsigned long *size_out) {
+	struct _flat flat;
+	unsigned long root, layers;
+	unsigned int i;
+
+	if (str == NULL || data_out == NULL || size_out == NULL) {
+		_xlog("str.saveToFlat : invalid argument (str=%p data_out=%p size_out=%p)\n", str, data_out, size_out);
+		return(1);
+	}
+	if (str_inspect(str) == 0) {
+		_xlog("str.saveToFlat : invalid\n");
+		return(1);
+	}
+
+	_flat_init(&flat, ROINT_FORMAT_STR);
+	root = _flat_add(&flat, str, sizeof(struct ROStr));
+	layers = _flat_addptr(&flat, root + offsetof(struct ROStr, layers), str->layers, sizeof(struct ROStrLayer) * str->layercount);
+	for (i = 0; layers != 0 && i < str->layercount; i++) {
+		const struct ROStrLayer *layer = &str->layers[i];
+		unsigned long layerAt = layers + sizeof(struct ROStrLayer) * i;
+		_flat_addptr(&flat, layerAt + offsetof(struct ROStrLayer, textures), layer->textures, sizeof(struct ROStrTexture) * layer->texturecount);
+		_flat_addptr(&flat, layerAt + offsetof(struct ROStrLayer, keyframes), layer->keyframes, sizeof(struct ROStrKeyFrame) * layer->keyframecount);
+	}
+
+	return(_flat_finish(&flat, root, data_out, size_out));
+}
+
+
+const struct ROStr *str_attachFlat(void *data, unsigned long size) {
+	int moved;
+	const struct ROStr *str = (const struct ROStr*)_flat_attach(data, size, ROINT_FORMAT_STR, sizeof(struct ROStr), &moved);
+
+	if (str != NULL && moved && str_verifyFlat(data, size) != 0)
+		return(NULL); // relocated from an unknown address, do not trust it
+	return(str);
+}
+
+
+int str_verifyFlat(const void *data, unsigned long size) {
+	const struct ROStr *str = (const struct ROStr*)_flat_verify(data, size, ROINT_FORMAT_STR, sizeof(struct ROStr));
+	unsigned int i;
+
+	if (str == NULL)
+		return(1);
+	// every array must fit in the block
+	if (_flat_checkarray(data, str->layers, str->layercount, sizeof(struct ROStrLayer))) {
+		_xlog("str.verifyFlat : invalid\n");
+		return(1);
+	}
+	for (i = 0; i < str->layercount; i++) {
+		const struct ROStrLayer *layer = &str->layers[i];
+		if (_flat_checkarray(data, layer->textures, layer->texturecount, sizeof(struct ROStrTexture)) ||
+			_flat_checkarray(data, layer->keyframes, layer->keyframecount, sizeof(struct ROStrKeyFrame))) {
+			_xlog("str.verifyFlat : [%u] invalid layer\n", i);
+			return(1);
+		}
+	}
+	return(0);
+}
+
+
 void str_unload(struct ROStr *str) {
 	unsigned int layerId;
 
 	if (str == NULL)
 		return;
+	if (_arena_release(str) == 0)
+		return;// loaded in arena mode, everything is released
 
 	if (str->layers != NULL) {
 		for (layerId = 0; layerId < str->layercount; layerId++) {
@@ -0,0 +1,137 @@
+/*
+    ------------------------------------------------------------------------------------
+    LICENSE:
+    ------------------------------------------------------------------------------------
+    This file is part of The Open Ragnarok Project
+    Copyright 2007 - 2011 The Open Ragnarok Team
+    For the latest information visit http://www.open-ragnarok.org
+    ------------------------------------------------------------------------------------
+    This program is free software; you can redistribute it and/or modify it under
+    the terms of the GNU Lesser General Public License as published by the Free Software
+    Foundation; either version 2 of the License, or (at your option) any later
+    version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License along with
+    this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+    Place - Suite 330, Boston, MA 02111-1307, USA, or go to
+    http://www.gnu.org/copyleft/lesser.txt.
+    ------------------------------------------------------------------------------------
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <roint.h>
+#include <time.h>
+
+
+// Loads the file and returns the saved data, to compare the modes.
+unsigned char *load(const char *fn, unsigned long *length) {
+	unsigned char *data = NULL;
+	size_t len = strlen(fn);
+
+	*length = 0;
+	if (len > 4 && strcmp(fn + len - 4, ".act") == 0) {
+		struct ROAct *act = act_loadFromFile(fn);
+		if (act != NULL) {
+			act_saveToData(act, &data, length);
+			act_unload(act);
+		}
+	}
+	else if (len > 4 && strcmp(fn + len - 4, ".gnd") == 0) {
+		struct ROGnd *gnd = gnd_loadFromFile(fn);
+		if (gnd != NULL) {
+			gnd_saveToData(gnd, &data, length);
+			gnd_unload(gnd);
+		}
+	}
+	return(data);
+}
+
+
+int main(int argc, char **argv)
+{
+	const char *names[] = {"stdio", "buffered", "map"};
+	unsigned char **expected;
+	unsigned long *expectedlength;
+	unsigned int rounds = 10;
+	unsigned int filecount;
+	unsigned int mode, round, i;
+	int ret;
+
+	if (argc < 2) {
+		const char *exe = argv[0];
+		printf("Usage:\n  %s [-n rounds] file.act|file.gnd ...\n", exe);
+		return(EXIT_FAILURE);
+	}
+	argv++;
+	argc--;
+	if (argc > 2 && strcmp(argv[0], "-n") == 0) {
+		rounds = (unsigned int)atoi(argv[1]);
+		argv += 2;
+		argc -= 2;
+	}
+	filecount = (unsigned int)argc;
+	expected = (unsigned char**)malloc(sizeof(unsigned char*) * filecount);
+	expectedlength = (unsigned long*)malloc(sizeof(unsigned long) * filecount);
+
+	ret = EXIT_SUCCESS;
+	for (i = 0; i < filecount; i++) {
+		roint_set_file_mode(ROINT_FILEMODE_STDIO);
+		expected[i] = load(argv[i], &expectedlength[i]);
+		if (expected[i] == NULL) {
+			printf("error : failed to load file '%s'\n", argv[i]);
+			ret = EXIT_FAILURE;
+		}
+	}
+
+	for (mode = ROINT_FILEMODE_STDIO; mode <= ROINT_FILEMODE_MAP; mode++) {
+		clock_t start;
+		roint_set_file_mode((unsigned char)mode);
+		start = clock();
+		for (round = 0; round < rounds; round++) {
+			for (i = 0; i < filecount; i++) {
+				unsigned long length;
+				unsigned char *data = load(argv[i], &length);
+				if (round == 0 && (length != expectedlength[i] || (data != NULL && memcmp(data, expected[i], length) != 0))) {
+					printf("error : %s mode loaded different data from '%s'\n", names[mode], argv[i]);
+					ret = EXIT_FAILURE;
+				}
+				free(data);
+			}
+		}
+		printf("%-8s : %.3f ms per round of %u files\n", names[mode], (double)(clock() - start) * 1000.0 / CLOCKS_PER_SEC / rounds, filecount);
+	}
+	roint_set_file_mode(ROINT_FILEMODE_STDIO);
+
+	{// one more round with the I/O counters
+		unsigned int format;
+		roint_reset_io_stats();
+		roint_set_io_stats(1);
+		for (i = 0; i < filecount; i++)
+			free(load(argv[i], &expectedlength[i]));
+		roint_set_io_stats(0);
+		for (format = 0; format < ROINT_FORMAT_COUNT; format++) {
+			struct ROIoStats load, save;
+			roint_get_io_stats(format, &load, &save);
+			if (load.count > 0)
+				printf("%-8s : load %llu files, %llu bytes in %llu calls, %llu seeks, %.3f ms of %.3f ms in I/O\n", roint_format_name(format),
+					load.count, load.bytes, load.calls, load.seeks, load.iotime / 1e6, load.time / 1e6);
+			if (save.count > 0)
+				printf("%-8s : save %llu files, %llu bytes in %llu calls, %llu seeks, %.3f ms of %.3f ms in I/O\n", roint_format_name(format),
+					save.count, save.bytes, save.calls, save.seeks, save.iotime / 1e6, save.time / 1e6);
+		}
+	}
+
+	for (i = 0; i < filecount; i++)
+		free(expected[i]);
+	free(expectedlength);
+	free(expected);
+
+	if (ret == EXIT_SUCCESS)
+		printf("OK\n");
+	return(ret);
+}
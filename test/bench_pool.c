@@ -0,0 +1,188 @@
+/*
+    ------------------------------------------------------------------------------------
+    LICENSE:
+    ------------------------------------------------------------------------------------
+    This file is part of The Open Ragnarok Project
+    Copyright 2007 - 2011 The Open Ragnarok Team
+    For the latest information visit http://www.open-ragnarok.org
+    ------------------------------------------------------------------------------------
+    This program is free software; you can redistribute it and/or modify it under
+    the terms of the GNU Lesser General Public License as published by the Free Software
+    Foundation; either version 2 of the License, or (at your option) any later
+    version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License along with
+    this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+    Place - Suite 330, Boston, MA 02111-1307, USA, or go to
+    http://www.gnu.org/copyleft/lesser.txt.
+    ------------------------------------------------------------------------------------
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <roint.h>
+#include <time.h>
+
+
+#define TYPE_ACT 0
+#define TYPE_GND 1
+#define TYPE_RSW 2
+#define TYPE_SPR 3
+#define TYPE_STR 4
+
+
+int filetype(const char *fn) {
+	const char *exts[] = {".act", ".gnd", ".rsw", ".spr", ".str"};
+	size_t len = strlen(fn);
+	int i;
+
+	for (i = 0; i < 5; i++) {
+		if (len > 4 && strcmp(fn + len - 4, exts[i]) == 0)
+			return(i);
+	}
+	return(-1);
+}
+
+
+void *load(const char *fn, int type) {
+	switch (type) {
+		case TYPE_ACT: return(act_loadFromFile(fn));
+		case TYPE_GND: return(gnd_loadFromFile(fn));
+		case TYPE_RSW: return(rsw_loadFromFile(fn));
+		case TYPE_SPR: return(spr_loadFromFile(fn));
+		case TYPE_STR: return(str_loadFromFile(fn));
+	}
+	return(NULL);
+}
+
+
+void unload(void *object, int type) {
+	switch (type) {
+		case TYPE_ACT: act_unload((struct ROAct*)object); break;
+		case TYPE_GND: gnd_unload((struct ROGnd*)object); break;
+		case TYPE_RSW: rsw_unload((struct RORsw*)object); break;
+		case TYPE_SPR: spr_unload((struct ROSpr*)object); break;
+		case TYPE_STR: str_unload((struct ROStr*)object); break;
+	}
+}
+
+
+// Returns the saved data, to compare the allocators. (NULL if the type cannot be saved)
+unsigned char *save(void *object, int type, unsigned long *length) {
+	unsigned char *data = NULL;
+
+	*length = 0;
+	switch (type) {
+		case TYPE_ACT: act_saveToData((struct ROAct*)object, &data, length); break;
+		case TYPE_GND: gnd_saveToData((struct ROGnd*)object, &data, length); break;
+		case TYPE_SPR: spr_saveToData((struct ROSpr*)object, &data, length); break;
+		case TYPE_STR: str_saveToData((struct ROStr*)object, &data, length); break;
+	}
+	return(data);
+}
+
+
+// Installs the allocator of a mode.
+void setmode(unsigned int mode) {
+	if (mode == 0) {
+		set_roint_malloc_func(NULL);
+		set_roint_free_func(NULL);
+	}
+	else if (mode == 1) {
+		set_roint_malloc_func(roint_pool_malloc);
+		set_roint_free_func(roint_pool_free);
+	}
+	else
+		roint_set_allocator(roint_pool_allocator());
+}
+
+
+int main(int argc, char **argv)
+{
+	const char *names[] = {"malloc", "pool", "pool+ctx"};
+	void **objects;
+	int *types;
+	unsigned char **expected;
+	unsigned long *expectedlength;
+	unsigned int rounds = 10;
+	unsigned int filecount;
+	unsigned int mode, round, i;
+	int ret;
+
+	if (argc < 2) {
+		const char *exe = argv[0];
+		printf("Usage:\n  %s [-n rounds] file.act|file.gnd|file.rsw|file.spr|file.str ...\n", exe);
+		return(EXIT_FAILURE);
+	}
+	argv++;
+	argc--;
+	if (argc > 2 && strcmp(argv[0], "-n") == 0) {
+		rounds = (unsigned int)atoi(argv[1]);
+		argv += 2;
+		argc -= 2;
+	}
+	filecount = (unsigned int)argc;
+	objects = (void**)malloc(sizeof(void*) * filecount);
+	types = (int*)malloc(sizeof(int) * filecount);
+	expected = (unsigned char**)malloc(sizeof(unsigned char*) * filecount);
+	expectedlength = (unsigned long*)malloc(sizeof(unsigned long) * filecount);
+
+	ret = EXIT_SUCCESS;
+	for (i = 0; i < filecount; i++) {
+		types[i] = filetype(argv[i]);
+		objects[i] = load(argv[i], types[i]);
+		if (objects[i] == NULL) {
+			printf("error : failed to load file '%s'\n", argv[i]);
+			ret = EXIT_FAILURE;
+		}
+		expected[i] = save(objects[i], types[i], &expectedlength[i]);
+		unload(objects[i], types[i]);
+	}
+
+	for (mode = 0; mode < 3; mode++) {
+		clock_t start;
+		setmode(mode);
+		start = clock();
+		for (round = 0; round < rounds; round++) {
+			for (i = 0; i < filecount; i++)
+				objects[i] = load(argv[i], types[i]);
+			for (i = 0; i < filecount; i++)
+				unload(objects[i], types[i]);
+		}
+		printf("%-8s : %.3f ms per round of %u files\n", names[mode], (double)(clock() - start) * 1000.0 / CLOCKS_PER_SEC / rounds, filecount);
+
+		for (i = 0; i < filecount; i++) {// compare with the default allocator
+			unsigned long length;
+			unsigned char *data;
+			if (expected[i] == NULL)
+				continue;
+			objects[i] = load(argv[i], types[i]);
+			data = save(objects[i], types[i], &length);
+			if (length != expectedlength[i] || (data != NULL && memcmp(data, expected[i], length) != 0)) {
+				printf("error : %s allocator produced different data for '%s'\n", names[mode], argv[i]);
+				ret = EXIT_FAILURE;
+			}
+			if (mode == 0)
+				free(data);
+			else
+				roint_pool_free(data);
+			unload(objects[i], types[i]);
+		}
+	}
+	setmode(0);
+
+	for (i = 0; i < filecount; i++)
+		free(expected[i]);
+	free(expectedlength);
+	free(expected);
+	free(types);
+	free(objects);
+
+	if (ret == EXIT_SUCCESS)
+		printf("OK\n");
+	return(ret);
+}
@@ -221,6 +221,53 @@ int main(int argc, char **argv)
 		}
 	}
 
+	{// test arena load mode
+		unsigned char *data = NULL;
+		unsigned long length = 0;
+		struct ROAct *act2, *act3 = NULL;
+		roint_set_load_mode(ROINT_LOADMODE_ARENA);
+		act2 = act_loadFromFile(fn);
+		if (act_saveToData(act, &data, &length) == 0)
+			act3 = act_loadFromData(data, length);
+		roint_set_load_mode(ROINT_LOADMODE_HEAP);
+		if (act2 == NULL || act3 == NULL || !act_equal(act, act2) || !act_equal(act, act3)) {
+			printf("error : loading in arena mode produced different data\n");
+			ret = EXIT_FAILURE;
+		}
+		act_unload(act2);
+		act_unload(act3);
+		if (data != NULL)
+			get_roint_free_func()(data);
+	}
+
+#ifdef ROINT_ENABLE_ALLOC_STATS
+	{// test allocation statistics
+		struct ROAllocStats before[ROINT_ALLOC_ALL + 1], after;
+		unsigned char *data = NULL;
+		unsigned long length = 0;
+		struct ROAct *act2;
+		unsigned int subsystem;
+		for (subsystem = 0; subsystem <= ROINT_ALLOC_ALL; subsystem++)
+			roint_get_alloc_stats(subsystem, &before[subsystem]);
+		act2 = act_loadFromFile(fn);
+		roint_get_alloc_stats(ROINT_FORMAT_ACT, &after);
+		if (act2 == NULL || after.count == before[ROINT_FORMAT_ACT].count || after.live == before[ROINT_FORMAT_ACT].live) {
+			printf("error : loading was not counted\n");
+			ret = EXIT_FAILURE;
+		}
+		act_saveToData(act2, &data, &length);
+		roint_free(data);
+		act_unload(act2);
+		for (subsystem = 0; subsystem <= ROINT_ALLOC_ALL; subsystem++) {
+			roint_get_alloc_stats(subsystem, &after);
+			if (after.live != before[subsystem].live) {
+				printf("error : [%u] %llu live bytes after unload instead of %llu\n", subsystem, after.live, before[subsystem].live);
+				ret = EXIT_FAILURE;
+			}
+		}
+	}
+#endif
+
 	{// test save to data
 		unsigned char *data = NULL;
 		unsigned long length = 0;
@@ -242,12 +289,75 @@ int main(int argc, char **argv)
 				printf("error : saving produced different data\n");
 				ret = EXIT_FAILURE;
 			}
+			else {// saving what was loaded gives the same bytes
+				unsigned char *data2 = NULL;
+				unsigned long length2 = 0;
+				if (act_saveToData(act2, &data2, &length2) != 0 || length2 != length || memcmp(data2, data, length) != 0) {
+					printf("error : saving again produced different bytes\n");
+					ret = EXIT_FAILURE;
+				}
+				if (data2 != NULL)
+					get_roint_free_func()(data2);
+			}
 		}
 		if (data != NULL)
 			get_roint_free_func()(data);
 		act_unload(act2);
 	}
 
+	{// test release of saved data with the pool allocator
+		unsigned char *data = NULL;
+		unsigned long length = 0;
+		roint_set_allocator(roint_pool_allocator());
+		if (act_saveToData(act, &data, &length) != 0 || data == NULL) {
+			printf("error : saving with the pool allocator failed\n");
+			ret = EXIT_FAILURE;
+		}
+		get_roint_free_func()(data);
+		data = NULL;
+		act_saveToData(act, &data, &length);
+		roint_free(data);
+		roint_set_allocator(NULL);
+	}
+
+	{// test flat block
+		unsigned char *data = NULL;
+		unsigned long length = 0;
+		const struct ROAct *view;
+		printf("Flat: %d\n", act_saveToFlat(act, &data, &length));
+		view = act_attachFlat(data, length);
+		if (view == NULL || !act_equal(act, (struct ROAct*)view)) {
+			printf("error : flat block is different\n");
+			ret = EXIT_FAILURE;
+		}
+		else {// moved copy
+			unsigned char *copy = (unsigned char*)malloc(length);
+			memcpy(copy, data, length);
+			view = act_attachFlat(copy, length);
+			if (view == NULL || (unsigned char*)view < copy || (unsigned char*)view >= copy + length || !act_equal(act, (struct ROAct*)view)) {
+				printf("error : moved flat block is different\n");
+				ret = EXIT_FAILURE;
+			}
+			else {// count bigger than its array
+				unsigned char *moved = (unsigned char*)malloc(length);
+				if (act_verifyFlat(copy, length) != 0 || roint_flat_verify(copy, length) != 0) {
+					printf("error : valid flat block failed to verify\n");
+					ret = EXIT_FAILURE;
+				}
+				((struct ROAct*)view)->actioncount = 0xFFFF;
+				memcpy(moved, copy, length);
+				if (act_verifyFlat(copy, length) == 0 || roint_flat_verify(copy, length) == 0 || act_attachFlat(moved, length) != NULL) {
+					printf("error : flat block with a bad count was accepted\n");
+					ret = EXIT_FAILURE;
+				}
+				free(moved);
+			}
+			free(copy);
+		}
+		if (data != NULL)
+			get_roint_free_func()(data);
+	}
+
 	if (ret == EXIT_SUCCESS)
 		printf("OK\n");
 	return(ret);
@@ -0,0 +1,126 @@
+/*
+    ------------------------------------------------------------------------------------
+    LICENSE:
+    ------------------------------------------------------------------------------------
+    This file is part of The Open Ragnarok Project
+    Copyright 2007 - 2011 The Open Ragnarok Team
+    For the latest information visit http://www.open-ragnarok.org
+    ------------------------------------------------------------------------------------
+    This program is free software; you can redistribute it and/or modify it under
+    the terms of the GNU Lesser General Public License as published by the Free Software
+    Foundation; either version 2 of the License, or (at your option) any later
+    version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License along with
+    this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+    Place - Suite 330, Boston, MA 02111-1307, USA, or go to
+    http://www.gnu.org/copyleft/lesser.txt.
+    ------------------------------------------------------------------------------------
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <roint.h>
+
+
+int catalog_equal(const struct ROCatalog *catalog, const struct ROCatalog *catalog2) {
+	if (catalog2->entrycount != catalog->entrycount ||
+		catalog2->namessize != catalog->namessize ||
+		catalog2->archivecount != catalog->archivecount ||
+		memcmp(catalog2->entries, catalog->entries, sizeof(struct ROCatalogEntry) * catalog->entrycount) != 0 ||
+		memcmp(catalog2->bytype, catalog->bytype, sizeof(unsigned int) * catalog->entrycount) != 0 ||
+		memcmp(catalog2->typeoffsets, catalog->typeoffsets, sizeof(catalog->typeoffsets)) != 0 ||
+		memcmp(catalog2->names, catalog->names, catalog->namessize) != 0)
+		return(0);
+	return(1);
+}
+
+
+int main(int argc, char **argv)
+{
+	const char *fn;
+	struct ROGrf *grf;
+	struct ROCatalog *catalog, *catalog2;
+	unsigned int i, count;
+	int ret;
+
+	if (argc != 2) {
+		const char *exe = argv[0];
+		printf("Usage:\n  %s file.grf\n", exe);
+		return(EXIT_FAILURE);
+	}
+
+	fn = argv[1];
+
+	grf = grf_open(fn);
+	if (grf == NULL) {
+		printf("error : failed to open file '%s'\n", fn);
+		return(EXIT_FAILURE);
+	}
+	catalog = catalog_build(&grf, 1, 0, 0);
+	if (catalog == NULL) {
+		printf("error : failed to build catalog of '%s'\n", fn);
+		grf_close(grf);
+		return(EXIT_FAILURE);
+	}
+	ret = EXIT_SUCCESS;
+	printf("Entries: %u\n", catalog->entrycount);
+	for (i = 0; i < ROCATALOG_TYPECOUNT; i++) {
+		if (catalog_findtype(catalog, (unsigned char)i, &count) != NULL)
+			printf("Type %u: %u\n", i, count);
+	}
+	for (i = 0; i < grf_filecount(grf); i++) {
+		struct ROGrfFile *file = grf_getfileinfo(grf, i);
+		const struct ROCatalogEntry *entry = catalog_find(catalog, file->fileName);
+		if ((file->flags & 1) == 0)
+			continue;
+		if (entry == NULL || strcmp(catalog_name(catalog, entry), file->fileName) != 0 ||
+			entry->size != (unsigned int)file->uncompressedLength) {
+			printf("error : [%u] catalog lookup of \"%s\" failed\n", i, file->fileName);
+			ret = EXIT_FAILURE;
+		}
+	}
+
+	{// test hash of the uncompressed data
+		struct ROCatalog *catalog3 = catalog_build(&grf, 1, 2, ROCATALOG_HASH_DATA);
+		if (catalog3 == NULL || catalog3->entrycount != catalog->entrycount) {
+			printf("error : failed to build catalog with data hashes\n");
+			ret = EXIT_FAILURE;
+		}
+		else {
+			for (i = 0; i < catalog->entrycount; i++) {
+				if (catalog3->entries[i].type != catalog->entries[i].type ||
+					catalog3->entries[i].count != catalog->entries[i].count ||
+					catalog3->entries[i].width != catalog->entries[i].width) {
+					printf("error : [%u] data hash changed the metadata of \"%s\"\n", i, catalog_name(catalog, &catalog->entries[i]));
+					ret = EXIT_FAILURE;
+				}
+			}
+		}
+		catalog_unload(catalog3);
+	}
+
+	{// test save to data
+		unsigned char *data = NULL;
+		unsigned long size = 0;
+		printf("Save: %d\n", catalog_saveToData(catalog, &data, &size));
+		catalog2 = catalog_loadFromData(data, size);
+		if (catalog2 == NULL || !catalog_equal(catalog, catalog2)) {
+			printf("error : saving produced invalid data\n");
+			ret = EXIT_FAILURE;
+		}
+		catalog_unload(catalog2);
+		free(data);
+	}
+
+	catalog_unload(catalog);
+	grf_close(grf);
+
+	if (ret == EXIT_SUCCESS)
+		printf("OK\n");
+	return(ret);
+}
@@ -169,12 +169,60 @@ int main(int argc, char **argv)
 				printf("error : saving produced different data\n");
 				ret = EXIT_FAILURE;
 			}
+			else {// saving what was loaded gives the same bytes
+				unsigned char *data2 = NULL;
+				unsigned long length2 = 0;
+				if (gnd_saveToData(gnd2, &data2, &length2) != 0 || length2 != length || memcmp(data2, data, length) != 0) {
+					printf("error : saving again produced different bytes\n");
+					ret = EXIT_FAILURE;
+				}
+				if (data2 != NULL)
+					get_roint_free_func()(data2);
+			}
 		}
 		if (data != NULL)
 			get_roint_free_func()(data);
 		gnd_unload(gnd2);
 	}
 
+	{// test flat block
+		unsigned char *data = NULL;
+		unsigned long length = 0;
+		const struct ROGnd *view;
+		printf("Flat: %d\n", gnd_saveToFlat(gnd, &data, &length));
+		view = gnd_attachFlat(data, length);
+		if (view == NULL || !gnd_equal(gnd, (struct ROGnd*)view)) {
+			printf("error : flat block is different\n");
+			ret = EXIT_FAILURE;
+		}
+		else {// moved copy
+			unsigned char *copy = (unsigned char*)malloc(length);
+			memcpy(copy, data, length);
+			view = gnd_attachFlat(copy, length);
+			if (view == NULL || (unsigned char*)view < copy || (unsigned char*)view >= copy + length || !gnd_equal(gnd, (struct ROGnd*)view)) {
+				printf("error : moved flat block is different\n");
+				ret = EXIT_FAILURE;
+			}
+			else {// count bigger than its array
+				unsigned char *moved = (unsigned char*)malloc(length);
+				if (gnd_verifyFlat(copy, length) != 0 || roint_flat_verify(copy, length) != 0) {
+					printf("error : valid flat block failed to verify\n");
+					ret = EXIT_FAILURE;
+				}
+				((struct ROGnd*)view)->texturecount = 0xFFFFFFFF;
+				memcpy(moved, copy, length);
+				if (gnd_verifyFlat(copy, length) == 0 || roint_flat_verify(copy, length) == 0 || gnd_attachFlat(moved, length) != NULL) {
+					printf("error : flat block with a bad count was accepted\n");
+					ret = EXIT_FAILURE;
+				}
+				free(moved);
+			}
+			free(copy);
+		}
+		if (data != NULL)
+			get_roint_free_func()(data);
+	}
+
 	gnd_unload(gnd);
 	if (ret == EXIT_SUCCESS)
 		printf("OK\n");
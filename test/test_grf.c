@@ -0,0 +1,348 @@
+/*
+    ------------------------------------------------------------------------------------
+    LICENSE:
+    ------------------------------------------------------------------------------------
+    This file is part of The Open Ragnarok Project
+    Copyright 2007 - 2011 The Open Ragnarok Team
+    For the latest information visit http://www.open-ragnarok.org
+    ------------------------------------------------------------------------------------
+    This program is free software; you can redistribute it and/or modify it under
+    the terms of the GNU Lesser General Public License as published by the Free Software
+    Foundation; either version 2 of the License, or (at your option) any later
+    version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License along with
+    this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+    Place - Suite 330, Boston, MA 02111-1307, USA, or go to
+    http://www.gnu.org/copyleft/lesser.txt.
+    ------------------------------------------------------------------------------------
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <roint.h>
+
+
+int grf_equal(struct ROGrf *grf, struct ROGrf *grf2) {
+	unsigned int i;
+
+	if (grf_filecount(grf2) != grf_filecount(grf))
+		return(0);
+	for (i = 0; i < grf_filecount(grf); i++) {
+		struct ROGrfFile *file = grf_getfileinfo(grf, i);
+		struct ROGrfFile *file2 = grf_getfileinfobyname(grf2, file->fileName);
+		if (file2 == NULL ||
+			file2->compressedLength != file->compressedLength ||
+			file2->compressedLengthAligned != file->compressedLengthAligned ||
+			file2->uncompressedLength != file->uncompressedLength ||
+			file2->flags != file->flags ||
+			file2->offset != file->offset)
+			return(0);
+	}
+	return(1);
+}
+
+
+int copy_file(const char *src, const char *dst) {
+	FILE *in, *out;
+	char buf[4096];
+	size_t len;
+	int ret = 0;
+
+	in = fopen(src, "rb");
+	out = fopen(dst, "wb");
+	if (in == NULL || out == NULL)
+		ret = 1;
+	while (ret == 0 && (len = fread(buf, 1, sizeof(buf), in)) > 0)
+		if (fwrite(buf, 1, len, out) != len)
+			ret = 1;
+	if (in != NULL)
+		fclose(in);
+	if (out != NULL && fclose(out) != 0)
+		ret = 1;
+	return(ret);
+}
+
+
+void grf_count(const struct ROGrfFile *file, void *aux) {
+	unsigned int *count = (unsigned int*)aux;
+	(*count)++;
+}
+
+
+int main(int argc, char **argv)
+{
+	const char *fn;
+	struct ROGrf *grf;
+	unsigned int i;
+	int ret;
+
+	if (argc != 2) {
+		const char *exe = argv[0];
+		printf("Usage:\n  %s file.grf\n", exe);
+		return(EXIT_FAILURE);
+	}
+
+	fn = argv[1];
+
+	grf = grf_open(fn);
+	if (grf == NULL) {
+		printf("error : failed to open file '%s'\n", fn);
+		return(EXIT_FAILURE);
+	}
+	ret = EXIT_SUCCESS;
+	printf("Version: 0x%x\n", grf->header.version);
+	printf("Files: %u\n", grf_filecount(grf));
+	for (i = 0; i < grf_filecount(grf); i++) {
+		struct ROGrfFile *file = grf_getfileinfo(grf, i);
+		if (grf_getfileinfobyname(grf, file->fileName) != file) {
+			printf("error : [%u] lookup of \"%s\" failed\n", i, file->fileName);
+			ret = EXIT_FAILURE;
+		}
+		if ((file->flags & 1) && grf_getdata(file) != 0) {
+			printf("error : [%u] failed to read \"%s\"\n", i, file->fileName);
+			ret = EXIT_FAILURE;
+		}
+		if (file->data != NULL) {
+			unsigned char head[16];
+			int n = (file->uncompressedLength < 16)? file->uncompressedLength: 16;
+			if (grf_peek(file, head, sizeof(head)) != n || memcmp(head, file->data, n) != 0) {
+				printf("error : [%u] failed to peek \"%s\"\n", i, file->fileName);
+				ret = EXIT_FAILURE;
+			}
+		}
+		grf_freedata(file);
+	}
+
+	{// test glob
+		unsigned int count = 0;
+		if (grf_glob(grf, "**", grf_count, &count) != (int)grf_filecount(grf) || count != grf_filecount(grf)) {
+			printf("error : glob of everything found %u files\n", count);
+			ret = EXIT_FAILURE;
+		}
+		for (i = 0; i < grf_filecount(grf) && i < 100; i++) {
+			struct ROGrfFile *file = grf_getfileinfo(grf, i);
+			if (strpbrk(file->fileName, "*?[") == NULL && grf_glob(grf, file->fileName, grf_count, &count) != 1) {
+				printf("error : [%u] glob of \"%s\" failed\n", i, file->fileName);
+				ret = EXIT_FAILURE;
+			}
+		}
+	}
+
+	{// test glob with consecutive "**"
+		const char *fn2 = "test_glob.grf";
+		const char *names[2] = {"a\\b\\x.act", "a\\y.act"};
+		const char *patterns[4] = {"**\\*.act", "**\\**\\*.act", "**\\**\\**", "**\\*\\**\\*.act"};
+		const int expected[4] = {2, 2, 2, 2};
+		struct ROGrfWriter *writer = grf_writer_open(fn2, 0);
+		struct ROGrf *grf2;
+		for (i = 0; writer != NULL && i < 2; i++)
+			grf_writer_add(writer, names[i], names[i], (unsigned int)strlen(names[i]));
+		grf_writer_close(writer);
+		grf2 = grf_open(fn2);
+		for (i = 0; i < 4; i++) {
+			unsigned int count = 0;
+			if (grf2 == NULL || grf_glob(grf2, patterns[i], grf_count, &count) != expected[i] || count != (unsigned int)expected[i]) {
+				printf("error : glob of \"%s\" found %u files instead of %d\n", patterns[i], count, expected[i]);
+				ret = EXIT_FAILURE;
+			}
+		}
+		grf_close(grf2);
+		remove(fn2);
+	}
+
+	{// test shared index
+		struct ROGrf *grf2, *grf3;
+		grf_unlink_shared(fn); // stale index from a previous run
+		grf2 = grf_open_shared(fn); // publishes
+		grf3 = grf_open_shared(fn); // attaches
+		if (grf2 == NULL || grf3 == NULL) {
+			printf("error : failed to open shared index\n");
+			ret = EXIT_FAILURE;
+		}
+		else {
+			printf("Shared: %p\n", grf3->current->shared);
+			if (!grf_equal(grf, grf2) || !grf_equal(grf, grf3)) {
+				printf("error : shared index is different\n");
+				ret = EXIT_FAILURE;
+			}
+		}
+		grf_close(grf3);
+		grf_close(grf2);
+		grf_unlink_shared(fn);
+	}
+
+	{// test reload of an unchanged file
+		struct ROGrf *grf2 = grf_open(fn);
+		if (grf2 == NULL || grf_reload(grf2) != 0) {
+			printf("error : failed to reload\n");
+			ret = EXIT_FAILURE;
+		}
+		else if (!grf_equal(grf, grf2)) {
+			printf("error : reload produced a different index\n");
+			ret = EXIT_FAILURE;
+		}
+		grf_close(grf2);
+	}
+
+	{// test that a snapshot survives a reload
+		struct ROGrf *grf2 = grf_open(fn);
+		const struct ROGrfSnapshot *snap;
+		int slot;
+		snap = grf_snapshot_acquire(grf2, &slot);
+		if (snap == NULL || grf_reload(grf2) != 0 || grf_snapshot_acquire(grf2, &slot) == snap) {
+			printf("error : failed to keep the snapshot\n");
+			ret = EXIT_FAILURE;
+		}
+		else {
+			for (i = 0; i < grf_snapshot_filecount(snap); i++) {
+				const struct ROGrfFile *file = grf_snapshot_getfileinfo(snap, i);
+				if (grf_snapshot_getfileinfobyname(snap, file->fileName) != file) {
+					printf("error : [%u] snapshot lookup of \"%s\" failed\n", i, file->fileName);
+					ret = EXIT_FAILURE;
+				}
+				if (file->flags & 1) {
+					void *buf = malloc(file->uncompressedLength + 1);
+					if (grf_snapshot_read(snap, file, buf) != 0) {
+						printf("error : [%u] snapshot read of \"%s\" failed\n", i, file->fileName);
+						ret = EXIT_FAILURE;
+					}
+					free(buf);
+				}
+			}
+		}
+		grf_close(grf2); // also frees the snapshots
+	}
+
+	{// test watch of a file written in place or replaced with a rename
+		const char *fn2 = "test_watch.grf";
+		const char *tmp = "test_watch.grf.tmp";
+		struct ROGrf *grf2 = NULL;
+		if (copy_file(fn, fn2) == 0)
+			grf2 = grf_open(fn2);
+		if (grf2 == NULL) {
+			printf("error : failed to open a copy\n");
+			ret = EXIT_FAILURE;
+		}
+		else if (grf_watch(grf2) != 0)
+			printf("Watch: not supported\n");
+		else {
+			int poll1, poll2, poll3;
+			copy_file(fn, tmp);
+			rename(tmp, fn2);
+			poll1 = grf_poll(grf2);
+			copy_file(fn, tmp); // the watch must survive the first replace
+			rename(tmp, fn2);
+			poll2 = grf_poll(grf2);
+			copy_file(fn, fn2);
+			poll3 = grf_poll(grf2);
+			printf("Watch: %d %d %d\n", poll1, poll2, poll3);
+			if (poll1 != 1 || poll2 != 1 || poll3 != 1) {
+				printf("error : watch missed a change\n");
+				ret = EXIT_FAILURE;
+			}
+			else if (!grf_equal(grf, grf2)) {
+				printf("error : watch reload produced a different index\n");
+				ret = EXIT_FAILURE;
+			}
+			if (grf_poll(grf2) != 0) {
+				printf("error : watch reported a change that did not happen\n");
+				ret = EXIT_FAILURE;
+			}
+		}
+		grf_close(grf2);
+		remove(fn2);
+	}
+
+	{// test save to file
+		const char *fn2 = "test_save.grf";
+		struct ROGrfWriter *writer = grf_writer_open(fn2, GRF_WRITER_STORED);
+		struct ROGrf *grf2;
+		for (i = 0; writer != NULL && i < grf_filecount(grf); i++) {
+			struct ROGrfFile *file = grf_getfileinfo(grf, i);
+			if ((file->flags & 1) && grf_getdata(file) == 0) {
+				grf_writer_add(writer, file->fileName, file->data, file->uncompressedLength);
+				grf_freedata(file);
+			}
+		}
+		printf("Save: %d\n", grf_writer_close(writer));
+		grf2 = grf_open(fn2);
+		if (grf2 == NULL) {
+			printf("error : saving produced invalid data or no file\n");
+			ret = EXIT_FAILURE;
+		}
+		else {
+			unsigned int stored = 0;
+			for (i = 0; i < grf_filecount(grf2); i++) {
+				struct ROGrfFile *file2 = grf_getfileinfo(grf2, i);
+				struct ROGrfFile *file = grf_getfileinfobyname(grf, file2->fileName);
+				const void *view = grf_getview(file2);
+				if (file == NULL || grf_getdata(file) != 0 || grf_getdata(file2) != 0 ||
+					file->uncompressedLength != file2->uncompressedLength ||
+					memcmp(file->data, file2->data, file->uncompressedLength) != 0 ||
+					(view != NULL && memcmp(view, file->data, file->uncompressedLength) != 0)) {
+					printf("error : [%u] saving produced different data for \"%s\"\n", i, file2->fileName);
+					ret = EXIT_FAILURE;
+				}
+				if (file2->flags & GRF_FLAG_STORED)
+					stored++;
+				grf_freedata(file);
+				grf_freedata(file2);
+			}
+			printf("Stored: %u\n", stored);
+		}
+		grf_close(grf2);
+		remove(fn2);
+	}
+
+	{// test store decision of the writer
+		const char *fn2 = "test_stored.grf";
+		const char *names[3] = {"data\\wav\\zero.WAV", "data\\noise.bin", "data\\zero.txt"};
+		const int expected[3] = {1, 1, 0};
+		unsigned int length = 0x10000;
+		unsigned char *zero = (unsigned char*)calloc(length, 1);
+		unsigned char *noise = (unsigned char*)malloc(length);
+		const unsigned char *datas[3];
+		unsigned int seed = 12345;
+		struct ROGrfWriter *writer = grf_writer_open(fn2, GRF_WRITER_STORED);
+		struct ROGrf *grf2;
+		for (i = 0; i < length; i++) {
+			seed = seed * 1103515245 + 12345;
+			noise[i] = (unsigned char)(seed >> 16);
+		}
+		datas[0] = zero; datas[1] = noise; datas[2] = zero;
+		for (i = 0; writer != NULL && i < 3; i++)
+			grf_writer_add(writer, names[i], datas[i], length);
+		grf_writer_close(writer);
+		grf2 = grf_open(fn2);
+		if (grf2 == NULL) {
+			printf("error : saving stored entries produced invalid data or no file\n");
+			ret = EXIT_FAILURE;
+		}
+		for (i = 0; grf2 != NULL && i < 3; i++) {
+			struct ROGrfFile *file2 = grf_getfileinfobyname(grf2, names[i]);
+			if (file2 == NULL || ((file2->flags & GRF_FLAG_STORED) != 0) != expected[i] ||
+				grf_getdata(file2) != 0 || file2->uncompressedLength != (int)length ||
+				memcmp(file2->data, datas[i], length) != 0) {
+				printf("error : wrong store decision or data for \"%s\"\n", names[i]);
+				ret = EXIT_FAILURE;
+			}
+			if (file2 != NULL)
+				grf_freedata(file2);
+		}
+		grf_close(grf2);
+		remove(fn2);
+		free(zero);
+		free(noise);
+	}
+
+	grf_close(grf);
+
+	if (ret == EXIT_SUCCESS)
+		printf("OK\n");
+	return(ret);
+}
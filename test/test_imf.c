@@ -156,6 +156,16 @@ int main(int argc, char **argv)
 				printf("error : saving produced different data\n");
 				ret = EXIT_FAILURE;
 			}
+			else {// saving what was loaded gives the same bytes
+				unsigned char *data2 = NULL;
+				unsigned long length2 = 0;
+				if (imf_saveToData(imf2, &data2, &length2) != 0 || length2 != length || memcmp(data2, data, length) != 0) {
+					printf("error : saving again produced different bytes\n");
+					ret = EXIT_FAILURE;
+				}
+				if (data2 != NULL)
+					get_roint_free_func()(data2);
+			}
 		}
 		if (data != NULL)
 			get_roint_free_func()(data);
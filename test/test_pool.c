@@ -0,0 +1,169 @@
+/*
+    ------------------------------------------------------------------------------------
+    LICENSE:
+    ------------------------------------------------------------------------------------
+    This file is part of The Open Ragnarok Project
+    Copyright 2007 - 2011 The Open Ragnarok Team
+    For the latest information visit http://www.open-ragnarok.org
+    ------------------------------------------------------------------------------------
+    This program is free software; you can redistribute it and/or modify it under
+    the terms of the GNU Lesser General Public License as published by the Free Software
+    Foundation; either version 2 of the License, or (at your option) any later
+    version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License along with
+    this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+    Place - Suite 330, Boston, MA 02111-1307, USA, or go to
+    http://www.gnu.org/copyleft/lesser.txt.
+    ------------------------------------------------------------------------------------
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <roint.h>
+
+
+#define BLOCKCOUNT 4096
+
+
+void fill(unsigned char *ptr, size_t size, unsigned char seed) {
+	size_t i;
+	for (i = 0; i < size; i++)
+		ptr[i] = (unsigned char)(seed + i);
+}
+
+
+int check(const unsigned char *ptr, size_t size, unsigned char seed) {
+	size_t i;
+	for (i = 0; i < size; i++)
+		if (ptr[i] != (unsigned char)(seed + i))
+			return(0);
+	return(1);
+}
+
+
+// Resize a filled block and check that the data is kept.
+int resize(const struct ROAllocator *pool, size_t oldsize, size_t size) {
+	unsigned char *ptr = (unsigned char*)pool->alloc(pool->ctx, oldsize);
+	int ret;
+
+	if (ptr == NULL)
+		return(0);
+	fill(ptr, oldsize, (unsigned char)oldsize);
+	ptr = (unsigned char*)pool->realloc(pool->ctx, ptr, oldsize, size);
+	if (ptr == NULL)
+		return(0);
+	ret = check(ptr, (oldsize < size)? oldsize: size, (unsigned char)oldsize);
+	fill(ptr, size, 0); // the whole new size is usable
+	pool->free(pool->ctx, ptr, size);
+	return(ret);
+}
+
+
+int main(int argc, char **argv)
+{
+	const struct ROAllocator *pool = roint_pool_allocator();
+	unsigned char *blocks[BLOCKCOUNT];
+	size_t sizes[BLOCKCOUNT];
+	unsigned int i, seed = 12345;
+	int ret = EXIT_SUCCESS;
+
+	if (pool == NULL || pool->alloc == NULL || pool->free == NULL || pool->realloc == NULL) {
+		printf("error : incomplete pool allocator\n");
+		return(EXIT_FAILURE);
+	}
+
+	{// test alloc and free of every size class and of malloc sizes
+		size_t size;
+		for (size = 0; size <= 2048; size++) {
+			unsigned char *ptr = (unsigned char*)roint_pool_malloc(size);
+			if (ptr == NULL || ((size_t)ptr & 15) != 0) {
+				printf("error : [%u] bad allocation %p\n", (unsigned int)size, ptr);
+				ret = EXIT_FAILURE;
+				continue;
+			}
+			fill(ptr, size, (unsigned char)size);
+			if (!check(ptr, size, (unsigned char)size)) {
+				printf("error : [%u] data changed\n", (unsigned int)size);
+				ret = EXIT_FAILURE;
+			}
+			roint_pool_free(ptr);
+		}
+		roint_pool_free(NULL);
+	}
+
+	{// test live blocks of mixed sizes do not overlap
+		for (i = 0; i < BLOCKCOUNT; i++) {
+			seed = seed * 1103515245 + 12345;
+			sizes[i] = (i % 16 == 0)? 1025 + (seed >> 16) % 4096: 1 + (seed >> 16) % 1024;
+			blocks[i] = (unsigned char*)roint_pool_malloc(sizes[i]);
+			fill(blocks[i], sizes[i], (unsigned char)i);
+		}
+		for (i = 0; i < BLOCKCOUNT; i += 2) {// free half, allocate again in the holes
+			roint_pool_free(blocks[i]);
+			blocks[i] = (unsigned char*)roint_pool_malloc(sizes[i]);
+			fill(blocks[i], sizes[i], (unsigned char)i);
+		}
+		for (i = 0; i < BLOCKCOUNT; i++) {
+			if (!check(blocks[i], sizes[i], (unsigned char)i)) {
+				printf("error : [%u] block of %u bytes was overwritten\n", i, (unsigned int)sizes[i]);
+				ret = EXIT_FAILURE;
+			}
+			roint_pool_free(blocks[i]);
+		}
+	}
+
+	{// test realloc in the same class, between classes and between the pool and malloc
+		const size_t cases[][2] = {
+			{20, 30}, {30, 20}, {129, 160}, // same class
+			{40, 500}, {500, 40}, {16, 1024}, {1024, 16}, // between classes
+			{100, 4000}, {1024, 1025}, {4000, 100}, {1025, 1024}, // pool and malloc
+			{3000, 5000}, {5000, 3000} // malloc
+		};
+		for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+			if (!resize(pool, cases[i][0], cases[i][1])) {
+				printf("error : realloc from %u to %u bytes lost data\n", (unsigned int)cases[i][0], (unsigned int)cases[i][1]);
+				ret = EXIT_FAILURE;
+			}
+		}
+		{// malloc block given to the pool
+			unsigned char *ptr = (unsigned char*)malloc(64);
+			fill(ptr, 64, 7);
+			ptr = (unsigned char*)pool->realloc(pool->ctx, ptr, 64, 200);
+			if (ptr == NULL || !check(ptr, 64, 7)) {
+				printf("error : realloc of a malloc block lost data\n");
+				ret = EXIT_FAILURE;
+			}
+			pool->free(pool->ctx, ptr, 200);
+		}
+	}
+
+	{// test flush of the thread cache
+		for (i = 0; i < BLOCKCOUNT; i++)
+			blocks[i] = (unsigned char*)roint_pool_malloc(48);
+		for (i = 0; i < BLOCKCOUNT; i++)
+			roint_pool_free(blocks[i]);
+		roint_pool_flush_thread();
+		roint_pool_flush_thread(); // nothing cached
+		for (i = 0; i < BLOCKCOUNT; i++) {
+			blocks[i] = (unsigned char*)roint_pool_malloc(48);
+			fill(blocks[i], 48, (unsigned char)i);
+		}
+		for (i = 0; i < BLOCKCOUNT; i++) {
+			if (!check(blocks[i], 48, (unsigned char)i)) {
+				printf("error : [%u] block was overwritten after the flush\n", i);
+				ret = EXIT_FAILURE;
+			}
+			roint_pool_free(blocks[i]);
+		}
+		roint_pool_flush_thread();
+	}
+
+	if (ret == EXIT_SUCCESS)
+		printf("OK\n");
+	return(ret);
+}
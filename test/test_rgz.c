@@ -122,6 +122,105 @@ int main(int argc, char **argv)
 		rgz_unload(rgz2);
 	}
 
+	{// test random access
+		const char *fn2 = "test_save.rgz";
+		const char *indexfn = "test_save.rgzi";
+		unsigned int pass;
+		printf("Save: %d\n", rgz_saveToFile(rgz, fn2));
+		for (pass = 0; pass < 2; pass++) {
+			struct RORgzStream *stream = rgz_open(fn2, (pass == 0)? NULL: indexfn);
+			if (stream == NULL || stream->entrycount != rgz->entrycount) {
+				printf("error : failed to open for random access\n");
+				ret = EXIT_FAILURE;
+			}
+			for (i = (stream != NULL)? stream->entrycount: 0; i-- > 0;) {
+				struct RORgzEntry *entry = &rgz->entries[i];
+				unsigned char *buf = (unsigned char*)malloc(entry->datalength + 1);
+				unsigned int offset = entry->datalength / 2;
+				if (strcmp(stream->entries[i].path, entry->path) != 0 ||
+					(entry->datalength > 0 &&
+					(rgz_read(stream, i, offset, buf, entry->datalength - offset) != 0 ||
+					memcmp(buf, entry->data + offset, entry->datalength - offset) != 0))) {
+					printf("error : [%u] random access read different data\n", i);
+					ret = EXIT_FAILURE;
+				}
+				free(buf);
+			}
+			if (pass == 0)
+				printf("Save index: %d\n", rgz_saveIndex(stream, indexfn));
+			rgz_close(stream);
+		}
+		remove(fn2);
+		remove(indexfn);
+	}
+
+	{// test random access with an index on several MB
+		const char *fn2 = "test_big.rgz";
+		const char *indexfn = "test_big.rgzi";
+		struct RORgz big;
+		struct RORgzEntry entries[4];
+		unsigned int seed = 12345, pass;
+		memset(entries, 0, sizeof(entries));
+		for (i = 0; i < 3; i++) {
+			unsigned int j;
+			entries[i].type = 'f';
+			sprintf(entries[i].path, "data\\big%u.bin", i);
+			entries[i].datalength = 0x180000 + i * 0x1234;
+			entries[i].data = (unsigned char*)malloc(entries[i].datalength);
+			for (j = 0; j < entries[i].datalength; j++) {
+				seed = seed * 1103515245 + 12345;
+				entries[i].data[j] = (unsigned char)((seed >> 16) & 0x0F); // compresses, but not to nothing
+			}
+		}
+		entries[3].type = 'e';
+		strcpy(entries[3].path, "end");
+		big.entrycount = 4;
+		big.entries = entries;
+		if (rgz_saveToFile(&big, fn2) != 0) {
+			printf("error : failed to save multi-MB file\n");
+			ret = EXIT_FAILURE;
+		}
+		for (pass = 0; pass < 2; pass++) {
+			struct RORgzStream *stream = rgz_open(fn2, (pass == 0)? NULL: indexfn);
+			if (stream == NULL || stream->entrycount != big.entrycount) {
+				printf("error : failed to open multi-MB file for random access\n");
+				ret = EXIT_FAILURE;
+				rgz_close(stream);
+				continue;
+			}
+			for (i = 3; i-- > 0;) {
+				unsigned char buf[0x1000];
+				unsigned int offset = entries[i].datalength - sizeof(buf) - i * 0x10001;
+				if (rgz_read(stream, i, offset, buf, sizeof(buf)) != 0 ||
+					memcmp(buf, entries[i].data + offset, sizeof(buf)) != 0) {
+					printf("error : [%u] multi-MB random access read different data\n", i);
+					ret = EXIT_FAILURE;
+				}
+			}
+			if (pass == 0 && rgz_saveIndex(stream, indexfn) != 0) {
+				printf("error : failed to save multi-MB index\n");
+				ret = EXIT_FAILURE;
+			}
+			rgz_close(stream);
+		}
+		{// the index of another file of the same size is not used
+			struct RORgzStream *stream;
+			for (i = 0; i < 3; i++)
+				sprintf(entries[i].path, "data\\gib%u.bin", i); // same letters, same compressed size
+			rgz_saveToFile(&big, fn2);
+			stream = rgz_open(fn2, indexfn);
+			if (stream == NULL || stream->entrycount != big.entrycount || strcmp(stream->entries[0].path, entries[0].path) != 0) {
+				printf("error : index of another file was used\n");
+				ret = EXIT_FAILURE;
+			}
+			rgz_close(stream);
+		}
+		for (i = 0; i < 3; i++)
+			free(entries[i].data);
+		remove(fn2);
+		remove(indexfn);
+	}
+
 	if (ret == EXIT_SUCCESS)
 		printf("OK\n");
 	return(ret);
@@ -36,15 +36,15 @@ int spr_equal(struct ROSpr *spr, struct ROSpr *spr2) {
 		return(0);
 	for (i = 0; i < spr->palimagecount; i++) {
 		struct ROSprPalImage *image = &spr->palimages[i];
-		struct ROSprPalImage *image2 = &spr->palimages[i];
+		struct ROSprPalImage *image2 = &spr2->palimages[i];
 		if (image2->width != image->width ||
 			image2->height != image->height ||
-			memcmp(image2->data, image->data, sizeof(unsigned char) * image->width * image->height) != 0)
+			(image->width * image->height > 0 && memcmp(image2->data, image->data, sizeof(unsigned char) * image->width * image->height) != 0))
 			return(0);
 	}
 	for (i = 0; i < spr->rgbaimagecount; i++) {
 		struct ROSprRgbaImage *image = &spr->rgbaimages[i];
-		struct ROSprRgbaImage *image2 = &spr->rgbaimages[i];
+		struct ROSprRgbaImage *image2 = &spr2->rgbaimages[i];
 		if (image2->width != image->width ||
 			image2->height != image->height ||
 			memcmp(image2->data, image->data, sizeof(struct ROSprColor) * image->width * image->height) != 0)
@@ -129,6 +129,105 @@ int main(int argc, char **argv)
 		ret = EXIT_FAILURE;
 	}
 
+	{// test lazy load
+		struct ROSprLazy *lazy = spr_loadLazyFromFile(fn);
+		if (lazy == NULL || lazy->version != spr->version ||
+			lazy->palimagecount != spr->palimagecount ||
+			lazy->rgbaimagecount != spr->rgbaimagecount ||
+			(spr->pal != NULL && (lazy->pal == NULL || memcmp(lazy->pal, spr->pal, sizeof(struct ROPal)) != 0))) {
+			printf("error : lazy load failed\n");
+			ret = EXIT_FAILURE;
+		}
+		else {
+			printf("Lazy: %lu bytes\n", lazy->datasize);
+			for (i = 0; i < spr->palimagecount; i++) {
+				const struct ROSprPalImage *image = &spr->palimages[i];
+				const unsigned char *data = spr_lazy_getpalimage(lazy, i);
+				if (lazy->palimages[i].width != image->width || lazy->palimages[i].height != image->height ||
+					(image->data != NULL && (data == NULL || memcmp(data, image->data, (size_t)image->width * image->height) != 0)) ||
+					spr_lazy_getpalimage(lazy, i) != data) {
+					printf("error : [%u] lazy pal image is different\n", i);
+					ret = EXIT_FAILURE;
+				}
+			}
+			for (i = 0; i < spr->palimagecount; i++) {// rectangle in the middle
+				const struct ROSprPalImage *image = &spr->palimages[i];
+				unsigned int x = image->width / 3, y = image->height / 3;
+				unsigned int width = image->width - x - image->width / 4, height = image->height - y - image->height / 4;
+				unsigned char *data = (unsigned char*)malloc((size_t)width * height + 1);
+				unsigned int row;
+				if (spr_lazy_decoderect(lazy, i, x, y, width, height, data, width) != 0) {
+					printf("error : [%u] lazy rectangle failed\n", i);
+					ret = EXIT_FAILURE;
+				}
+				else {
+					for (row = 0; row < height; row++) {
+						if (memcmp(data + (size_t)row * width, image->data + (size_t)(y + row) * image->width + x, width) != 0) {
+							printf("error : [%u] lazy rectangle is different\n", i);
+							ret = EXIT_FAILURE;
+							break;
+						}
+					}
+				}
+				free(data);
+			}
+			for (i = 0; i < spr->rgbaimagecount; i++) {
+				const struct ROSprRgbaImage *image = &spr->rgbaimages[i];
+				const struct ROSprColor *data = spr_lazy_getrgbaimage(lazy, i);
+				if (lazy->rgbaimages[i].width != image->width || lazy->rgbaimages[i].height != image->height ||
+					(image->data != NULL && (data == NULL || memcmp(data, image->data, sizeof(struct ROSprColor) * image->width * image->height) != 0))) {
+					printf("error : [%u] lazy rgba image is different\n", i);
+					ret = EXIT_FAILURE;
+				}
+			}
+			spr_lazy_flush(lazy);
+			if (lazy->cachesize != 0) {
+				printf("error : lazy cache not flushed\n");
+				ret = EXIT_FAILURE;
+			}
+		}
+		spr_lazy_unload(lazy);
+	}
+
+	{// test lazy load of a v1.0 sprite from data (the last frame ends the data)
+		static const unsigned char v100[14] = {'S','P', 0x00,0x01, 0x01,0x00, 0x02,0x00,0x02,0x00, 1,2,3,4};
+		struct ROSpr *spr2 = spr_loadFromData(v100, sizeof(v100));
+		struct ROSprLazy *lazy = spr_loadLazyFromData(v100, sizeof(v100));
+		const unsigned char *data = (lazy != NULL)? spr_lazy_getpalimage(lazy, 0): NULL;
+		if (spr2 == NULL || lazy == NULL || lazy->palimagecount != 1 || lazy->pal != NULL ||
+			data == NULL || memcmp(data, spr2->palimages[0].data, 4) != 0) {
+			printf("error : lazy load of a v1.0 sprite failed\n");
+			ret = EXIT_FAILURE;
+		}
+		spr_lazy_unload(lazy);
+		lazy = spr_loadLazyFromData(v100, sizeof(v100) - 1);
+		if (lazy != NULL) {
+			printf("error : lazy load of a truncated v1.0 sprite succeeded\n");
+			ret = EXIT_FAILURE;
+		}
+		spr_lazy_unload(lazy);
+		spr_unload(spr2);
+	}
+
+	{// test arena load mode
+		unsigned char *data = NULL;
+		unsigned long length = 0;
+		struct ROSpr *spr2, *spr3 = NULL;
+		roint_set_load_mode(ROINT_LOADMODE_ARENA);
+		spr2 = spr_loadFromFile(fn);
+		if (spr_saveToData(spr, &data, &length) == 0)
+			spr3 = spr_loadFromData(data, length);
+		roint_set_load_mode(ROINT_LOADMODE_HEAP);
+		if (spr2 == NULL || spr3 == NULL || !spr_equal(spr, spr2) || !spr_equal(spr, spr3)) {
+			printf("error : loading in arena mode produced different data\n");
+			ret = EXIT_FAILURE;
+		}
+		spr_unload(spr2);
+		spr_unload(spr3);
+		if (data != NULL)
+			get_roint_free_func()(data);
+	}
+
 	{// test save to data
 		unsigned char *data = NULL;
 		unsigned long length = 0;
@@ -150,12 +249,171 @@ int main(int argc, char **argv)
 				printf("error : saving produced different data\n");
 				ret = EXIT_FAILURE;
 			}
+			else {// saving what was loaded gives the same bytes
+				unsigned char *data2 = NULL;
+				unsigned long length2 = 0;
+				if (spr_saveToData(spr2, &data2, &length2) != 0 || length2 != length || memcmp(data2, data, length) != 0) {
+					printf("error : saving again produced different bytes\n");
+					ret = EXIT_FAILURE;
+				}
+				if (data2 != NULL)
+					get_roint_free_func()(data2);
+			}
 		}
 		if (data != NULL)
 			get_roint_free_func()(data);
 		spr_unload(spr2);
 	}
 
+	{// test save and load of a generated v2.1 sprite (RLE pal images)
+		struct ROSpr rle;
+		struct ROSprPalImage images[3];
+		unsigned char *data = NULL, *data2 = NULL;
+		unsigned long length = 0, length2 = 0;
+		struct ROSpr *rle2;
+		memset(&rle, 0, sizeof(rle));
+		memset(images, 0, sizeof(images));
+		images[0].width = 16; // literals, short zero runs and a zero row
+		images[0].height = 8;
+		images[0].data = (unsigned char*)calloc(16 * 8, 1);
+		for (i = 0; i < 16 * 6; i++)
+			images[0].data[i] = (unsigned char)((i % 5 < 2)? 0: i);
+		images[1].width = 300; // zero runs longer than 255
+		images[1].height = 3;
+		images[1].data = (unsigned char*)calloc(300 * 3, 1);
+		images[1].data[299] = 1;
+		images[2].width = 0; // empty
+		images[2].height = 0;
+		rle.version = 0x201;
+		rle.palimagecount = 3;
+		rle.palimages = images;
+		rle.pal = (struct ROPal*)calloc(1, sizeof(struct ROPal));
+		for (i = 0; i < 256; i++)
+			rle.pal->pal[i].r = (unsigned char)i;
+		rle2 = NULL;
+		if (spr_saveToData(&rle, &data, &length) != 0 || (rle2 = spr_loadFromData(data, length)) == NULL ||
+			!spr_equal(&rle, rle2) || spr_saveToData(rle2, &data2, &length2) != 0 ||
+			length2 != length || memcmp(data2, data, length) != 0) {
+			printf("error : generated v2.1 sprite is different after save and load\n");
+			ret = EXIT_FAILURE;
+		}
+		if (data != NULL)
+			get_roint_free_func()(data);
+		if (data2 != NULL)
+			get_roint_free_func()(data2);
+		spr_unload(rle2);
+		free(images[0].data);
+		free(images[1].data);
+		free(rle.pal);
+	}
+
+	{// test flat block
+		unsigned char *data = NULL;
+		unsigned long length = 0;
+		const struct ROSpr *view;
+		printf("Flat: %d\n", spr_saveToFlat(spr, &data, &length));
+		view = spr_attachFlat(data, length);
+		if (view == NULL || !spr_equal(spr, (struct ROSpr*)view)) {
+			printf("error : flat block is different\n");
+			ret = EXIT_FAILURE;
+		}
+		else {// moved copy
+			unsigned char *copy = (unsigned char*)malloc(length);
+			memcpy(copy, data, length);
+			view = spr_attachFlat(copy, length);
+			if (view == NULL || (unsigned char*)view < copy || (unsigned char*)view >= copy + length || !spr_equal(spr, (struct ROSpr*)view)) {
+				printf("error : moved flat block is different\n");
+				ret = EXIT_FAILURE;
+			}
+			else {// count bigger than its array
+				unsigned char *moved = (unsigned char*)malloc(length);
+				if (spr_verifyFlat(copy, length) != 0 || roint_flat_verify(copy, length) != 0) {
+					printf("error : valid flat block failed to verify\n");
+					ret = EXIT_FAILURE;
+				}
+				((struct ROSpr*)view)->palimagecount = 0xFFFF;
+				memcpy(moved, copy, length);
+				if (spr_verifyFlat(copy, length) == 0 || roint_flat_verify(copy, length) == 0 || spr_attachFlat(moved, length) != NULL) {
+					printf("error : flat block with a bad count was accepted\n");
+					ret = EXIT_FAILURE;
+				}
+				free(moved);
+			}
+			free(copy);
+		}
+		if (data != NULL)
+			get_roint_free_func()(data);
+	}
+
+	if (spr->pal != NULL) {// test rgba expansion
+		unsigned char *data = NULL;
+		unsigned long length = 0;
+		unsigned char *rgba;
+		printf("Rgba: %d\n", spr_pal_to_rgba(spr, NULL, &data, &length));
+		rgba = data;
+		for (i = 0; rgba != NULL && i < spr->palimagecount; i++) {
+			const struct ROSprPalImage *image = &spr->palimages[i];
+			unsigned int pixel;
+			for (pixel = 0; pixel < (unsigned int)image->width * image->height; pixel++, rgba += 4) {
+				unsigned char index = image->data[pixel];
+				const struct ROPalColor *color = &spr->pal->pal[index];
+				if ((index == 0 && (rgba[0] | rgba[1] | rgba[2] | rgba[3]) != 0) ||
+					(index != 0 && (rgba[0] != color->r || rgba[1] != color->g || rgba[2] != color->b || rgba[3] != 0xFF))) {
+					printf("error : [%u] wrong rgba pixel %u\n", i, pixel);
+					ret = EXIT_FAILURE;
+					break;
+				}
+			}
+		}
+		if (data == NULL) {
+			printf("error : rgba expansion failed\n");
+			ret = EXIT_FAILURE;
+		}
+		else
+			get_roint_free_func()(data);
+	}
+
+	if (spr->pal != NULL) {// test atlas
+		const struct ROSpr *sprs[1];
+		struct ROSprAtlas *atlas;
+		sprs[0] = spr;
+		atlas = spr_atlas_pack(sprs, 1, 1024, 1, SPR_ATLAS_TRIM);
+		if (atlas == NULL || atlas->framecount != spr->palimagecount + spr->rgbaimagecount) {
+			printf("error : atlas packing failed\n");
+			ret = EXIT_FAILURE;
+		}
+		else {
+			printf("Atlas: %u frames, %u pages\n", atlas->framecount, atlas->pagecount);
+			for (i = 0; i < spr->palimagecount; i++) {
+				const struct ROSprPalImage *image = &spr->palimages[i];
+				const struct ROSprAtlasFrame *frame = &atlas->frames[i];
+				unsigned char *rgba = (unsigned char*)malloc((size_t)image->width * image->height * 4 + 1);
+				unsigned int x, y;
+				spr_palimage_to_rgba(image, spr->pal, rgba);
+				for (y = 0; y < image->height; y++) {
+					for (x = 0; x < image->width; x++) {
+						const unsigned char *expected = rgba + ((size_t)y * image->width + x) * 4;
+						const unsigned char *actual = NULL;
+						if (frame->width > 0 &&
+							x >= frame->trimx && x < frame->trimx + frame->width &&
+							y >= frame->trimy && y < frame->trimy + frame->height) {
+							const struct ROSprAtlasPage *page = &atlas->pages[frame->page];
+							actual = page->rgba + ((size_t)(frame->y + y - frame->trimy) * page->width + frame->x + x - frame->trimx) * 4;
+						}
+						if ((actual == NULL && expected[3] != 0) || (actual != NULL && memcmp(actual, expected, 4) != 0)) {
+							printf("error : [%u] wrong atlas pixel %u,%u\n", i, x, y);
+							ret = EXIT_FAILURE;
+							y = image->height;
+							break;
+						}
+					}
+				}
+				free(rgba);
+			}
+		}
+		spr_atlas_unload(atlas);
+	}
+
 	if (ret == EXIT_SUCCESS)
 		printf("OK\n");
 	return(ret);
@@ -166,12 +166,60 @@ int main(int argc, char **argv)
 				printf("error : saving produced different data\n");
 				ret = EXIT_FAILURE;
 			}
+			else {// saving what was loaded gives the same bytes
+				unsigned char *data2 = NULL;
+				unsigned long length2 = 0;
+				if (str_saveToData(str2, &data2, &length2) != 0 || length2 != length || memcmp(data2, data, length) != 0) {
+					printf("error : saving again produced different bytes\n");
+					ret = EXIT_FAILURE;
+				}
+				if (data2 != NULL)
+					get_roint_free_func()(data2);
+			}
 		}
 		if (data != NULL)
 			get_roint_free_func()(data);
 		str_unload(str2);
 	}
 
+	{// test flat block
+		unsigned char *data = NULL;
+		unsigned long length = 0;
+		const struct ROStr *view;
+		printf("Flat: %d\n", str_saveToFlat(str, &data, &length));
+		view = str_attachFlat(data, length);
+		if (view == NULL || !str_equal(str, (struct ROStr*)view)) {
+			printf("error : flat block is different\n");
+			ret = EXIT_FAILURE;
+		}
+		else {// moved copy
+			unsigned char *copy = (unsigned char*)malloc(length);
+			memcpy(copy, data, length);
+			view = str_attachFlat(copy, length);
+			if (view == NULL || (unsigned char*)view < copy || (unsigned char*)view >= copy + length || !str_equal(str, (struct ROStr*)view)) {
+				printf("error : moved flat block is different\n");
+				ret = EXIT_FAILURE;
+			}
+			else {// count bigger than its array
+				unsigned char *moved = (unsigned char*)malloc(length);
+				if (str_verifyFlat(copy, length) != 0 || roint_flat_verify(copy, length) != 0) {
+					printf("error : valid flat block failed to verify\n");
+					ret = EXIT_FAILURE;
+				}
+				((struct ROStr*)view)->layercount = 0xFFFFFFFF;
+				memcpy(moved, copy, length);
+				if (str_verifyFlat(copy, length) == 0 || roint_flat_verify(copy, length) == 0 || str_attachFlat(moved, length) != NULL) {
+					printf("error : flat block with a bad count was accepted\n");
+					ret = EXIT_FAILURE;
+				}
+				free(moved);
+			}
+			free(copy);
+		}
+		if (data != NULL)
+			get_roint_free_func()(data);
+	}
+
 	str_unload(str);
 	if (ret == EXIT_SUCCESS)
 		printf("OK\n");
@@ -40,10 +40,10 @@ const char* compare_cp949(char *mine) {
 	if (mine == NULL)
 		return("NULL");
 	if (strcmp(cp949, mine) != 0) {
-		free(mine);
+		roint_free(mine);
 		return("MISSMATCH");
 	}
-	free(mine);
+	roint_free(mine);
 	num_ok++;
 	return("OK");
 }
@@ -54,10 +54,10 @@ const char* compare_utf8(char *mine) {
 	if (mine == NULL)
 		return("NULL");
 	if (strcmp(utf8, mine) != 0) {
-		free(mine);
+		roint_free(mine);
 		return("MISSMATCH");
 	}
-	free(mine);
+	roint_free(mine);
 	num_ok++;
 	return("OK");
 }
@@ -70,11 +70,11 @@ const char* compare_utf16(unsigned short *mine) {
 		return("NULL");
 	for (i = 0; utf16[i] != 0 || mine[i] != 0; ++i) {
 		if (utf16[i] != mine[i]) {
-			free(mine);
+			roint_free(mine);
 			return("MISSMATCH");
 		}
 	}
-	free(mine);
+	roint_free(mine);
 	num_ok++;
 	return("OK");
 }
@@ -87,11 +87,11 @@ const char* compare_unicode(unsigned int *mine) {
 		return("NULL");
 	for (i = 0; unicode[i] != 0 || mine[i] != 0; ++i) {
 		if (unicode[i] != mine[i]) {
-			free(mine);
+			roint_free(mine);
 			return("MISSMATCH");
 		}
 	}
-	free(mine);
+	roint_free(mine);
 	num_ok++;
 	return("OK");
 }
@@ -40,6 +40,17 @@ const struct s_converter converter[] = {
 #define CP949_START 0x8141
 
 
+// Allocate a string for the caller. (counted as text, handed over to the caller)
+static void *_text_alloc(size_t size) {
+	unsigned int subsystem = _xalloc_subsystem(ROINT_ALLOC_TEXT);
+	void *ret = _xalloc(size);
+
+	_xalloc_subsystem(subsystem);
+	_xhandover(ret);
+	return(ret);
+}
+
+
 //-------------------------------------------------------------------
 // UNICODE int code points (20 bits used)
 // CP949 1/2-byte code points
@@ -134,7 +145,7 @@ unsigned int* roint_string_cp949_to_unicode(const char *cp949) {
 	}
 
 	// convert
-	unicode = (unsigned int*)_xalloc(sizeof(unsigned int) * (unicode_len+1));
+	unicode = (unsigned int*)_text_alloc(sizeof(unsigned int) * (unicode_len+1));
 	unicode_len = 0;
 	for (i = 0; cp949[i] != 0; ) {
 		len = roint_decode_cp949(cp949 + i, &cp949_c);
@@ -170,7 +181,7 @@ char *roint_string_unicode_to_cp949(const unsigned int *unicode) {
 	}
 
 	// convert
-	cp949 = (char*)_xalloc(sizeof(char) * (cp949_len+1));
+	cp949 = (char*)_text_alloc(sizeof(char) * (cp949_len+1));
 	cp949_len = 0;
 	for (i = 0; unicode[i] != 0; i++) {
 		cp949_c = roint_convert_unicode_to_cp949(unicode[i]);
@@ -284,7 +295,7 @@ unsigned int *roint_string_utf8_to_unicode(const char *utf8) {
 	}
 
 	// convert
-	unicode = (unsigned int*)_xalloc(sizeof(unsigned int) * (unicode_len+1));
+	unicode = (unsigned int*)_text_alloc(sizeof(unsigned int) * (unicode_len+1));
 	unicode_len = 0;
 	for (i = 0; utf8[i] != 0; ) {
 		len = roint_decode_utf8(utf8 + i, unicode + unicode_len);
@@ -315,7 +326,7 @@ char *roint_string_unicode_to_utf8(const unsigned int *unicode) {
 	}
 
 	// translate
-	utf8 = (char*)_xalloc(sizeof(char) * (utf8_len+1));
+	utf8 = (char*)_text_alloc(sizeof(char) * (utf8_len+1));
 	utf8_len = 0;
 	for (i = 0; unicode[i] != 0; i++) {
 		len = roint_encode_utf8(unicode[i], utf8 + utf8_len);
@@ -355,7 +366,7 @@ char* roint_string_cp949_to_utf8(const char *cp949) {
 	}
 
 	// convert
-	utf8 = (char*)_xalloc(sizeof(char) * (utf8_len+1));
+	utf8 = (char*)_text_alloc(sizeof(char) * (utf8_len+1));
 	utf8_len = 0;
 	for (i = 0; cp949[i] != 0; ) {
 		in = roint_decode_cp949(cp949 + i, &cp949_c);
@@ -397,7 +408,7 @@ char *roint_string_utf8_to_cp949(const char *utf8) {
 	}
 
 	// convert
-	cp949 = (char*)_xalloc(sizeof(char) * (cp949_len+1));
+	cp949 = (char*)_text_alloc(sizeof(char) * (cp949_len+1));
 	cp949_len = 0;
 	for (i = 0; utf8[i] != 0; ) {
 		in = roint_decode_utf8(utf8 + i, &unicode_c);
@@ -475,7 +486,7 @@ unsigned int *roint_string_utf16_to_unicode(const unsigned short *utf16) {
 	}
 
 	// convert
-	unicode = (unsigned int*)_xalloc(sizeof(unsigned int) * (unicode_len+1));
+	unicode = (unsigned int*)_text_alloc(sizeof(unsigned int) * (unicode_len+1));
 	unicode_len = 0;
 	for (i = 0; utf16[i] != 0; ) {
 		len = roint_decode_utf16(utf16 + i, unicode + unicode_len);
@@ -506,7 +517,7 @@ unsigned short *roint_string_unicode_to_utf16(const unsigned int *unicode) {
 	}
 
 	// translate
-	utf16 = (unsigned short*)_xalloc(sizeof(unsigned short) * (utf16_len+1));
+	utf16 = (unsigned short*)_text_alloc(sizeof(unsigned short) * (utf16_len+1));
 	utf16_len = 0;
 	for (i = 0; unicode[i] != 0; i++) {
 		len = roint_encode_utf16(unicode[i], utf16 + utf16_len);
@@ -546,7 +557,7 @@ unsigned short* roint_string_cp949_to_utf16(const char *cp949) {
 	}
 
 	// convert
-	utf16 = (unsigned short*)_xalloc(sizeof(unsigned short) * (utf16_len+1));
+	utf16 = (unsigned short*)_text_alloc(sizeof(unsigned short) * (utf16_len+1));
 	utf16_len = 0;
 	for (i = 0; cp949[i] != 0; ) {
 		in = roint_decode_cp949(cp949 + i, &cp949_c);
@@ -588,7 +599,7 @@ char *roint_string_utf16_to_cp949(const unsigned short *utf16) {
 	}
 
 	// convert
-	cp949 = (char*)_xalloc(sizeof(char) * (cp949_len+1));
+	cp949 = (char*)_text_alloc(sizeof(char) * (cp949_len+1));
 	cp949_len = 0;
 	for (i = 0; utf16[i] != 0; ) {
 		in = roint_decode_utf16(utf16 + i, &unicode_c);
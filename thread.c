@@ -0,0 +1,141 @@
+/*
+    ------------------------------------------------------------------------------------
+    LICENSE:
+    ------------------------------------------------------------------------------------
+    This file is part of The Open Ragnarok Project
+    Copyright 2007 - 2012 The Open Ragnarok Team
+    For the latest information visit http://www.open-ragnarok.org
+    ------------------------------------------------------------------------------------
+    This program is free software; you can redistribute it and/or modify it under
+    the terms of the GNU Lesser General Public License as published by the Free Software
+    Foundation; either version 2 of the License, or (at your option) any later
+    version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License along with
+    this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+    Place - Suite 330, Boston, MA 02111-1307, USA, or go to
+    http://www.gnu.org/copyleft/lesser.txt.
+    ------------------------------------------------------------------------------------
+*/
+#include "internal.h"
+#include "thread.h"
+
+#if defined(HAVE_PTHREAD_H)
+#	include <pthread.h>
+#	include <unistd.h>
+#elif defined(_WIN32)
+#	include <windows.h>
+#	include <process.h>
+#endif
+
+struct _xthread_task {
+	t_xthread_func func;
+	void *arg;
+	unsigned int index;
+	struct _xalloc_state state; // allocator and subsystem of the calling thread
+};
+
+#if defined(HAVE_PTHREAD_H)
+static void *_xthread_main(void *ptr) {
+	struct _xthread_task *task = (struct _xthread_task*)ptr;
+	_xalloc_setstate(&task->state);
+	task->func(task->arg, task->index);
+	roint_pool_flush_thread(); // the cache of the pool dies with the thread
+	return(NULL);
+}
+#elif defined(_WIN32)
+static unsigned __stdcall _xthread_main(void *ptr) {
+	struct _xthread_task *task = (struct _xthread_task*)ptr;
+	_xalloc_setstate(&task->state);
+	task->func(task->arg, task->index);
+	roint_pool_flush_thread(); // the cache of the pool dies with the thread
+	return(0);
+}
+#endif
+
+
+unsigned int _xthread_hwcount(void) {
+#if defined(HAVE_PTHREAD_H) && defined(_SC_NPROCESSORS_ONLN)
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	if (count > 0)
+		return((unsigned int)count);
+#elif defined(_WIN32)
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	if (info.dwNumberOfProcessors > 0)
+		return((unsigned int)info.dwNumberOfProcessors);
+#endif
+	return(1);
+}
+
+
+void _xthread_parallel(unsigned int count, t_xthread_func func, void *arg) {
+#if defined(HAVE_PTHREAD_H) || defined(_WIN32)
+	struct _xthread_task *tasks;
+	unsigned int i;
+#	if defined(HAVE_PTHREAD_H)
+	pthread_t *threads;
+	unsigned char *started;
+#	else
+	HANDLE *threads;
+#	endif
+
+	if (count == 0)
+		return;
+	if (count == 1) {
+		func(arg, 0);
+		return;
+	}
+
+	tasks = (struct _xthread_task*)_xalloc(sizeof(struct _xthread_task) * count);
+#	if defined(HAVE_PTHREAD_H)
+	threads = (pthread_t*)_xalloc(sizeof(pthread_t) * count);
+	started = (unsigned char*)_xalloc(count);
+#	else
+	threads = (HANDLE*)_xalloc(sizeof(HANDLE) * count);
+#	endif
+	for (i = 1; i < count; i++) {
+		tasks[i].func = func;
+		tasks[i].arg = arg;
+		tasks[i].index = i;
+		_xalloc_getstate(&tasks[i].state);
+#	if defined(HAVE_PTHREAD_H)
+		started[i] = (pthread_create(&threads[i], NULL, &_xthread_main, &tasks[i]) == 0);
+		if (!started[i])
+			func(arg, i);
+#	else
+		threads[i] = (HANDLE)_beginthreadex(NULL, 0, &_xthread_main, &tasks[i], 0, NULL);
+		if (threads[i] == 0)
+			func(arg, i);
+#	endif
+	}
+
+	func(arg, 0);
+
+	for (i = 1; i < count; i++) {
+#	if defined(HAVE_PTHREAD_H)
+		if (started[i])
+			pthread_join(threads[i], NULL);
+#	else
+		if (threads[i] != 0) {
+			WaitForSingleObject(threads[i], INFINITE);
+			CloseHandle(threads[i]);
+		}
+#	endif
+	}
+
+#	if defined(HAVE_PTHREAD_H)
+	_xfree(started);
+#	endif
+	_xfree(threads);
+	_xfree(tasks);
+#else
+	unsigned int i;
+	for (i = 0; i < count; i++)
+		func(arg, i);
+#endif
+}
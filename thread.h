@@ -0,0 +1,46 @@
+/*
+    ------------------------------------------------------------------------------------
+    LICENSE:
+    ------------------------------------------------------------------------------------
+    This file is part of The Open Ragnarok Project
+    Copyright 2007 - 2012 The Open Ragnarok Team
+    For the latest information visit http://www.open-ragnarok.org
+    ------------------------------------------------------------------------------------
+    This program is free software; you can redistribute it and/or modify it under
+    the terms of the GNU Lesser General Public License as published by the Free Software
+    Foundation; either version 2 of the License, or (at your option) any later
+    version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License along with
+    this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+    Place - Suite 330, Boston, MA 02111-1307, USA, or go to
+    http://www.gnu.org/copyleft/lesser.txt.
+    ------------------------------------------------------------------------------------
+*/
+#ifndef __ROINT_INTERNAL_THREAD_H
+#define __ROINT_INTERNAL_THREAD_H
+
+// Minimal "parallel for" used to spread independent work over the cores.
+
+// Function run by each thread. index is in [0,count).
+typedef void (*t_xthread_func)(void *arg, unsigned int index);
+
+// Returns the number of hardware threads (at least 1).
+unsigned int _xthread_hwcount(void);
+
+// Runs func(arg, index) for every index in [0,count) on count threads and waits for all of them.
+// The calling thread runs index 0. If a thread cannot be created its index runs on the calling thread.
+void _xthread_parallel(unsigned int count, t_xthread_func func, void *arg);
+
+// Storage class of the thread-local variables. (undefined if the compiler has none)
+#if defined(_MSC_VER)
+#	define _XTHREADLOCAL __declspec(thread)
+#elif defined(HAVE___THREAD)
+#	define _XTHREADLOCAL __thread
+#endif
+
+#endif /* __ROINT_INTERNAL_THREAD_H */
@@ -62,10 +62,29 @@ struct _writer {
 /// type=1 : write gzip wrapper around deflate data
 /// type=255 : generate raw deflate data
 struct _writer *deflatewriter_init(struct _writer *parent, unsigned char type);
-/// Writer that uses an internal memory buffer.
+/// Same as deflatewriter_init, but the data is split in 128k blocks that are compressed
+/// on 'threadcount' threads (0 for the number of cores) and written in order.
+/// Each block is primed with the previous 32k of data, so the output does not depend
+/// on the number of threads and is only slightly bigger.
+/// The buffers and the streams of the threads are allocated as the input grows,
+/// so a small output costs about the same as with deflatewriter_init.
+/// type=0, type=1 and type=255 are supported.
+struct _writer *deflatewriter_initparallel(struct _writer *parent, unsigned char type, unsigned int threadcount);
+/// Writer that keeps the data in memory, in a chain of fixed-size chunks.
 /// Fills data_out and size_out when destroyed.
-/// WARNING : the 'data_out' data has to be released with the roint free function
+/// The data is only made contiguous if data_out is not NULL.
+/// WARNING : the 'data_out' data has to be released with roint_free
 struct _writer *memwriter_init(unsigned char **data_out, unsigned long *size_out);
+/// Write the data of a memwriter to a system file, with vectored writes when available.
+/// The data goes to a temporary file next to 'fn' that replaces 'fn' when complete,
+/// so a failed save leaves the old file as it was.
+/// Returns 0 on success.
+int memwriter_savefile(struct _writer *memwriter, const char *fn);
 struct _writer *filewriter_init(const char *fn);
+/// Writer that counts the calls to 'parent' and adds them to the ROINT_FORMAT_* 'format'
+/// totals when destroyed. Destroys 'parent' when destroyed.
+/// Until then, the allocations of the thread are attributed to 'format'. (ROINT_ENABLE_ALLOC_STATS)
+/// Returns 'parent' itself if the I/O counters are disabled and there are no allocation statistics.
+struct _writer *statswriter_init(struct _writer *parent, unsigned int format);
 
 #endif /* __ROINT_INTERNAL_WRITER_H */
@@ -48,5 +48,8 @@
 // output log messages to the console
 //#cmakedefine ROINT_ENABLE_CONSOLE_LOG_FUNC
 
+// count the allocations of each subsystem (roint_get_alloc_stats)
+//#cmakedefine ROINT_ENABLE_ALLOC_STATS
+
 
 #endif /* __ROINT_CONFIG_H */
@@ -32,4 +32,17 @@
 #define HAVE_CHSIZE
 #define HAVE__CHSIZE_S
 
+#define HAVE_SYS_MMAN_H
+#define HAVE_SHM_OPEN
+//#define HAVE_SYS_INOTIFY_H
+//#define HAVE_POSIX_FADVISE
+#define HAVE_SYS_UIO_H
+#define HAVE_WRITEV
+#define HAVE_CLOCK_GETTIME
+#define HAVE_POSIX_MEMALIGN
+#define HAVE___THREAD
+#define HAVE_TARGET_AVX2
+
+#define HAVE_PTHREAD_H
+
 #endif /* __ROINT_CONFIG_H */